@@ -63,6 +63,7 @@ static_libraries_needed_by_slang := \
 	libLLVMMC \
 	libLLVMMCParser \
 	libLLVMCore \
+	libclangSerialization \
 	libclangParse \
 	libclangSema \
 	libclangAnalysis \
@@ -101,6 +102,8 @@ LOCAL_SRC_FILES :=	\
 	slang.cpp	\
 	slang_utils.cpp	\
 	slang_backend.cpp	\
+	slang_bitcode_compressor.cpp	\
+	slang_compile_report.cpp	\
 	slang_pragma_recorder.cpp	\
 	slang_diagnostic_buffer.cpp
 
@@ -117,7 +120,6 @@ include $(BUILD_HOST_STATIC_LIBRARY)
 # ========================================================
 include $(CLEAR_VARS)
 
-input_data_file := frameworks/compile/slang/rslib.bc
 slangdata_output_var_name := rslib_bc
 
 LOCAL_IS_HOST_MODULE := true
@@ -126,6 +128,16 @@ LOCAL_MODULE_TAGS := optional
 
 LOCAL_MODULE_CLASS := STATIC_LIBRARIES
 
+# rslib.bc is assembled from rslib.ll by the llvm-as of this tree, such that
+# it's always read by the llvm-rs-link built along.
+rslib_llvm_as := $(HOST_OUT_EXECUTABLES)/llvm-as$(HOST_EXECUTABLE_SUFFIX)
+input_data_file := $(call local-intermediates-dir)/rslib.bc
+$(input_data_file): PRIVATE_LLVM_AS := $(rslib_llvm_as)
+$(input_data_file): $(LOCAL_PATH)/rslib.ll $(rslib_llvm_as)
+	@echo "Assembling rslib.bc"
+	@mkdir -p $(dir $@)
+	$(hide) $(PRIVATE_LLVM_AS) $< -o $@
+
 include $(LOCAL_PATH)/SlangData.mk
 include $(BUILD_HOST_STATIC_LIBRARY)
 
@@ -211,24 +223,34 @@ RS_SPEC_TABLES :=	\
 	RSDataElementEnums.inc	\
 	RSDataKindEnums.inc	\
 	RSMatrixTypeEnums.inc	\
-	RSObjectTypeEnums.inc
+	RSObjectTypeEnums.inc	\
+	RSSpecificTypeTable.inc	\
+	RSDataElementTable.inc
 
 LOCAL_SRC_FILES :=	\
 	llvm-rs-cc.cpp	\
 	slang_rs.cpp	\
 	slang_rs_ast_replace.cpp	\
 	slang_rs_context.cpp	\
+	slang_rs_element_access.cpp	\
+	slang_rs_kernel_cost.cpp	\
 	slang_rs_pragma_handler.cpp	\
 	slang_rs_backend.cpp	\
+	slang_rs_cache.cpp	\
 	slang_rs_exportable.cpp	\
 	slang_rs_export_type.cpp	\
 	slang_rs_export_element.cpp	\
 	slang_rs_export_var.cpp	\
 	slang_rs_export_func.cpp	\
 	slang_rs_export_foreach.cpp \
+	slang_rs_export_reduce.cpp \
+	slang_rs_metadata_spec_encoder.cpp	\
 	slang_rs_object_ref_count.cpp	\
+	slang_rs_odr_database.cpp	\
+	slang_rs_profile.cpp	\
 	slang_rs_reflection.cpp \
 	slang_rs_reflect_utils.cpp  \
+	slang_rs_struct_layout.cpp	\
 
 LOCAL_STATIC_LIBRARIES :=	\
 	libclangDriver libslang \
@@ -24,3 +24,27 @@ include $(LLVM_HOST_BUILD_MK)
 include $(LLVM_GEN_INTRINSICS_MK)
 include $(BUILD_HOST_STATIC_LIBRARY)
 
+
+# Microbenchmark of the writer for the host (see WriterBenchmark.cpp)
+# =====================================================
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := WriterBenchmark.cpp
+
+LOCAL_MODULE:= bitwriter-2.9-bench
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_MODULE_CLASS := EXECUTABLES
+
+LOCAL_STATIC_LIBRARIES :=	\
+	libLLVMBitWriter_2_9	\
+	libLLVMBitReader	\
+	libLLVMCore	\
+	libLLVMSupport
+
+LOCAL_LDLIBS := -ldl -lpthread
+
+include $(LLVM_HOST_BUILD_MK)
+include $(LLVM_GEN_INTRINSICS_MK)
+include $(BUILD_HOST_EXECUTABLE)
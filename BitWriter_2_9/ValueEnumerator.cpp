@@ -12,7 +12,6 @@
 //===----------------------------------------------------------------------===//
 
 #include "ValueEnumerator.h"
-#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Constants.h"
 #include "llvm/DerivedTypes.h"
@@ -103,6 +102,9 @@ ValueEnumerator::ValueEnumerator(const Module *M) {
       }
   }
 
+  // The function-level constants are enumerated by incorporateFunction.
+  OperandTypesEnumerated.clear();
+
   // Optimize constant ordering.
   OptimizeConstants(FirstConstant, Values.size());
 }
@@ -130,29 +132,52 @@ unsigned ValueEnumerator::getValueID(const Value *V) const {
   return I->second-1;
 }
 
-// Optimize constant ordering.
-namespace {
-  struct CstSortPredicate {
-    ValueEnumerator &VE;
-    explicit CstSortPredicate(ValueEnumerator &ve) : VE(ve) {}
-    bool operator()(const std::pair<const Value*, unsigned> &LHS,
-                    const std::pair<const Value*, unsigned> &RHS) {
-      // Sort by plane.
-      if (LHS.first->getType() != RHS.first->getType())
-        return VE.getTypeID(LHS.first->getType()) <
-               VE.getTypeID(RHS.first->getType());
-      // Then by frequency.
-      return LHS.second > RHS.second;
-    }
-  };
+static bool isMoreFrequent(const std::pair<const Value*, unsigned> &LHS,
+                           const std::pair<const Value*, unsigned> &RHS) {
+  return LHS.second > RHS.second;
 }
 
 /// OptimizeConstants - Reorder constant pool for denser encoding.
 void ValueEnumerator::OptimizeConstants(unsigned CstStart, unsigned CstEnd) {
   if (CstStart == CstEnd || CstStart+1 == CstEnd) return;
 
-  CstSortPredicate P(*this);
-  std::stable_sort(Values.begin()+CstStart, Values.begin()+CstEnd, P);
+  // Sort by plane, then by frequency.  This is a stable sort on (type ID,
+  // -frequency), done as a counting sort into the type planes (which keeps the
+  // original order within a plane) followed by a stable sort of each plane by
+  // frequency.  The type IDs are thus looked up once per constant rather than
+  // once per comparison.
+  unsigned NumCsts = CstEnd - CstStart;
+  CstTypeIDs.resize(NumCsts);
+  CstPlaneEnds.assign(Types.size(), 0);
+  for (unsigned i = 0; i != NumCsts; ++i) {
+    unsigned TypeID = getTypeID(Values[CstStart+i].first->getType());
+    CstTypeIDs[i] = TypeID;
+    ++CstPlaneEnds[TypeID];
+  }
+
+  // Turn the plane sizes into the plane starts.
+  unsigned PlaneStart = 0;
+  for (unsigned i = 0, e = CstPlaneEnds.size(); i != e; ++i) {
+    unsigned PlaneSize = CstPlaneEnds[i];
+    CstPlaneEnds[i] = PlaneStart;
+    PlaneStart += PlaneSize;
+  }
+
+  // Scatter the constants into their planes, after which CstPlaneEnds holds
+  // the plane ends.
+  SortedCsts.resize(NumCsts);
+  for (unsigned i = 0; i != NumCsts; ++i)
+    SortedCsts[CstPlaneEnds[CstTypeIDs[i]]++] = Values[CstStart+i];
+
+  PlaneStart = 0;
+  for (unsigned i = 0, e = CstPlaneEnds.size(); i != e; ++i) {
+    unsigned PlaneEnd = CstPlaneEnds[i];
+    if (PlaneEnd - PlaneStart > 1)
+      std::stable_sort(SortedCsts.begin()+PlaneStart,
+                       SortedCsts.begin()+PlaneEnd, isMoreFrequent);
+    PlaneStart = PlaneEnd;
+  }
+  std::copy(SortedCsts.begin(), SortedCsts.end(), Values.begin()+CstStart);
 
   // Ensure that integer constants are at the start of the constant pool.  This
   // is important so that GEP structure indices come before gep constant exprs.
@@ -362,6 +387,9 @@ void ValueEnumerator::EnumerateOperandType(const Value *V) {
     // be enumerated.
     if (ValueMap.count(V)) return;
 
+    // Neither can a constant whose operands were walked before add any types.
+    if (C->getNumOperands() && !OperandTypesEnumerated.insert(C)) return;
+
     // This constant may have operands, make sure to enumerate the types in
     // them.
     for (unsigned i = 0, e = C->getNumOperands(); i != e; ++i) {
@@ -428,7 +456,7 @@ void ValueEnumerator::incorporateFunction(const Function &F) {
 
   FirstInstID = Values.size();
 
-  SmallVector<MDNode *, 8> FnLocalMDVector;
+  FnLocalMDVector.clear();
   // Add all of the instructions.
   for (Function::const_iterator BB = F.begin(), E = F.end(); BB != E; ++BB) {
     for (BasicBlock::const_iterator I = BB->begin(), E = BB->end(); I!=E; ++I) {
@@ -440,10 +468,10 @@ void ValueEnumerator::incorporateFunction(const Function &F) {
             FnLocalMDVector.push_back(MD);
       }
 
-      SmallVector<std::pair<unsigned, MDNode*>, 8> MDs;
-      I->getAllMetadataOtherThanDebugLoc(MDs);
-      for (unsigned i = 0, e = MDs.size(); i != e; ++i) {
-        MDNode *N = MDs[i].second;
+      InstMDs.clear();
+      I->getAllMetadataOtherThanDebugLoc(InstMDs);
+      for (unsigned i = 0, e = InstMDs.size(); i != e; ++i) {
+        MDNode *N = InstMDs[i].second;
         if (N->isFunctionLocal() && N->getFunction())
           FnLocalMDVector.push_back(N);
       }
@@ -471,6 +499,9 @@ void ValueEnumerator::purgeFunction() {
   MDValues.resize(NumModuleMDValues);
   BasicBlocks.clear();
   FunctionLocalMDs.clear();
+
+  // The instruction IDs are only used while the function is written.
+  InstructionMap.clear();
 }
 
 static void IncorporateFunctionInfoGlobalBBIDs(const Function *F,
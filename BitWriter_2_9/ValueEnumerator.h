@@ -15,6 +15,7 @@
 #define VALUE_ENUMERATOR_H
 
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Attributes.h"
 #include <vector>
@@ -77,6 +78,19 @@ private:
 
   unsigned FirstFuncConstantID;
   unsigned FirstInstID;
+
+  /// OperandTypesEnumerated - The constants with operands whose types have
+  /// been enumerated by EnumerateOperandType, so that constant expressions
+  /// used many times are walked only once.
+  SmallPtrSet<const Value*, 32> OperandTypesEnumerated;
+
+  /// Scratch tables of OptimizeConstants and incorporateFunction.  They are
+  /// kept across functions so that their storage is reused.
+  std::vector<unsigned> CstTypeIDs;
+  std::vector<unsigned> CstPlaneEnds;
+  ValueList SortedCsts;
+  SmallVector<MDNode*, 8> FnLocalMDVector;
+  SmallVector<std::pair<unsigned, MDNode*>, 8> InstMDs;
   
   ValueEnumerator(const ValueEnumerator &);  // DO NOT IMPLEMENT
   void operator=(const ValueEnumerator &);   // DO NOT IMPLEMENT
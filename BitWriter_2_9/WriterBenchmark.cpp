@@ -0,0 +1,228 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===----------------------------------------------------------------------===//
+//
+// Microbenchmark of the LLVM 2.9 bitcode writer.  It builds synthetic modules
+// shaped like big generated kernels (many functions, each using lots of
+// integer, floating point and constant expression operands, with metadata
+// attached), writes each of them a number of times and prints
+//
+//   <module> <functions> <bytes> <hash> <ms per write>
+//
+// The hash is the 64-bit FNV-1a of the bitcode.  The modules are generated
+// deterministically, so the output of two builds of the tool (e.g. before and
+// after a change to the writer) must show the same sizes and hashes.  With
+// -dump <dir>, the bitcode is also written to <dir>/<module>.bc to be compared
+// byte by byte.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ReaderWriter_2_9.h"
+
+#include "llvm/Bitcode/BitstreamWriter.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Constants.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/Function.h"
+#include "llvm/GlobalVariable.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Metadata.h"
+#include "llvm/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/IRBuilder.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <vector>
+using namespace llvm;
+
+static cl::opt<unsigned>
+Functions("functions", cl::desc("Number of functions of the largest module"),
+          cl::init(2000));
+
+static cl::opt<unsigned>
+Repeat("repeat", cl::desc("Number of writes of each module"), cl::init(5));
+
+static cl::opt<std::string>
+DumpDir("dump", cl::desc("Also write the bitcode to <dir>/<module>.bc"),
+        cl::value_desc("dir"), cl::init(""));
+
+/// BuildModule - Build a module of NumFunctions functions.  Each of them loads
+/// the fields of a global struct array through constant GEPs, mixes them with
+/// integer and floating point constants (some shared by all functions, some
+/// unique to the function) and stores the result back.
+static Module *BuildModule(LLVMContext &Context, StringRef Name,
+                           unsigned NumFunctions) {
+  Module *M = new Module(Name, Context);
+  M->setTargetTriple("armv7-none-linux-gnueabi");
+
+  Type *Int32Ty = Type::getInt32Ty(Context);
+  Type *FloatTy = Type::getFloatTy(Context);
+  Type *Fields[] = { Int32Ty, FloatTy, VectorType::get(FloatTy, 4) };
+  StructType *ElemTy = StructType::create(Fields, "struct.elem");
+  ArrayType *ArrayTy = ArrayType::get(ElemTy, 64);
+
+  GlobalVariable *Data =
+      new GlobalVariable(*M, ArrayTy, false, GlobalValue::ExternalLinkage,
+                         ConstantAggregateZero::get(ArrayTy), "data");
+
+  unsigned KindID = Context.getMDKindID("bench.id");
+  NamedMDNode *Names = M->getOrInsertNamedMetadata("bench.functions");
+
+  FunctionType *FTy = FunctionType::get(Type::getVoidTy(Context),
+                                        ArrayRef<Type*>(Int32Ty), false);
+  for (unsigned f = 0; f != NumFunctions; ++f) {
+    Function *F = Function::Create(FTy, GlobalValue::ExternalLinkage,
+                                   "kernel" + utostr(f), M);
+    BasicBlock *BB = BasicBlock::Create(Context, "entry", F);
+    IRBuilder<> B(BB);
+
+    Value *Acc = F->arg_begin();
+    Value *FAcc = ConstantFP::get(FloatTy, 0.5);
+    Constant *FloatPtr = NULL;
+    for (unsigned i = 0; i != 16; ++i) {
+      unsigned Elem = (f * 7 + i) % 64;
+      Constant *IntIdx[] = {
+        ConstantInt::get(Int32Ty, 0),
+        ConstantInt::get(Int32Ty, Elem),
+        ConstantInt::get(Int32Ty, 0)
+      };
+      Constant *FloatIdx[] = {
+        ConstantInt::get(Int32Ty, 0),
+        ConstantInt::get(Int32Ty, Elem),
+        ConstantInt::get(Int32Ty, 1)
+      };
+      Value *IntField = B.CreateLoad(
+          ConstantExpr::getGetElementPtr(Data, IntIdx));
+      FloatPtr = ConstantExpr::getGetElementPtr(Data, FloatIdx);
+      Value *FloatField = B.CreateLoad(FloatPtr);
+
+      Acc = B.CreateAdd(Acc, IntField);
+      Acc = B.CreateMul(Acc, ConstantInt::get(Int32Ty, i + 3));
+      Acc = B.CreateXor(Acc, ConstantInt::get(Int32Ty, f * 16 + i));
+      FAcc = B.CreateFAdd(FAcc, FloatField);
+      FAcc = B.CreateFMul(FAcc, ConstantFP::get(FloatTy, f + i * 0.25));
+
+      Instruction *St = B.CreateStore(
+          Acc, ConstantExpr::getGetElementPtr(Data, IntIdx));
+      Value *Ops[] = {
+        ConstantInt::get(Int32Ty, f),
+        MDString::get(Context, "store")
+      };
+      St->setMetadata(KindID, MDNode::get(Context, Ops));
+    }
+    B.CreateStore(FAcc, FloatPtr);
+    B.CreateRetVoid();
+
+    Value *NameOps[] = { F, MDString::get(Context, F->getName()) };
+    Names->addOperand(MDNode::get(Context, NameOps));
+  }
+
+  return M;
+}
+
+static uint64_t HashBitcode(const std::vector<unsigned char> &Buffer) {
+  uint64_t Hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0, e = Buffer.size(); i != e; ++i) {
+    Hash ^= Buffer[i];
+    Hash *= 0x100000001b3ULL;
+  }
+  return Hash;
+}
+
+/// RunBenchmark - Write the module Repeat times, check that every write gives
+/// the same bitcode and that it can be read back.  Return false on failure.
+static bool RunBenchmark(const Module *M) {
+  std::vector<unsigned char> First;
+  double WallTime = 0;
+
+  for (unsigned r = 0; r != Repeat; ++r) {
+    std::vector<unsigned char> Buffer;
+    Buffer.reserve(256*1024);
+    BitstreamWriter Stream(Buffer);
+
+    TimeRecord Start = TimeRecord::getCurrentTime(true);
+    llvm_2_9::WriteBitcodeToStream(M, Stream);
+    TimeRecord End = TimeRecord::getCurrentTime(false);
+    WallTime += End.getWallTime() - Start.getWallTime();
+
+    if (r == 0) {
+      First.swap(Buffer);
+    } else if (Buffer != First) {
+      errs() << M->getModuleIdentifier() << ": writes are not deterministic\n";
+      return false;
+    }
+  }
+
+  StringRef Bitcode(reinterpret_cast<const char*>(&First.front()),
+                    First.size());
+  OwningPtr<MemoryBuffer> MB(MemoryBuffer::getMemBuffer(Bitcode, "", false));
+  LLVMContext Context;
+  std::string Error;
+  OwningPtr<Module> ReadBack(ParseBitcodeFile(MB.get(), Context, &Error));
+  if (!ReadBack) {
+    errs() << M->getModuleIdentifier() << ": cannot read the bitcode back: "
+           << Error << '\n';
+    return false;
+  }
+
+  if (!DumpDir.empty()) {
+    std::string File = DumpDir + "/" + M->getModuleIdentifier() + ".bc";
+    std::string ErrorInfo;
+    raw_fd_ostream OS(File.c_str(), ErrorInfo, raw_fd_ostream::F_Binary);
+    if (!ErrorInfo.empty()) {
+      errs() << File << ": " << ErrorInfo << '\n';
+      return false;
+    }
+    OS << Bitcode;
+  }
+
+  outs() << format("%-8s %6u %10lu %016llx %10.3f\n",
+                   M->getModuleIdentifier().c_str(),
+                   static_cast<unsigned>(M->size()),
+                   static_cast<unsigned long>(First.size()),
+                   static_cast<unsigned long long>(HashBitcode(First)),
+                   WallTime * 1000 / Repeat);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "LLVM 2.9 bitcode writer microbenchmark\n");
+  if (Repeat == 0)
+    Repeat = 1;
+
+  const char *const Names[] = { "small", "medium", "large" };
+  const unsigned Divisors[] = { 100, 10, 1 };
+
+  bool Success = true;
+  for (unsigned i = 0; i != sizeof(Names) / sizeof(Names[0]); ++i) {
+    LLVMContext Context;
+    unsigned NumFunctions = Functions / Divisors[i];
+    if (NumFunctions == 0)
+      NumFunctions = 1;
+    OwningPtr<Module> M(BuildModule(Context, Names[i], NumFunctions));
+    Success &= RunBenchmark(M.get());
+  }
+
+  return Success ? 0 : 1;
+}
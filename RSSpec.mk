@@ -62,4 +62,16 @@ $(intermediates)/RSDataElementEnums.inc: $(RS_SPEC_GEN)
 	$(call generate-rs-spec-inc,rs-data-element-enums)
 endif
 
+ifneq ($(findstring RSSpecificTypeTable.inc,$(RS_SPEC_TABLES)),)
+LOCAL_GENERATED_SOURCES += $(intermediates)/RSSpecificTypeTable.inc
+$(intermediates)/RSSpecificTypeTable.inc: $(RS_SPEC_GEN)
+	$(call generate-rs-spec-inc,rs-specific-type-table)
+endif
+
+ifneq ($(findstring RSDataElementTable.inc,$(RS_SPEC_TABLES)),)
+LOCAL_GENERATED_SOURCES += $(intermediates)/RSDataElementTable.inc
+$(intermediates)/RSDataElementTable.inc: $(RS_SPEC_GEN)
+	$(call generate-rs-spec-inc,rs-data-element-table)
+endif
+
 endif
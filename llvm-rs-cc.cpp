@@ -14,9 +14,28 @@
  * limitations under the License.
  */
 
+#ifndef USE_MINGW
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include <list>
 #include <set>
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -33,6 +52,9 @@
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/IntrusiveRefCntPtr.h"
 #include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/Triple.h"
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ManagedStatic.h"
@@ -40,11 +62,14 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/system_error.h"
+#include "llvm/Support/Threading.h"
 
 #include "slang.h"
 #include "slang_assert.h"
+#include "slang_compile_report.h"
 #include "slang_rs.h"
 #include "slang_rs_reflect_utils.h"
+#include "slang_version.h"
 
 // Class under clang::driver used are enumerated here.
 using clang::driver::arg_iterator;
@@ -105,14 +130,31 @@ class RSCCOptions {
   // The include search paths
   std::vector<std::string> mIncludePaths;
 
+  // Where the precompiled RS runtime headers are cached, if any.
+  std::string mRSHeaderPCHDir;
+
+  // Where the outputs of the compilations are cached, if any.
+  std::string mCacheDir;
+
+  // The ODR database shared with the other invocations, if any.
+  std::string mODRDatabaseFile;
+
   // The output directory, if any.
   std::string mOutputDir;
 
+  // Where the code for mTriple goes. The same as mOutputDir unless there are
+  // multiple -target, then the code for each target goes to a subdirectory of
+  // mOutputDir named after its architecture (and CPU.)
+  std::string mTargetOutputDir;
+
   // The output type
   slang::Slang::OutputType mOutputType;
 
   unsigned mAllowRSPrefix : 1;
 
+  // Emit the compact export metadata too (-emit-compact-export-metadata.)
+  unsigned mEmitCompactMetadata : 1;
+
   // The name of the target triple to compile for.
   std::string mTriple;
 
@@ -123,10 +165,15 @@ class RSCCOptions {
   // be a list of strings starting with by '+' or '-'.
   std::vector<std::string> mFeatures;
 
+  // The targets other than mTriple the code is generated for (-target)
+  std::vector<slang::Slang::CodeGenTarget> mExtraTargets;
+
   std::string mJavaReflectionPathBase;
 
   std::string mJavaReflectionPackageName;
 
+  slang::ReflectionOptions mReflectionOptions;
+
   slang::BitCodeStorageType mBitcodeStorage;
 
   unsigned mOutputDep : 1;
@@ -140,9 +187,47 @@ class RSCCOptions {
 
   unsigned int mTargetAPI;
 
+  // The maximum number of input files compiled concurrently.
+  unsigned int mJobs;
+
+  // Free the AST of each input file right after its IR generation
+  // (-low-memory.)
+  unsigned mLowMemory : 1;
+
+  // Optimize for size and strip the output (-Os.)
+  unsigned mOptimizeForSize : 1;
+
+  // Instrument the code (-fprofile-generate) or optimize it by the profile in
+  // mProfileUseFile (-fprofile-use.)
+  unsigned mProfileGenerate : 1;
+  std::string mProfileUseFile;
+
+  // Time the entry points of the scripts (-finstrument-kernels.)
+  unsigned mInstrumentKernels : 1;
+
+  // Print the layouts of the exported structs (-struct-layout-report) or warn
+  // about their padding (-warn-struct-padding.)
+  unsigned mReportStructLayouts : 1;
+  unsigned mWarnStructPadding : 1;
+
+  // Write the costs of the entry points next to the bitcode
+  // (-kernel-cost-report.)
+  unsigned mReportKernelCosts : 1;
+
+  // Print the per-phase compile report (-ftime-report) and/or write it to
+  // mTimeReportFile in JSON (-ftime-report-json).
+  unsigned mTimeReport : 1;
+  std::string mTimeReportFile;
+
+  // The socket the compile server listens on (-server) or the client
+  // connects to (-connect).
+  std::string mServerSocket;
+  std::string mConnectSocket;
+
   RSCCOptions() {
     mOutputType = slang::Slang::OT_Bitcode;
-    // Triple/CPU/Features must be hard-coded to our chosen portable ABI.
+    // Triple/CPU/Features default to our chosen portable ABI (the Features
+    // are kept by -target.)
     mTriple = "armv7-none-linux-gnueabi";
     mCPU = "";
     slangAssert(mFeatures.empty());
@@ -152,6 +237,16 @@ class RSCCOptions {
     mShowHelp = 0;
     mShowVersion = 0;
     mTargetAPI = RS_VERSION;
+    mJobs = 1;
+    mEmitCompactMetadata = 0;
+    mLowMemory = 0;
+    mOptimizeForSize = 0;
+    mProfileGenerate = 0;
+    mInstrumentKernels = 0;
+    mReportStructLayouts = 0;
+    mWarnStructPadding = 0;
+    mReportKernelCosts = 0;
+    mTimeReport = 0;
   }
 };
 
@@ -187,8 +282,46 @@ static void ParseArguments(llvm::SmallVectorImpl<const char*> &ArgVector,
     }
 
     Opts.mIncludePaths = Args->getAllArgValues(OPT_I);
+    Opts.mRSHeaderPCHDir = Args->getLastArgValue(OPT_rs_header_pch_dir);
+    Opts.mCacheDir = Args->getLastArgValue(OPT_cache_dir);
+    Opts.mODRDatabaseFile = Args->getLastArgValue(OPT_odr_database);
 
     Opts.mOutputDir = Args->getLastArgValue(OPT_o);
+    Opts.mTargetOutputDir = Opts.mOutputDir;
+
+    std::vector<std::string> Targets = Args->getAllArgValues(OPT_target);
+    std::set<std::string> TargetDirs;
+    for (unsigned i = 0, e = Targets.size(); i != e; i++) {
+      std::pair<llvm::StringRef, llvm::StringRef> TripleAndCPU =
+          llvm::StringRef(Targets[i]).split(':');
+      slang::Slang::CodeGenTarget Target;
+      Target.Triple = TripleAndCPU.first.str();
+      Target.CPU = TripleAndCPU.second.str();
+
+      std::string Dir = llvm::Triple(Target.Triple).getArchName().str();
+      if (!Target.CPU.empty())
+        Dir.append("-").append(Target.CPU);
+      if (Target.Triple.empty() || !TargetDirs.insert(Dir).second) {
+        DiagEngine.Report(clang::diag::err_drv_invalid_value)
+            << OptParser->getOptionName(OPT_target) << Targets[i];
+        continue;
+      }
+
+      if (e > 1) {
+        llvm::SmallString<256> TargetOutputDir(Opts.mOutputDir);
+        llvm::sys::path::append(TargetOutputDir, Dir);
+        Target.OutputDir = TargetOutputDir.str();
+      }
+
+      if (i == 0) {
+        Opts.mTriple = Target.Triple;
+        Opts.mCPU = Target.CPU;
+        if (e > 1)
+          Opts.mTargetOutputDir = Target.OutputDir;
+      } else {
+        Opts.mExtraTargets.push_back(Target);
+      }
+    }
 
     if (const Arg *A = Args->getLastArg(OPT_M_Group)) {
       switch (A->getOption().getID()) {
@@ -240,11 +373,34 @@ static void ParseArguments(llvm::SmallVectorImpl<const char*> &ArgVector,
           << Args->getLastArg(OPT_Output_Type_Group)->getAsString(*Args);
 
     Opts.mAllowRSPrefix = Args->hasArg(OPT_allow_rs_prefix);
+    Opts.mEmitCompactMetadata = Args->hasArg(OPT_emit_compact_export_metadata);
 
     Opts.mJavaReflectionPathBase =
         Args->getLastArgValue(OPT_java_reflection_path_base);
     Opts.mJavaReflectionPackageName =
         Args->getLastArgValue(OPT_java_reflection_package_name);
+    Opts.mReflectionOptions.BulkAccessors =
+        Args->hasArg(OPT_reflect_bulk_accessors);
+    Opts.mReflectionOptions.AmortizedResize =
+        Args->hasArg(OPT_reflect_amortized_resize);
+    Opts.mReflectionOptions.CachedFieldPackers =
+        Args->hasArg(OPT_reflect_cached_field_packers);
+    Opts.mReflectionOptions.BatchedUpdates =
+        Args->hasArg(OPT_reflect_batched_updates);
+    Opts.mReflectionOptions.PackedBitcodeAccessor =
+        Args->hasArg(OPT_reflect_packed_bitcode_accessor);
+    Opts.mReflectionOptions.CompressedBitcodeAccessor =
+        Args->hasArg(OPT_reflect_compressed_bitcode_accessor);
+    Opts.mReflectionOptions.SharedTypesPackageName =
+        Args->getLastArgValue(OPT_reflect_shared_types_package);
+    if (Args->hasArg(OPT_reflect_usage_manifest)) {
+      std::string Error;
+      if (!slang::RSSlangReflectUtils::ReadUsageManifest(
+              Args->getLastArgValue(OPT_reflect_usage_manifest),
+              &Opts.mReflectionOptions, &Error))
+        DiagEngine.Report(DiagEngine.getCustomDiagID(
+            clang::DiagnosticsEngine::Error, "%0")) << Error;
+    }
 
     llvm::StringRef BitcodeStorageValue =
         Args->getLastArgValue(OPT_bitcode_storage);
@@ -257,6 +413,14 @@ static void ParseArguments(llvm::SmallVectorImpl<const char*> &ArgVector,
           << OptParser->getOptionName(OPT_bitcode_storage)
           << BitcodeStorageValue;
 
+    // The resources are read by libbcc, which only knows the uncompressed
+    // wrapper.
+    if (Opts.mReflectionOptions.CompressedBitcodeAccessor &&
+        (Opts.mBitcodeStorage != slang::BCST_JAVA_CODE))
+      DiagEngine.Report(DiagEngine.getCustomDiagID(
+          clang::DiagnosticsEngine::Error, "%0 requires '-s jc'"))
+          << OptParser->getOptionName(OPT_reflect_compressed_bitcode_accessor);
+
     Opts.mOutputDepDir =
         Args->getLastArgValue(OPT_output_dep_dir, Opts.mOutputDir);
     Opts.mAdditionalDepTargets =
@@ -268,6 +432,46 @@ static void ParseArguments(llvm::SmallVectorImpl<const char*> &ArgVector,
     Opts.mTargetAPI = Args->getLastArgIntValue(OPT_target_api,
                                                RS_VERSION,
                                                DiagEngine);
+
+    Opts.mServerSocket = Args->getLastArgValue(OPT_server);
+    Opts.mConnectSocket = Args->getLastArgValue(OPT_connect);
+#ifdef USE_MINGW
+    if (const Arg *A = Args->getLastArg(OPT_server, OPT_connect))
+      DiagEngine.Report(clang::diag::err_drv_unsupported_opt)
+          << A->getAsString(*Args);
+#endif
+
+    Opts.mLowMemory = Args->hasArg(OPT_low_memory);
+    Opts.mOptimizeForSize = Args->hasArg(OPT_Os);
+
+    Opts.mInstrumentKernels = Args->hasArg(OPT_finstrument_kernels);
+    // The counters are updated by atomicrmw, which the bitcode writer of the
+    // older targets (LLVM 2.9) can't write.
+    if (Opts.mInstrumentKernels && (Opts.mTargetAPI < SLANG_JB_TARGET_API))
+      DiagEngine.Report(DiagEngine.getCustomDiagID(
+          clang::DiagnosticsEngine::Error,
+          "-finstrument-kernels requires a target API of %0 or later"))
+          << SLANG_JB_TARGET_API;
+    Opts.mReportStructLayouts = Args->hasArg(OPT_struct_layout_report);
+    Opts.mWarnStructPadding = Args->hasArg(OPT_warn_struct_padding);
+    Opts.mReportKernelCosts = Args->hasArg(OPT_kernel_cost_report);
+    Opts.mProfileGenerate = Args->hasArg(OPT_fprofile_generate);
+    Opts.mProfileUseFile = Args->getLastArgValue(OPT_fprofile_use_EQ);
+    if (Opts.mProfileGenerate && Args->hasArg(OPT_fprofile_use_EQ))
+      DiagEngine.Report(clang::diag::err_drv_argument_not_allowed_with)
+          << Args->getLastArg(OPT_fprofile_use_EQ)->getAsString(*Args)
+          << Args->getLastArg(OPT_fprofile_generate)->getAsString(*Args);
+
+    Opts.mTimeReport = Args->hasArg(OPT_ftime_report);
+    Opts.mTimeReportFile = Args->getLastArgValue(OPT_ftime_report_json);
+
+    int Jobs = Args->getLastArgIntValue(OPT_jobs, 1, DiagEngine);
+    if (Jobs > 0)
+      Opts.mJobs = Jobs;
+    else
+      DiagEngine.Report(clang::diag::err_drv_invalid_value)
+          << OptParser->getOptionName(OPT_jobs)
+          << Args->getLastArgValue(OPT_jobs);
   }
 
   return;
@@ -326,6 +530,620 @@ static const char *DetermineOutputFile(const std::string &OutputDir,
   return SaveStringInSet(SavedStrings, OutputFile);
 }
 
+typedef std::list<std::pair<const char*, const char*> > FileListTy;
+
+// CompileJob - A subset of the input files compiled by a dedicated SlangRS
+// instance. Different jobs can be run concurrently (see -jobs.) The
+// diagnostics and the stdout of concurrent jobs are buffered (in DiagOS and
+// VerboseOS) and printed in the order of the jobs once they're all done.
+struct CompileJob {
+  const RSCCOptions *Opts;
+  slang::SlangRS *Compiler;
+  FileListTy IOFiles;
+  FileListTy DepFiles;
+  slang::CompileReport Report;
+  bool Success;
+  std::string DiagBuffer;
+  llvm::raw_string_ostream *DiagOS;
+  std::ostringstream *VerboseOS;
+};
+
+static void RunCompileJob(CompileJob *Job) {
+  const RSCCOptions &Opts = *Job->Opts;
+  Job->Compiler->setRSHeaderPCHDir(Opts.mRSHeaderPCHDir);
+  Job->Compiler->setCacheDir(Opts.mCacheDir);
+  Job->Compiler->setODRDatabase(Opts.mODRDatabaseFile);
+  Job->Compiler->setReflectionOptions(Opts.mReflectionOptions);
+  Job->Compiler->setCompileReport(
+      (Opts.mTimeReport || !Opts.mTimeReportFile.empty()) ? &Job->Report
+                                                          : NULL);
+  Job->Success = Job->Compiler->compile(Job->IOFiles,
+                                        Job->DepFiles,
+                                        Opts.mIncludePaths,
+                                        Opts.mAdditionalDepTargets,
+                                        Opts.mOutputType,
+                                        Opts.mBitcodeStorage,
+                                        Opts.mAllowRSPrefix,
+                                        Opts.mOutputDep,
+                                        Opts.mTargetAPI,
+                                        Opts.mJavaReflectionPathBase,
+                                        Opts.mJavaReflectionPackageName);
+  Job->Compiler->setCompileReport(NULL);
+  return;
+}
+
+#ifndef USE_MINGW
+static void *CompileJobThread(void *Job) {
+  RunCompileJob(static_cast<CompileJob*>(Job));
+  return NULL;
+}
+#endif
+
+// CompileInParallel - Run all the @Jobs (one per thread except the first
+// one, which is run on the calling thread) and wait for them to finish.
+static void CompileInParallel(std::vector<CompileJob> &Jobs) {
+#ifndef USE_MINGW
+  std::vector<pthread_t> Threads(Jobs.size());
+  std::vector<bool> Started(Jobs.size(), false);
+
+  for (unsigned i = 1, e = Jobs.size(); i != e; i++)
+    Started[i] =
+        (pthread_create(&Threads[i], NULL, CompileJobThread, &Jobs[i]) == 0);
+
+  RunCompileJob(&Jobs[0]);
+
+  for (unsigned i = 1, e = Jobs.size(); i != e; i++) {
+    if (Started[i])
+      pthread_join(Threads[i], NULL);
+    else
+      // Failed to spawn the thread, fall back to compile it here.
+      RunCompileJob(&Jobs[i]);
+  }
+#else
+  for (unsigned i = 0, e = Jobs.size(); i != e; i++)
+    RunCompileJob(&Jobs[i]);
+#endif
+  return;
+}
+
+// Compile - Compile the @Inputs according to @Opts. The first (or the only one
+// if there's no -jobs) compile job is run by @Compiler, which must have been
+// initialized. Diagnostics are written to @DiagOutput, and the messages of
+// the reflection and the reports to @StdOutput. Note that the caller is
+// responsible for calling @Compiler->reset() afterward.
+static int Compile(slang::SlangRS *Compiler,
+                   const RSCCOptions &Opts,
+                   const llvm::SmallVectorImpl<const char*> &Inputs,
+                   std::set<std::string> &SavedStrings,
+                   llvm::raw_ostream *DiagOutput,
+                   std::ostream *StdOutput) {
+  // Prepare input data for RS compiler. Input files are split among the jobs
+  // in contiguous chunks, such that the output of the jobs printed in order is
+  // in the order of the input files.
+  unsigned NumJobs = std::min<unsigned>(Opts.mJobs, Inputs.size());
+#ifdef USE_MINGW
+  NumJobs = 1;
+#endif
+  // A single compiler knows which shared ScriptField_* classes are reflected.
+  if (!Opts.mReflectionOptions.SharedTypesPackageName.empty())
+    NumJobs = 1;
+  // The extra targets are compiled on threads of their own as well.
+  if (((NumJobs > 1) || !Opts.mExtraTargets.empty()) &&
+      !llvm::llvm_is_multithreaded() && !llvm::llvm_start_multithreaded())
+    NumJobs = 1;
+
+  std::vector<CompileJob> Jobs(NumJobs);
+
+  for (unsigned i = 0; i != NumJobs; i++) {
+    Jobs[i].Opts = &Opts;
+    if (i == 0) {
+      Jobs[i].Compiler = Compiler;
+    } else {
+      Jobs[i].Compiler = new slang::SlangRS();
+      Jobs[i].Compiler->init(Opts.mTriple, Opts.mCPU, Opts.mFeatures);
+      Jobs[i].Compiler->setDiagnosticOutput(DiagOutput);
+    }
+    Jobs[i].Compiler->setExtraTargets(Opts.mExtraTargets);
+    Jobs[i].Compiler->setLowMemory(Opts.mLowMemory);
+    Jobs[i].Compiler->setOptimizeForSize(Opts.mOptimizeForSize);
+    Jobs[i].Compiler->setEmitCompactMetadata(Opts.mEmitCompactMetadata);
+    Jobs[i].Compiler->setProfileGenerate(Opts.mProfileGenerate);
+    Jobs[i].Compiler->setProfileUseFile(Opts.mProfileUseFile);
+    Jobs[i].Compiler->setInstrumentKernels(Opts.mInstrumentKernels);
+    Jobs[i].Compiler->setReportStructLayouts(Opts.mReportStructLayouts);
+    Jobs[i].Compiler->setWarnStructPadding(Opts.mWarnStructPadding);
+    Jobs[i].Compiler->setReportKernelCosts(Opts.mReportKernelCosts);
+    Jobs[i].Success = false;
+    Jobs[i].DiagOS = NULL;
+    Jobs[i].VerboseOS = NULL;
+  }
+
+  // Jobs[] isn't resized anymore, so DiagBuffer can be referenced.
+  if (NumJobs > 1) {
+    for (unsigned i = 0; i != NumJobs; i++) {
+      Jobs[i].DiagOS = new llvm::raw_string_ostream(Jobs[i].DiagBuffer);
+      Jobs[i].VerboseOS = new std::ostringstream();
+      Jobs[i].Compiler->setDiagnosticOutput(Jobs[i].DiagOS);
+      Jobs[i].Compiler->setVerboseOutput(Jobs[i].VerboseOS);
+    }
+  }
+
+  for (unsigned i = 0, e = Inputs.size(); i != e; i++) {
+    FileListTy &IOFiles = Jobs[i * NumJobs / e].IOFiles;
+    FileListTy &DepFiles = Jobs[i * NumJobs / e].DepFiles;
+
+    const char *InputFile = Inputs[i];
+    const char *OutputFile =
+        DetermineOutputFile((Opts.mOutputType == slang::Slang::OT_Dependency) ?
+                                Opts.mOutputDir : Opts.mTargetOutputDir,
+                            InputFile, Opts.mOutputType, SavedStrings);
+
+    if (Opts.mOutputDep) {
+      const char *BCOutputFile, *DepOutputFile;
+
+      if (Opts.mOutputType == slang::Slang::OT_Bitcode)
+        BCOutputFile = OutputFile;
+      else
+        BCOutputFile = DetermineOutputFile(Opts.mOutputDepDir,
+                                           InputFile,
+                                           slang::Slang::OT_Bitcode,
+                                           SavedStrings);
+
+      if (Opts.mOutputType == slang::Slang::OT_Dependency)
+        DepOutputFile = OutputFile;
+      else
+        DepOutputFile = DetermineOutputFile(Opts.mOutputDepDir,
+                                            InputFile,
+                                            slang::Slang::OT_Dependency,
+                                            SavedStrings);
+
+      DepFiles.push_back(std::make_pair(BCOutputFile, DepOutputFile));
+    }
+
+    IOFiles.push_back(std::make_pair(InputFile, OutputFile));
+  }
+
+  // Let's rock!
+  if (NumJobs == 1) {
+    Compiler->setVerboseOutput(StdOutput);
+    RunCompileJob(&Jobs[0]);
+    Compiler->setVerboseOutput(NULL);
+  } else {
+    CompileInParallel(Jobs);
+
+    for (unsigned i = 0; i != NumJobs; i++) {
+      Jobs[i].Compiler->flushDiagnostics();
+      Jobs[i].Compiler->setDiagnosticOutput(DiagOutput);
+      Jobs[i].Compiler->setVerboseOutput(NULL);
+      (*DiagOutput) << Jobs[i].DiagOS->str();
+      DiagOutput->flush();
+      (*StdOutput) << Jobs[i].VerboseOS->str() << std::flush;
+      delete Jobs[i].DiagOS;
+      delete Jobs[i].VerboseOS;
+    }
+  }
+
+  int CompileFailed = !Jobs[0].Success;
+  std::string StructLayoutReport = Compiler->getStructLayoutReport();
+  for (unsigned i = 1; i != NumJobs; i++) {
+    slang::SlangRS *JobCompiler = Jobs[i].Compiler;
+    StructLayoutReport.append(JobCompiler->getStructLayoutReport());
+    JobCompiler->reset();
+    if (!Jobs[i].Success)
+      CompileFailed = 1;
+    // Cross-file ODR checking among the jobs. Within a job it's done by
+    // SlangRS::compile() already. It only adds diagnostics, so it's done
+    // even after a failure, which would hide the conflicts otherwise.
+    if (!Compiler->mergeODR(*JobCompiler))
+      CompileFailed = 1;
+    delete JobCompiler;
+  }
+
+  if (Opts.mReportStructLayouts)
+    (*StdOutput) << StructLayoutReport << std::flush;
+
+  slang::CompileReport Report;
+  for (unsigned i = 0; i != NumJobs; i++)
+    Report.merge(Jobs[i].Report);
+
+  if (Opts.mTimeReport)
+    Report.printText(*DiagOutput);
+
+  if (!Opts.mTimeReportFile.empty()) {
+    std::string Error;
+    llvm::raw_fd_ostream OS(Opts.mTimeReportFile.c_str(), Error);
+    if (Error.empty())
+      Report.printJSON(OS);
+    else
+      (*DiagOutput) << "error: cannot write '" << Opts.mTimeReportFile
+                    << "': " << Error << "\n";
+  }
+
+  return CompileFailed;
+}
+
+#ifndef USE_MINGW
+// The compile server (-server) and its clients (-connect) talk through a UNIX
+// domain socket. A request is its size in decimal followed by a '\n', then
+// the client's working directory and its command line arguments (without
+// argv[0] and -connect), each is terminated by '\0'. The reply is the exit
+// status and the size of the standard output in decimal separated by a ' '
+// and followed by a '\n', then the standard output (see the @StdOutput of
+// Compile()) and the diagnostics. The server closes the connection after the
+// reply.
+// The server acts on behalf of its clients, so the socket is only accessible
+// to its owner and the requests of the other users are refused.
+
+// How long the server waits for a request to arrive, such that a client which
+// stalls doesn't block the others
+static const int RequestTimeoutSeconds = 30;
+
+// The largest request accepted
+static const size_t MaxRequestSize = 16 * 1024 * 1024;
+
+static bool WriteAll(int FD, const char *Buf, size_t Size) {
+  while (Size > 0) {
+    ssize_t Written = ::write(FD, Buf, Size);
+    if (Written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    Buf += Written;
+    Size -= Written;
+  }
+  return true;
+}
+
+static bool ReadAll(int FD, std::string &Buf) {
+  char Chunk[4096];
+  while (true) {
+    ssize_t Read = ::read(FD, Chunk, sizeof(Chunk));
+    if (Read == 0)
+      return true;
+    if (Read < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    Buf.append(Chunk, Read);
+  }
+}
+
+// ReadRequest - Read a request (see above) from @FD into @Request. Return
+// false if it's malformed, too large or not fully sent in time.
+static bool ReadRequest(int FD, std::string &Request) {
+  struct timeval Timeout;
+  Timeout.tv_sec = RequestTimeoutSeconds;
+  Timeout.tv_usec = 0;
+  if (::setsockopt(FD, SOL_SOCKET, SO_RCVTIMEO, &Timeout,
+                   sizeof(Timeout)) != 0)
+    return false;
+
+  size_t Size = 0;
+  unsigned Digits = 0;
+  while (true) {
+    char C;
+    ssize_t Read = ::read(FD, &C, 1);
+    if ((Read < 0) && (errno == EINTR))
+      continue;
+    if (Read <= 0)
+      return false;
+    if (C == '\n')
+      break;
+    if ((C < '0') || (C > '9') || (++Digits > 9))
+      return false;
+    Size = Size * 10 + (C - '0');
+  }
+  if ((Digits == 0) || (Size > MaxRequestSize))
+    return false;
+
+  Request.resize(Size);
+  for (size_t Done = 0; Done < Size; ) {
+    ssize_t Read = ::read(FD, &Request[Done], Size - Done);
+    if ((Read < 0) && (errno == EINTR))
+      continue;
+    if (Read <= 0)
+      return false;
+    Done += Read;
+  }
+  return true;
+}
+
+// CreateSocket - Return a UNIX domain socket bound to (if @Listen, then
+// accessible to the owner only) or connected to @Path, or -1 on error
+// (reported to llvm::errs().)
+static int CreateSocket(const std::string &Path, bool Listen,
+                        const std::string &Argv0) {
+  struct sockaddr_un Addr;
+  if (Path.size() >= sizeof(Addr.sun_path)) {
+    llvm::errs() << Argv0 << ": error: socket path '" << Path
+                 << "' is too long\n";
+    return -1;
+  }
+
+  // Only the socket left by a previous server is replaced.
+  struct stat Stat;
+  if (Listen && (::lstat(Path.c_str(), &Stat) == 0) &&
+      !S_ISSOCK(Stat.st_mode)) {
+    llvm::errs() << Argv0 << ": error: '" << Path
+                 << "' exists and is not a socket\n";
+    return -1;
+  }
+
+  ::memset(&Addr, 0, sizeof(Addr));
+  Addr.sun_family = AF_UNIX;
+  ::strcpy(Addr.sun_path, Path.c_str());
+
+  int FD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (FD >= 0) {
+    if (Listen) {
+      ::unlink(Path.c_str());
+      // No other user can connect between bind() and chmod().
+      mode_t OldMask = ::umask(0077);
+      bool Bound = (::bind(FD, reinterpret_cast<struct sockaddr*>(&Addr),
+                           sizeof(Addr)) == 0);
+      ::umask(OldMask);
+      if (Bound &&
+          (::chmod(Path.c_str(), S_IRUSR | S_IWUSR) == 0) &&
+          (::listen(FD, SOMAXCONN) == 0))
+        return FD;
+    } else {
+      if (::connect(FD, reinterpret_cast<struct sockaddr*>(&Addr),
+                    sizeof(Addr)) == 0)
+        return FD;
+    }
+    ::close(FD);
+  }
+
+  llvm::errs() << Argv0 << ": error: socket '" << Path << "': "
+               << ::strerror(errno) << "\n";
+  return -1;
+}
+
+// IsPeerOwner - Return true if the peer of the connected socket @FD runs as
+// the same user as we do.
+static bool IsPeerOwner(int FD) {
+#if defined(__linux__)
+  struct ucred Cred;
+  socklen_t Len = sizeof(Cred);
+  if (::getsockopt(FD, SOL_SOCKET, SO_PEERCRED, &Cred, &Len) != 0)
+    return false;
+  return (Cred.uid == ::geteuid());
+#else
+  uid_t UID;
+  gid_t GID;
+  if (::getpeereid(FD, &UID, &GID) != 0)
+    return false;
+  return (UID == ::geteuid());
+#endif
+}
+
+// ServeRequest - Compile according to the @Request using @Compiler. The
+// standard output and the diagnostics are appended to @Output and @Diags.
+// Return the exit status.
+static int ServeRequest(slang::SlangRS *Compiler,
+                        const std::string &Argv0,
+                        const std::string &Request,
+                        std::string &Output,
+                        std::string &Diags) {
+  std::set<std::string> SavedStrings;
+  llvm::SmallVector<const char*, 256> ArgVector;
+  llvm::SmallVector<const char*, 16> Inputs;
+  RSCCOptions Opts;
+
+  llvm::raw_string_ostream DiagOS(Diags);
+  clang::TextDiagnosticPrinter *DiagClient =
+    new clang::TextDiagnosticPrinter(DiagOS, clang::DiagnosticOptions());
+  DiagClient->setPrefix(Argv0);
+
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticIDs> DiagIDs(
+    new clang::DiagnosticIDs());
+
+  clang::DiagnosticsEngine DiagEngine(DiagIDs, DiagClient, true);
+
+  // Split the request. The strings in Request stay alive until we return.
+  const char *P = Request.c_str(), *E = P + Request.size();
+  const char *WorkingDir = P;
+  P += ::strlen(P) + 1;
+
+  ArgVector.push_back(Argv0.c_str());
+  while (P < E) {
+    ArgVector.push_back(P);
+    P += ::strlen(P) + 1;
+  }
+
+  if (::chdir(WorkingDir) != 0) {
+    DiagEngine.Report(DiagEngine.getCustomDiagID(
+        clang::DiagnosticsEngine::Error,
+        "unable to change the working directory to '%0'")) << WorkingDir;
+    DiagOS.flush();
+    return 1;
+  }
+
+  ParseArguments(ArgVector, Inputs, Opts, DiagEngine);
+
+  if (!DiagEngine.hasErrorOccurred() && Inputs.empty())
+    DiagEngine.Report(clang::diag::err_drv_no_input_files);
+
+  if (DiagEngine.hasErrorOccurred()) {
+    DiagOS.flush();
+    return 1;
+  }
+
+  // The compiler was initialized for the default target.
+  RSCCOptions DefaultOpts;
+  if ((Opts.mTriple != DefaultOpts.mTriple) ||
+      (Opts.mCPU != DefaultOpts.mCPU)) {
+    DiagEngine.Report(DiagEngine.getCustomDiagID(
+        clang::DiagnosticsEngine::Error,
+        "the compile server requires the first -target to be '%0'"))
+        << DefaultOpts.mTriple;
+    DiagOS.flush();
+    return 1;
+  }
+
+  // Requests are served one at a time by the single long-lived compiler.
+  Opts.mJobs = 1;
+
+  Compiler->flushFileCache();
+  Compiler->recycleLLVMContext();
+  Compiler->setDiagnosticOutput(&DiagOS);
+
+  std::ostringstream OutputOS;
+  int CompileFailed = Compile(Compiler, Opts, Inputs, SavedStrings, &DiagOS,
+                              &OutputOS);
+  Compiler->reset();
+  Output.append(OutputOS.str());
+
+  Compiler->setDiagnosticOutput(&llvm::errs());
+  DiagOS.flush();
+
+  return CompileFailed;
+}
+
+// The pipe through which SIGTERM and SIGINT wake up the server (see
+// RunServer())
+static int ShutdownPipe[2] = { -1, -1 };
+
+static void ShutdownHandler(int Signal) {
+  char C = 0;
+  // Nothing to do on failure, the pipe is non-blocking and already has one.
+  ssize_t Written = ::write(ShutdownPipe[1], &C, 1);
+  (void) Written;
+  return;
+}
+
+// RunServer - Keep serving the requests sent to @SocketPath (see -connect)
+// with an initialized SlangRS instance such that the compiler startup cost
+// is paid only once, until SIGTERM or SIGINT. The request being served (if
+// any) is finished first, then the socket is removed.
+static int RunServer(const std::string &SocketPath, const std::string &Argv0) {
+  if ((::pipe(ShutdownPipe) != 0) ||
+      (::fcntl(ShutdownPipe[1], F_SETFL, O_NONBLOCK) != 0)) {
+    llvm::errs() << Argv0 << ": error: pipe: " << ::strerror(errno) << "\n";
+    return 1;
+  }
+
+  int ServerFD = CreateSocket(SocketPath, /* Listen = */true, Argv0);
+  if (ServerFD < 0)
+    return 1;
+
+  struct sigaction Action;
+  ::memset(&Action, 0, sizeof(Action));
+  Action.sa_handler = ShutdownHandler;
+  ::sigemptyset(&Action.sa_mask);
+  ::sigaction(SIGTERM, &Action, NULL);
+  ::sigaction(SIGINT, &Action, NULL);
+
+  // Don't die when a client goes away before reading its reply.
+  ::signal(SIGPIPE, SIG_IGN);
+
+  RSCCOptions Opts;
+  llvm::OwningPtr<slang::SlangRS> Compiler(new slang::SlangRS());
+
+  Compiler->init(Opts.mTriple, Opts.mCPU, Opts.mFeatures);
+
+  int Status = 0;
+  while (true) {
+    struct pollfd FDs[2];
+    FDs[0].fd = ServerFD;
+    FDs[0].events = POLLIN;
+    FDs[1].fd = ShutdownPipe[0];
+    FDs[1].events = POLLIN;
+    if (::poll(FDs, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      llvm::errs() << Argv0 << ": error: poll: " << ::strerror(errno)
+                   << "\n";
+      Status = 1;
+      break;
+    }
+    if (FDs[1].revents != 0)
+      break;
+    if (FDs[0].revents == 0)
+      continue;
+
+    int FD = ::accept(ServerFD, NULL, NULL);
+    if (FD < 0) {
+      if ((errno == EINTR) || (errno == ECONNABORTED))
+        continue;
+      llvm::errs() << Argv0 << ": error: accept: " << ::strerror(errno)
+                   << "\n";
+      Status = 1;
+      break;
+    }
+
+    if (!IsPeerOwner(FD)) {
+      llvm::errs() << Argv0 << ": warning: refused a request from another "
+                              "user\n";
+      ::close(FD);
+      continue;
+    }
+
+    std::string Request, Output, Diags;
+    if (ReadRequest(FD, Request) && !Request.empty()) {
+      int Status = ServeRequest(Compiler.get(), Argv0, Request, Output, Diags);
+      std::string Reply = llvm::utostr(Status) + " " +
+                          llvm::utostr(Output.size()) + "\n" + Output + Diags;
+      WriteAll(FD, Reply.data(), Reply.size());
+    }
+
+    ::close(FD);
+  }
+
+  ::close(ServerFD);
+  ::unlink(SocketPath.c_str());
+  return Status;
+}
+
+// RunClient - Forward the command line in @ArgVector to the compile server
+// listening on @SocketPath and report its result.
+static int RunClient(const std::string &SocketPath,
+                     const std::string &Argv0,
+                     const llvm::SmallVectorImpl<const char*> &ArgVector) {
+  std::string Payload(llvm::sys::Path::GetCurrentDirectory().str());
+  Payload.append(1, '\0');
+
+  for (unsigned i = 1, e = ArgVector.size(); i != e; i++) {
+    if (::strcmp(ArgVector[i], "-connect") == 0) {
+      i++;  // Skip its value too
+      if (i == e)
+        break;
+      continue;
+    }
+    Payload.append(ArgVector[i]);
+    Payload.append(1, '\0');
+  }
+  std::string Request = llvm::utostr(Payload.size()) + "\n" + Payload;
+
+  int FD = CreateSocket(SocketPath, /* Listen = */false, Argv0);
+  if (FD < 0)
+    return 1;
+
+  std::string Reply;
+  bool Success = WriteAll(FD, Request.data(), Request.size()) &&
+                 ReadAll(FD, Reply);
+  ::close(FD);
+
+  int Status = 0;
+  unsigned long OutputSize = 0;  // NOLINT
+  size_t HeaderEnd = Reply.find('\n');
+  if (!Success || (HeaderEnd == std::string::npos) ||
+      (::sscanf(Reply.c_str(), "%d %lu", &Status, &OutputSize) != 2) ||
+      (OutputSize > Reply.size() - HeaderEnd - 1)) {
+    llvm::errs() << Argv0 << ": error: no valid reply from the compile "
+                             "server at '" << SocketPath << "'\n";
+    return 1;
+  }
+
+  std::cout << Reply.substr(HeaderEnd + 1, OutputSize) << std::flush;
+  llvm::errs() << Reply.substr(HeaderEnd + 1 + OutputSize);
+
+  return Status;
+}
+#endif  // USE_MINGW
+
 #define str(s) #s
 #define wrap_str(s) str(s)
 static void llvm_rs_cc_VersionPrinter() {
@@ -370,8 +1188,6 @@ int main(int argc, const char **argv) {
 
   clang::Diagnostic Diags(&DiagEngine);
 
-  slang::Slang::GlobalInitialization();
-
   ParseArguments(ArgVector, Inputs, Opts, DiagEngine);
 
   // Exits when there's any error occurred during parsing the arguments
@@ -390,63 +1206,31 @@ int main(int argc, const char **argv) {
     return 0;
   }
 
+#ifndef USE_MINGW
+  if (!Opts.mConnectSocket.empty())
+    return RunClient(Opts.mConnectSocket, Argv0, ArgVector);
+#endif
+
+  slang::Slang::GlobalInitialization();
+
+#ifndef USE_MINGW
+  if (!Opts.mServerSocket.empty())
+    return RunServer(Opts.mServerSocket, Argv0);
+#endif
+
   // No input file
   if (Inputs.empty()) {
     DiagEngine.Report(clang::diag::err_drv_no_input_files);
     return 1;
   }
 
-  // Prepare input data for RS compiler.
-  std::list<std::pair<const char*, const char*> > IOFiles;
-  std::list<std::pair<const char*, const char*> > DepFiles;
-
   llvm::OwningPtr<slang::SlangRS> Compiler(new slang::SlangRS());
 
   Compiler->init(Opts.mTriple, Opts.mCPU, Opts.mFeatures);
 
-  for (int i = 0, e = Inputs.size(); i != e; i++) {
-    const char *InputFile = Inputs[i];
-    const char *OutputFile =
-        DetermineOutputFile(Opts.mOutputDir, InputFile,
-                            Opts.mOutputType, SavedStrings);
-
-    if (Opts.mOutputDep) {
-      const char *BCOutputFile, *DepOutputFile;
-
-      if (Opts.mOutputType == slang::Slang::OT_Bitcode)
-        BCOutputFile = OutputFile;
-      else
-        BCOutputFile = DetermineOutputFile(Opts.mOutputDepDir,
-                                           InputFile,
-                                           slang::Slang::OT_Bitcode,
-                                           SavedStrings);
+  int CompileFailed = Compile(Compiler.get(), Opts, Inputs, SavedStrings,
+                              &llvm::errs(), &std::cout);
 
-      if (Opts.mOutputType == slang::Slang::OT_Dependency)
-        DepOutputFile = OutputFile;
-      else
-        DepOutputFile = DetermineOutputFile(Opts.mOutputDepDir,
-                                            InputFile,
-                                            slang::Slang::OT_Dependency,
-                                            SavedStrings);
-
-      DepFiles.push_back(std::make_pair(BCOutputFile, DepOutputFile));
-    }
-
-    IOFiles.push_back(std::make_pair(InputFile, OutputFile));
-  }
-
-  // Let's rock!
-  int CompileFailed = !Compiler->compile(IOFiles,
-                                         DepFiles,
-                                         Opts.mIncludePaths,
-                                         Opts.mAdditionalDepTargets,
-                                         Opts.mOutputType,
-                                         Opts.mBitcodeStorage,
-                                         Opts.mAllowRSPrefix,
-                                         Opts.mOutputDep,
-                                         Opts.mTargetAPI,
-                                         Opts.mJavaReflectionPathBase,
-                                         Opts.mJavaReflectionPackageName);
   Compiler->reset();
 
   return CompileFailed;
@@ -14,34 +14,48 @@
  * limitations under the License.
  */
 
+#ifndef USE_MINGW
+#include <pthread.h>
+#endif
+
+#include <algorithm>
 #include <list>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "llvm/ADT/SmallPtrSet.h"
+
 #include "llvm/Analysis/Verifier.h"
 
 #include "llvm/Bitcode/ReaderWriter.h"
 
+#include "llvm/Constants.h"
+#include "llvm/Function.h"
 #include "llvm/Linker.h"
 #include "llvm/LLVMContext.h"
 #include "llvm/Metadata.h"
 #include "llvm/Module.h"
 
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InstIterator.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
-#include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/system_error.h"
+#include "llvm/Support/Threading.h"
 
 #include "llvm/PassManager.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
 
 #include "llvm/Target/TargetData.h"
 
+#include "slang_rs_cache.h"
 #include "slang_rs_metadata.h"
+#include "slang_utils.h"
 
 using llvm::errs;
 using llvm::LLVMContext;
@@ -64,9 +78,23 @@ static llvm::cl::list<std::string>
                    llvm::cl::desc("Specify additional libraries to link to"),
                    llvm::cl::value_desc("<library bitcode>"));
 
+static llvm::cl::opt<unsigned>
+Jobs("jobs", llvm::cl::desc("Link up to <N> input files in parallel"),
+     llvm::cl::value_desc("N"), llvm::cl::init(1));
+
+static llvm::cl::opt<std::string>
+CacheDir("cache-dir",
+         llvm::cl::desc("Reuse the outputs of linking the same input files "
+                        "with the same libraries cached in <directory>"),
+         llvm::cl::value_desc("directory"));
+
+// The symbols never internalized, besides the exported ones
+static const char *const FixedExportSymbols[] = { "init", "root", ".rs.dtor" };
+
 static bool GetExportSymbolNames(llvm::NamedMDNode *N,
                                  unsigned NameOpIdx,
-                                 std::vector<const char *> &Names) {
+                                 std::vector<const char *> &Names,
+                                 llvm::raw_ostream &OS) {
   if (N == NULL)
     return true;
 
@@ -76,16 +104,16 @@ static bool GetExportSymbolNames(llvm::NamedMDNode *N,
       continue;
 
     if (V->getNumOperands() < (NameOpIdx + 1)) {
-      errs() << "Invalid metadata spec of " << N->getName()
-             << " in Renderscript executable. (#op)\n";
+      OS << "Invalid metadata spec of " << N->getName()
+         << " in Renderscript executable. (#op)\n";
       return false;
     }
 
     llvm::MDString *Name =
         llvm::dyn_cast<llvm::MDString>(V->getOperand(NameOpIdx));
     if (Name == NULL) {
-      errs() << "Invalid metadata spec of " << N->getName()
-             << " in Renderscript executable. (#name)\n";
+      OS << "Invalid metadata spec of " << N->getName()
+         << " in Renderscript executable. (#name)\n";
       return false;
     }
 
@@ -94,47 +122,51 @@ static bool GetExportSymbolNames(llvm::NamedMDNode *N,
   return true;
 }
 
-static bool GetExportSymbols(Module *M, std::vector<const char *> &Names) {
+static bool GetExportSymbols(Module *M, std::vector<const char *> &Names,
+                             llvm::raw_ostream &OS) {
   bool Result = true;
   // Variables marked as export must be externally visible
   if (llvm::NamedMDNode *EV = M->getNamedMetadata(RS_EXPORT_VAR_MN))
-    Result |= GetExportSymbolNames(EV, RS_EXPORT_VAR_NAME, Names);
+    Result |= GetExportSymbolNames(EV, RS_EXPORT_VAR_NAME, Names, OS);
   // So are those exported functions
   if (llvm::NamedMDNode *EF = M->getNamedMetadata(RS_EXPORT_FUNC_MN))
-    Result |= GetExportSymbolNames(EF, RS_EXPORT_FUNC_NAME, Names);
+    Result |= GetExportSymbolNames(EF, RS_EXPORT_FUNC_NAME, Names, OS);
   return Result;
 }
 
-static inline MemoryBuffer *LoadFileIntoMemory(const std::string &F) {
+static inline MemoryBuffer *LoadFileIntoMemory(const std::string &F,
+                                               llvm::raw_ostream &OS) {
   llvm::OwningPtr<MemoryBuffer> MB;
 
   if (llvm::error_code EC = MemoryBuffer::getFile(F, MB)) {
-    errs() << "Failed to load `" << F << "' (" + EC.message() + ")\n";
+    OS << "Failed to load `" << F << "' (" + EC.message() + ")\n";
   }
 
   return MB.take();
 }
 
 static inline Module *ParseBitcodeFromMemoryBuffer(MemoryBuffer *MB,
-                                                   LLVMContext& Context) {
+                                                   LLVMContext& Context,
+                                                   llvm::raw_ostream &OS) {
   std::string Err;
   Module *M = ParseBitcodeFile(MB, Context, &Err);
 
   if (M == NULL)
-    errs() << "Corrupted bitcode file `" << MB->getBufferIdentifier()
-           <<  "' (" << Err << ")\n";
+    OS << "Corrupted bitcode file `" << MB->getBufferIdentifier()
+       <<  "' (" << Err << ")\n";
 
   return M;
 }
 
 // LoadBitcodeFile - Read the specified bitcode file in and return it.
 static inline Module *LoadBitcodeFile(const std::string &F,
-                                      LLVMContext& Context) {
-  MemoryBuffer *MB = LoadFileIntoMemory(F);
+                                      LLVMContext& Context,
+                                      llvm::raw_ostream &OS) {
+  MemoryBuffer *MB = LoadFileIntoMemory(F, OS);
   if (MB == NULL)
     return NULL;
 
-  Module *M = ParseBitcodeFromMemoryBuffer(MB, Context);
+  Module *M = ParseBitcodeFromMemoryBuffer(MB, Context, OS);
   if (M == NULL)
     delete MB;
 
@@ -144,6 +176,8 @@ static inline Module *LoadBitcodeFile(const std::string &F,
 extern const char rslib_bc[];
 extern unsigned rslib_bc_size;
 
+// PreloadLibraries - Read the bitcode of the libraries into @LibBitcode, which
+// is shared (read-only) by all the link jobs.
 static bool PreloadLibraries(bool NoStdLib,
                              const std::vector<std::string> &AdditionalLibs,
                              std::list<MemoryBuffer *> &LibBitcode) {
@@ -168,7 +202,7 @@ static bool PreloadLibraries(bool NoStdLib,
           I = AdditionalLibs.begin(), E = AdditionalLibs.end();
        I != E;
        I++) {
-    MB = LoadFileIntoMemory(*I);
+    MB = LoadFileIntoMemory(*I, errs());
     if (MB == NULL)
       return false;
     LibBitcode.push_back(MB);
@@ -187,35 +221,203 @@ static void UnloadLibraries(std::list<MemoryBuffer *>& LibBitcode) {
   return;
 }
 
+// LoadLibraries - Read the headers of the libraries in @LibBitcode into
+// @Context. The function bodies are only read when materialized and the
+// modules are kept across the input files linked in @Context, so each body is
+// read once at most.
+static bool LoadLibraries(const std::list<MemoryBuffer *> &LibBitcode,
+                          LLVMContext &Context,
+                          std::list<Module *> &Libs,
+                          llvm::raw_ostream &OS) {
+  for (std::list<MemoryBuffer *>::const_iterator I = LibBitcode.begin(),
+          E = LibBitcode.end();
+       I != E;
+       I++) {
+    // The module takes the ownership of the buffer but not of the bitcode.
+    MemoryBuffer *MB =
+        MemoryBuffer::getMemBuffer((*I)->getBuffer(),
+                                   (*I)->getBufferIdentifier());
+    std::string Err;
+    Module *Lib = llvm::getLazyBitcodeModule(MB, Context, &Err);
+    if (Lib == NULL) {
+      OS << "Corrupted bitcode file `" << MB->getBufferIdentifier()
+         <<  "' (" << Err << ")\n";
+      delete MB;
+      return false;
+    }
+    Libs.push_back(Lib);
+  }
+  return true;
+}
+
+static void UnloadLibraries(std::list<Module *>& Libs) {
+  for (std::list<Module *>::iterator I = Libs.begin(), E = Libs.end();
+       I != E;
+       I++)
+    delete *I;
+  Libs.clear();
+  return;
+}
+
+// AddReferencedFunctions - Add the functions referenced by the constant @C
+// (e.g., a function or a constant expression casting one) to @Worklist.
+static void AddReferencedFunctions(const llvm::Constant *C,
+                                   std::vector<llvm::Function *> &Worklist) {
+  if (const llvm::Function *F = llvm::dyn_cast<llvm::Function>(C)) {
+    Worklist.push_back(const_cast<llvm::Function *>(F));
+  } else if (!llvm::isa<llvm::GlobalValue>(C)) {
+    for (unsigned i = 0, e = C->getNumOperands(); i != e; i++)
+      AddReferencedFunctions(llvm::cast<llvm::Constant>(C->getOperand(i)),
+                             Worklist);
+  }
+  return;
+}
+
+// FindDefinition - Return the function named @Name defined (maybe not
+// materialized yet) by the first of @Libs, or NULL if none of them does.
+static llvm::Function *FindDefinition(const std::list<Module *> &Libs,
+                                      llvm::StringRef Name) {
+  for (std::list<Module *>::const_iterator I = Libs.begin(), E = Libs.end();
+       I != E;
+       I++) {
+    llvm::Function *F = (*I)->getFunction(Name);
+    if ((F != NULL) && !F->isDeclaration())
+      return F;
+  }
+  return NULL;
+}
+
+// CollectNeededFunctions - Collect the functions in @Libs which @M references,
+// either directly or through the other needed functions or the global
+// variables of @Libs, to @Needed and materialize them. A function only
+// declared where it's referenced (e.g., an rslib function called by a library
+// given by -l) is resolved by the first of @Libs defining it.
+static bool CollectNeededFunctions(Module *M,
+                                   const std::list<Module *> &Libs,
+                                   llvm::SmallPtrSet<llvm::Function *, 64>
+                                       &Needed,
+                                   llvm::raw_ostream &OS) {
+  std::vector<llvm::Function *> Worklist;
+
+  for (Module::iterator I = M->begin(), E = M->end(); I != E; I++) {
+    if (I->isDeclaration())
+      Worklist.push_back(I);
+  }
+
+  // All global variables of the libraries are linked.
+  for (std::list<Module *>::const_iterator LI = Libs.begin(),
+          LE = Libs.end();
+       LI != LE;
+       LI++) {
+    for (Module::global_iterator I = (*LI)->global_begin(),
+            E = (*LI)->global_end();
+         I != E;
+         I++) {
+      if (I->hasInitializer())
+        AddReferencedFunctions(I->getInitializer(), Worklist);
+    }
+  }
+
+  while (!Worklist.empty()) {
+    llvm::Function *F = Worklist.back();
+    Worklist.pop_back();
+
+    if (F->isDeclaration()) {
+      if (F->isIntrinsic())
+        continue;
+      F = FindDefinition(Libs, F->getName());
+      if (F == NULL)
+        continue;
+    }
+
+    if (!Needed.insert(F))
+      continue;
+
+    std::string Err;
+    if (F->Materialize(&Err)) {
+      OS << "Failed to read `" << F->getName() << "' from library bitcode `"
+         << F->getParent()->getModuleIdentifier() << "' (" << Err << ")\n";
+      return false;
+    }
+
+    for (llvm::inst_iterator II = llvm::inst_begin(F), IE = llvm::inst_end(F);
+         II != IE;
+         II++) {
+      for (unsigned i = 0, e = II->getNumOperands(); i != e; i++)
+        if (const llvm::Constant *C =
+                llvm::dyn_cast<llvm::Constant>(II->getOperand(i)))
+          AddReferencedFunctions(C, Worklist);
+    }
+  }
+
+  return true;
+}
+
+// ExtractNeededFunctions - Return a copy of @Lib with only the function bodies
+// in @Needed, which can be linked with (and destroyed by) the linker.
+static Module *ExtractNeededFunctions(
+    Module *Lib,
+    const llvm::SmallPtrSet<llvm::Function *, 64> &Needed) {
+  // The unmaterialized functions become declarations in the copy, so do the
+  // functions materialized for the other input files but not needed now.
+  llvm::ValueToValueMapTy VMap;
+  Module *Copy = llvm::CloneModule(Lib, VMap);
+
+  for (Module::iterator I = Lib->begin(), E = Lib->end(); I != E; I++) {
+    llvm::Function *LibF = I;
+    llvm::Function *F = llvm::cast<llvm::Function>(VMap[LibF]);
+    if (!Needed.count(LibF) && !F->isDeclaration())
+      F->deleteBody();
+  }
+
+  for (Module::iterator I = Copy->begin(), E = Copy->end(); I != E; ) {
+    llvm::Function *F = I++;
+    if (F->isDeclaration()) {
+      if (F->use_empty())
+        F->eraseFromParent();
+      else
+        F->setLinkage(llvm::GlobalValue::ExternalLinkage);
+    }
+  }
+
+  return Copy;
+}
+
 Module *PerformLinking(const std::string &InputFile,
-                       const std::list<MemoryBuffer *> &LibBitcode,
-                       LLVMContext &Context) {
+                       const std::list<Module *> &Libs,
+                       LLVMContext &Context,
+                       llvm::raw_ostream &OS) {
   std::string Err;
-  std::auto_ptr<Module> Composite(LoadBitcodeFile(InputFile, Context));
+  std::auto_ptr<Module> Composite(LoadBitcodeFile(InputFile, Context, OS));
 
   if (Composite.get() == NULL)
     return NULL;
 
-  for (std::list<MemoryBuffer *>::const_iterator I = LibBitcode.begin(),
-          E = LibBitcode.end();
+  // The needed functions are collected across all the libraries first, since
+  // a library may call the functions of another one which the input doesn't.
+  llvm::SmallPtrSet<llvm::Function *, 64> Needed;
+  if (!CollectNeededFunctions(Composite.get(), Libs, Needed, OS))
+    return NULL;
+
+  for (std::list<Module *>::const_iterator I = Libs.begin(), E = Libs.end();
        I != E;
        I++) {
-    Module *Lib = ParseBitcodeFromMemoryBuffer(*I, Context);
-    if (Lib == NULL)
-      return NULL;
+    Module *Lib = ExtractNeededFunctions(*I, Needed);
 
     if (llvm::Linker::LinkModules(Composite.get(), Lib,
                                   llvm::Linker::DestroySource, &Err)) {
-      errs() << "Failed to link `" << InputFile << "' with library bitcode `"
-             << (*I)->getBufferIdentifier() << "' (" << Err << ")\n";
+      OS << "Failed to link `" << InputFile << "' with library bitcode `"
+         << (*I)->getModuleIdentifier() << "' (" << Err << ")\n";
+      delete Lib;
       return NULL;
     }
+    delete Lib;
   }
 
   return Composite.release();
 }
 
-bool OptimizeModule(Module *M) {
+bool OptimizeModule(Module *M, llvm::raw_ostream &OS) {
   llvm::PassManager Passes;
 
   const std::string &ModuleDataLayout = M->getDataLayout();
@@ -224,12 +426,12 @@ bool OptimizeModule(Module *M) {
       Passes.add(TD);
 
   // Some symbols must not be internalized
-  std::vector<const char *> ExportList;
-  ExportList.push_back("init");
-  ExportList.push_back("root");
-  ExportList.push_back(".rs.dtor");
+  std::vector<const char *> ExportList(
+      FixedExportSymbols,
+      FixedExportSymbols + (sizeof(FixedExportSymbols) /
+                            sizeof(FixedExportSymbols[0])));
 
-  if (!GetExportSymbols(M, ExportList)) {
+  if (!GetExportSymbols(M, ExportList, OS)) {
     return false;
   }
 
@@ -245,63 +447,249 @@ bool OptimizeModule(Module *M) {
   return true;
 }
 
-int main(int argc, char **argv) {
-  llvm::llvm_shutdown_obj X;  // Call llvm_shutdown() on exit.
+// ComputeCacheKey - The key of the cached output of linking @Input (the
+// content of the input file) with @LibBitcode. The symbols exported from the
+// output are either fixed or given by the metadata of @Input.
+static void ComputeCacheKey(slang::RSCompilationCache *Cache,
+                            llvm::StringRef Input,
+                            const std::list<MemoryBuffer *> &LibBitcode) {
+  Cache->resetKey();
+
+  // Any change to llvm-rs-link (including the LLVM libraries linked into it)
+  // invalidates the entries.
+  Cache->addToKey("llvm-rs-link");
+  Cache->addToKey(slang::SlangUtils::GetBuildID());
+
+  Cache->addToKey(Input);
+  Cache->addToKey(static_cast<unsigned>(LibBitcode.size()));
+  for (std::list<MemoryBuffer *>::const_iterator I = LibBitcode.begin(),
+          E = LibBitcode.end();
+       I != E;
+       I++) {
+    Cache->addToKey((*I)->getBuffer());
+  }
+  for (unsigned i = 0,
+          e = sizeof(FixedExportSymbols) / sizeof(FixedExportSymbols[0]);
+       i != e;
+       i++) {
+    Cache->addToKey(FixedExportSymbols[i]);
+  }
+  return;
+}
 
-  llvm::cl::ParseCommandLineOptions(argc, argv, "llvm-rs-link\n");
+static bool WriteOutput(const std::string &InputFile,
+                        llvm::StringRef Bitcode,
+                        llvm::raw_ostream &OS) {
+  std::string Err;
+  if (!slang::SlangUtils::WriteFileAtomically(InputFile, Bitcode, &Err)) {
+    OS << InputFile << " linked, but failed to write out! (" << Err << ")\n";
+    return false;
+  }
+  return true;
+}
 
-  std::list<MemoryBuffer *> LibBitcode;
+// LinkFile - Link @InputFile with @Libs (read from @LibBitcode), optimize it
+// and write it back. With -cache-dir, the output of linking the same input
+// with the same libraries before is reused. The errors are written to @OS.
+static bool LinkFile(const std::string &InputFile,
+                     const std::list<MemoryBuffer *> &LibBitcode,
+                     const std::list<Module *> &Libs,
+                     LLVMContext &Context,
+                     llvm::raw_ostream &OS) {
+  llvm::OwningPtr<slang::RSCompilationCache> Cache;
+  slang::RSCompilationCache::Entry CacheEntry;
+  std::string Input;
+
+  // An unreadable input file is reported by linking it.
+  if (!CacheDir.empty() &&
+      slang::RSCompilationCache::ReadFile(InputFile, &Input)) {
+    Cache.reset(new slang::RSCompilationCache(CacheDir));
+    ComputeCacheKey(Cache.get(), Input, LibBitcode);
+    if (Cache->lookup(&CacheEntry))
+      return WriteOutput(InputFile, CacheEntry.Bitcode, OS);
+  }
 
-  if (!PreloadLibraries(NoStdLib, AdditionalLibs, LibBitcode))
-    return 1;
+  std::string Err;
+  std::auto_ptr<Module> Linked(PerformLinking(InputFile, Libs, Context, OS));
 
-  // No libraries specified to be linked
-  if (LibBitcode.size() == 0)
-    return 0;
+  // Failed to link with InputFile with Libs
+  if (Linked.get() == NULL)
+    return false;
 
-  LLVMContext &Context = llvm::getGlobalContext();
-  bool HasError = true;
-  std::string Err;
+  // Verify linked module
+  if (verifyModule(*Linked, llvm::ReturnStatusAction, &Err)) {
+    OS << InputFile << " linked, but does not verify as correct! (" << Err
+       << ")\n";
+    return false;
+  }
 
-  for (unsigned i = 0, e = InputFilenames.size(); i != e; i++) {
-    std::auto_ptr<Module> Linked(
-        PerformLinking(InputFilenames[i], LibBitcode, Context));
+  if (!OptimizeModule(Linked.get(), OS))
+    return false;
 
-    // Failed to link with InputFilenames[i] with LibBitcode
-    if (Linked.get() == NULL)
-      break;
+  // Write out the module
+  std::string Bitcode;
+  llvm::raw_string_ostream BitcodeOS(Bitcode);
+  WriteBitcodeToFile(Linked.get(), BitcodeOS);
+  BitcodeOS.flush();
 
-    // Verify linked module
-    if (verifyModule(*Linked, llvm::ReturnStatusAction, &Err)) {
-      errs() << InputFilenames[i] << " linked, but does not verify as "
-                                     "correct! (" << Err << ")\n";
-      break;
+  if (Cache) {
+    // Failing to cache the output is not an error.
+    CacheEntry.Bitcode = Bitcode;
+    Cache->store(CacheEntry);
+  }
+
+  return WriteOutput(InputFile, Bitcode, OS);
+}
+
+// LinkJob - The input files linked in the same LLVMContext (on one thread.)
+struct LinkJob {
+  const std::list<MemoryBuffer *> *LibBitcode;
+
+  // Indices to InputFilenames
+  std::vector<unsigned> Inputs;
+
+  // Stop at the first input file failed to link
+  bool StopOnError;
+
+  // Where the errors are written to. If NULL, they're kept in Diagnostics
+  // (one for each of Inputs) to be printed once all the jobs are done.
+  llvm::raw_ostream *DiagOutput;
+  std::vector<std::string> Diagnostics;
+
+  // Whether each of Inputs is linked successfully
+  std::vector<bool> Success;
+};
+
+static void RunLinkJob(LinkJob *Job) {
+  LLVMContext Context;
+  std::list<Module *> Libs;
+  std::string LoadError;
+  llvm::raw_string_ostream LoadOS(LoadError);
+
+  Job->Diagnostics.assign(Job->Inputs.size(), std::string());
+  Job->Success.assign(Job->Inputs.size(), false);
+
+  bool Loaded = LoadLibraries(*Job->LibBitcode, Context, Libs,
+                              (Job->DiagOutput) ? *Job->DiagOutput : LoadOS);
+  for (unsigned i = 0, e = Job->Inputs.size(); i != e; i++) {
+    if (!Loaded) {
+      Job->Diagnostics[i] = LoadOS.str();
+      continue;
+    }
+
+    const std::string &InputFile = InputFilenames[Job->Inputs[i]];
+    if (Job->DiagOutput) {
+      Job->Success[i] = LinkFile(InputFile, *Job->LibBitcode, Libs, Context,
+                                 *Job->DiagOutput);
+    } else {
+      llvm::raw_string_ostream OS(Job->Diagnostics[i]);
+      Job->Success[i] = LinkFile(InputFile, *Job->LibBitcode, Libs, Context,
+                                 OS);
     }
 
-    if (!OptimizeModule(Linked.get()))
+    if (!Job->Success[i] && Job->StopOnError)
       break;
+  }
 
-    // Write out the module
-    llvm::tool_output_file Out(InputFilenames[i].c_str(), Err,
-                               llvm::raw_fd_ostream::F_Binary);
+  UnloadLibraries(Libs);
+  return;
+}
 
-    if (!Err.empty()) {
-      errs() << InputFilenames[i] << " linked, but failed to write out! "
-                                     "(" << Err << ")\n";
-      break;
-    }
+#ifndef USE_MINGW
+static void *LinkJobThread(void *Job) {
+  RunLinkJob(static_cast<LinkJob*>(Job));
+  return NULL;
+}
+#endif
+
+// LinkInParallel - Run all the @Jobs (one per thread except the first one,
+// which is run on the calling thread) and wait for them to finish.
+static void LinkInParallel(std::vector<LinkJob> &Jobs) {
+#ifndef USE_MINGW
+  std::vector<pthread_t> Threads(Jobs.size());
+  std::vector<bool> Started(Jobs.size(), false);
+
+  for (unsigned i = 1, e = Jobs.size(); i != e; i++)
+    Started[i] =
+        (pthread_create(&Threads[i], NULL, LinkJobThread, &Jobs[i]) == 0);
+
+  RunLinkJob(&Jobs[0]);
+
+  for (unsigned i = 1, e = Jobs.size(); i != e; i++) {
+    if (Started[i])
+      pthread_join(Threads[i], NULL);
+    else
+      // Failed to spawn the thread, fall back to link it here.
+      RunLinkJob(&Jobs[i]);
+  }
+#else
+  for (unsigned i = 0, e = Jobs.size(); i != e; i++)
+    RunLinkJob(&Jobs[i]);
+#endif
+  return;
+}
 
-    WriteBitcodeToFile(Linked.get(), Out.os());
+int main(int argc, char **argv) {
+  llvm::llvm_shutdown_obj X;  // Call llvm_shutdown() on exit.
 
-    Out.keep();
-    Linked.reset();
+  llvm::cl::ParseCommandLineOptions(argc, argv, "llvm-rs-link\n");
 
-    if (i == (InputFilenames.size() - 1))
-      // This is the last file and no error occured.
-      HasError = false;
+  std::list<MemoryBuffer *> LibBitcode;
+
+  if (!PreloadLibraries(NoStdLib, AdditionalLibs, LibBitcode)) {
+    UnloadLibraries(LibBitcode);
+    return 1;
+  }
+
+  // No libraries specified to be linked
+  if (LibBitcode.size() == 0)
+    return 0;
+
+  // Input files are distributed among the jobs in a round-robin manner. Each
+  // job has its own LLVMContext.
+  unsigned NumJobs = std::min<unsigned>(Jobs, InputFilenames.size());
+  if (NumJobs == 0)
+    NumJobs = 1;
+#ifdef USE_MINGW
+  NumJobs = 1;
+#endif
+  if ((NumJobs > 1) && !llvm::llvm_start_multithreaded())
+    NumJobs = 1;
+
+  std::vector<LinkJob> LinkJobs(NumJobs);
+  for (unsigned i = 0; i != NumJobs; i++) {
+    LinkJobs[i].LibBitcode = &LibBitcode;
+    // Without -jobs, stop at the first failure and report it right away as
+    // before. Otherwise link all the input files and report the failures
+    // after all.
+    LinkJobs[i].StopOnError = (NumJobs == 1);
+    LinkJobs[i].DiagOutput = (NumJobs == 1) ? &errs() : NULL;
+  }
+  for (unsigned i = 0, e = InputFilenames.size(); i != e; i++)
+    LinkJobs[i % NumJobs].Inputs.push_back(i);
+
+  if (NumJobs == 1)
+    RunLinkJob(&LinkJobs[0]);
+  else
+    LinkInParallel(LinkJobs);
+
+  // Report the failures in the order of the input files.
+  unsigned NumFailed = 0;
+  for (unsigned i = 0, e = InputFilenames.size(); i != e; i++) {
+    const LinkJob &Job = LinkJobs[i % NumJobs];
+    unsigned Index = i / NumJobs;
+    if (Job.Success[Index])
+      continue;
+
+    NumFailed++;
+    errs() << Job.Diagnostics[Index];
   }
 
+  if ((NumJobs > 1) && (NumFailed > 0))
+    errs() << NumFailed << " of " << InputFilenames.size()
+           << " input files failed to link\n";
+
   UnloadLibraries(LibBitcode);
 
-  return HasError;
+  return (NumFailed > 0);
 }
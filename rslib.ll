@@ -54,3 +54,303 @@ define i32 @test4() {
   %ret2 = add i32 %ret1, %retz
   ret i32 %ret2
 }
+
+; The vector overloads of the math functions, written on the vectors such that
+; the backend of each target turns them into its SIMD instructions (NEON on
+; ARM, SSE on x86.)
+
+declare float @llvm.sqrt.f32(float) nounwind readonly
+
+define float @_Z3dotDv2_fS_(<2 x float> %lhs, <2 x float> %rhs) nounwind readnone {
+  %mul = fmul <2 x float> %lhs, %rhs
+  %mul.0 = extractelement <2 x float> %mul, i32 0
+  %mul.1 = extractelement <2 x float> %mul, i32 1
+  %sum = fadd float %mul.0, %mul.1
+  ret float %sum
+}
+
+define float @_Z6lengthDv2_f(<2 x float> %v) nounwind readnone {
+  %dot = tail call float @_Z3dotDv2_fS_(<2 x float> %v, <2 x float> %v)
+  %len = tail call float @llvm.sqrt.f32(float %dot)
+  ret float %len
+}
+
+define float @_Z8distanceDv2_fS_(<2 x float> %lhs, <2 x float> %rhs) nounwind readnone {
+  %sub = fsub <2 x float> %lhs, %rhs
+  %len = tail call float @_Z6lengthDv2_f(<2 x float> %sub)
+  ret float %len
+}
+
+define <2 x float> @_Z9normalizeDv2_f(<2 x float> %v) nounwind readnone {
+  %len = tail call float @_Z6lengthDv2_f(<2 x float> %v)
+  %lenv.0 = insertelement <2 x float> undef, float %len, i32 0
+  %lenv = shufflevector <2 x float> %lenv.0, <2 x float> undef, <2 x i32> zeroinitializer
+  %ret = fdiv <2 x float> %v, %lenv
+  ret <2 x float> %ret
+}
+
+define <2 x float> @_Z3mixDv2_fS_S_(<2 x float> %start, <2 x float> %stop, <2 x float> %amount) nounwind readnone {
+  %sub = fsub <2 x float> %stop, %start
+  %mul = fmul <2 x float> %sub, %amount
+  %ret = fadd <2 x float> %start, %mul
+  ret <2 x float> %ret
+}
+
+define <2 x float> @_Z3mixDv2_fS_f(<2 x float> %start, <2 x float> %stop, float %amount) nounwind readnone {
+  %amountv.0 = insertelement <2 x float> undef, float %amount, i32 0
+  %amountv = shufflevector <2 x float> %amountv.0, <2 x float> undef, <2 x i32> zeroinitializer
+  %ret = tail call <2 x float> @_Z3mixDv2_fS_S_(<2 x float> %start, <2 x float> %stop, <2 x float> %amountv)
+  ret <2 x float> %ret
+}
+
+define <2 x float> @_Z5clampDv2_fS_S_(<2 x float> %value, <2 x float> %low, <2 x float> %high) nounwind readnone {
+  %lt = fcmp olt <2 x float> %value, %low
+  %max = select <2 x i1> %lt, <2 x float> %low, <2 x float> %value
+  %gt = fcmp ogt <2 x float> %max, %high
+  %ret = select <2 x i1> %gt, <2 x float> %high, <2 x float> %max
+  ret <2 x float> %ret
+}
+
+define <2 x float> @_Z5clampDv2_fff(<2 x float> %value, float %low, float %high) nounwind readnone {
+  %lowv.0 = insertelement <2 x float> undef, float %low, i32 0
+  %lowv = shufflevector <2 x float> %lowv.0, <2 x float> undef, <2 x i32> zeroinitializer
+  %highv.0 = insertelement <2 x float> undef, float %high, i32 0
+  %highv = shufflevector <2 x float> %highv.0, <2 x float> undef, <2 x i32> zeroinitializer
+  %ret = tail call <2 x float> @_Z5clampDv2_fS_S_(<2 x float> %value, <2 x float> %lowv, <2 x float> %highv)
+  ret <2 x float> %ret
+}
+
+define float @_Z3dotDv3_fS_(<3 x float> %lhs, <3 x float> %rhs) nounwind readnone {
+  %mul = fmul <3 x float> %lhs, %rhs
+  %mul.0 = extractelement <3 x float> %mul, i32 0
+  %mul.1 = extractelement <3 x float> %mul, i32 1
+  %mul.2 = extractelement <3 x float> %mul, i32 2
+  %sum.1 = fadd float %mul.0, %mul.1
+  %sum = fadd float %sum.1, %mul.2
+  ret float %sum
+}
+
+define float @_Z6lengthDv3_f(<3 x float> %v) nounwind readnone {
+  %dot = tail call float @_Z3dotDv3_fS_(<3 x float> %v, <3 x float> %v)
+  %len = tail call float @llvm.sqrt.f32(float %dot)
+  ret float %len
+}
+
+define float @_Z8distanceDv3_fS_(<3 x float> %lhs, <3 x float> %rhs) nounwind readnone {
+  %sub = fsub <3 x float> %lhs, %rhs
+  %len = tail call float @_Z6lengthDv3_f(<3 x float> %sub)
+  ret float %len
+}
+
+define <3 x float> @_Z9normalizeDv3_f(<3 x float> %v) nounwind readnone {
+  %len = tail call float @_Z6lengthDv3_f(<3 x float> %v)
+  %lenv.0 = insertelement <3 x float> undef, float %len, i32 0
+  %lenv = shufflevector <3 x float> %lenv.0, <3 x float> undef, <3 x i32> zeroinitializer
+  %ret = fdiv <3 x float> %v, %lenv
+  ret <3 x float> %ret
+}
+
+define <3 x float> @_Z3mixDv3_fS_S_(<3 x float> %start, <3 x float> %stop, <3 x float> %amount) nounwind readnone {
+  %sub = fsub <3 x float> %stop, %start
+  %mul = fmul <3 x float> %sub, %amount
+  %ret = fadd <3 x float> %start, %mul
+  ret <3 x float> %ret
+}
+
+define <3 x float> @_Z3mixDv3_fS_f(<3 x float> %start, <3 x float> %stop, float %amount) nounwind readnone {
+  %amountv.0 = insertelement <3 x float> undef, float %amount, i32 0
+  %amountv = shufflevector <3 x float> %amountv.0, <3 x float> undef, <3 x i32> zeroinitializer
+  %ret = tail call <3 x float> @_Z3mixDv3_fS_S_(<3 x float> %start, <3 x float> %stop, <3 x float> %amountv)
+  ret <3 x float> %ret
+}
+
+define <3 x float> @_Z5clampDv3_fS_S_(<3 x float> %value, <3 x float> %low, <3 x float> %high) nounwind readnone {
+  %lt = fcmp olt <3 x float> %value, %low
+  %max = select <3 x i1> %lt, <3 x float> %low, <3 x float> %value
+  %gt = fcmp ogt <3 x float> %max, %high
+  %ret = select <3 x i1> %gt, <3 x float> %high, <3 x float> %max
+  ret <3 x float> %ret
+}
+
+define <3 x float> @_Z5clampDv3_fff(<3 x float> %value, float %low, float %high) nounwind readnone {
+  %lowv.0 = insertelement <3 x float> undef, float %low, i32 0
+  %lowv = shufflevector <3 x float> %lowv.0, <3 x float> undef, <3 x i32> zeroinitializer
+  %highv.0 = insertelement <3 x float> undef, float %high, i32 0
+  %highv = shufflevector <3 x float> %highv.0, <3 x float> undef, <3 x i32> zeroinitializer
+  %ret = tail call <3 x float> @_Z5clampDv3_fS_S_(<3 x float> %value, <3 x float> %lowv, <3 x float> %highv)
+  ret <3 x float> %ret
+}
+
+define float @_Z3dotDv4_fS_(<4 x float> %lhs, <4 x float> %rhs) nounwind readnone {
+  %mul = fmul <4 x float> %lhs, %rhs
+  %mul.0 = extractelement <4 x float> %mul, i32 0
+  %mul.1 = extractelement <4 x float> %mul, i32 1
+  %mul.2 = extractelement <4 x float> %mul, i32 2
+  %mul.3 = extractelement <4 x float> %mul, i32 3
+  %sum.1 = fadd float %mul.0, %mul.1
+  %sum.2 = fadd float %sum.1, %mul.2
+  %sum = fadd float %sum.2, %mul.3
+  ret float %sum
+}
+
+define float @_Z6lengthDv4_f(<4 x float> %v) nounwind readnone {
+  %dot = tail call float @_Z3dotDv4_fS_(<4 x float> %v, <4 x float> %v)
+  %len = tail call float @llvm.sqrt.f32(float %dot)
+  ret float %len
+}
+
+define float @_Z8distanceDv4_fS_(<4 x float> %lhs, <4 x float> %rhs) nounwind readnone {
+  %sub = fsub <4 x float> %lhs, %rhs
+  %len = tail call float @_Z6lengthDv4_f(<4 x float> %sub)
+  ret float %len
+}
+
+define <4 x float> @_Z9normalizeDv4_f(<4 x float> %v) nounwind readnone {
+  %len = tail call float @_Z6lengthDv4_f(<4 x float> %v)
+  %lenv.0 = insertelement <4 x float> undef, float %len, i32 0
+  %lenv = shufflevector <4 x float> %lenv.0, <4 x float> undef, <4 x i32> zeroinitializer
+  %ret = fdiv <4 x float> %v, %lenv
+  ret <4 x float> %ret
+}
+
+define <4 x float> @_Z3mixDv4_fS_S_(<4 x float> %start, <4 x float> %stop, <4 x float> %amount) nounwind readnone {
+  %sub = fsub <4 x float> %stop, %start
+  %mul = fmul <4 x float> %sub, %amount
+  %ret = fadd <4 x float> %start, %mul
+  ret <4 x float> %ret
+}
+
+define <4 x float> @_Z3mixDv4_fS_f(<4 x float> %start, <4 x float> %stop, float %amount) nounwind readnone {
+  %amountv.0 = insertelement <4 x float> undef, float %amount, i32 0
+  %amountv = shufflevector <4 x float> %amountv.0, <4 x float> undef, <4 x i32> zeroinitializer
+  %ret = tail call <4 x float> @_Z3mixDv4_fS_S_(<4 x float> %start, <4 x float> %stop, <4 x float> %amountv)
+  ret <4 x float> %ret
+}
+
+define <4 x float> @_Z5clampDv4_fS_S_(<4 x float> %value, <4 x float> %low, <4 x float> %high) nounwind readnone {
+  %lt = fcmp olt <4 x float> %value, %low
+  %max = select <4 x i1> %lt, <4 x float> %low, <4 x float> %value
+  %gt = fcmp ogt <4 x float> %max, %high
+  %ret = select <4 x i1> %gt, <4 x float> %high, <4 x float> %max
+  ret <4 x float> %ret
+}
+
+define <4 x float> @_Z5clampDv4_fff(<4 x float> %value, float %low, float %high) nounwind readnone {
+  %lowv.0 = insertelement <4 x float> undef, float %low, i32 0
+  %lowv = shufflevector <4 x float> %lowv.0, <4 x float> undef, <4 x i32> zeroinitializer
+  %highv.0 = insertelement <4 x float> undef, float %high, i32 0
+  %highv = shufflevector <4 x float> %highv.0, <4 x float> undef, <4 x i32> zeroinitializer
+  %ret = tail call <4 x float> @_Z5clampDv4_fS_S_(<4 x float> %value, <4 x float> %lowv, <4 x float> %highv)
+  ret <4 x float> %ret
+}
+
+; cross(lhs, rhs) = lhs.yzx * rhs.zxy - lhs.zxy * rhs.yzx
+define <3 x float> @_Z5crossDv3_fS_(<3 x float> %lhs, <3 x float> %rhs) nounwind readnone {
+  %lhs.yzx = shufflevector <3 x float> %lhs, <3 x float> undef, <3 x i32> <i32 1, i32 2, i32 0>
+  %lhs.zxy = shufflevector <3 x float> %lhs, <3 x float> undef, <3 x i32> <i32 2, i32 0, i32 1>
+  %rhs.yzx = shufflevector <3 x float> %rhs, <3 x float> undef, <3 x i32> <i32 1, i32 2, i32 0>
+  %rhs.zxy = shufflevector <3 x float> %rhs, <3 x float> undef, <3 x i32> <i32 2, i32 0, i32 1>
+  %mul1 = fmul <3 x float> %lhs.yzx, %rhs.zxy
+  %mul2 = fmul <3 x float> %lhs.zxy, %rhs.yzx
+  %ret = fsub <3 x float> %mul1, %mul2
+  ret <3 x float> %ret
+}
+
+; cross(lhs, rhs) = lhs.yzx * rhs.zxy - lhs.zxy * rhs.yzx (w = 0)
+define <4 x float> @_Z5crossDv4_fS_(<4 x float> %lhs, <4 x float> %rhs) nounwind readnone {
+  %lhs.yzx = shufflevector <4 x float> %lhs, <4 x float> undef, <4 x i32> <i32 1, i32 2, i32 0, i32 3>
+  %lhs.zxy = shufflevector <4 x float> %lhs, <4 x float> undef, <4 x i32> <i32 2, i32 0, i32 1, i32 3>
+  %rhs.yzx = shufflevector <4 x float> %rhs, <4 x float> undef, <4 x i32> <i32 1, i32 2, i32 0, i32 3>
+  %rhs.zxy = shufflevector <4 x float> %rhs, <4 x float> undef, <4 x i32> <i32 2, i32 0, i32 1, i32 3>
+  %mul1 = fmul <4 x float> %lhs.yzx, %rhs.zxy
+  %mul2 = fmul <4 x float> %lhs.zxy, %rhs.yzx
+  %ret = fsub <4 x float> %mul1, %mul2
+  ret <4 x float> %ret
+}
+
+; rs_matrix4x4 and rs_matrix2x2 are column major.
+%struct.rs_matrix4x4 = type { [16 x float] }
+%struct.rs_matrix2x2 = type { [4 x float] }
+
+; m * in = col0 * in.x + col1 * in.y + col2 * in.z + col3 * in.w
+define <4 x float> @_Z16rsMatrixMultiplyPK12rs_matrix4x4Dv4_f(%struct.rs_matrix4x4* nocapture %m, <4 x float> %in) nounwind readonly {
+  %cols = bitcast %struct.rs_matrix4x4* %m to <4 x float>*
+  %col0 = load <4 x float>* %cols, align 4
+  %col1.p = getelementptr <4 x float>* %cols, i32 1
+  %col1 = load <4 x float>* %col1.p, align 4
+  %col2.p = getelementptr <4 x float>* %cols, i32 2
+  %col2 = load <4 x float>* %col2.p, align 4
+  %col3.p = getelementptr <4 x float>* %cols, i32 3
+  %col3 = load <4 x float>* %col3.p, align 4
+  %x = shufflevector <4 x float> %in, <4 x float> undef, <4 x i32> zeroinitializer
+  %y = shufflevector <4 x float> %in, <4 x float> undef, <4 x i32> <i32 1, i32 1, i32 1, i32 1>
+  %z = shufflevector <4 x float> %in, <4 x float> undef, <4 x i32> <i32 2, i32 2, i32 2, i32 2>
+  %w = shufflevector <4 x float> %in, <4 x float> undef, <4 x i32> <i32 3, i32 3, i32 3, i32 3>
+  %mul0 = fmul <4 x float> %col0, %x
+  %mul1 = fmul <4 x float> %col1, %y
+  %sum1 = fadd <4 x float> %mul0, %mul1
+  %mul2 = fmul <4 x float> %col2, %z
+  %sum2 = fadd <4 x float> %sum1, %mul2
+  %mul3 = fmul <4 x float> %col3, %w
+  %ret = fadd <4 x float> %sum2, %mul3
+  ret <4 x float> %ret
+}
+
+; in.w = 1
+define <4 x float> @_Z16rsMatrixMultiplyPK12rs_matrix4x4Dv3_f(%struct.rs_matrix4x4* nocapture %m, <3 x float> %in) nounwind readonly {
+  %in4 = shufflevector <3 x float> %in, <3 x float> <float 1.0, float undef, float undef>, <4 x i32> <i32 0, i32 1, i32 2, i32 3>
+  %ret = tail call <4 x float> @_Z16rsMatrixMultiplyPK12rs_matrix4x4Dv4_f(%struct.rs_matrix4x4* %m, <4 x float> %in4)
+  ret <4 x float> %ret
+}
+
+; in.z = 0 and in.w = 1
+define <4 x float> @_Z16rsMatrixMultiplyPK12rs_matrix4x4Dv2_f(%struct.rs_matrix4x4* nocapture %m, <2 x float> %in) nounwind readonly {
+  %in4 = shufflevector <2 x float> %in, <2 x float> <float 0.0, float 1.0>, <4 x i32> <i32 0, i32 1, i32 2, i32 3>
+  %ret = tail call <4 x float> @_Z16rsMatrixMultiplyPK12rs_matrix4x4Dv4_f(%struct.rs_matrix4x4* %m, <4 x float> %in4)
+  ret <4 x float> %ret
+}
+
+define <2 x float> @_Z16rsMatrixMultiplyPK12rs_matrix2x2Dv2_f(%struct.rs_matrix2x2* nocapture %m, <2 x float> %in) nounwind readonly {
+  %cols = bitcast %struct.rs_matrix2x2* %m to <2 x float>*
+  %col0 = load <2 x float>* %cols, align 4
+  %col1.p = getelementptr <2 x float>* %cols, i32 1
+  %col1 = load <2 x float>* %col1.p, align 4
+  %x = shufflevector <2 x float> %in, <2 x float> undef, <2 x i32> zeroinitializer
+  %y = shufflevector <2 x float> %in, <2 x float> undef, <2 x i32> <i32 1, i32 1>
+  %mul0 = fmul <2 x float> %col0, %x
+  %mul1 = fmul <2 x float> %col1, %y
+  %ret = fadd <2 x float> %mul0, %mul1
+  ret <2 x float> %ret
+}
+
+; Column j of ret is lhs * column j of rhs. Both are read before ret is
+; written, since ret may be either of them.
+define void @_Z20rsMatrixLoadMultiplyP12rs_matrix4x4PKS_S2_(%struct.rs_matrix4x4* nocapture %ret, %struct.rs_matrix4x4* nocapture %lhs, %struct.rs_matrix4x4* nocapture %rhs) nounwind {
+  %rhs.cols = bitcast %struct.rs_matrix4x4* %rhs to <4 x float>*
+  %rhs.col0 = load <4 x float>* %rhs.cols, align 4
+  %rhs.col1.p = getelementptr <4 x float>* %rhs.cols, i32 1
+  %rhs.col1 = load <4 x float>* %rhs.col1.p, align 4
+  %rhs.col2.p = getelementptr <4 x float>* %rhs.cols, i32 2
+  %rhs.col2 = load <4 x float>* %rhs.col2.p, align 4
+  %rhs.col3.p = getelementptr <4 x float>* %rhs.cols, i32 3
+  %rhs.col3 = load <4 x float>* %rhs.col3.p, align 4
+  %col0 = tail call <4 x float> @_Z16rsMatrixMultiplyPK12rs_matrix4x4Dv4_f(%struct.rs_matrix4x4* %lhs, <4 x float> %rhs.col0)
+  %col1 = tail call <4 x float> @_Z16rsMatrixMultiplyPK12rs_matrix4x4Dv4_f(%struct.rs_matrix4x4* %lhs, <4 x float> %rhs.col1)
+  %col2 = tail call <4 x float> @_Z16rsMatrixMultiplyPK12rs_matrix4x4Dv4_f(%struct.rs_matrix4x4* %lhs, <4 x float> %rhs.col2)
+  %col3 = tail call <4 x float> @_Z16rsMatrixMultiplyPK12rs_matrix4x4Dv4_f(%struct.rs_matrix4x4* %lhs, <4 x float> %rhs.col3)
+  %cols = bitcast %struct.rs_matrix4x4* %ret to <4 x float>*
+  store <4 x float> %col0, <4 x float>* %cols, align 4
+  %col1.p = getelementptr <4 x float>* %cols, i32 1
+  store <4 x float> %col1, <4 x float>* %col1.p, align 4
+  %col2.p = getelementptr <4 x float>* %cols, i32 2
+  store <4 x float> %col2, <4 x float>* %col2.p, align 4
+  %col3.p = getelementptr <4 x float>* %cols, i32 3
+  store <4 x float> %col3, <4 x float>* %col3.p, align 4
+  ret void
+}
+
+; lhs = lhs * rhs
+define void @_Z16rsMatrixMultiplyP12rs_matrix4x4PKS_(%struct.rs_matrix4x4* nocapture %lhs, %struct.rs_matrix4x4* nocapture %rhs) nounwind {
+  tail call void @_Z20rsMatrixLoadMultiplyP12rs_matrix4x4PKS_S2_(%struct.rs_matrix4x4* %lhs, %struct.rs_matrix4x4* %lhs, %struct.rs_matrix4x4* %rhs)
+  ret void
+}
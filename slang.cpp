@@ -16,8 +16,12 @@
 
 #include "slang.h"
 
+#ifndef USE_MINGW
+#include <pthread.h>
+#endif
 #include <stdlib.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -34,20 +38,26 @@
 
 #include "clang/Frontend/CodeGenOptions.h"
 #include "clang/Frontend/DiagnosticOptions.h"
-#include "clang/Frontend/DependencyOutputOptions.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Frontend/Utils.h"
 
 #include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/PPCallbacks.h"
 #include "clang/Lex/HeaderSearch.h"
 
 #include "clang/Parse/ParseAST.h"
 
+#include "clang/Serialization/ASTReader.h"
+#include "clang/Serialization/ASTWriter.h"
+
 #include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/SmallString.h"
 
 #include "llvm/Bitcode/ReaderWriter.h"
 
+#include "llvm/LLVMContext.h"
+
 // More force linking
 #include "llvm/Linker.h"
 
@@ -58,6 +68,7 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/TargetSelect.h"
@@ -65,6 +76,7 @@
 
 #include "slang_assert.h"
 #include "slang_backend.h"
+#include "slang_compile_report.h"
 #include "slang_utils.h"
 
 namespace {
@@ -88,6 +100,84 @@ struct ForceSlangLinking {
   }
 } ForceSlangLinking;
 
+// Record the files entered by the preprocessor (see Slang::preprocessInput())
+class SourceFileCollector : public clang::PPCallbacks {
+ private:
+  clang::SourceManager &mSourceMgr;
+  const std::string &mMainFileName;
+  slang::Slang::SourceFileListTy *mFiles;
+
+ public:
+  SourceFileCollector(clang::SourceManager &SourceMgr,
+                      const std::string &MainFileName,
+                      slang::Slang::SourceFileListTy *Files)
+      : mSourceMgr(SourceMgr),
+        mMainFileName(MainFileName),
+        mFiles(Files) {
+    return;
+  }
+
+  virtual void FileChanged(clang::SourceLocation Loc,
+                           FileChangeReason Reason,
+                           clang::SrcMgr::CharacteristicKind FileType,
+                           clang::FileID PrevFID) {
+    if (Reason != EnterFile)
+      return;
+
+    clang::FileID FID = mSourceMgr.getFileID(Loc);
+    bool Invalid = false;
+    llvm::StringRef Content = mSourceMgr.getBufferData(FID, &Invalid);
+    if (FID.isInvalid() || Invalid)
+      return;
+
+    const clang::FileEntry *FE = mSourceMgr.getFileEntryForID(FID);
+
+    slang::Slang::SourceFile File;
+    if (FID == mSourceMgr.getMainFileID())
+      File.Name = mMainFileName;
+    else if (FE != NULL)
+      File.Name = FE->getName();
+    else
+      File.Name = mSourceMgr.getBuffer(FID)->getBufferIdentifier();
+    File.Content = Content;
+    File.IsOnDisk = (FE != NULL);
+
+    mFiles->push_back(File);
+    return;
+  }
+};
+
+// Append @File to @DepFiles unless it's already there. Same as
+// clang::DependencyFileGenerator, a leading "./" is stripped.
+void AppendDepFile(llvm::StringRef File, std::vector<std::string> *DepFiles) {
+  if (File.startswith("./"))
+    File = File.substr(2);
+
+  std::string DepFile = File.str();
+  if (std::find(DepFiles->begin(), DepFiles->end(), DepFile) ==
+      DepFiles->end())
+    DepFiles->push_back(DepFile);
+  return;
+}
+
+// Append the files on disk in @Files to @DepFiles
+void AppendDepFiles(const slang::Slang::SourceFileListTy &Files,
+                    std::vector<std::string> *DepFiles) {
+  for (slang::Slang::SourceFileListTy::const_iterator I = Files.begin(),
+          E = Files.end();
+       I != E;
+       I++) {
+    if (I->IsOnDisk)
+      AppendDepFile(I->Name, DepFiles);
+  }
+  return;
+}
+
+// Where the dependencies of a PCH are kept
+std::string GetPCHDepFileName(const std::string &PCHFile) {
+  return PCHFile + ".deps";
+}
+
 }  // namespace
 
 namespace slang {
@@ -101,13 +191,52 @@ namespace slang {
 #   define DEFAULT_TARGET_TRIPLE_STRING "i686-unknown-linux"
 #endif
 
-bool Slang::GlobalInitialized = false;
+namespace {
+
+// The Slang instance in Slang::compile() on each thread, for
+// Slang::LLVMErrorHandler()
+#ifndef USE_MINGW
+pthread_once_t GlobalInitializationControl = PTHREAD_ONCE_INIT;
+pthread_key_t CompilingSlangKey;
+
+inline void InitCompilingSlang() {
+  pthread_key_create(&CompilingSlangKey, NULL);
+  return;
+}
+inline Slang *GetCompilingSlang() {
+  return static_cast<Slang*>(pthread_getspecific(CompilingSlangKey));
+}
+inline void SetCompilingSlang(Slang *S) {
+  pthread_setspecific(CompilingSlangKey, S);
+  return;
+}
+#else
+// No threads
+bool GlobalInitialized = false;
+Slang *CompilingSlang = NULL;
+
+inline void InitCompilingSlang() { }
+inline Slang *GetCompilingSlang() { return CompilingSlang; }
+inline void SetCompilingSlang(Slang *S) {
+  CompilingSlang = S;
+  return;
+}
+#endif
 
-// Language option (define the language feature for compiler such as C99)
-clang::LangOptions Slang::LangOpts;
+// Set the Slang instance compiling on this thread during its lifetime.
+class CompilingScope {
+ public:
+  explicit CompilingScope(Slang *S) {
+    SetCompilingSlang(S);
+    return;
+  }
+  ~CompilingScope() {
+    SetCompilingSlang(NULL);
+    return;
+  }
+};
 
-// Code generation option for the compiler
-clang::CodeGenOptions Slang::CodeGenOpts;
+}  // namespace
 
 // The named of metadata node that pragma resides (should be synced with
 // bcc.cpp)
@@ -137,37 +266,56 @@ OpenOutputFile(const char *OutputFile,
   return NULL;
 }
 
-void Slang::GlobalInitialization() {
-  if (!GlobalInitialized) {
-    // We only support x86, x64 and ARM target
+void Slang::InitializeGlobals() {
+  // We only support x86, x64 and ARM target
 
-    // For ARM
-    LLVMInitializeARMTargetInfo();
-    LLVMInitializeARMTarget();
-    LLVMInitializeARMAsmPrinter();
+  // For ARM
+  LLVMInitializeARMTargetInfo();
+  LLVMInitializeARMTarget();
+  LLVMInitializeARMAsmPrinter();
 
-    // For x86 and x64
-    LLVMInitializeX86TargetInfo();
-    LLVMInitializeX86Target();
-    LLVMInitializeX86AsmPrinter();
+  // For x86 and x64
+  LLVMInitializeX86TargetInfo();
+  LLVMInitializeX86Target();
+  LLVMInitializeX86AsmPrinter();
 
-    // Please refer to include/clang/Basic/LangOptions.h to setup
-    // the options.
-    LangOpts.RTTI = 0;  // Turn off the RTTI information support
-    LangOpts.NeXTRuntime = 0;   // Turn off the NeXT runtime uses
-    LangOpts.C99 = 1;
-
-    CodeGenOpts.OptimizationLevel = 3;  /* -O3 */
+  InitCompilingSlang();
+  llvm::install_fatal_error_handler(LLVMErrorHandler, NULL);
+  return;
+}
 
+// Only the LLVM target registry and the fatal error handler are global (and
+// never change once set), the rest of the state is per Slang instance.
+void Slang::GlobalInitialization() {
+#ifndef USE_MINGW
+  pthread_once(&GlobalInitializationControl, InitializeGlobals);
+#else
+  if (!GlobalInitialized) {
+    InitializeGlobals();
     GlobalInitialized = true;
   }
+#endif
+  return;
 }
 
+// The error can't be returned to the caller of compile(): LLVM 3.0 calls
+// exit(1) once the fatal error handler returns, and neither LLVM nor clang can
+// be unwound (they're built without exceptions.) So the process ends here,
+// including a compile server (whose client then reports that there's no
+// reply), and the diagnostics are written to stderr rather than to
+// setDiagnosticOutput(), which may be a buffer nobody prints anymore (e.g.,
+// the one of a job of llvm-rs-cc -jobs.)
 void Slang::LLVMErrorHandler(void *UserData, const std::string &Message) {
-  clang::DiagnosticsEngine* DiagEngine =
-    static_cast<clang::DiagnosticsEngine *>(UserData);
+  Slang *S = GetCompilingSlang();
+  if (S == NULL) {
+    llvm::errs() << "error: " << Message << "\n";
+  } else {
+    // Emit the diagnostics of the compilation so far with this one.
+    S->mDiagEngine->Report(clang::diag::err_fe_error_backend) << Message;
+    llvm::errs() << S->mDiagClient->str();
+  }
+  llvm::errs().flush();
 
-  DiagEngine->Report(clang::diag::err_fe_error_backend) << Message;
   exit(1);
 }
 
@@ -212,7 +360,7 @@ void Slang::createPreprocessor() {
   clang::HeaderSearch *HeaderInfo = new clang::HeaderSearch(*mFileMgr);
 
   mPP.reset(new clang::Preprocessor(*mDiagEngine,
-                                    LangOpts,
+                                    mLangOpts,
                                     mTarget.get(),
                                     *mSourceMgr,
                                     *HeaderInfo,
@@ -243,7 +391,7 @@ void Slang::createPreprocessor() {
 }
 
 void Slang::createASTContext() {
-  mASTContext.reset(new clang::ASTContext(LangOpts,
+  mASTContext.reset(new clang::ASTContext(mLangOpts,
                                           *mSourceMgr,
                                           mTarget.get(),
                                           mPP->getIdentifierTable(),
@@ -253,15 +401,27 @@ void Slang::createASTContext() {
   initASTContext();
 }
 
-clang::ASTConsumer *
+Backend *
 Slang::createBackend(const clang::CodeGenOptions& CodeGenOpts,
                      llvm::raw_ostream *OS, OutputType OT) {
-  return new Backend(mDiagEngine.getPtr(), CodeGenOpts, mTargetOpts,
-                     &mPragmas, OS, OT);
+  return new Backend(*mLLVMContext, mDiagEngine.getPtr(), CodeGenOpts,
+                     mTargetOpts, &mPragmas, OS, OT, getExtraOutputs(),
+                     mReport);
 }
 
-Slang::Slang() : mInitialized(false), mDiagClient(NULL), mOT(OT_Default) {
+Slang::Slang() : mInitialized(false), mLLVMContext(new llvm::LLVMContext()),
+                 mDiagClient(NULL), mDiagOutput(&llvm::errs()),
+                 mOT(OT_Default), mOutputBuffer(NULL), mReport(NULL),
+                 mLowMemory(false), mOptimizeForSize(false) {
   GlobalInitialization();
+
+  // Please refer to include/clang/Basic/LangOptions.h to setup
+  // the options.
+  mLangOpts.RTTI = 0;  // Turn off the RTTI information support
+  mLangOpts.NeXTRuntime = 0;   // Turn off the NeXT runtime uses
+  mLangOpts.C99 = 1;
+
+  mCodeGenOpts.OptimizationLevel = 3;  /* -O3 */
 }
 
 void Slang::init(const std::string &Triple, const std::string &CPU,
@@ -270,7 +430,6 @@ void Slang::init(const std::string &Triple, const std::string &CPU,
     return;
 
   createDiagnostic();
-  llvm::install_fatal_error_handler(LLVMErrorHandler, mDiagEngine.getPtr());
 
   createTarget(Triple, CPU, Features);
   createFileManager();
@@ -295,9 +454,11 @@ bool Slang::setInputSource(llvm::StringRef InputFile,
   // Reset the ID tables if we are reusing the SourceManager
   mSourceMgr->clearIDTables();
 
-  // Load the source
+  // Load the source. Copied since the lexer wants it null-terminated, which
+  // @Text may not be.
   llvm::MemoryBuffer *SB =
-      llvm::MemoryBuffer::getMemBuffer(Text, Text + TextLength);
+      llvm::MemoryBuffer::getMemBufferCopy(llvm::StringRef(Text, TextLength),
+                                           InputFile);
   mSourceMgr->createMainFileIDForMemBuffer(SB);
 
   if (mSourceMgr->getMainFileID().isInvalid()) {
@@ -328,6 +489,9 @@ bool Slang::setOutput(const char *OutputFile) {
   llvm::sys::Path OutputFilePath(OutputFile);
   std::string Error;
   llvm::tool_output_file *OS = NULL;
+  unsigned Flags = 0;
+
+  closeExtraOutputs(/* Keep = */false);
 
   switch (mOT) {
     case OT_Dependency:
@@ -341,8 +505,8 @@ bool Slang::setOutput(const char *OutputFile) {
     }
     case OT_Object:
     case OT_Bitcode: {
-      OS = OpenOutputFile(OutputFile, llvm::raw_fd_ostream::F_Binary,
-                          &Error, mDiagEngine.getPtr());
+      Flags = llvm::raw_fd_ostream::F_Binary;
+      OS = OpenOutputFile(OutputFile, Flags, &Error, mDiagEngine.getPtr());
       break;
     }
     default: {
@@ -354,12 +518,55 @@ bool Slang::setOutput(const char *OutputFile) {
     return false;
 
   mOS.reset(OS);
+  mBufferOS.reset();
+  mOutputBuffer = NULL;
 
   mOutputFileName = OutputFile;
 
+  if ((mOT == OT_Dependency) || (mOT == OT_Nothing))
+    return true;
+
+  llvm::StringRef FileName = llvm::sys::path::filename(OutputFile);
+  for (std::vector<CodeGenTarget>::const_iterator I = mExtraTargets.begin(),
+          E = mExtraTargets.end();
+       I != E;
+       I++) {
+    llvm::SmallString<256> ExtraOutputFile(I->OutputDir);
+    llvm::sys::path::append(ExtraOutputFile, FileName);
+
+    llvm::tool_output_file *ExtraOS =
+        OpenOutputFile(ExtraOutputFile.c_str(), Flags, &Error,
+                       mDiagEngine.getPtr());
+    if (!Error.empty()) {
+      closeExtraOutputs(/* Keep = */false);
+      return false;
+    }
+
+    CodeGenOutput Output;
+    Output.Triple = I->Triple;
+    Output.CPU = I->CPU;
+    Output.OS = &ExtraOS->os();
+    mExtraOS.push_back(ExtraOS);
+    mExtraOutputs.push_back(Output);
+  }
+
   return true;
 }
 
+void Slang::closeExtraOutputs(bool Keep) {
+  for (std::vector<llvm::tool_output_file*>::iterator I = mExtraOS.begin(),
+          E = mExtraOS.end();
+       I != E;
+       I++) {
+    if (Keep)
+      (*I)->keep();
+    delete *I;
+  }
+  mExtraOS.clear();
+  mExtraOutputs.clear();
+  return;
+}
+
 bool Slang::setDepOutput(const char *OutputFile) {
   llvm::sys::Path OutputFilePath(OutputFile);
   std::string Error;
@@ -379,28 +586,70 @@ int Slang::generateDepFile() {
   if (mDOS.get() == NULL)
     return 1;
 
-  // Initialize options for generating dependency file
-  clang::DependencyOutputOptions DepOpts;
-  DepOpts.IncludeSystemHeaders = 1;
-  DepOpts.OutputFile = mDepOutputFileName;
-  DepOpts.Targets = mAdditionalDepTargets;
-  DepOpts.Targets.push_back(mDepTargetBCFileName);
-  for (std::vector<std::string>::const_iterator
-           I = mGeneratedFileNames.begin(), E = mGeneratedFileNames.end();
+  std::vector<std::string> Targets = mAdditionalDepTargets;
+  Targets.push_back(mDepTargetBCFileName);
+  Targets.insert(Targets.end(), mGeneratedFileNames.begin(),
+                 mGeneratedFileNames.end());
+  mGeneratedFileNames.clear();
+
+  // Write out the dependencies in the same format as
+  // clang::DependencyFileGenerator, trying to avoid overly long lines.
+  llvm::raw_ostream &OS = mDOS->os();
+  const unsigned MaxColumns = 75;
+  unsigned Columns = 0;
+
+  for (std::vector<std::string>::const_iterator I = Targets.begin(),
+          E = Targets.end();
        I != E;
        I++) {
-    DepOpts.Targets.push_back(*I);
+    unsigned N = I->length();
+    if (Columns == 0) {
+      Columns += N;
+      OS << *I;
+    } else if (Columns + N + 2 > MaxColumns) {
+      Columns = N + 2;
+      OS << " \\\n  " << *I;
+    } else {
+      Columns += N + 1;
+      OS << ' ' << *I;
+    }
   }
-  mGeneratedFileNames.clear();
 
-  // Per-compilation needed initialization
+  OS << ':';
+  Columns += 1;
+
+  for (std::vector<std::string>::const_iterator I = mDepFiles.begin(),
+          E = mDepFiles.end();
+       I != E;
+       I++) {
+    // Leave space for a trailing " \" in case we need to break the line on
+    // the next iteration.
+    unsigned N = I->length();
+    if (Columns + (N + 1) + 2 > MaxColumns) {
+      OS << " \\\n ";
+      Columns = 2;
+    }
+    OS << ' ' << *I;
+    Columns += N + 1;
+  }
+  OS << '\n';
+
+  mDOS->keep();
+  mDOS.reset();
+
+  return 0;
+}
+
+bool Slang::preprocessInput(SourceFileListTy *Files) {
+  if (mDiagEngine->hasErrorOccurred())
+    return false;
+
   createPreprocessor();
-  AttachDependencyFileGen(*mPP.get(), DepOpts);
+  mPP->addPPCallbacks(new SourceFileCollector(*mSourceMgr, mInputFileName,
+                                              Files));
 
-  // Inform the diagnostic client we are processing a source file
-  mDiagClient->BeginSourceFile(LangOpts, mPP.get());
+  mDiagClient->BeginSourceFile(mLangOpts, mPP.get());
 
-  // Go through the source file (no operations necessary)
   clang::Token Tok;
   mPP->EnterMainSourceFile();
   do {
@@ -409,40 +658,238 @@ int Slang::generateDepFile() {
 
   mPP->EndSourceFile();
 
-  // Declare success if no error
-  if (!mDiagEngine->hasErrorOccurred())
-    mDOS->keep();
-
-  // Clean up after compilation
   mPP.reset();
-  mDOS.reset();
 
-  return mDiagEngine->hasErrorOccurred() ? 1 : 0;
+  mDepFiles.clear();
+  AppendDepFiles(*Files, &mDepFiles);
+
+  return !mDiagEngine->hasErrorOccurred();
+}
+
+bool Slang::createPCH(const std::string &PCHFile) {
+  // The main file is empty, only the predefines go into the PCH.
+  if (!setInputSource(PCHFile, "", 0))
+    return false;
+
+  std::string Error;
+  if (!SlangUtils::CreateDirectoryWithParents(
+          llvm::sys::path::parent_path(PCHFile), &Error)) {
+    mDiagEngine->Report(clang::diag::err_fe_error_opening) << PCHFile << Error;
+    return false;
+  }
+
+  // Write to a temporary file first and then move it to PCHFile, so others
+  // never see a partially written PCH.
+  int FD;
+  llvm::SmallString<128> TmpFile;
+  if (llvm::error_code EC =
+          llvm::sys::fs::unique_file(PCHFile + "-%%%%%%%%", FD, TmpFile)) {
+    mDiagEngine->Report(clang::diag::err_fe_error_opening) << PCHFile
+                                                           << EC.message();
+    return false;
+  }
+
+  SourceFileListTy Files;
+  {
+    llvm::raw_fd_ostream OS(FD, /* shouldClose = */true);
+
+    createPreprocessor();
+    createASTContext();
+
+    // Record the headers being precompiled for generateDepFile().
+    mPP->addPPCallbacks(new SourceFileCollector(*mSourceMgr, mInputFileName,
+                                                &Files));
+
+    llvm::OwningPtr<clang::ASTConsumer> Generator(
+        new clang::PCHGenerator(*mPP, PCHFile, /* IsModule = */false,
+                                /* isysroot = */"", &OS));
+
+    mDiagClient->BeginSourceFile(mLangOpts, mPP.get());
+    ParseAST(*mPP, Generator.get(), *mASTContext);
+    mDiagClient->EndSourceFile();
+
+    Generator.reset();
+    mASTContext.reset();
+    mPP.reset();
+  }
+
+  bool Existed;
+  if (mDiagEngine->hasErrorOccurred()) {
+    llvm::sys::fs::remove(TmpFile.str(), Existed);
+    return false;
+  }
+
+  // The dependencies go first, a PCH is never used without them (see
+  // loadPCH().)
+  std::vector<std::string> PCHDepFiles;
+  AppendDepFiles(Files, &PCHDepFiles);
+
+  std::string DepsFile = GetPCHDepFileName(PCHFile);
+  llvm::SmallString<128> TmpDepsFile;
+  if (llvm::error_code EC =
+          llvm::sys::fs::unique_file(DepsFile + "-%%%%%%%%", FD, TmpDepsFile)) {
+    mDiagEngine->Report(clang::diag::err_fe_error_opening) << DepsFile
+                                                           << EC.message();
+    llvm::sys::fs::remove(TmpFile.str(), Existed);
+    return false;
+  }
+
+  {
+    llvm::raw_fd_ostream OS(FD, /* shouldClose = */true);
+    for (std::vector<std::string>::const_iterator I = PCHDepFiles.begin(),
+            E = PCHDepFiles.end();
+         I != E;
+         I++) {
+      OS << *I << '\n';
+    }
+  }
+
+  if (llvm::sys::fs::rename(TmpDepsFile.str(), DepsFile) ||
+      llvm::sys::fs::rename(TmpFile.str(), PCHFile)) {
+    llvm::sys::fs::remove(TmpDepsFile.str(), Existed);
+    llvm::sys::fs::remove(TmpFile.str(), Existed);
+    return false;
+  }
+
+  return true;
+}
+
+bool Slang::loadPCH() {
+  // Failing to load the PCH is not an error, we will fall back to parse the
+  // predefines.
+  llvm::OwningPtr<llvm::MemoryBuffer> DepsBuffer;
+  if (llvm::MemoryBuffer::getFile(GetPCHDepFileName(mPCHFileName),
+                                  DepsBuffer))
+    return false;
+
+  mPCHDepFiles.clear();
+  llvm::StringRef Deps = DepsBuffer->getBuffer();
+  while (!Deps.empty()) {
+    std::pair<llvm::StringRef, llvm::StringRef> DepAndRest = Deps.split('\n');
+    if (!DepAndRest.first.empty())
+      mPCHDepFiles.push_back(DepAndRest.first.str());
+    Deps = DepAndRest.second;
+  }
+
+  bool SuppressAllDiagnostics = mDiagEngine->getSuppressAllDiagnostics();
+  mDiagEngine->setSuppressAllDiagnostics(true);
+
+  llvm::OwningPtr<clang::ASTReader> Reader(
+      new clang::ASTReader(*mPP, *mASTContext));
+  clang::ASTReader::ASTReadResult Result =
+      Reader->ReadAST(mPCHFileName, clang::serialization::MK_PCH);
+
+  mDiagEngine->setSuppressAllDiagnostics(SuppressAllDiagnostics);
+
+  if (Result != clang::ASTReader::Success)
+    return false;
+
+  // The PCH has already included what the predefines include.
+  mPP->setPredefines(Reader->getSuggestedPredefines());
+
+  llvm::OwningPtr<clang::ExternalASTSource> Source(Reader.take());
+  mASTContext->setExternalSource(Source);
+
+  return true;
+}
+
+bool Slang::setOutputBuffer(const char *OutputFile, std::string *Buffer) {
+  closeExtraOutputs(/* Keep = */false);
+
+  mOS.reset();
+  Buffer->clear();
+  mOutputBuffer = Buffer;
+  mBufferOS.reset(new llvm::raw_string_ostream(*Buffer));
+
+  mOutputFileName = OutputFile;
+
+  return true;
 }
 
 int Slang::compile() {
   if (mDiagEngine->hasErrorOccurred())
     return 1;
-  if (mOS.get() == NULL)
+  if ((mOS.get() == NULL) && (mBufferOS.get() == NULL))
     return 1;
 
+  CompilingScope Compiling(this);
+
   // Here is per-compilation needed initialization
   createPreprocessor();
   createASTContext();
 
-  mBackend.reset(createBackend(CodeGenOpts, &mOS->os(), mOT));
+  if (!mPCHFileName.empty() && !loadPCH()) {
+    // Out-of-date (e.g., the headers were modified.) Remove it such that it
+    // will be re-generated and start over without it.
+    bool Existed;
+    llvm::sys::fs::remove(mPCHFileName, Existed);
+    llvm::sys::fs::remove(GetPCHDepFileName(mPCHFileName), Existed);
+    mPCHFileName.clear();
+    mPCHDepFiles.clear();
+
+    mASTContext.reset();
+    mPP.reset();
+    createPreprocessor();
+    createASTContext();
+  }
+
+  // Record the dependencies for generateDepFile() on the way.
+  SourceFileListTy Files;
+  mPP->addPPCallbacks(new SourceFileCollector(*mSourceMgr, mInputFileName,
+                                              &Files));
+
+  mBackend.reset(createBackend(mCodeGenOpts,
+                               (mBufferOS.get() != NULL) ? mBufferOS.get()
+                                                         : &mOS->os(),
+                               mOT));
+  mBackend->setDeferCodeGen(mLowMemory);
+  mBackend->setOptimizeForSize(mOptimizeForSize);
 
   // Inform the diagnostic client we are processing a source file
-  mDiagClient->BeginSourceFile(LangOpts, mPP.get());
+  mDiagClient->BeginSourceFile(mLangOpts, mPP.get());
 
   // The core of the slang compiler
-  ParseAST(*mPP, mBackend.get(), *mASTContext);
+  if (mReport != NULL)
+    mReport->beginFile(mInputFileName);
+  {
+    CompileReport::PhaseScope Scope(mReport, CompileReport::PhaseParse);
+    ParseAST(*mPP, mBackend.get(), *mASTContext);
+  }
+
+  if (mLowMemory) {
+    // ParseAST() returned right after the IR generation (see
+    // Backend::setDeferCodeGen()), free the AST before the optimizer runs.
+    mASTContext.reset();
+    mPP.reset();
+    mBackend->EmitDeferredModule();
+  }
 
   // Inform the diagnostic client we are done with previous source file
   mDiagClient->EndSourceFile();
 
+  mDepFiles.clear();
+  AppendDepFiles(Files, &mDepFiles);
+  if (!mPCHFileName.empty() && !mDepFiles.empty()) {
+    // The headers in the PCH are included right after entering the main file.
+    std::vector<std::string> UserDepFiles(mDepFiles.begin() + 1,
+                                          mDepFiles.end());
+    mDepFiles.resize(1);
+    for (std::vector<std::string>::const_iterator I = mPCHDepFiles.begin(),
+            E = mPCHDepFiles.end();
+         I != E;
+         I++) {
+      AppendDepFile(*I, &mDepFiles);
+    }
+    for (std::vector<std::string>::const_iterator I = UserDepFiles.begin(),
+            E = UserDepFiles.end();
+         I != E;
+         I++) {
+      AppendDepFile(*I, &mDepFiles);
+    }
+  }
+
   // Declare success if no error
-  if (!mDiagEngine->hasErrorOccurred())
+  if (!mDiagEngine->hasErrorOccurred() && (mOS.get() != NULL))
     mOS->keep();
 
   // The compilation ended, clear
@@ -450,18 +897,47 @@ int Slang::compile() {
   mASTContext.reset();
   mPP.reset();
   mOS.reset();
+  if (mBufferOS.get() != NULL) {
+    mBufferOS.reset();
+    if (mDiagEngine->hasErrorOccurred())
+      mOutputBuffer->clear();
+    mOutputBuffer = NULL;
+  }
+  closeExtraOutputs(/* Keep = */!mDiagEngine->hasErrorOccurred());
 
   return mDiagEngine->hasErrorOccurred() ? 1 : 0;
 }
 
+void Slang::flushFileCache() {
+  // SourceManager refers to the FileManager, destroy it first.
+  mSourceMgr.reset();
+  createFileManager();
+  createSourceManager();
+  return;
+}
+
+void Slang::recycleLLVMContext() {
+  mLLVMContext.reset(new llvm::LLVMContext());
+  return;
+}
+
+void Slang::flushDiagnostics() {
+  (*mDiagOutput) << mDiagClient->str();
+  mDiagOutput->flush();
+  mDiagClient->reset();
+  return;
+}
+
 void Slang::reset() {
-  llvm::errs() << mDiagClient->str();
+  flushDiagnostics();
   mDiagEngine->Reset();
-  mDiagClient->reset();
+  mGeneratedFileNames.clear();
 }
 
 Slang::~Slang() {
-  llvm::llvm_shutdown();
+  closeExtraOutputs(/* Keep = */false);
+  // Note that llvm::llvm_shutdown() is left to the client since other Slang
+  // instances may still be alive (e.g., llvm-rs-cc -j).
 }
 
 }  // namespace slang
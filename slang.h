@@ -32,6 +32,9 @@
 #include "slang_pragma_recorder.h"
 
 namespace llvm {
+  class LLVMContext;
+  class raw_ostream;
+  class raw_string_ostream;
   class tool_output_file;
 }
 
@@ -53,14 +56,18 @@ namespace clang {
 
 namespace slang {
 
-class Slang : public clang::ModuleLoader {
-  static clang::LangOptions LangOpts;
-  static clang::CodeGenOptions CodeGenOpts;
-
-  static bool GlobalInitialized;
+class Backend;
+class CompileReport;
 
+class Slang : public clang::ModuleLoader {
+  // LLVM only supports a single fatal error handler per process. It's
+  // installed once by GlobalInitialization() and reports to the instance
+  // compiling on the failing thread (see compile().)
   static void LLVMErrorHandler(void *UserData, const std::string &Message);
 
+  // Run once by GlobalInitialization()
+  static void InitializeGlobals();
+
  public:
   enum OutputType {
     OT_Dependency,
@@ -73,9 +80,36 @@ class Slang : public clang::ModuleLoader {
     OT_Default = OT_Bitcode
   };
 
+  // A target the code is generated for in addition to the one given to init()
+  // (see setExtraTargets().)
+  struct CodeGenTarget {
+    std::string Triple;
+    std::string CPU;
+    // Where the outputs for this target go, each with the file name of the
+    // output given to setOutput()
+    std::string OutputDir;
+  };
+
+  // Where the code for a CodeGenTarget is written to
+  struct CodeGenOutput {
+    std::string Triple;
+    std::string CPU;
+    llvm::raw_ostream *OS;
+  };
+
  private:
   bool mInitialized;
 
+  // Language option (define the language feature for compiler such as C99)
+  clang::LangOptions mLangOpts;
+
+  // Code generation option for the compiler
+  clang::CodeGenOptions mCodeGenOpts;
+
+  // Each compiler instance owns its LLVM context such that multiple instances
+  // can compile concurrently on different threads.
+  llvm::OwningPtr<llvm::LLVMContext> mLLVMContext;
+
   // Diagnostics Mediator (An interface for both Producer and Consumer)
   llvm::OwningPtr<clang::Diagnostic> mDiag;
 
@@ -89,6 +123,9 @@ class Slang : public clang::ModuleLoader {
   // NOTE: The ownership is taken by mDiagEngine after creation.
   DiagnosticBuffer *mDiagClient;
 
+  // Where the buffered diagnostics go on reset() (llvm::errs() by default)
+  llvm::raw_ostream *mDiagOutput;
+
   void createDiagnostic();
 
 
@@ -121,7 +158,7 @@ class Slang : public clang::ModuleLoader {
 
 
   // AST consumer, responsible for code generation
-  llvm::OwningPtr<clang::ASTConsumer> mBackend;
+  llvm::OwningPtr<Backend> mBackend;
 
 
   // File names
@@ -133,20 +170,53 @@ class Slang : public clang::ModuleLoader {
   std::vector<std::string> mAdditionalDepTargets;
   std::vector<std::string> mGeneratedFileNames;
 
+  // The files the input depends on, recorded while it's compiled or
+  // preprocessed (see generateDepFile())
+  std::vector<std::string> mDepFiles;
+
   OutputType mOT;
 
   // Output stream
   llvm::OwningPtr<llvm::tool_output_file> mOS;
 
+  // Or where the output goes instead (see setOutputBuffer())
+  std::string *mOutputBuffer;
+  llvm::OwningPtr<llvm::raw_string_ostream> mBufferOS;
+
   // Dependency output stream
   llvm::OwningPtr<llvm::tool_output_file> mDOS;
 
+  std::vector<CodeGenTarget> mExtraTargets;
+  // The output streams of mExtraTargets opened by setOutput() and what the
+  // backend is given for them (empty if no code is emitted)
+  std::vector<llvm::tool_output_file*> mExtraOS;
+  std::vector<CodeGenOutput> mExtraOutputs;
+  void closeExtraOutputs(bool Keep);
+
   std::vector<std::string> mIncludePaths;
 
+  // Where the time spent in each phase goes (NULL if not wanted)
+  CompileReport *mReport;
+
+  // Free the AST and the preprocessor right after the IR generation
+  // (see setLowMemory())
+  bool mLowMemory;
+
+  // -Os (see setOptimizeForSize())
+  bool mOptimizeForSize;
+
+  // The precompiled header loaded before parsing each input (none if empty)
+  std::string mPCHFileName;
+  // The files mPCHFileName depends on, which are never read when compiling
+  // with it
+  std::vector<std::string> mPCHDepFiles;
+  bool loadPCH();
+
  protected:
   PragmaList mPragmas;
 
   clang::DiagnosticsEngine &getDiagnostics() { return *mDiagEngine; }
+  llvm::LLVMContext &getLLVMContext() { return *mLLVMContext; }
   clang::TargetInfo const &getTargetInfo() const { return *mTarget; }
   clang::FileManager &getFileManager() { return *mFileMgr; }
   clang::SourceManager &getSourceManager() { return *mSourceMgr; }
@@ -156,11 +226,27 @@ class Slang : public clang::ModuleLoader {
   inline clang::TargetOptions const &getTargetOptions() const
     { return mTargetOpts; }
 
+  clang::CodeGenOptions const &getCodeGenOptions() const
+    { return mCodeGenOpts; }
+
+  llvm::raw_ostream &getDiagnosticOutput() { return *mDiagOutput; }
+
+  const DiagnosticBuffer &getDiagnosticBuffer() const { return *mDiagClient; }
+
+  CompileReport *getCompileReport() { return mReport; }
+
+  bool isOptimizingForSize() const { return mOptimizeForSize; }
+
+  bool hasExtraTargets() const { return !mExtraTargets.empty(); }
+  const std::vector<CodeGenOutput> &getExtraOutputs() const {
+    return mExtraOutputs;
+  }
+
   virtual void initDiagnostic() {}
   virtual void initPreprocessor() {}
   virtual void initASTContext() {}
 
-  virtual clang::ASTConsumer *
+  virtual Backend *
     createBackend(const clang::CodeGenOptions& CodeGenOpts,
                   llvm::raw_ostream *OS,
                   OutputType OT);
@@ -192,8 +278,23 @@ class Slang : public clang::ModuleLoader {
 
   void setOutputType(OutputType OT) { mOT = OT; }
 
+  // Also generate the code for @Targets. The input is parsed, reference
+  // counted and reflected only once, the module is copied for each of them
+  // right before the optimizations and the code generation, which are run in
+  // parallel. Note that the data layout (and thus the layout of the reflected
+  // structs) is still the one of the target given to init().
+  void setExtraTargets(const std::vector<CodeGenTarget> &Targets) {
+    mExtraTargets = Targets;
+  }
+
   bool setOutput(const char *OutputFile);
 
+  // Write the output of compile() into @Buffer instead of a file (which is
+  // left empty on error.) @OutputFile is only the name of the output (e.g.,
+  // where the reflected resource ID comes from.) The extra targets are not
+  // generated.
+  bool setOutputBuffer(const char *OutputFile, std::string *Buffer);
+
   std::string const &getOutputFileName() const {
     return mOutputFileName;
   }
@@ -213,12 +314,85 @@ class Slang : public clang::ModuleLoader {
     mGeneratedFileNames.push_back(GeneratedFileName);
   }
 
+  // Write the dependencies of the last input given to compile() (or
+  // preprocessInput()) to the file given by setDepOutput(). The input is not
+  // read again.
   int generateDepFile();
 
+  std::vector<std::string> const &getDepFiles() const { return mDepFiles; }
+
+  // Override the dependencies written by generateDepFile() (e.g., with the
+  // ones recorded by a previous compilation of the same input)
+  void setDepFiles(std::vector<std::string> const &DepFiles) {
+    mDepFiles = DepFiles;
+  }
+
+  // A file read by the preprocessor (see preprocessInput())
+  struct SourceFile {
+    std::string Name;
+    // Valid until the next flushFileCache()
+    llvm::StringRef Content;
+    // False for the predefines and the input given in memory
+    bool IsOnDisk;
+  };
+  typedef std::vector<SourceFile> SourceFileListTy;
+
+  // Run the preprocessor over the input and collect every file it reads
+  // (including the main file and the predefines) to @Files in order. The
+  // dependencies are recorded as well (see generateDepFile().) Return false on
+  // error.
+  bool preprocessInput(SourceFileListTy *Files);
+
+  // Precompile the predefines set up in initPreprocessor() into @PCHFile such
+  // that it can be given to setPCH() for the subsequent compilations. Return
+  // false on error.
+  bool createPCH(const std::string &PCHFile);
+
+  // Use @PCHFile (created by createPCH()) instead of parsing the predefines in
+  // compile(). An out-of-date @PCHFile is removed and ignored.
+  void setPCH(const std::string &PCHFile) { mPCHFileName = PCHFile; }
+
   int compile();
 
   char const *getErrorMessage() { return mDiagClient->str().c_str(); }
 
+  void setDiagnosticOutput(llvm::raw_ostream *OS) { mDiagOutput = OS; }
+
+  // Write the diagnostics buffered so far to the diagnostic output (see
+  // setDiagnosticOutput()), as reset() does, but keep the rest of the state.
+  void flushDiagnostics();
+
+  // Record the time spent in each phase of compile() to @Report. Disabled if
+  // @Report is NULL (the default.)
+  void setCompileReport(CompileReport *Report) { mReport = Report; }
+
+  // Free the AST and the preprocessor of each input as soon as its LLVM module
+  // is generated, rather than after the module is optimized and emitted, to
+  // cut the peak memory usage of compile(). Nothing after the IR generation
+  // needs them: the export processing is done by then, and the reflection
+  // runs from the exportables, which keep the names, types, layouts and
+  // initial values they reflect apart from the AST (see RSExportable.)
+  void setLowMemory(bool LowMemory) { mLowMemory = LowMemory; }
+
+  // Optimize for size instead of speed and strip the debug info, the local
+  // symbol names and the unused internal globals and declarations off the
+  // output, while keeping the exported symbols and the metadata the runtime
+  // needs. This is meant for the code shipped to the devices.
+  void setOptimizeForSize(bool OptimizeForSize) {
+    mOptimizeForSize = OptimizeForSize;
+  }
+
+  // Discard the cached file contents and status such that the modifications
+  // to the source files since the previous compilation can be seen. Needed
+  // only when the compiler instance is reused (e.g., by llvm-rs-cc -server.)
+  void flushFileCache();
+
+  // Replace the LLVMContext, which keeps the types, the constants and the
+  // metadata of all the modules compiled in it, such that a compiler instance
+  // reused for many files (e.g., by llvm-rs-cc -server) doesn't keep growing.
+  // Must be called between compilations only, i.e., after reset().
+  void recycleLLVMContext();
+
   // Reset the slang compiler state such that it can be reused to compile
   // another file
   virtual void reset();
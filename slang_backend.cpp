@@ -16,6 +16,11 @@
 
 #include "slang_backend.h"
 
+#ifndef USE_MINGW
+#include <pthread.h>
+#endif
+
+#include <map>
 #include <string>
 #include <vector>
 
@@ -34,23 +39,30 @@
 #include "clang/Frontend/CodeGenOptions.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
 
+#include "llvm/ADT/Triple.h"
+
 #include "llvm/Assembly/PrintModulePass.h"
 
+#include "llvm/Bitcode/BitstreamWriter.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 
 #include "llvm/CodeGen/RegAllocRegistry.h"
 #include "llvm/CodeGen/SchedulerRegistry.h"
 
+#include "llvm/Function.h"
 #include "llvm/LLVMContext.h"
 #include "llvm/Module.h"
 #include "llvm/Metadata.h"
 
+#include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 
 #include "llvm/Target/TargetData.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/Threading.h"
 
 #include "llvm/MC/SubtargetFeature.h"
 
@@ -59,68 +71,157 @@
 
 namespace slang {
 
-void Backend::CreateFunctionPasses() {
-  if (!mPerFunctionPasses) {
-    mPerFunctionPasses = new llvm::FunctionPassManager(mpModule);
-    mPerFunctionPasses->add(new llvm::TargetData(mpModule));
-
-    llvm::PassManagerBuilder PMBuilder;
-    PMBuilder.OptLevel = mCodeGenOpts.OptimizationLevel;
-    PMBuilder.populateFunctionPassManager(*mPerFunctionPasses);
+namespace {
+
+#ifndef USE_MINGW
+// Held while the process-wide options of the LLVM code generator (see
+// Backend::SetCodeGenOptions()) are in use, such that the backends of
+// different compilations running concurrently don't change them under each
+// other.
+pthread_mutex_t CodeGenOptionsMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+class CodeGenOptionsLock {
+ private:
+  bool mLocked;
+
+ public:
+  explicit CodeGenOptionsLock(bool Lock) : mLocked(Lock) {
+#ifndef USE_MINGW
+    if (mLocked)
+      pthread_mutex_lock(&CodeGenOptionsMutex);
+#endif
+    return;
   }
-  return;
+  ~CodeGenOptionsLock() {
+#ifndef USE_MINGW
+    if (mLocked)
+      pthread_mutex_unlock(&CodeGenOptionsMutex);
+#endif
+    return;
+  }
+};
+
+}  // namespace
+
+// -Os is -O2 with the transformations growing the code turned down, as in
+// clang.
+unsigned Backend::getOptimizationLevel() const {
+  return mOptimizeForSize ? 2 : mCodeGenOpts.OptimizationLevel;
 }
 
-void Backend::CreateModulePasses() {
-  if (!mPerModulePasses) {
-    mPerModulePasses = new llvm::PassManager();
-    mPerModulePasses->add(new llvm::TargetData(mpModule));
-
-    llvm::PassManagerBuilder PMBuilder;
-    PMBuilder.OptLevel = mCodeGenOpts.OptimizationLevel;
-    PMBuilder.SizeLevel = mCodeGenOpts.OptimizeSize;
-    PMBuilder.SizeLevel = mCodeGenOpts.OptimizeSize;
-    if (mCodeGenOpts.UnitAtATime) {
-      PMBuilder.DisableUnitAtATime = 0;
-    } else {
-      PMBuilder.DisableUnitAtATime = 1;
-    }
+unsigned Backend::getSizeLevel() const {
+  return mOptimizeForSize ? 1 : mCodeGenOpts.OptimizeSize;
+}
 
-    if (mCodeGenOpts.UnrollLoops) {
-      PMBuilder.DisableUnrollLoops = 0;
-    } else {
-      PMBuilder.DisableUnrollLoops = 1;
-    }
+Backend::OptimizationLevelTy
+Backend::getOptimizationLevel(const llvm::Function &F) const {
+  std::map<std::string, OptimizationLevelTy>::const_iterator I =
+      mFunctionOptimizationLevels.find(F.getName());
+  if (I != mFunctionOptimizationLevels.end())
+    return I->second;
+  return std::make_pair(getOptimizationLevel(), getSizeLevel());
+}
+
+void Backend::SetFunctionAttributes(llvm::Module *M) const {
+  if (mFunctionOptimizationLevels.empty())
+    return;
 
-    PMBuilder.DisableSimplifyLibCalls = false;
-    PMBuilder.populateModulePassManager(*mPerModulePasses);
+  for (llvm::Module::iterator I = M->begin(), E = M->end(); I != E; I++) {
+    if (I->isDeclaration())
+      continue;
+    OptimizationLevelTy Level = getOptimizationLevel(*I);
+    // The module passes run at the level of the module, so what's left of -O0
+    // is keeping the body out of its callers.
+    if (Level.first == 0)
+      I->addFnAttr(llvm::Attribute::NoInline);
+    if (Level.second > 0)
+      I->addFnAttr(llvm::Attribute::OptimizeForSize);
   }
   return;
 }
 
-bool Backend::CreateCodeGenPasses() {
-  if ((mOT != Slang::OT_Assembly) && (mOT != Slang::OT_Object))
-    return true;
+llvm::FunctionPassManager *
+Backend::CreateFunctionPasses(llvm::Module *M,
+                              const OptimizationLevelTy &Level) const {
+  llvm::FunctionPassManager *PM = new llvm::FunctionPassManager(M);
+  PM->add(new llvm::TargetData(M));
+
+  llvm::PassManagerBuilder PMBuilder;
+  PMBuilder.OptLevel = Level.first;
+  PMBuilder.SizeLevel = Level.second;
+  PMBuilder.populateFunctionPassManager(*PM);
+  return PM;
+}
+
+llvm::PassManager *Backend::CreateModulePasses(llvm::Module *M) const {
+  llvm::PassManager *PM = new llvm::PassManager();
+  PM->add(new llvm::TargetData(M));
 
-  // Now we add passes for code emitting
-  if (mCodeGenPasses) {
-    return true;
+  llvm::PassManagerBuilder PMBuilder;
+  PMBuilder.OptLevel = getOptimizationLevel();
+  PMBuilder.SizeLevel = getSizeLevel();
+  if (mCodeGenOpts.UnitAtATime) {
+    PMBuilder.DisableUnitAtATime = 0;
   } else {
-    mCodeGenPasses = new llvm::FunctionPassManager(mpModule);
-    mCodeGenPasses->add(new llvm::TargetData(mpModule));
+    PMBuilder.DisableUnitAtATime = 1;
   }
 
-  // Create the TargetMachine for generating code.
-  std::string Triple = mpModule->getTargetTriple();
+  if (mCodeGenOpts.UnrollLoops) {
+    PMBuilder.DisableUnrollLoops = 0;
+  } else {
+    PMBuilder.DisableUnrollLoops = 1;
+  }
 
-  std::string Error;
-  const llvm::Target* TargetInfo =
-      llvm::TargetRegistry::lookupTarget(Triple, Error);
-  if (TargetInfo == NULL) {
-    mDiagEngine.Report(clang::diag::err_fe_unable_to_create_target) << Error;
-    return false;
+  PMBuilder.DisableSimplifyLibCalls = false;
+  AddModulePasses(&PMBuilder);
+  PMBuilder.populateModulePassManager(*PM);
+  return PM;
+}
+
+// Strip what the device doesn't need off @M: the debug info, the internal
+// globals and the declarations nothing refers to, and the names of the
+// internal globals and of the values local to the functions. The external
+// symbols, which cover everything the #rs_export_* metadata names, and the
+// metadata itself are kept.
+void Backend::StripModule(llvm::Module *M) const {
+  llvm::PassManager PM;
+  PM.add(llvm::createStripSymbolsPass(/* OnlyDebugInfo = */true));
+  PM.add(llvm::createGlobalDCEPass());
+  PM.add(llvm::createStripDeadPrototypesPass());
+  PM.run(*M);
+
+  for (llvm::Module::global_iterator I = M->global_begin(),
+          E = M->global_end();
+       I != E;
+       I++) {
+    if (I->hasLocalLinkage())
+      I->setName("");
   }
 
+  for (llvm::Module::iterator F = M->begin(), FE = M->end(); F != FE; F++) {
+    if (F->hasLocalLinkage())
+      F->setName("");
+    for (llvm::Function::arg_iterator A = F->arg_begin(), AE = F->arg_end();
+         A != AE;
+         A++) {
+      A->setName("");
+    }
+    for (llvm::Function::iterator BB = F->begin(), BBE = F->end();
+         BB != BBE;
+         BB++) {
+      BB->setName("");
+      for (llvm::BasicBlock::iterator I = BB->begin(), IE = BB->end();
+           I != IE;
+           I++) {
+        I->setName("");
+      }
+    }
+  }
+  return;
+}
+
+void Backend::SetCodeGenOptions() const {
   llvm::NoFramePointerElim = mCodeGenOpts.DisableFPElim;
 
   // Use hardware FPU.
@@ -133,6 +234,43 @@ bool Backend::CreateCodeGenPasses() {
   llvm::FloatABIType = llvm::FloatABI::Hard;
   llvm::UseSoftFloat = false;
 
+  // Relax the floating point semantics as far as the source allows.
+  FPPrecision Precision = getFPPrecision();
+  llvm::LessPreciseFPMADOption = (Precision != FP_Full);
+  llvm::UnsafeFPMath = (Precision == FP_Imprecise);
+  llvm::NoInfsFPMath = (Precision == FP_Imprecise);
+  llvm::NoNaNsFPMath = (Precision == FP_Imprecise);
+
+  // Register scheduler
+  llvm::RegisterScheduler::setDefault(llvm::createDefaultScheduler);
+
+  // Register allocation policy:
+  //  createFastRegisterAllocator: fast but bad quality
+  //  createLinearScanRegisterAllocator: not so fast but good quality
+  llvm::RegisterRegAlloc::setDefault((mCodeGenOpts.OptimizationLevel == 0) ?
+                                     llvm::createFastRegisterAllocator :
+                                     llvm::createLinearScanRegisterAllocator);
+  return;
+}
+
+llvm::FunctionPassManager *
+Backend::CreateCodeGenPasses(llvm::Module *M, const std::string &CPU,
+                             llvm::formatted_raw_ostream &OS,
+                             llvm::OwningPtr<llvm::TargetMachine> *TM,
+                             std::string *Error) const {
+  // Create the TargetMachine for generating code.
+  std::string Triple = M->getTargetTriple();
+
+  std::string LookupError;
+  const llvm::Target* TargetInfo =
+      llvm::TargetRegistry::lookupTarget(Triple, LookupError);
+  if (TargetInfo == NULL) {
+    *Error = "unable to create target: '" + LookupError + "'";
+    return NULL;
+  }
+
+  FPPrecision Precision = getFPPrecision();
+
   // BCC needs all unknown symbols resolved at compilation time. So we don't
   // need any relocation model.
   llvm::Reloc::Model RM = llvm::Reloc::Static;
@@ -140,7 +278,7 @@ bool Backend::CreateCodeGenPasses() {
   // This is set for the linker (specify how large of the virtual addresses we
   // can access for all unknown symbols.)
   llvm::CodeModel::Model CM;
-  if (mpModule->getPointerSize() == llvm::Module::Pointer32) {
+  if (M->getPointerSize() == llvm::Module::Pointer32) {
     CM = llvm::CodeModel::Small;
   } else {
     // The target may have pointer size greater than 32 (e.g. x86_64
@@ -150,7 +288,8 @@ bool Backend::CreateCodeGenPasses() {
 
   // Setup feature string
   std::string FeaturesStr;
-  if (mTargetOpts.CPU.size() || mTargetOpts.Features.size()) {
+  if (CPU.size() || mTargetOpts.Features.size() ||
+      (Precision != FP_Full)) {
     llvm::SubtargetFeatures Features;
 
     for (std::vector<std::string>::const_iterator
@@ -159,27 +298,21 @@ bool Backend::CreateCodeGenPasses() {
          I++)
       Features.AddFeature(*I);
 
+    // NEON flushes the denormals to zero, which is allowed to do the single
+    // precision math on it.
+    if ((Precision != FP_Full) &&
+        (llvm::Triple(Triple).getArch() == llvm::Triple::arm))
+      Features.AddFeature("neonfp");
+
     FeaturesStr = Features.getString();
   }
 
-  llvm::TargetMachine *TM =
-    TargetInfo->createTargetMachine(Triple, mTargetOpts.CPU, FeaturesStr,
-                                    RM, CM);
-
-  // Register scheduler
-  llvm::RegisterScheduler::setDefault(llvm::createDefaultScheduler);
-
-  // Register allocation policy:
-  //  createFastRegisterAllocator: fast but bad quality
-  //  createLinearScanRegisterAllocator: not so fast but good quality
-  llvm::RegisterRegAlloc::setDefault((mCodeGenOpts.OptimizationLevel == 0) ?
-                                     llvm::createFastRegisterAllocator :
-                                     llvm::createLinearScanRegisterAllocator);
+  TM->reset(TargetInfo->createTargetMachine(Triple, CPU, FeaturesStr, RM, CM));
 
   llvm::CodeGenOpt::Level OptLevel = llvm::CodeGenOpt::Default;
-  if (mCodeGenOpts.OptimizationLevel == 0) {
+  if (getOptimizationLevel() == 0) {
     OptLevel = llvm::CodeGenOpt::None;
-  } else if (mCodeGenOpts.OptimizationLevel == 3) {
+  } else if (getOptimizationLevel() == 3) {
     OptLevel = llvm::CodeGenOpt::Aggressive;
   }
 
@@ -188,34 +321,41 @@ bool Backend::CreateCodeGenPasses() {
   if (mOT == Slang::OT_Object) {
     CGFT = llvm::TargetMachine::CGFT_ObjectFile;
   }
-  if (TM->addPassesToEmitFile(*mCodeGenPasses, FormattedOutStream,
-                              CGFT, OptLevel)) {
-    mDiagEngine.Report(clang::diag::err_fe_unable_to_interface_with_target);
-    return false;
+
+  llvm::FunctionPassManager *CodeGenPasses = new llvm::FunctionPassManager(M);
+  CodeGenPasses->add(new llvm::TargetData(M));
+  if ((*TM)->addPassesToEmitFile(*CodeGenPasses, OS, CGFT, OptLevel)) {
+    delete CodeGenPasses;
+    *Error = "unable to interface with target machine";
+    return NULL;
   }
 
-  return true;
+  return CodeGenPasses;
 }
 
-Backend::Backend(clang::DiagnosticsEngine *DiagEngine,
+Backend::Backend(llvm::LLVMContext &LLVMContext,
+                 clang::DiagnosticsEngine *DiagEngine,
                  const clang::CodeGenOptions &CodeGenOpts,
                  const clang::TargetOptions &TargetOpts,
                  PragmaList *Pragmas,
                  llvm::raw_ostream *OS,
-                 Slang::OutputType OT)
+                 Slang::OutputType OT,
+                 const std::vector<Slang::CodeGenOutput> &ExtraOutputs,
+                 CompileReport *Report)
     : ASTConsumer(),
       mCodeGenOpts(CodeGenOpts),
       mTargetOpts(TargetOpts),
       mpModule(NULL),
       mpOS(OS),
       mOT(OT),
+      mExtraOutputs(ExtraOutputs),
       mGen(NULL),
-      mPerFunctionPasses(NULL),
-      mPerModulePasses(NULL),
-      mCodeGenPasses(NULL),
-      mLLVMContext(llvm::getGlobalContext()),
+      mDeferCodeGen(false),
+      mOptimizeForSize(false),
+      mLLVMContext(LLVMContext),
       mDiagEngine(*DiagEngine),
-      mPragmas(Pragmas) {
+      mPragmas(Pragmas),
+      mReport(Report) {
   FormattedOutStream.setStream(*mpOS,
                                llvm::formatted_raw_ostream::PRESERVE_STREAM);
   mGen = CreateLLVMCodeGen(mDiagEngine, "", mCodeGenOpts, mLLVMContext);
@@ -230,25 +370,42 @@ void Backend::Initialize(clang::ASTContext &Ctx) {
   return;
 }
 
+void Backend::WriteBitcode(const llvm::Module *M, bool UseLLVM29Writer,
+                           std::vector<unsigned char> *Bitcode) {
+  // The bitstream is always built in memory by the writers (e.g.,
+  // llvm::WriteBitcodeToFile() does exactly this and then copies the buffer
+  // to its output.)
+  llvm::BitstreamWriter Stream(*Bitcode);
+  Bitcode->reserve(256 * 1024);
+  if (UseLLVM29Writer)
+    llvm_2_9::WriteBitcodeToStream(M, Stream);
+  else
+    llvm::WriteBitcodeToStream(M, Stream);
+  return;
+}
+
 // Encase the Bitcode in a wrapper containing RS version information.
-void Backend::WrapBitcode(llvm::raw_string_ostream &Bitcode) {
+void Backend::WrapBitcode(const std::vector<unsigned char> &Bitcode,
+                          llvm::raw_ostream &OS) const {
   struct bcinfo::BCWrapperHeader header;
   header.Magic = 0x0B17C0DE;
   header.Version = 0;
   header.BitcodeOffset = sizeof(header);
-  header.BitcodeSize = Bitcode.str().length();
+  header.BitcodeSize = Bitcode.size();
   header.HeaderVersion = 0;
   header.TargetAPI = getTargetAPI();
 
   // Write out the bitcode wrapper.
-  FormattedOutStream.write((const char*) &header, sizeof(header));
+  OS.write((const char*) &header, sizeof(header));
 
   // Write out the actual encoded bitcode.
-  FormattedOutStream << Bitcode.str();
+  if (!Bitcode.empty())
+    OS.write((const char*) &Bitcode.front(), Bitcode.size());
   return;
 }
 
 void Backend::HandleTopLevelDecl(clang::DeclGroupRef D) {
+  CompileReport::PhaseScope Scope(mReport, CompileReport::PhaseIRGen);
   mGen->HandleTopLevelDecl(D);
   return;
 }
@@ -256,7 +413,10 @@ void Backend::HandleTopLevelDecl(clang::DeclGroupRef D) {
 void Backend::HandleTranslationUnit(clang::ASTContext &Ctx) {
   HandleTranslationUnitPre(Ctx);
 
-  mGen->HandleTranslationUnit(Ctx);
+  {
+    CompileReport::PhaseScope Scope(mReport, CompileReport::PhaseIRGen);
+    mGen->HandleTranslationUnit(Ctx);
+  }
 
   // Here, we complete a translation unit (whole translation unit is now in LLVM
   // IR). Now, interact with LLVM backend to generate actual machine code (asm
@@ -295,80 +455,222 @@ void Backend::HandleTranslationUnit(clang::ASTContext &Ctx) {
     }
   }
 
-  HandleTranslationUnitPost(mpModule);
+  {
+    CompileReport::PhaseScope Scope(mReport, CompileReport::PhaseExport);
+    HandleTranslationUnitPost(mpModule);
+  }
+
+  if (mDeferCodeGen) {
+    // Nothing refers to the AST from here on, see EmitDeferredModule().
+    delete mGen;
+    mGen = NULL;
+    return;
+  }
+
+  EmitModule();
+  return;
+}
+
+void Backend::EmitDeferredModule() {
+  slangAssert(mDeferCodeGen && "Code generation was not deferred");
+  // No module if the IR generation failed
+  if (mpModule != NULL)
+    EmitModule();
+  return;
+}
+
+void Backend::EmitModule() {
+  bool GeneratesCode =
+      (mOT == Slang::OT_Assembly) || (mOT == Slang::OT_Object);
+  CodeGenOptionsLock Lock(GeneratesCode || !mExtraOutputs.empty());
+  if (GeneratesCode)
+    SetCodeGenOptions();
+
+  // Fan out to the extra targets. Each of them gets a copy of the module as it
+  // is now (i.e., before any target-specific optimization) in an LLVMContext
+  // of its own, which is what allows them to run concurrently with each other
+  // and with the code generation of mpModule below.
+  std::vector<ExtraTargetJob> Jobs(mExtraOutputs.size());
+  std::vector<unsigned char> Bitcode;
+  if (!Jobs.empty())
+    WriteBitcode(mpModule, /* UseLLVM29Writer = */false, &Bitcode);
+
+  for (unsigned i = 0, e = Jobs.size(); i != e; i++) {
+    Jobs[i].B = this;
+    Jobs[i].Bitcode = &Bitcode;
+    Jobs[i].Output = &mExtraOutputs[i];
+    Jobs[i].Success = false;
+  }
+
+#ifndef USE_MINGW
+  std::vector<pthread_t> Threads(Jobs.size());
+  std::vector<bool> Started(Jobs.size(), false);
+  if (llvm::llvm_is_multithreaded()) {
+    for (unsigned i = 0, e = Jobs.size(); i != e; i++)
+      Started[i] = (pthread_create(&Threads[i], NULL, ExtraTargetJobThread,
+                                   &Jobs[i]) == 0);
+  }
+#endif
+
+  std::string Error;
+  if (!OptimizeAndEmit(mpModule, mTargetOpts.CPU, FormattedOutStream, mReport,
+                       &Error))
+    mDiagEngine.Report(mDiagEngine.getCustomDiagID(
+        clang::DiagnosticsEngine::Error, "%0")) << Error;
+  else
+    HandleModuleEmitted(mpModule);
+
+  CompileReport::PhaseScope Scope(mReport, CompileReport::PhaseCodeEmission);
+  for (unsigned i = 0, e = Jobs.size(); i != e; i++) {
+#ifndef USE_MINGW
+    if (Started[i])
+      pthread_join(Threads[i], NULL);
+    else
+#endif
+      // Not threaded (or failed to spawn the thread), run it here.
+      RunExtraTargetJob(&Jobs[i]);
+
+    if (!Jobs[i].Success)
+      mDiagEngine.Report(mDiagEngine.getCustomDiagID(
+          clang::DiagnosticsEngine::Error, "%0: %1"))
+          << Jobs[i].Output->Triple << Jobs[i].Error;
+  }
 
-  // Create passes for optimization and code emission
+  return;
+}
 
+bool Backend::OptimizeAndEmit(llvm::Module *M, const std::string &CPU,
+                              llvm::formatted_raw_ostream &OS,
+                              CompileReport *Report,
+                              std::string *Error) const {
   // Create and run per-function passes
-  CreateFunctionPasses();
-  if (mPerFunctionPasses) {
-    mPerFunctionPasses->doInitialization();
+  {
+    CompileReport::PhaseScope Scope(Report,
+                                    CompileReport::PhaseFunctionPasses);
+    // One pipeline per level, each run over the functions at that level
+    std::map<OptimizationLevelTy, std::vector<llvm::Function*> > Functions;
+    for (llvm::Module::iterator I = M->begin(), E = M->end(); I != E; I++)
+      if (!I->isDeclaration())
+        Functions[getOptimizationLevel(*I)].push_back(I);
 
-    for (llvm::Module::iterator I = mpModule->begin(), E = mpModule->end();
+    for (std::map<OptimizationLevelTy,
+                  std::vector<llvm::Function*> >::const_iterator
+            I = Functions.begin(), E = Functions.end();
          I != E;
-         I++)
-      if (!I->isDeclaration())
-        mPerFunctionPasses->run(*I);
+         I++) {
+      llvm::OwningPtr<llvm::FunctionPassManager> PerFunctionPasses(
+          CreateFunctionPasses(M, I->first));
+      PerFunctionPasses->doInitialization();
 
-    mPerFunctionPasses->doFinalization();
+      for (std::vector<llvm::Function*>::const_iterator FI = I->second.begin(),
+              FE = I->second.end();
+           FI != FE;
+           FI++)
+        PerFunctionPasses->run(**FI);
+
+      PerFunctionPasses->doFinalization();
+    }
   }
 
+  SetFunctionAttributes(M);
+
   // Create and run module passes
-  CreateModulePasses();
-  if (mPerModulePasses)
-    mPerModulePasses->run(*mpModule);
+  {
+    CompileReport::PhaseScope Scope(Report, CompileReport::PhaseModulePasses);
+    llvm::OwningPtr<llvm::PassManager> PerModulePasses(CreateModulePasses(M));
+    PerModulePasses->run(*M);
+  }
+
+  CompileReport::PhaseScope Scope(Report, CompileReport::PhaseCodeEmission);
+
+  // Pre-ICS targets must use the LLVM 2.9 BitcodeWriter
+  bool UseLLVM29Writer = (getTargetAPI() < SLANG_ICS_TARGET_API);
+
+  if (mOptimizeForSize) {
+    if ((mOT == Slang::OT_Bitcode) && (Report != NULL)) {
+      std::vector<unsigned char> Unstripped;
+      WriteBitcode(M, UseLLVM29Writer, &Unstripped);
+      Report->addCount("bitcode_bytes_unstripped", Unstripped.size());
+    }
+    StripModule(M);
+  }
 
   switch (mOT) {
     case Slang::OT_Assembly:
     case Slang::OT_Object: {
-      if (!CreateCodeGenPasses())
-        return;
+      llvm::OwningPtr<llvm::TargetMachine> TM;
+      llvm::OwningPtr<llvm::FunctionPassManager> CodeGenPasses(
+          CreateCodeGenPasses(M, CPU, OS, &TM, Error));
+      if (!CodeGenPasses)
+        return false;
 
-      mCodeGenPasses->doInitialization();
+      CodeGenPasses->doInitialization();
 
-      for (llvm::Module::iterator I = mpModule->begin(), E = mpModule->end();
-          I != E;
-          I++)
+      for (llvm::Module::iterator I = M->begin(), E = M->end(); I != E; I++)
         if (!I->isDeclaration())
-          mCodeGenPasses->run(*I);
+          CodeGenPasses->run(*I);
 
-      mCodeGenPasses->doFinalization();
+      CodeGenPasses->doFinalization();
       break;
     }
     case Slang::OT_LLVMAssembly: {
-      llvm::PassManager *LLEmitPM = new llvm::PassManager();
-      LLEmitPM->add(llvm::createPrintModulePass(&FormattedOutStream));
-      LLEmitPM->run(*mpModule);
+      llvm::PassManager LLEmitPM;
+      LLEmitPM.add(llvm::createPrintModulePass(&OS));
+      LLEmitPM.run(*M);
       break;
     }
     case Slang::OT_Bitcode: {
-      llvm::PassManager *BCEmitPM = new llvm::PassManager();
-      std::string BCStr;
-      llvm::raw_string_ostream Bitcode(BCStr);
-      if (getTargetAPI() < SLANG_ICS_TARGET_API) {
-        // Pre-ICS targets must use the LLVM 2.9 BitcodeWriter
-        BCEmitPM->add(llvm_2_9::createBitcodeWriterPass(Bitcode));
-      } else {
-        BCEmitPM->add(llvm::createBitcodeWriterPass(Bitcode));
-      }
-
-      BCEmitPM->run(*mpModule);
-      WrapBitcode(Bitcode);
+      std::vector<unsigned char> Bitcode;
+      WriteBitcode(M, UseLLVM29Writer, &Bitcode);
+      if (Report != NULL)
+        Report->addCount("bitcode_bytes", Bitcode.size());
+      WrapBitcode(Bitcode, OS);
       break;
     }
     case Slang::OT_Nothing: {
-      return;
+      return true;
     }
     default: {
       slangAssert(false && "Unknown output type");
     }
   }
 
-  FormattedOutStream.flush();
+  OS.flush();
+
+  return true;
+}
+
+void Backend::RunExtraTargetJob(ExtraTargetJob *Job) {
+  llvm::LLVMContext Context;
+  llvm::StringRef Bitcode(
+      reinterpret_cast<const char*>(&Job->Bitcode->front()),
+      Job->Bitcode->size());
+  llvm::OwningPtr<llvm::MemoryBuffer> MB(
+      llvm::MemoryBuffer::getMemBuffer(Bitcode, "",
+                                       /* RequiresNullTerminator = */false));
+  llvm::OwningPtr<llvm::Module> M(
+      llvm::ParseBitcodeFile(MB.get(), Context, &Job->Error));
+  if (!M) {
+    Job->Success = false;
+    return;
+  }
+
+  M->setTargetTriple(Job->Output->Triple);
 
+  llvm::formatted_raw_ostream OS(*Job->Output->OS,
+                                 llvm::formatted_raw_ostream::PRESERVE_STREAM);
+  // The compile report is not thread-safe, the time spent here is accounted
+  // to the code emission of the primary target which waits for it.
+  Job->Success = Job->B->OptimizeAndEmit(M.get(), Job->Output->CPU, OS, NULL,
+                                         &Job->Error);
   return;
 }
 
+void *Backend::ExtraTargetJobThread(void *Job) {
+  RunExtraTargetJob(static_cast<ExtraTargetJob*>(Job));
+  return NULL;
+}
+
 void Backend::HandleTagDeclDefinition(clang::TagDecl *D) {
   mGen->HandleTagDeclDefinition(D);
   return;
@@ -382,9 +684,6 @@ void Backend::CompleteTentativeDefinition(clang::VarDecl *D) {
 Backend::~Backend() {
   delete mpModule;
   delete mGen;
-  delete mPerFunctionPasses;
-  delete mPerModulePasses;
-  delete mCodeGenPasses;
   return;
 }
 
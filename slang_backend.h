@@ -17,23 +17,34 @@
 #ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_BACKEND_H_  // NOLINT
 #define _FRAMEWORKS_COMPILE_SLANG_SLANG_BACKEND_H_
 
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "clang/AST/ASTConsumer.h"
 
 #include "llvm/PassManager.h"
 
+#include "llvm/ADT/OwningPtr.h"
+
 #include "llvm/Support/FormattedStream.h"
 
 #include "slang.h"
+#include "slang_compile_report.h"
 #include "slang_pragma_recorder.h"
 #include "slang_version.h"
 
 namespace llvm {
   class formatted_raw_ostream;
+  class Function;
   class LLVMContext;
   class NamedMDNode;
   class Module;
   class PassManager;
+  class PassManagerBuilder;
   class FunctionPassManager;
+  class TargetMachine;
 }
 
 namespace clang {
@@ -57,25 +68,89 @@ class Backend : public clang::ASTConsumer {
   llvm::raw_ostream *mpOS;
   Slang::OutputType mOT;
 
+  // The targets the code is generated for in addition to the one of
+  // mTargetOpts (see Slang::setExtraTargets())
+  std::vector<Slang::CodeGenOutput> mExtraOutputs;
+
   // This helps us translate Clang AST using into LLVM IR
   clang::CodeGenerator *mGen;
 
-  // Passes
+  // Leave the optimization and the code generation of HandleTranslationUnit()
+  // to EmitDeferredModule() (see setDeferCodeGen())
+  bool mDeferCodeGen;
 
-  // Passes apply on function scope in a translation unit
-  llvm::FunctionPassManager *mPerFunctionPasses;
-  // Passes apply on module scope
-  llvm::PassManager *mPerModulePasses;
-  // Passes for code emission
-  llvm::FunctionPassManager *mCodeGenPasses;
+  // -Os (see setOptimizeForSize())
+  bool mOptimizeForSize;
+
+  unsigned getOptimizationLevel() const;
+  unsigned getSizeLevel() const;
+
+  // <optimization level, size level> of the functions optimized otherwise
+  // than the module (see setFunctionOptimizationLevel()), by name since they
+  // are looked up in the modules read back for the extra targets as well.
+  typedef std::pair<unsigned, unsigned> OptimizationLevelTy;
+  std::map<std::string, OptimizationLevelTy> mFunctionOptimizationLevels;
+
+  OptimizationLevelTy getOptimizationLevel(const llvm::Function &F) const;
+
+  // Mark the functions of @M with a level of their own such that the module
+  // passes (the inliner, the loop unroller) follow it.
+  void SetFunctionAttributes(llvm::Module *M) const;
 
   llvm::formatted_raw_ostream FormattedOutStream;
 
-  void CreateFunctionPasses();
-  void CreateModulePasses();
-  bool CreateCodeGenPasses();
+  // Passes apply on function scope in a translation unit, built for @Level
+  llvm::FunctionPassManager *
+  CreateFunctionPasses(llvm::Module *M, const OptimizationLevelTy &Level)
+      const;
+  // Passes apply on module scope
+  llvm::PassManager *CreateModulePasses(llvm::Module *M) const;
+  // Passes for code emission. Return NULL and describe the reason in @Error
+  // on failure. The passes refer to the TargetMachine returned in @TM.
+  llvm::FunctionPassManager *
+  CreateCodeGenPasses(llvm::Module *M, const std::string &CPU,
+                      llvm::formatted_raw_ostream &OS,
+                      llvm::OwningPtr<llvm::TargetMachine> *TM,
+                      std::string *Error) const;
+
+  // Strip the names and the dead internals off the optimized @M for -Os
+  void StripModule(llvm::Module *M) const;
+
+  // Set up the options of the LLVM code generator, which are process-wide and
+  // thus shared by all the targets (and locked by EmitModule() against the
+  // other compilations.)
+  void SetCodeGenOptions() const;
+
+  // Optimize @M and write out the code for the target of @M (and @CPU) to @OS.
+  // Only this touches @M, so it can be run for different modules (in
+  // different LLVMContexts) concurrently. Return false and describe the reason
+  // in @Error on failure.
+  bool OptimizeAndEmit(llvm::Module *M, const std::string &CPU,
+                       llvm::formatted_raw_ostream &OS, CompileReport *Report,
+                       std::string *Error) const;
+
+  // Write @M to @Bitcode, which is the only copy of the bitcode made before it
+  // goes to the output.
+  static void WriteBitcode(const llvm::Module *M, bool UseLLVM29Writer,
+                           std::vector<unsigned char> *Bitcode);
+
+  void WrapBitcode(const std::vector<unsigned char> &Bitcode,
+                   llvm::raw_ostream &OS) const;
 
-  void WrapBitcode(llvm::raw_string_ostream &Bitcode);
+  // The code generation for one of mExtraOutputs, from a module of its own
+  // read from the bitcode of mpModule
+  struct ExtraTargetJob {
+    const Backend *B;
+    const std::vector<unsigned char> *Bitcode;
+    const Slang::CodeGenOutput *Output;
+    bool Success;
+    std::string Error;
+  };
+  static void RunExtraTargetJob(ExtraTargetJob *Job);
+  static void *ExtraTargetJobThread(void *Job);
+
+  // Optimize and emit mpModule for all the targets
+  void EmitModule();
 
  protected:
   llvm::LLVMContext &mLLVMContext;
@@ -83,10 +158,45 @@ class Backend : public clang::ASTConsumer {
 
   PragmaList *mPragmas;
 
+  // Where the time spent in each phase goes (NULL if not wanted)
+  CompileReport *mReport;
+
   virtual unsigned int getTargetAPI() const {
     return SLANG_MAXIMUM_TARGET_API;
   }
 
+  // The floating point semantics the generated code has to keep
+  enum FPPrecision {
+    // IEEE 754
+    FP_Full,
+    // Denormals may be flushed to zero and a * b + c may be contracted
+    FP_Relaxed,
+    // In addition, Inf and NaN may be ignored, math functions may lose
+    // precision and the operations may be reassociated
+    FP_Imprecise
+  };
+
+  virtual FPPrecision getFPPrecision() const {
+    return FP_Full;
+  }
+
+  // Add the passes of the language (e.g., by the extensions of @PMBuilder) to
+  // the module passes. It's called for the module of each target, possibly
+  // concurrently.
+  virtual void AddModulePasses(llvm::PassManagerBuilder *PMBuilder) const {
+    return;
+  }
+
+  // Optimize the function @Name at @OptLevel and @SizeLevel (as the ones of
+  // llvm::PassManagerBuilder) rather than at the level of the module. Call it
+  // from HandleTranslationUnitPost().
+  void setFunctionOptimizationLevel(const std::string &Name,
+                                    unsigned OptLevel,
+                                    unsigned SizeLevel) {
+    mFunctionOptimizationLevels[Name] = std::make_pair(OptLevel, SizeLevel);
+    return;
+  }
+
   // This handler will be invoked before Clang translates @Ctx to LLVM IR. This
   // give you an opportunity to modified the IR in AST level (scope information,
   // unoptimized IR, etc.). After the return from this method, slang will start
@@ -100,13 +210,20 @@ class Backend : public clang::ASTConsumer {
   // method, slang will start doing optimization and code generation for @M.
   virtual void HandleTranslationUnitPost(llvm::Module *M) { return; }
 
+  // This handler will be invoked once @M has been optimized and written out
+  // successfully (for the main target only), e.g., to report on the code.
+  virtual void HandleModuleEmitted(llvm::Module *M) { return; }
+
  public:
-  Backend(clang::DiagnosticsEngine *DiagEngine,
+  Backend(llvm::LLVMContext &LLVMContext,
+          clang::DiagnosticsEngine *DiagEngine,
           const clang::CodeGenOptions &CodeGenOpts,
           const clang::TargetOptions &TargetOpts,
           PragmaList *Pragmas,
           llvm::raw_ostream *OS,
-          Slang::OutputType OT);
+          Slang::OutputType OT,
+          const std::vector<Slang::CodeGenOutput> &ExtraOutputs,
+          CompileReport *Report);
 
   // Initialize - This is called to initialize the consumer, providing the
   // ASTContext.
@@ -133,6 +250,20 @@ class Backend : public clang::ASTConsumer {
   // completed.
   virtual void CompleteTentativeDefinition(clang::VarDecl *D);
 
+  // Make HandleTranslationUnit() stop after the IR generation and the export
+  // processing (i.e., HandleTranslationUnitPost()), and free the code
+  // generator. Then nothing refers to the AST anymore, so the ASTContext can
+  // be freed before EmitDeferredModule() optimizes and emits the module.
+  void setDeferCodeGen(bool Defer) { mDeferCodeGen = Defer; }
+
+  void EmitDeferredModule();
+
+  // Optimize for size (-Os) instead of -O3 and strip the optimized module
+  // (see StripModule()) before it's emitted.
+  void setOptimizeForSize(bool OptimizeForSize) {
+    mOptimizeForSize = OptimizeForSize;
+  }
+
   virtual ~Backend();
 };
 
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "slang_bitcode_compressor.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+
+#include "bcinfo/BitcodeWrapper.h"
+
+namespace slang {
+
+namespace {
+
+// The constraints of the LZ4 block format on the end of a block, which the
+// decoders rely on to copy by words: the last 5 bytes are literals and the
+// last match starts at least 12 bytes before the end.
+const size_t LZ4MinMatch = 4;
+const size_t LZ4LastLiterals = 5;
+const size_t LZ4MatchFindLimit = 12;
+const size_t LZ4MaxOffset = 0xffff;
+const unsigned LZ4HashLog = 14;
+
+inline uint32_t Read32(const unsigned char *P) {
+  uint32_t V;
+  memcpy(&V, P, sizeof(V));
+  return V;
+}
+
+inline unsigned HashLZ4(uint32_t Sequence) {
+  return (Sequence * 2654435761U) >> (32 - LZ4HashLog);
+}
+
+// The part of a length beyond the 4 bits of the token
+void AppendLZ4Length(size_t Length, std::string &Out) {
+  for (; Length >= 255; Length -= 255)
+    Out.push_back(static_cast<char>(255));
+  Out.push_back(static_cast<char>(Length));
+  return;
+}
+
+// A sequence of the literals [@Literals, @Literals + @LiteralLength) then,
+// unless @MatchLength is 0, a match at @Offset bytes back.
+void AppendLZ4Sequence(const unsigned char *Literals, size_t LiteralLength,
+                       size_t Offset, size_t MatchLength, std::string &Out) {
+  size_t MatchCode = (MatchLength != 0) ? (MatchLength - LZ4MinMatch) : 0;
+  unsigned char Token =
+      (((LiteralLength < 15) ? LiteralLength : 15) << 4) |
+      ((MatchCode < 15) ? MatchCode : 15);
+  Out.push_back(static_cast<char>(Token));
+  if (LiteralLength >= 15)
+    AppendLZ4Length(LiteralLength - 15, Out);
+  Out.append(reinterpret_cast<const char*>(Literals), LiteralLength);
+
+  if (MatchLength != 0) {
+    Out.push_back(static_cast<char>(Offset & 0xff));
+    Out.push_back(static_cast<char>(Offset >> 8));
+    if (MatchCode >= 15)
+      AppendLZ4Length(MatchCode - 15, Out);
+  }
+  return;
+}
+
+void AppendLE32(uint32_t V, std::string &Out) {
+  for (int i = 0; i < 4; i++)
+    Out.push_back(static_cast<char>((V >> (i * 8)) & 0xff));
+  return;
+}
+
+}  // namespace
+
+uint32_t BitcodeCompressor::ComputeCRC32(llvm::StringRef Data) {
+  uint32_t CRC = 0xffffffff;
+  for (size_t i = 0, e = Data.size(); i != e; i++) {
+    CRC ^= static_cast<unsigned char>(Data[i]);
+    for (int Bit = 0; Bit < 8; Bit++)
+      CRC = (CRC >> 1) ^ (0xedb88320 & (0 - (CRC & 1)));
+  }
+  return ~CRC;
+}
+
+// A greedy compressor with a single hash table of the last position of each
+// 4-byte sequence, i.e., the fast mode of the reference LZ4. The bitcode is
+// compressed once at build time and decompressed by a simple loop at run time,
+// where the cost matters.
+void BitcodeCompressor::CompressLZ4Block(llvm::StringRef In,
+                                         std::string &Out) {
+  const unsigned char *Src =
+      reinterpret_cast<const unsigned char*>(In.data());
+  size_t Size = In.size();
+  size_t Anchor = 0;
+
+  if (Size > LZ4MatchFindLimit) {
+    // The positions + 1 (0 is none)
+    std::vector<size_t> Table(1 << LZ4HashLog, 0);
+    size_t MatchStartLimit = Size - LZ4MatchFindLimit;
+    size_t MatchEndLimit = Size - LZ4LastLiterals;
+
+    size_t i = 0;
+    while (i <= MatchStartLimit) {
+      uint32_t Sequence = Read32(Src + i);
+      size_t &Entry = Table[HashLZ4(Sequence)];
+      size_t Candidate = Entry;
+      Entry = i + 1;
+      if ((Candidate == 0) || (i - (Candidate - 1) > LZ4MaxOffset) ||
+          (Read32(Src + Candidate - 1) != Sequence)) {
+        i++;
+        continue;
+      }
+
+      size_t Match = Candidate - 1;
+      size_t Length = LZ4MinMatch;
+      while ((i + Length < MatchEndLimit) &&
+             (Src[Match + Length] == Src[i + Length]))
+        Length++;
+      while ((i > Anchor) && (Match > 0) && (Src[i - 1] == Src[Match - 1])) {
+        i--;
+        Match--;
+        Length++;
+      }
+
+      AppendLZ4Sequence(Src + Anchor, i - Anchor, i - Match, Length, Out);
+      i += Length;
+      Anchor = i;
+    }
+  }
+
+  AppendLZ4Sequence(Src + Anchor, Size - Anchor, 0, 0, Out);
+  return;
+}
+
+bool BitcodeCompressor::CompressWrapper(llvm::StringRef Wrapper,
+                                        std::string &Out,
+                                        std::string *Error) {
+  struct bcinfo::BCWrapperHeader Header;
+  if (Wrapper.size() < sizeof(Header)) {
+    *Error = "the bitcode is not wrapped";
+    return false;
+  }
+  memcpy(&Header, Wrapper.data(), sizeof(Header));
+  if ((Header.Magic != 0x0B17C0DE) || (Header.HeaderVersion != 0)) {
+    *Error = "the bitcode is not wrapped by a header of version 0";
+    return false;
+  }
+
+  std::string Payload;
+  CompressLZ4Block(Wrapper, Payload);
+
+  Header.HeaderVersion = CompressedHeaderVersion;
+  Header.BitcodeOffset = sizeof(Header) + sizeof(BCCompressionHeader);
+  Header.BitcodeSize = Payload.size();
+
+  Out.clear();
+  Out.reserve(Header.BitcodeOffset + Payload.size());
+  Out.append(reinterpret_cast<const char*>(&Header), sizeof(Header));
+  // Little-endian, as read by the generated accessor
+  AppendLE32(BCCM_LZ4_BLOCK, Out);
+  AppendLE32(Wrapper.size(), Out);
+  AppendLE32(ComputeCRC32(Wrapper), Out);
+  Out.append(Payload);
+  return true;
+}
+
+}  // namespace slang
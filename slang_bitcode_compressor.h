@@ -0,0 +1,75 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_BITCODE_COMPRESSOR_H_  // NOLINT
+#define _FRAMEWORKS_COMPILE_SLANG_SLANG_BITCODE_COMPRESSOR_H_
+
+#include <string>
+
+#include "llvm/Support/DataTypes.h"
+
+namespace llvm {
+  class StringRef;
+}
+
+namespace slang {
+
+// The compressed form of a bitcode wrapper (as written by
+// Backend::WrapBitcode) is itself a wrapper of header version 1:
+//
+//   BCWrapperHeader  with HeaderVersion 1, BitcodeOffset and BitcodeSize
+//                    locating the compressed payload, the other fields as in
+//                    the original wrapper
+//   BCCompressionHeader  right before the payload
+//   payload          the whole original wrapper, compressed
+//
+// such that decompressing the payload gives back the original wrapper (of
+// header version 0) byte for byte.
+struct BCCompressionHeader {
+  uint32_t Method;
+  uint32_t UncompressedSize;
+  // Of the original wrapper, as computed by java.util.zip.CRC32
+  uint32_t UncompressedCRC32;
+};
+
+// BCCompressionHeader::Method
+enum BCCompressionMethod {
+  // A single block of the LZ4 block format
+  BCCM_LZ4_BLOCK = 1
+};
+
+class BitcodeCompressor {
+ private:
+  BitcodeCompressor() {}
+
+ public:
+  enum { CompressedHeaderVersion = 1 };
+
+  // The CRC-32 of @Data, as computed by java.util.zip.CRC32
+  static uint32_t ComputeCRC32(llvm::StringRef Data);
+
+  // Append @In compressed in an LZ4 block to @Out.
+  static void CompressLZ4Block(llvm::StringRef In, std::string &Out);
+
+  // Set @Out to the compressed form of the bitcode wrapper @Wrapper. Return
+  // false (and set @Error) if @Wrapper isn't a wrapper of header version 0.
+  static bool CompressWrapper(llvm::StringRef Wrapper, std::string &Out,
+                              std::string *Error);
+};
+
+}  // namespace slang
+
+#endif  // _FRAMEWORKS_COMPILE_SLANG_SLANG_BITCODE_COMPRESSOR_H_  NOLINT
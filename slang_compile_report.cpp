@@ -0,0 +1,201 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "slang_compile_report.h"
+
+#ifndef USE_MINGW
+#include <sys/resource.h>
+#endif
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "slang_assert.h"
+#include "slang_utils.h"
+
+namespace slang {
+
+namespace {
+
+double GetWallTime() {
+  return llvm::TimeRecord::getCurrentTime(/* Start = */true).getWallTime();
+}
+
+}  // namespace
+
+const char *CompileReport::GetPhaseName(Phase P) {
+  switch (P) {
+    case PhaseParse: return "parse";
+    case PhaseRefCount: return "refcount";
+    case PhaseIRGen: return "irgen";
+    case PhaseExport: return "export";
+    case PhaseFunctionPasses: return "function_passes";
+    case PhaseModulePasses: return "module_passes";
+    case PhaseCodeEmission: return "code_emission";
+    case PhaseReflection: return "reflection";
+    default: {
+      slangAssert(false && "Unknown phase");
+      return "";
+    }
+  }
+}
+
+size_t CompileReport::GetPeakRSS() {
+#ifndef USE_MINGW
+  struct rusage Usage;
+  if (::getrusage(RUSAGE_SELF, &Usage) != 0)
+    return 0;
+#if defined(__APPLE__)
+  // In bytes on Mac OS X
+  return static_cast<size_t>(Usage.ru_maxrss) / 1024;
+#else
+  return static_cast<size_t>(Usage.ru_maxrss);
+#endif
+#else
+  return 0;
+#endif
+}
+
+CompileReport::CompileReport() : mLastTime(0), mPeakRSS(0) {
+  return;
+}
+
+void CompileReport::account() {
+  double Now = GetWallTime();
+  if (!mPhaseStack.empty() && !mFiles.empty())
+    mFiles.back().WallTime[mPhaseStack.back()] += Now - mLastTime;
+  mLastTime = Now;
+  mPeakRSS = GetPeakRSS();
+  return;
+}
+
+void CompileReport::beginFile(const std::string &InputFile) {
+  slangAssert(mPhaseStack.empty() && "Phases left running");
+
+  FileRecord File;
+  File.InputFile = InputFile;
+  for (unsigned i = 0; i < NumPhases; i++)
+    File.WallTime[i] = 0;
+  mFiles.push_back(File);
+  return;
+}
+
+void CompileReport::enterPhase(Phase P) {
+  account();
+  mPhaseStack.push_back(P);
+  return;
+}
+
+void CompileReport::exitPhase() {
+  slangAssert(!mPhaseStack.empty() && "No phase to exit");
+  account();
+  mPhaseStack.pop_back();
+  return;
+}
+
+void CompileReport::addCount(const std::string &Name, unsigned Count) {
+  if (!mFiles.empty())
+    mFiles.back().Counts.push_back(std::make_pair(Name, Count));
+  return;
+}
+
+void CompileReport::merge(const CompileReport &Other) {
+  mFiles.insert(mFiles.end(), Other.mFiles.begin(), Other.mFiles.end());
+  if (Other.mPeakRSS > mPeakRSS)
+    mPeakRSS = Other.mPeakRSS;
+  return;
+}
+
+void CompileReport::printText(llvm::raw_ostream &OS) const {
+  for (std::vector<FileRecord>::const_iterator I = mFiles.begin(),
+          E = mFiles.end();
+       I != E;
+       I++) {
+    OS << "===" << std::string(73, '-') << "===\n"
+       << "  Compile report for " << I->InputFile << "\n"
+       << "===" << std::string(73, '-') << "===\n"
+       << llvm::format("  %-20s %14s\n", "Phase", "Wall Time (s)");
+
+    double Total = 0;
+    for (unsigned i = 0; i < NumPhases; i++) {
+      OS << llvm::format("  %-20s %14.4f\n",
+                         GetPhaseName(static_cast<Phase>(i)),
+                         I->WallTime[i]);
+      Total += I->WallTime[i];
+    }
+    OS << llvm::format("  %-20s %14.4f\n", "total", Total);
+
+    for (std::vector<std::pair<std::string, unsigned> >::const_iterator
+            CI = I->Counts.begin(), CE = I->Counts.end();
+         CI != CE;
+         CI++) {
+      OS << llvm::format("  %-20s %14u\n", CI->first.c_str(), CI->second);
+    }
+    OS << "\n";
+  }
+
+  // Once, since it's the high-water mark of the process (e.g., of all the
+  // files compiled concurrently under -jobs.)
+  OS << "===" << std::string(73, '-') << "===\n"
+     << "  Compiler process\n"
+     << "===" << std::string(73, '-') << "===\n"
+     << llvm::format("  %-20s %14lu\n", "peak RSS (KB)",
+                     static_cast<unsigned long>(mPeakRSS))  // NOLINT
+     << "\n";
+  return;
+}
+
+void CompileReport::printJSON(llvm::raw_ostream &OS) const {
+  OS << "{\n  \"process_peak_rss_kb\": "
+     << static_cast<unsigned long>(mPeakRSS)  // NOLINT
+     << ",\n  \"files\": [";
+  for (std::vector<FileRecord>::const_iterator I = mFiles.begin(),
+          E = mFiles.end();
+       I != E;
+       I++) {
+    OS << ((I == mFiles.begin()) ? "\n" : ",\n");
+    OS << "    {\n      \"input\": ";
+    SlangUtils::PrintJSONString(OS, I->InputFile);
+    OS << ",\n      \"phases\": {";
+    for (unsigned i = 0; i < NumPhases; i++) {
+      OS << ((i == 0) ? "\n" : ",\n");
+      OS << "        \"" << GetPhaseName(static_cast<Phase>(i)) << "\": "
+         << llvm::format("{ \"wall_time\": %.6f }", I->WallTime[i]);
+    }
+    OS << "\n      },\n      \"counts\": {";
+    for (std::vector<std::pair<std::string, unsigned> >::const_iterator
+            CI = I->Counts.begin(), CE = I->Counts.end();
+         CI != CE;
+         CI++) {
+      OS << ((CI == I->Counts.begin()) ? "\n" : ",\n");
+      OS << "        ";
+      SlangUtils::PrintJSONString(OS, CI->first);
+      OS << ": " << CI->second;
+    }
+    OS << "\n      }\n    }";
+  }
+  OS << "\n  ]\n}\n";
+  return;
+}
+
+}  // namespace slang
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_COMPILE_REPORT_H_  // NOLINT
+#define _FRAMEWORKS_COMPILE_SLANG_SLANG_COMPILE_REPORT_H_
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace slang {
+
+// CompileReport - The wall time of each phase of compiling the input files and
+// the peak memory usage of the process (see llvm-rs-cc -ftime-report.) The
+// time spent in a phase nested in another one (e.g., IR generation is done
+// while parsing) is accounted to the inner phase only.
+class CompileReport {
+ public:
+  enum Phase {
+    PhaseParse,
+    PhaseRefCount,
+    PhaseIRGen,
+    PhaseExport,
+    PhaseFunctionPasses,
+    PhaseModulePasses,
+    PhaseCodeEmission,
+    PhaseReflection,
+
+    NumPhases
+  };
+
+  static const char *GetPhaseName(Phase P);
+
+  struct FileRecord {
+    std::string InputFile;
+
+    // In seconds
+    double WallTime[NumPhases];
+
+    // <name, value> of the counters (e.g., number of exported variables)
+    std::vector<std::pair<std::string, unsigned> > Counts;
+  };
+
+  // PhaseScope - Account the time spent until the end of the scope to the phase
+  // @P of @Report (if any).
+  class PhaseScope {
+   private:
+    CompileReport *mReport;
+
+   public:
+    PhaseScope(CompileReport *Report, Phase P) : mReport(Report) {
+      if (mReport != NULL)
+        mReport->enterPhase(P);
+    }
+
+    ~PhaseScope() {
+      if (mReport != NULL)
+        mReport->exitPhase();
+    }
+  };
+
+ private:
+  std::vector<FileRecord> mFiles;
+
+  // The phases being run, the innermost one is the last.
+  std::vector<Phase> mPhaseStack;
+
+  // When the time was last accounted
+  double mLastTime;
+
+  // The peak resident set size of the process (in KB) when the time was last
+  // accounted, 0 if unavailable. It's a high-water mark of the whole process,
+  // so it can't be told apart per file (e.g., under -jobs.)
+  size_t mPeakRSS;
+
+  void account();
+
+ public:
+  CompileReport();
+
+  // Start recording the phases of compiling @InputFile. The following
+  // enterPhase(), exitPhase() and addCount() go to it.
+  void beginFile(const std::string &InputFile);
+
+  void enterPhase(Phase P);
+  void exitPhase();
+
+  void addCount(const std::string &Name, unsigned Count);
+
+  // Append the records of @Other (e.g., from another compile job of the same
+  // process) to this.
+  void merge(const CompileReport &Other);
+
+  bool empty() const { return mFiles.empty(); }
+
+  void printText(llvm::raw_ostream &OS) const;
+
+  void printJSON(llvm::raw_ostream &OS) const;
+
+  // The peak resident set size of the process so far in KB, or 0 if
+  // unsupported by the host.
+  static size_t GetPeakRSS();
+};
+
+}  // namespace slang
+
+#endif  // _FRAMEWORKS_COMPILE_SLANG_SLANG_COMPILE_REPORT_H_  NOLINT
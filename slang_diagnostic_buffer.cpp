@@ -32,7 +32,8 @@ DiagnosticBuffer::DiagnosticBuffer()
 DiagnosticBuffer::DiagnosticBuffer(DiagnosticBuffer const &src)
   : clang::DiagnosticConsumer(src),
     mDiags(src.mDiags),
-    mSOS(new llvm::raw_string_ostream(mDiags)) {
+    mSOS(new llvm::raw_string_ostream(mDiags)),
+    mEntries(src.mEntries) {
 }
 
 DiagnosticBuffer::~DiagnosticBuffer() {
@@ -47,9 +48,21 @@ void DiagnosticBuffer::HandleDiagnostic(
   // 100 is enough for storing general diagnosis message
   llvm::SmallString<100> Buf;
 
+  Entry E;
+  E.Level = DiagLevel;
+  E.Line = 0;
+  E.Column = 0;
+
   if (SrcLoc.isValid()) {
     SrcLoc.print(*mSOS, Info.getSourceManager());
     (*mSOS) << ": ";
+
+    clang::PresumedLoc PLoc = Info.getSourceManager().getPresumedLoc(SrcLoc);
+    if (PLoc.isValid()) {
+      E.File = PLoc.getFilename();
+      E.Line = PLoc.getLine();
+      E.Column = PLoc.getColumn();
+    }
   }
 
   switch (DiagLevel) {
@@ -76,6 +89,9 @@ void DiagnosticBuffer::HandleDiagnostic(
 
   Info.FormatDiagnostic(Buf);
   (*mSOS) << Buf.str() << '\n';
+
+  E.Message = Buf.str();
+  mEntries.push_back(E);
 }
 
 clang::DiagnosticConsumer *
@@ -18,6 +18,7 @@
 #define _FRAMEWORKS_COMPILE_SLANG_SLANG_DIAGNOSTIC_BUFFER_H_
 
 #include <string>
+#include <vector>
 
 #include "clang/Basic/Diagnostic.h"
 
@@ -31,9 +32,22 @@ namespace slang {
 
 // The diagnostics consumer instance (for reading the processed diagnostics)
 class DiagnosticBuffer : public clang::DiagnosticConsumer {
+ public:
+  // A diagnostic as reported, for the clients showing them in their own way
+  // (see SlangRS::compileFromMemory())
+  struct Entry {
+    clang::DiagnosticsEngine::Level Level;
+    // Empty and 0 if the diagnostic has no location
+    std::string File;
+    unsigned Line;
+    unsigned Column;
+    std::string Message;
+  };
+
  private:
   std::string mDiags;
   llvm::OwningPtr<llvm::raw_string_ostream> mSOS;
+  std::vector<Entry> mEntries;
 
  public:
   DiagnosticBuffer();
@@ -53,8 +67,11 @@ class DiagnosticBuffer : public clang::DiagnosticConsumer {
     return mDiags;
   }
 
+  inline const std::vector<Entry> &getEntries() const { return mEntries; }
+
   inline void reset() {
     this->mSOS->str().clear();
+    mEntries.clear();
   }
 };
 
@@ -17,7 +17,10 @@
 #include "slang_rs.h"
 
 #include <cstring>
+#include <iostream>
+#include <iterator>
 #include <list>
+#include <set>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -25,16 +28,25 @@
 
 #include "clang/Basic/SourceLocation.h"
 
+#include "clang/Frontend/CodeGenOptions.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
 
 #include "clang/Sema/SemaDiagnostic.h"
 
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
 
 #include "os_sep.h"
+#include "slang_assert.h"
+#include "slang_compile_report.h"
 #include "slang_rs_backend.h"
 #include "slang_rs_context.h"
 #include "slang_rs_export_type.h"
+#include "slang_utils.h"
 
 namespace slang {
 
@@ -59,10 +71,62 @@ namespace slang {
 bool SlangRS::reflectToJava(const std::string &OutputPathBase,
                             const std::string &OutputPackageName,
                             std::string *RealPackageName) {
+  if (CompileReport *Report = getCompileReport()) {
+    Report->addCount("exported_vars",
+                     std::distance(mRSContext->export_vars_begin(),
+                                   mRSContext->export_vars_end()));
+    Report->addCount("exported_funcs",
+                     std::distance(mRSContext->export_funcs_begin(),
+                                   mRSContext->export_funcs_end()));
+    Report->addCount("exported_foreach",
+                     std::distance(mRSContext->export_foreach_begin(),
+                                   mRSContext->export_foreach_end()));
+    Report->addCount("exported_reduce",
+                     std::distance(mRSContext->export_reduce_begin(),
+                                   mRSContext->export_reduce_end()));
+    Report->addCount("exported_types",
+                     std::distance(mRSContext->export_types_begin(),
+                                   mRSContext->export_types_end()));
+    Report->addCount("export_type_cache_hits",
+                     mRSContext->getExportTypeCacheHits());
+    Report->addCount("export_type_cache_misses",
+                     mRSContext->getExportTypeCacheMisses());
+    Report->addCount("export_arena_bytes",
+                     mRSContext->getExportableArenaSize());
+    Report->addCount("export_type_names_bytes",
+                     mRSContext->getExportTypeNameArenaSize());
+    Report->addCount("odr_arena_bytes",
+                     ReflectedDefinitions.getAllocator().getTotalMemory());
+  }
+
+  CompileReport::PhaseScope Scope(getCompileReport(),
+                                  CompileReport::PhaseReflection);
+
+  ReflectionOptions Options(mReflectionOptions);
+  Options.InMemoryFiles = mInMemoryJavaFiles;
+  Options.VerboseOutput = mVerboseOutput;
+  if (!Options.SharedTypesPackageName.empty()) {
+    // The structs reflected before with the same definition are shared. The
+    // others are reported by checkODR() after the reflection.
+    ODRSignatureListTy Signatures;
+    collectODRSignatures(&Signatures);
+    for (ODRSignatureListTy::const_iterator I = Signatures.begin(),
+            E = Signatures.end();
+         I != E;
+         I++) {
+      ReflectedDefinitionListTy::const_iterator RD =
+          ReflectedDefinitions.find(I->first);
+      if ((RD != ReflectedDefinitions.end()) &&
+          (RD->getValue().first == I->second))
+        Options.ReflectedSharedTypes.insert(I->first);
+    }
+  }
+
   return mRSContext->reflectToJava(OutputPathBase,
                                    OutputPackageName,
                                    getInputFileName(),
                                    getOutputFileName(),
+                                   Options,
                                    RealPackageName);
 }
 
@@ -75,11 +139,133 @@ bool SlangRS::generateBitcodeAccessor(const std::string &OutputPathBase,
   BCAccessorContext.reflectPath = OutputPathBase.c_str();
   BCAccessorContext.packageName = PackageName.c_str();
   BCAccessorContext.bcStorage = BCST_JAVA_CODE;   // Must be BCST_JAVA_CODE
+  BCAccessorContext.packed = mReflectionOptions.PackedBitcodeAccessor;
+  BCAccessorContext.compressed = mReflectionOptions.CompressedBitcodeAccessor;
+  BCAccessorContext.verboseOutput = mVerboseOutput;
 
+  CompileReport::PhaseScope Scope(getCompileReport(),
+                                  CompileReport::PhaseReflection);
   return RSSlangReflectUtils::GenerateBitCodeAccessor(BCAccessorContext);
 }
 
-bool SlangRS::checkODR(const char *CurInputFile) {
+bool SlangRS::reflect(const std::string &JavaReflectionPathBase,
+                      const std::string &JavaReflectionPackageName,
+                      bool WithBitcodeAccessor,
+                      std::string *RealPackageName) {
+  if (!reflectToJava(JavaReflectionPathBase,
+                     JavaReflectionPackageName,
+                     RealPackageName))
+    return false;
+
+  for (std::vector<std::string>::const_iterator
+           I = mGeneratedFileNames.begin(), E = mGeneratedFileNames.end();
+       I != E;
+       I++) {
+    // The shared ScriptField_* classes come with their package.
+    std::string QualifiedName = (I->find('.') != std::string::npos) ?
+        *I : (*RealPackageName + OS_PATH_SEPARATOR_STR + *I);
+    std::string ReflectedName = RSSlangReflectUtils::ComputePackagedPath(
+        JavaReflectionPathBase.c_str(), QualifiedName.c_str());
+    appendGeneratedFileName(ReflectedName + ".java");
+  }
+
+  if (WithBitcodeAccessor &&
+      !generateBitcodeAccessor(JavaReflectionPathBase,
+                               RealPackageName->c_str()))
+    return false;
+
+  return true;
+}
+
+std::ostream &SlangRS::getVerboseOutput() {
+  return (mVerboseOutput != NULL) ? *mVerboseOutput : std::cout;
+}
+
+// Two record types A and B have the same "definition" iff:
+//
+//  struct A {              struct B {
+//    Type(a1) a1,            Type(b1) b1,
+//    Type(a2) a2,            Type(b1) b2,
+//    ...                     ...
+//    Type(aN) aN             Type(b3) b3,
+//  };                      }
+//  Cond. #1. They have same number of fields, i.e., N = M;
+//  Cond. #2. for (i := 1 to N)
+//              Type(ai) = Type(bi) must hold;
+//  Cond. #3. for (i := 1 to N)
+//              Name(ai) = Name(bi) must hold;
+//
+// where,
+//  Type(F) = the type of field F (see RSExportType::equals()) and
+//  Name(F) = the field name.
+//
+// AppendODRSignature() encodes exactly the above into a string so that the
+// definitions can be compared without keeping the RSExportRecordType (e.g.,
+// when the definition comes from the compilation cache.) Only the top-level
+// record type has its field names encoded (Cond. #3).
+static void AppendODRSignature(const RSExportType *ET, bool IsTopLevel,
+                               std::string *Signature) {
+  std::stringstream SS;
+
+  switch (ET->getClass()) {
+    case RSExportType::ExportClassPrimitive: {
+      SS << "P" << static_cast<const RSExportPrimitiveType*>(ET)->getType();
+      break;
+    }
+    case RSExportType::ExportClassVector: {
+      const RSExportVectorType *EVT =
+          static_cast<const RSExportVectorType*>(ET);
+      SS << "V" << EVT->getType() << "x" << EVT->getNumElement();
+      break;
+    }
+    case RSExportType::ExportClassMatrix: {
+      SS << "M" << static_cast<const RSExportMatrixType*>(ET)->getDim();
+      break;
+    }
+    case RSExportType::ExportClassPointer: {
+      Signature->append("*");
+      AppendODRSignature(
+          static_cast<const RSExportPointerType*>(ET)->getPointeeType(),
+          false, Signature);
+      return;
+    }
+    case RSExportType::ExportClassConstantArray: {
+      const RSExportConstantArrayType *ECAT =
+          static_cast<const RSExportConstantArrayType*>(ET);
+      SS << "A" << ECAT->getSize() << "[";
+      Signature->append(SS.str());
+      AppendODRSignature(ECAT->getElementType(), false, Signature);
+      Signature->append("]");
+      return;
+    }
+    case RSExportType::ExportClassRecord: {
+      const RSExportRecordType *ERT =
+          static_cast<const RSExportRecordType*>(ET);
+      Signature->append("{");
+      for (RSExportRecordType::const_field_iterator I = ERT->fields_begin(),
+              E = ERT->fields_end();
+           I != E;
+           I++) {
+        if (IsTopLevel) {
+          Signature->append((*I)->getName());
+          Signature->append(":");
+        }
+        AppendODRSignature((*I)->getType(), false, Signature);
+        Signature->append(";");
+      }
+      Signature->append("}");
+      return;
+    }
+    default: {
+      slangAssert(false && "Unknown class of type");
+    }
+  }
+
+  Signature->append(SS.str());
+  return;
+}
+
+void SlangRS::collectODRSignatures(ODRSignatureListTy *Signatures) {
   for (RSContext::ExportableList::iterator I = mRSContext->exportable_begin(),
           E = mRSContext->exportable_end();
        I != E;
@@ -99,69 +285,304 @@ bool SlangRS::checkODR(const char *CurInputFile) {
     if (ERT->isArtificial())
       continue;
 
-    // Key to lookup ERT in ReflectedDefinitions
-    llvm::StringRef RDKey(ERT->getName());
+    std::string Signature;
+    AppendODRSignature(ERT, true, &Signature);
+    Signatures->push_back(std::make_pair(ERT->getName(), Signature));
+  }
+  return;
+}
+
+bool SlangRS::checkODR(const char *CurInputFile,
+                       const ODRSignatureListTy &Signatures) {
+  for (ODRSignatureListTy::const_iterator I = Signatures.begin(),
+          E = Signatures.end();
+       I != E;
+       I++) {
+    // Key to lookup the record type in ReflectedDefinitions
+    llvm::StringRef RDKey(I->first);
     ReflectedDefinitionListTy::const_iterator RD =
         ReflectedDefinitions.find(RDKey);
 
     if (RD != ReflectedDefinitions.end()) {
-      const RSExportRecordType *Reflected = RD->getValue().first;
       // There's a record (struct) with the same name reflected before. Enforce
       // ODR checking - the Reflected must hold *exactly* the same "definition"
-      // as the one defined previously. We say two record types A and B have the
-      // same definition iff:
-      //
-      //  struct A {              struct B {
-      //    Type(a1) a1,            Type(b1) b1,
-      //    Type(a2) a2,            Type(b1) b2,
-      //    ...                     ...
-      //    Type(aN) aN             Type(b3) b3,
-      //  };                      }
-      //  Cond. #1. They have same number of fields, i.e., N = M;
-      //  Cond. #2. for (i := 1 to N)
-      //              Type(ai) = Type(bi) must hold;
-      //  Cond. #3. for (i := 1 to N)
-      //              Name(ai) = Name(bi) must hold;
-      //
-      // where,
-      //  Type(F) = the type of field F and
-      //  Name(F) = the field name.
-
-      bool PassODR = false;
-      // Cond. #1 and Cond. #2
-      if (Reflected->equals(ERT)) {
-        // Cond #3.
-        RSExportRecordType::const_field_iterator AI = Reflected->fields_begin(),
-                                                 BI = ERT->fields_begin();
-
-        for (unsigned i = 0, e = Reflected->getFields().size(); i != e; i++) {
-          if ((*AI)->getName() != (*BI)->getName())
-            break;
-          AI++;
-          BI++;
-        }
-        PassODR = (AI == (Reflected->fields_end()));
-      }
-
-      if (!PassODR) {
-        getDiagnostics().Report(mDiagErrorODR) << Reflected->getName()
+      // as the one defined previously (see AppendODRSignature()).
+      if (RD->getValue().first != I->second) {
+        getDiagnostics().Report(mDiagErrorODR) << RD->getKey()
                                                << getInputFileName()
                                                << RD->getValue().second;
         return false;
       }
     } else {
-      llvm::StringMapEntry<ReflectedDefinitionTy> *ME =
-          llvm::StringMapEntry<ReflectedDefinitionTy>::Create(RDKey.begin(),
-                                                              RDKey.end());
-      ME->setValue(std::make_pair(ERT, CurInputFile));
+      ReflectedDefinitions.GetOrCreateValue(
+          RDKey, std::make_pair(saveODRSignature(I->second), CurInputFile));
+    }
+
+    // And the ones of the other invocations
+    if (mODRDatabase) {
+      RSODRDatabase::Definition Conflict;
+      if (mODRDatabase->findConflict(RDKey, I->second, &Conflict)) {
+        getDiagnostics().Report(mDiagErrorODR) << RDKey
+                                               << CurInputFile
+                                               << Conflict.File;
+        return false;
+      }
+      mODRDatabase->add(RDKey, I->second, CurInputFile);
+    }
+  }
+  return true;
+}
+
+bool SlangRS::mergeODR(SlangRS &Other) {
+  bool Result = true;
+
+  for (ReflectedDefinitionListTy::const_iterator
+          I = Other.ReflectedDefinitions.begin(),
+          E = Other.ReflectedDefinitions.end();
+       I != E;
+       I++) {
+    llvm::StringRef RDKey(I->getKey());
+    const char *File = I->getValue().second;
+
+    ReflectedDefinitionListTy::const_iterator RD =
+        ReflectedDefinitions.find(RDKey);
+
+    if (RD == ReflectedDefinitions.end()) {
+      ReflectedDefinitions.GetOrCreateValue(
+          RDKey, std::make_pair(saveODRSignature(I->getValue().first), File));
+      continue;
+    }
+
+    if (RD->getValue().first != I->getValue().first) {
+      getDiagnostics().Report(mDiagErrorODR) << RDKey
+                                             << File
+                                             << RD->getValue().second;
+      Result = false;
+    }
+  }
+
+  Other.clearReflectedDefinitions();
+
+  return Result;
+}
+
+llvm::StringRef SlangRS::saveODRSignature(llvm::StringRef Signature) {
+  char *Buf =
+      ReflectedDefinitions.getAllocator().Allocate<char>(Signature.size());
+  memcpy(Buf, Signature.data(), Signature.size());
+  return llvm::StringRef(Buf, Signature.size());
+}
+
+std::string SlangRS::getRSHeaderPCH(
+    const std::vector<std::string> &IncludePaths) {
+  // Anything affecting the content of the PCH is encoded in its file name:
+  // the build of the compiler, the target API (see initPreprocessor()), the
+  // target (the triple, the CPU and the features, e.g., +long64 changes the
+  // width of long) and the include paths where the headers are searched from.
+  // All but the target API and the triple are only hashed.
+  const clang::TargetOptions &TargetOpts = getTargetOptions();
+  std::string KeyStr(SlangUtils::GetBuildID());
+  KeyStr.append(1, '\0');
+  KeyStr.append(TargetOpts.CPU);
+  KeyStr.append(1, '\0');
+  for (std::vector<std::string>::const_iterator
+          I = TargetOpts.Features.begin(), E = TargetOpts.Features.end();
+       I != E;
+       I++) {
+    KeyStr.append(*I);
+    KeyStr.append(1, '\0');
+  }
+  KeyStr.append(1, '\0');
+  for (std::vector<std::string>::const_iterator I = IncludePaths.begin(),
+          E = IncludePaths.end();
+       I != E;
+       I++) {
+    KeyStr.append(*I);
+    KeyStr.append(1, '\0');
+  }
+
+  std::stringstream PCHFile;
+  PCHFile << mRSHeaderPCHDir << OS_PATH_SEPARATOR_STR
+          << "rs_core-" << mTargetAPI << "-" << TargetOpts.Triple << "-"
+          << llvm::utohexstr(llvm::HashString(KeyStr)) << ".pch";
+
+  bool Exists;
+  if (!llvm::sys::fs::exists(PCHFile.str(), Exists) && Exists)
+    return PCHFile.str();
+
+  // The errors in the RS headers (if any) are reported when compiling the
+  // input file.
+  getDiagnostics().setSuppressAllDiagnostics(true);
+  bool Created = createPCH(PCHFile.str());
+  getDiagnostics().setSuppressAllDiagnostics(false);
+  reset();
+
+  return (Created ? PCHFile.str() : "");
+}
+
+bool SlangRS::computeCacheKey(RSCompilationCache *Cache,
+                              const char *OutputFile,
+                              BitCodeStorageType BitcodeStorage,
+                              const std::string &JavaReflectionPackageName,
+                              std::vector<std::string> *Deps) {
+  Slang::SourceFileListTy Files;
+
+  // The errors (if any) are reported when compiling the input file.
+  getDiagnostics().setSuppressAllDiagnostics(true);
+  bool Preprocessed = preprocessInput(&Files);
+  getDiagnostics().setSuppressAllDiagnostics(false);
+  if (!Preprocessed) {
+    reset();
+    return false;
+  }
+
+  Cache->resetKey();
+
+  // The preprocessed input is given by every file read by the preprocessor,
+  // which also covers the macros defined in the command line (predefines.)
+  for (Slang::SourceFileListTy::const_iterator I = Files.begin(),
+          E = Files.end();
+       I != E;
+       I++) {
+    Cache->addToKey(I->Name);
+    Cache->addToKey(I->Content);
+  }
+  *Deps = getDepFiles();
+
+  const clang::TargetOptions &TargetOpts = getTargetOptions();
+  Cache->addToKey(TargetOpts.Triple);
+  Cache->addToKey(TargetOpts.CPU);
+  for (std::vector<std::string>::const_iterator
+          I = TargetOpts.Features.begin(), E = TargetOpts.Features.end();
+       I != E;
+       I++) {
+    Cache->addToKey(*I);
+  }
+
+  Cache->addToKey(getCodeGenOptions().OptimizationLevel);
+  Cache->addToKey(isOptimizingForSize());
+  Cache->addToKey(mTargetAPI);
+  Cache->addToKey(BitcodeStorage);
+  Cache->addToKey(mAllowRSPrefix);
+  Cache->addToKey(mEmitCompactMetadata);
+  Cache->addToKey(mProfileGenerate);
+  if (!mProfileUseFile.empty()) {
+    std::string Profile;
+    RSCompilationCache::ReadFile(mProfileUseFile, &Profile);
+    Cache->addToKey(Profile);
+  }
+  Cache->addToKey(mInstrumentKernels);
+  Cache->addToKey(mWarnStructPadding);
+  Cache->addToKey(JavaReflectionPackageName);
+  Cache->addToKey(mReflectionOptions.BulkAccessors);
+  Cache->addToKey(mReflectionOptions.AmortizedResize);
+  Cache->addToKey(mReflectionOptions.CachedFieldPackers);
+  Cache->addToKey(mReflectionOptions.BatchedUpdates);
+  Cache->addToKey(mReflectionOptions.PackedBitcodeAccessor);
+  Cache->addToKey(mReflectionOptions.CompressedBitcodeAccessor);
+  Cache->addToKey(mReflectionOptions.HasUsageManifest);
+  for (std::set<std::string>::const_iterator
+          I = mReflectionOptions.UsedMethods.begin(),
+          E = mReflectionOptions.UsedMethods.end();
+       I != E;
+       I++) {
+    Cache->addToKey(*I);
+  }
+
+  // The reflected classes refer to the bitcode by its file name.
+  Cache->addToKey(RSSlangReflectUtils::GetFileNameStem(OutputFile));
 
-      if (!ReflectedDefinitions.insert(ME))
-        delete ME;
+  return true;
+}
+
+bool SlangRS::restoreFromCache(const RSCompilationCache::Entry &E,
+                               const char *OutputFile,
+                               const std::string &JavaReflectionPathBase) {
+  std::string Error;
+
+  if (!SlangUtils::WriteFileIfChanged(OutputFile, E.Bitcode, &Error)) {
+    getDiagnostics().Report(clang::diag::err_fe_error_opening) << OutputFile
+                                                               << Error;
+    return false;
+  }
+
+  std::string JavaDir = RSSlangReflectUtils::ComputePackagedPath(
+      JavaReflectionPathBase.c_str(), E.PackageName.c_str());
+  if (!SlangUtils::CreateDirectoryWithParents(JavaDir, &Error)) {
+    getDiagnostics().Report(clang::diag::err_fe_error_opening) << JavaDir
+                                                               << Error;
+    return false;
+  }
+
+  for (std::vector<RSCompilationCache::JavaFileTy>::const_iterator
+          I = E.JavaFiles.begin(), IE = E.JavaFiles.end();
+       I != IE;
+       I++) {
+    std::string JavaFile = JavaDir + OS_PATH_SEPARATOR_STR + I->first +
+                           ".java";
+    if (!SlangUtils::WriteFileIfChanged(JavaFile, I->second, &Error)) {
+      getDiagnostics().Report(clang::diag::err_fe_error_opening) << JavaFile
+                                                                 << Error;
+      return false;
+    }
+    appendGeneratedFileName(JavaFile);
+  }
 
-      // Take the ownership of ERT such that it won't be freed in ~RSContext().
-      ERT->keep();
+  if (!E.BitcodeAccessor.first.empty()) {
+    std::string JavaFile = JavaDir + OS_PATH_SEPARATOR_STR +
+                           E.BitcodeAccessor.first + ".java";
+    if (!SlangUtils::WriteFileIfChanged(JavaFile, E.BitcodeAccessor.second,
+                                        &Error)) {
+      getDiagnostics().Report(clang::diag::err_fe_error_opening) << JavaFile
+                                                                 << Error;
+      return false;
     }
   }
+
+  // Replay the names of the reflected classes and the warnings.
+  getVerboseOutput() << E.Messages << std::flush;
+  getDiagnosticOutput() << E.Diagnostics;
+
+  return true;
+}
+
+bool SlangRS::collectCacheEntry(RSCompilationCache::Entry *E,
+                                const char *OutputFile,
+                                BitCodeStorageType BitcodeStorage,
+                                const std::string &JavaReflectionPathBase,
+                                const std::string &RealPackageName) {
+  if (!RSCompilationCache::ReadFile(OutputFile, &E->Bitcode))
+    return false;
+
+  E->PackageName = RealPackageName;
+
+  std::string JavaDir = RSSlangReflectUtils::ComputePackagedPath(
+      JavaReflectionPathBase.c_str(), RealPackageName.c_str());
+
+  for (std::vector<std::string>::const_iterator
+           I = mGeneratedFileNames.begin(), IE = mGeneratedFileNames.end();
+       I != IE;
+       I++) {
+    std::string Content;
+    if (!RSCompilationCache::ReadFile(
+            JavaDir + OS_PATH_SEPARATOR_STR + *I + ".java", &Content))
+      return false;
+    E->JavaFiles.push_back(std::make_pair(*I, Content));
+  }
+
+  if (BitcodeStorage == BCST_JAVA_CODE) {
+    // See RSSlangReflectUtils::GenerateBitCodeAccessor().
+    std::string ClassName = RSSlangReflectUtils::JavaClassNameFromRSFileName(
+        getInputFileName().c_str()) + "BitCode";
+    std::string Content;
+    if (!RSCompilationCache::ReadFile(
+            JavaDir + OS_PATH_SEPARATOR_STR + ClassName + ".java", &Content))
+      return false;
+    E->BitcodeAccessor = std::make_pair(ClassName, Content);
+  }
+
+  E->Diagnostics = getErrorMessage();
+
   return true;
 }
 
@@ -189,6 +610,11 @@ void SlangRS::initDiagnostic() {
       "type '%0' in different translation unit (%1 v.s. %2) "
       "has incompatible type definition");
 
+  mDiagErrorODRDatabase =
+    DiagEngine.getCustomDiagID(
+      clang::DiagnosticsEngine::Error,
+      "ODR database: %0");
+
   mDiagErrorTargetAPIRange =
     DiagEngine.getCustomDiagID(
       clang::DiagnosticsEngine::Error,
@@ -201,19 +627,32 @@ void SlangRS::initPreprocessor() {
   std::stringstream RSH;
   RSH << "#define RS_VERSION " << mTargetAPI << std::endl;
   RSH << "#include \"rs_core." RS_HEADER_SUFFIX "\"" << std::endl;
+  // Storage-only half precision floats (the arithmetic is done in float.)
+  RSH << "typedef __fp16 half;" << std::endl;
+  for (unsigned N = 2; N <= 4; N++)
+    RSH << "typedef half half" << N << " __attribute__((ext_vector_type(" << N
+        << ")));" << std::endl;
   PP.setPredefines(RSH.str());
 }
 
 void SlangRS::initASTContext() {
+  // The previous one (if any) is left by a failure to load the PCH.
+  delete mRSContext;
   mRSContext = new RSContext(getPreprocessor(),
                              getASTContext(),
                              getTargetInfo(),
+                             getLLVMContext(),
                              &mPragmas,
                              mTargetAPI,
                              &mGeneratedFileNames);
+  mRSContext->setInstrumentKernels(mInstrumentKernels);
+  mRSContext->setStructLayoutReport(mReportStructLayouts ? &mStructLayoutReport
+                                                         : NULL);
+  mRSContext->setWarnStructPadding(mWarnStructPadding);
+  mRSContext->setKernelCostReportFile(mKernelCostReportFile);
 }
 
-clang::ASTConsumer
+Backend
 *SlangRS::createBackend(const clang::CodeGenOptions& CodeGenOpts,
                         llvm::raw_ostream *OS,
                         Slang::OutputType OT) {
@@ -224,8 +663,13 @@ clang::ASTConsumer
                          &mPragmas,
                          OS,
                          OT,
+                         getExtraOutputs(),
+                         getCompileReport(),
                          getSourceManager(),
-                         mAllowRSPrefix);
+                         mAllowRSPrefix,
+                         mEmitCompactMetadata,
+                         mProfileGenerate,
+                         mProfileUseFile);
 }
 
 bool SlangRS::IsRSHeaderFile(const char *File) {
@@ -251,7 +695,12 @@ bool SlangRS::IsFunctionInRSHeaderFile(const clang::FunctionDecl *FD,
 }
 
 SlangRS::SlangRS()
-  : Slang(), mRSContext(NULL), mAllowRSPrefix(false), mTargetAPI(0) {
+  : Slang(), mRSContext(NULL), mAllowRSPrefix(false),
+    mEmitCompactMetadata(false), mProfileGenerate(false),
+    mInstrumentKernels(false), mReportStructLayouts(false),
+    mWarnStructPadding(false), mReportKernelCosts(false), mTargetAPI(0),
+    mInMemoryJavaFiles(NULL), mVerboseOutput(NULL) {
+  return;
 }
 
 bool SlangRS::compile(
@@ -274,6 +723,28 @@ bool SlangRS::compile(
 
   std::string RealPackageName;
 
+  // ODR is enforced among the files given in a single invocation, and the
+  // ones recorded in the database by the others.
+  clearReflectedDefinitions();
+  mStructLayoutReport.clear();
+
+  mODRDatabase.reset();
+  if (!mODRDatabaseFile.empty()) {
+    mODRDatabase.reset(new RSODRDatabase(mODRDatabaseFile));
+    // Their earlier definitions are replaced.
+    for (std::list<std::pair<const char*, const char*> >::const_iterator
+             I = IOFiles.begin(), E = IOFiles.end();
+         I != E;
+         I++)
+      mODRDatabase->addCompiledFile(I->first);
+
+    std::string Error;
+    if (!mODRDatabase->load(&Error)) {
+      getDiagnostics().Report(mDiagErrorODRDatabase) << Error;
+      return false;
+    }
+  }
+
   const char *InputFile, *OutputFile, *BCOutputFile, *DepOutputFile;
   std::list<std::pair<const char*, const char*> >::const_iterator
       IOFileIter = IOFiles.begin(), DepFileIter = DepFiles.begin();
@@ -294,9 +765,18 @@ bool SlangRS::compile(
     return false;
   }
 
-  // Skip generation of warnings a second time if we are doing more than just
-  // a single pass over the input file.
-  bool SuppressAllWarnings = (OutputType != Slang::OT_Dependency);
+  // Look for the PCH only after the include paths and the target API are set.
+  setPCH(mRSHeaderPCHDir.empty() ? "" : getRSHeaderPCH(IncludePaths));
+
+  // Only the full compilation is cached, and only for a single target. The
+  // shared ScriptField_* classes depend on the files compiled before. The
+  // struct layout and kernel cost reports aren't stored.
+  llvm::OwningPtr<RSCompilationCache> Cache;
+  if (!mCacheDir.empty() && (OutputType == Slang::OT_Bitcode) &&
+      !hasExtraTargets() &&
+      mReflectionOptions.SharedTypesPackageName.empty() &&
+      !mReportStructLayouts && !mReportKernelCosts)
+    Cache.reset(new RSCompilationCache(mCacheDir));
 
   for (unsigned i = 0, e = IOFiles.size(); i != e; i++) {
     InputFile = IOFileIter->first;
@@ -307,33 +787,71 @@ bool SlangRS::compile(
     if (!setInputSource(InputFile))
       return false;
 
+    RSCompilationCache::Entry CacheEntry;
+    bool Cacheable = (Cache.get() != NULL) &&
+                     computeCacheKey(Cache.get(), OutputFile, BitcodeStorage,
+                                     JavaReflectionPackageName,
+                                     &CacheEntry.Deps);
+
+    if (Cacheable && Cache->lookup(&CacheEntry)) {
+      if (!restoreFromCache(CacheEntry, OutputFile, JavaReflectionPathBase))
+        return false;
+
+      if (OutputDep) {
+        setDepTargetBC(DepFileIter->first);
+        setDepFiles(CacheEntry.Deps);
+
+        if (!setDepOutput(DepFileIter->second))
+          return false;
+
+        if (generateDepFile() > 0)
+          return false;
+
+        DepFileIter++;
+      }
+
+      if (!checkODR(InputFile, CacheEntry.ODRSignatures))
+        return false;
+
+      IOFileIter++;
+      continue;
+    }
+
     if (!setOutput(OutputFile))
       return false;
 
+    mKernelCostReportFile.clear();
+    if (mReportKernelCosts && (OutputType != Slang::OT_Dependency)) {
+      llvm::SmallString<256> ReportFile(OutputFile);
+      llvm::sys::path::replace_extension(ReportFile, "cost.json");
+      mKernelCostReportFile = ReportFile.str().str();
+    }
+
     if (Slang::compile() > 0)
       return false;
 
     if (OutputType != Slang::OT_Dependency) {
-      if (!reflectToJava(JavaReflectionPathBase,
-                         JavaReflectionPackageName,
-                         &RealPackageName))
-        return false;
-
-      for (std::vector<std::string>::const_iterator
-               I = mGeneratedFileNames.begin(), E = mGeneratedFileNames.end();
-           I != E;
-           I++) {
-        std::string ReflectedName = RSSlangReflectUtils::ComputePackagedPath(
-            JavaReflectionPathBase.c_str(),
-            (RealPackageName + OS_PATH_SEPARATOR_STR + *I).c_str());
-        appendGeneratedFileName(ReflectedName + ".java");
+      // Keep what the reflection prints with the cached outputs, such that a
+      // hit prints the same.
+      std::ostringstream Messages;
+      std::ostream *VerboseOutput = mVerboseOutput;
+      if (Cacheable)
+        mVerboseOutput = &Messages;
+
+      bool Reflected = reflect(JavaReflectionPathBase,
+                               JavaReflectionPackageName,
+                               (OutputType == Slang::OT_Bitcode) &&
+                                   (BitcodeStorage == BCST_JAVA_CODE),
+                               &RealPackageName);
+
+      mVerboseOutput = VerboseOutput;
+      if (Cacheable) {
+        CacheEntry.Messages = Messages.str();
+        getVerboseOutput() << CacheEntry.Messages << std::flush;
       }
 
-      if ((OutputType == Slang::OT_Bitcode) &&
-          (BitcodeStorage == BCST_JAVA_CODE) &&
-          !generateBitcodeAccessor(JavaReflectionPathBase,
-                                     RealPackageName.c_str()))
-          return false;
+      if (!Reflected)
+        return false;
     }
 
     if (OutputDep) {
@@ -345,27 +863,108 @@ bool SlangRS::compile(
       if (!setDepOutput(DepOutputFile))
         return false;
 
-      if (SuppressAllWarnings) {
-        getDiagnostics().setSuppressAllDiagnostics(true);
-      }
+      // The dependencies were recorded by the compilation above.
       if (generateDepFile() > 0)
         return false;
-      if (SuppressAllWarnings) {
-        getDiagnostics().setSuppressAllDiagnostics(false);
-      }
 
       DepFileIter++;
     }
 
-    if (!checkODR(InputFile))
+    ODRSignatureListTy ODRSignatures;
+    collectODRSignatures(&ODRSignatures);
+    if (!checkODR(InputFile, ODRSignatures))
       return false;
 
+    // Failing to store the outputs only slows down the next compilation.
+    if (Cacheable) {
+      CacheEntry.ODRSignatures = ODRSignatures;
+      if (collectCacheEntry(&CacheEntry, OutputFile, BitcodeStorage,
+                            JavaReflectionPathBase, RealPackageName))
+        Cache->store(CacheEntry);
+    }
+
     IOFileIter++;
   }
 
+  if (mODRDatabase) {
+    RSODRDatabase::ConflictListTy Conflicts;
+    std::string Error;
+    if (!mODRDatabase->commit(&Conflicts, &Error)) {
+      // Defined meanwhile by another invocation
+      for (RSODRDatabase::ConflictListTy::const_iterator I = Conflicts.begin(),
+              E = Conflicts.end();
+           I != E;
+           I++) {
+        getDiagnostics().Report(mDiagErrorODR) << I->first.Name
+                                               << I->first.File
+                                               << I->second.File;
+      }
+      if (Conflicts.empty())
+        getDiagnostics().Report(mDiagErrorODRDatabase) << Error;
+      return false;
+    }
+  }
+
   return true;
 }
 
+bool SlangRS::compileFromMemory(llvm::StringRef InputFile,
+                                llvm::StringRef Text,
+                                const std::vector<std::string> &IncludePaths,
+                                bool AllowRSPrefix,
+                                unsigned int TargetAPI,
+                                const std::string &JavaReflectionPackageName,
+                                InMemoryOutputs *Outputs) {
+  Outputs->Bitcode.clear();
+  Outputs->PackageName.clear();
+  Outputs->JavaFiles.clear();
+  Outputs->Deps.clear();
+  Outputs->Diagnostics.clear();
+
+  reset();
+  flushFileCache();
+  clearReflectedDefinitions();
+  mStructLayoutReport.clear();
+
+  setIncludePaths(IncludePaths);
+  setOutputType(Slang::OT_Bitcode);
+  mAllowRSPrefix = AllowRSPrefix;
+  mKernelCostReportFile.clear();
+
+  bool Success = true;
+  mTargetAPI = TargetAPI;
+  if (mTargetAPI < SLANG_MINIMUM_TARGET_API ||
+      mTargetAPI > SLANG_MAXIMUM_TARGET_API) {
+    getDiagnostics().Report(mDiagErrorTargetAPIRange) << mTargetAPI
+        << SLANG_MINIMUM_TARGET_API << SLANG_MAXIMUM_TARGET_API;
+    Success = false;
+  }
+
+  if (Success) {
+    setPCH(mRSHeaderPCHDir.empty() ? "" : getRSHeaderPCH(IncludePaths));
+
+    // The output is named as llvm-rs-cc would, which gives the reflected
+    // resource ID.
+    std::string OutputFile = llvm::sys::path::stem(InputFile).str() + ".bc";
+    Success = setInputSource(InputFile, Text.data(), Text.size()) &&
+              setOutputBuffer(OutputFile.c_str(), &Outputs->Bitcode) &&
+              (Slang::compile() == 0);
+  }
+
+  if (Success) {
+    mInMemoryJavaFiles = &Outputs->JavaFiles;
+    Success = reflectToJava("", JavaReflectionPackageName,
+                            &Outputs->PackageName);
+    mInMemoryJavaFiles = NULL;
+  }
+
+  if (Success)
+    Outputs->Deps = getDepFiles();
+  Outputs->Diagnostics = getDiagnosticBuffer().getEntries();
+
+  return Success;
+}
+
 void SlangRS::reset() {
   delete mRSContext;
   mRSContext = NULL;
@@ -374,14 +973,15 @@ void SlangRS::reset() {
   return;
 }
 
+void SlangRS::clearReflectedDefinitions() {
+  ReflectedDefinitions.clear();
+  ReflectedDefinitions.getAllocator().Reset();
+  return;
+}
+
 SlangRS::~SlangRS() {
   delete mRSContext;
-  for (ReflectedDefinitionListTy::iterator I = ReflectedDefinitions.begin(),
-          E = ReflectedDefinitions.end();
-       I != E;
-       I++) {
-    delete I->getValue().first;
-  }
+  clearReflectedDefinitions();
   return;
 }
 
@@ -19,13 +19,20 @@
 
 #include "slang.h"
 
+#include <iosfwd>
 #include <list>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "llvm/ADT/OwningPtr.h"
 #include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
 
+#include "llvm/Support/Allocator.h"
+
+#include "slang_rs_cache.h"
+#include "slang_rs_odr_database.h"
 #include "slang_rs_reflect_utils.h"
 #include "slang_version.h"
 
@@ -44,26 +51,86 @@ class SlangRS : public Slang {
 
   bool mAllowRSPrefix;
 
+  // See RSBackend::EmitCompactMetadata()
+  bool mEmitCompactMetadata;
+
+  // See RSProfile
+  bool mProfileGenerate;
+  std::string mProfileUseFile;
+
+  // See RSContext::getInstrumentedFuncs()
+  bool mInstrumentKernels;
+
+  // See RSContext::processStructLayouts()
+  bool mReportStructLayouts;
+  bool mWarnStructPadding;
+  std::string mStructLayoutReport;
+
+  // See RSKernelCost. The report of the input file being compiled goes to
+  // mKernelCostReportFile.
+  bool mReportKernelCosts;
+  std::string mKernelCostReportFile;
+
   unsigned int mTargetAPI;
 
   // Custom diagnostic identifiers
   unsigned mDiagErrorInvalidOutputDepParameter;
   unsigned mDiagErrorODR;
+  unsigned mDiagErrorODRDatabase;
   unsigned mDiagErrorTargetAPIRange;
 
   // Collect generated filenames (without the .java) for dependency generation
   std::vector<std::string> mGeneratedFileNames;
 
+  // Where the precompiled RS runtime headers are kept (disabled if empty)
+  std::string mRSHeaderPCHDir;
+
+  // Find (or create if not exist) the precompiled RS runtime headers
+  // applicable to the current target API, target and include paths. Return
+  // the empty string when unavailable.
+  std::string getRSHeaderPCH(const std::vector<std::string> &IncludePaths);
+
+  // Where compileFromMemory() collects the reflected classes (NULL otherwise)
+  std::vector<RSCompilationCache::JavaFileTy> *mInMemoryJavaFiles;
+
+  // See ReflectionOptions::VerboseOutput
+  std::ostream *mVerboseOutput;
+
+  // Where the compilation cache is kept (disabled if empty)
+  std::string mCacheDir;
+
+  // The record types defined by the other invocations sharing the database in
+  // mODRDatabaseFile (disabled if empty), loaded by compile()
+  std::string mODRDatabaseFile;
+  llvm::OwningPtr<RSODRDatabase> mODRDatabase;
+
+  ReflectionOptions mReflectionOptions;
+
   // FIXME: Should be std::list<RSExportable *> here. But currently we only
   //        check ODR on record type.
   //
   // ReflectedDefinitions maps record type name to a pair:
-  //  <its RSExportRecordType instance,
+  //  <the signature of its definition (see collectODRSignatures()),
   //   the first file contains this record type definition>
-  typedef std::pair<RSExportRecordType*, const char*> ReflectedDefinitionTy;
-  typedef llvm::StringMap<ReflectedDefinitionTy> ReflectedDefinitionListTy;
+  //
+  // Unlike the exportables (which go away with the RSContext of each input
+  // file), the entries live across the input files. Both the entries and the
+  // signatures (see saveODRSignature()) are in the allocator of the map, which
+  // is released by clearReflectedDefinitions().
+  typedef std::pair<llvm::StringRef, const char*> ReflectedDefinitionTy;
+  typedef llvm::StringMap<ReflectedDefinitionTy, llvm::BumpPtrAllocator>
+      ReflectedDefinitionListTy;
   ReflectedDefinitionListTy ReflectedDefinitions;
 
+  // Copy @Signature into the allocator of ReflectedDefinitions.
+  llvm::StringRef saveODRSignature(llvm::StringRef Signature);
+
+  // List of <record type name, signature>
+  typedef std::vector<std::pair<std::string, std::string> >
+      ODRSignatureListTy;
+
+  void clearReflectedDefinitions();
+
   // The package name that's really applied will be filled in RealPackageName.
   bool reflectToJava(const std::string &OutputPathBase,
                      const std::string &OutputPackageName,
@@ -72,16 +139,53 @@ class SlangRS : public Slang {
   bool generateBitcodeAccessor(const std::string &OutputPathBase,
                                const std::string &PackageName);
 
+  // Reflect the current input file (see reflectToJava()), and write its
+  // bitcode accessor too if @WithBitcodeAccessor.
+  bool reflect(const std::string &JavaReflectionPathBase,
+               const std::string &JavaReflectionPackageName,
+               bool WithBitcodeAccessor,
+               std::string *RealPackageName);
+
+  // Where the names of the reflected classes are printed (see
+  // setVerboseOutput())
+  std::ostream &getVerboseOutput();
+
+  // Collect the signatures of the record types defined by the current input
+  // file, which are the same iff the record types have the same "definition".
+  void collectODRSignatures(ODRSignatureListTy *Signatures);
+
   // CurInputFile is the pointer to a char array holding the input filename
   // and is valid before compile() ends.
-  bool checkODR(const char *CurInputFile);
+  bool checkODR(const char *CurInputFile,
+                const ODRSignatureListTy &Signatures);
+
+  // Compute the key of the current input file in @Cache, and collect the
+  // files it depends on to @Deps. Return false if it can't be preprocessed.
+  bool computeCacheKey(RSCompilationCache *Cache,
+                       const char *OutputFile,
+                       BitCodeStorageType BitcodeStorage,
+                       const std::string &JavaReflectionPackageName,
+                       std::vector<std::string> *Deps);
+
+  // Write out the outputs of the current input file kept in @E.
+  bool restoreFromCache(const RSCompilationCache::Entry &E,
+                        const char *OutputFile,
+                        const std::string &JavaReflectionPathBase);
+
+  // Fill @E with the outputs of the current input file (except the
+  // dependencies, see computeCacheKey().)
+  bool collectCacheEntry(RSCompilationCache::Entry *E,
+                         const char *OutputFile,
+                         BitCodeStorageType BitcodeStorage,
+                         const std::string &JavaReflectionPathBase,
+                         const std::string &RealPackageName);
 
  protected:
   virtual void initDiagnostic();
   virtual void initPreprocessor();
   virtual void initASTContext();
 
-  virtual clang::ASTConsumer
+  virtual Backend
   *createBackend(const clang::CodeGenOptions& CodeGenOpts,
                  llvm::raw_ostream *OS,
                  Slang::OutputType OT);
@@ -97,6 +201,55 @@ class SlangRS : public Slang {
 
   SlangRS();
 
+  // Enable caching the precompiled RS runtime headers (e.g. rs_core.rsh) in
+  // @Dir, which are used to avoid parsing them for every input file.
+  void setRSHeaderPCHDir(const std::string &Dir) { mRSHeaderPCHDir = Dir; }
+
+  // Enable caching the outputs of compile() in @Dir, which are restored
+  // instead of compiling the input files again if nothing they depend on has
+  // changed.
+  void setCacheDir(const std::string &Dir) { mCacheDir = Dir; }
+
+  // Check the ODR against and record the definitions of the record types in
+  // the database @File shared by separate invocations (see RSODRDatabase.)
+  void setODRDatabase(const std::string &File) { mODRDatabaseFile = File; }
+
+  void setReflectionOptions(const ReflectionOptions &Options) {
+    mReflectionOptions = Options;
+  }
+
+  // Emit the compact export metadata (see slang_rs_metadata_spec.h) alongside
+  // the legacy one.
+  void setEmitCompactMetadata(bool Emit) { mEmitCompactMetadata = Emit; }
+
+  // Instrument the code to collect a profile, or optimize it by the profile
+  // in @File (see RSProfile.)
+  void setProfileGenerate(bool Generate) { mProfileGenerate = Generate; }
+  void setProfileUseFile(const std::string &File) { mProfileUseFile = File; }
+
+  // Time the kernels, root(), init() and the invokable functions, and reflect
+  // getProfile() to read the counts.
+  void setInstrumentKernels(bool Instrument) {
+    mInstrumentKernels = Instrument;
+  }
+
+  // Describe the layout of the exported structs of each input file (see
+  // RSStructLayout) into getStructLayoutReport(), and/or warn about the ones
+  // whose fields could be declared in an order with less padding.
+  void setReportStructLayouts(bool Report) { mReportStructLayouts = Report; }
+  void setWarnStructPadding(bool Warn) { mWarnStructPadding = Warn; }
+  const std::string &getStructLayoutReport() const {
+    return mStructLayoutReport;
+  }
+
+  // Write the costs of the kernels and the invokable functions of each input
+  // file (see RSKernelCost) to <output file stem>.cost.json.
+  void setReportKernelCosts(bool Report) { mReportKernelCosts = Report; }
+
+  // Print the names of the reflected classes to @OS instead of std::cout (if
+  // NULL), e.g., to buffer the output of a compile job.
+  void setVerboseOutput(std::ostream *OS) { mVerboseOutput = OS; }
+
   // Compile bunch of RS files given in the llvm-rs-cc arguments. Return true if
   // all given input files are successfully compiled without errors.
   //
@@ -134,6 +287,46 @@ class SlangRS : public Slang {
                const std::string &JavaReflectionPathBase,
                const std::string &JavaReflectionPackageName);
 
+  // Check ODR (see checkODR()) between the record types reflected by this
+  // compiler and those by @Other, which compiled a disjoint set of input files
+  // (e.g., on another thread). Record types first seen in @Other are taken
+  // over by this compiler such that the merge can be repeated for any number of
+  // compilers. Both compile() must have been returned.
+  bool mergeODR(SlangRS &Other);
+
+  // The outputs of compileFromMemory()
+  struct InMemoryOutputs {
+    std::string Bitcode;
+
+    // The package of the reflected classes, and <fully qualified class name,
+    // source> of each of them
+    std::string PackageName;
+    std::vector<RSCompilationCache::JavaFileTy> JavaFiles;
+
+    // The files the input depends on (the first is the input itself)
+    std::vector<std::string> Deps;
+
+    std::vector<DiagnosticBuffer::Entry> Diagnostics;
+  };
+
+  // Compile the RS source @Text, named @InputFile, to the bitcode and reflect
+  // it without touching the file system except for reading the headers. The
+  // compiler (e.g., its LLVM context and the precompiled RS headers) is
+  // reused across the calls, and the headers are read again by each one such
+  // that their modifications are seen. The other parameters are the ones of
+  // compile(). Nothing is cached, and -reflect-shared-types-package,
+  // -odr-database and the bitcode accessor are not applicable.
+  //
+  // Return true if successful. The diagnostics are in @Outputs either way
+  // (and are also written to the diagnostic output on the next reset(), see
+  // setDiagnosticOutput().)
+  bool compileFromMemory(llvm::StringRef InputFile, llvm::StringRef Text,
+                         const std::vector<std::string> &IncludePaths,
+                         bool AllowRSPrefix,
+                         unsigned int TargetAPI,
+                         const std::string &JavaReflectionPackageName,
+                         InMemoryOutputs *Outputs);
+
   virtual void reset();
 
   virtual ~SlangRS();
@@ -26,117 +26,117 @@ void RSASTReplace::ReplaceStmt(
     clang::Stmt *OuterStmt,
     clang::Stmt *OldStmt,
     clang::Stmt *NewStmt) {
-  mOldStmt = OldStmt;
-  mNewStmt = NewStmt;
-  mOuterStmt = OuterStmt;
+  ReplacementMap Replacements;
+  Replacements[OldStmt] = NewStmt;
+  ReplaceStmts(OuterStmt, Replacements);
+  return;
+}
 
-  // This simplifies use in various Stmt visitor passes where the only
-  // valid type is an Expr.
-  mOldExpr = llvm::dyn_cast<clang::Expr>(OldStmt);
-  if (mOldExpr) {
-    mNewExpr = llvm::dyn_cast<clang::Expr>(NewStmt);
-  }
-  Visit(mOuterStmt);
+void RSASTReplace::ReplaceStmts(
+    clang::Stmt *OuterStmt,
+    const ReplacementMap &Replacements) {
+  mReplacements = &Replacements;
+  Visit(OuterStmt);
+  mReplacements = NULL;
+  return;
 }
 
-void RSASTReplace::ReplaceInCompoundStmt(clang::CompoundStmt *CS) {
-  clang::Stmt **UpdatedStmtList = new clang::Stmt*[CS->size()];
+clang::Stmt *RSASTReplace::replaceStmt(clang::Stmt *S) {
+  if (S == NULL) {
+    return NULL;
+  }
 
-  unsigned UpdatedStmtCount = 0;
-  clang::CompoundStmt::body_iterator bI = CS->body_begin();
-  clang::CompoundStmt::body_iterator bE = CS->body_end();
+  Visit(S);
 
-  for ( ; bI != bE; bI++) {
-    if (matchesStmt(*bI)) {
-      UpdatedStmtList[UpdatedStmtCount++] = mNewStmt;
-    } else {
-      UpdatedStmtList[UpdatedStmtCount++] = *bI;
-    }
+  clang::Stmt *NewStmt = getReplacement(S);
+  return NewStmt ? NewStmt : S;
+}
+
+clang::Expr *RSASTReplace::replaceExpr(clang::Expr *E) {
+  if (E == NULL) {
+    return NULL;
   }
 
-  CS->setStmts(C, UpdatedStmtList, UpdatedStmtCount);
+  Visit(E);
 
-  delete [] UpdatedStmtList;
+  clang::Stmt *NewStmt = getReplacement(E);
+  if (NewStmt == NULL) {
+    return E;
+  }
 
-  return;
+  // This simplifies use in various Stmt visitor passes where the only
+  // valid type is an Expr.
+  clang::Expr *NewExpr = llvm::dyn_cast<clang::Expr>(NewStmt);
+  slangAssert(NewExpr &&
+      "Cannot replace an expression if we don't have a new expression");
+  return NewExpr;
 }
 
 void RSASTReplace::VisitStmt(clang::Stmt *S) {
   // This function does the actual iteration through all sub-Stmt's within
-  // a given Stmt. Note that this function is skipped by all of the other
-  // Visit* functions if we have already found a higher-level match.
+  // a given Stmt. Note that the sub-Stmt's are only replaced by the other
+  // Visit* functions.
   for (clang::Stmt::child_iterator I = S->child_begin(), E = S->child_end();
        I != E;
        I++) {
     if (clang::Stmt *Child = *I) {
-      if (!matchesStmt(Child)) {
-        Visit(Child);
-      }
+      Visit(Child);
     }
   }
   return;
 }
 
 void RSASTReplace::VisitCompoundStmt(clang::CompoundStmt *CS) {
-  VisitStmt(CS);
-  ReplaceInCompoundStmt(CS);
+  clang::Stmt **UpdatedStmtList = new clang::Stmt*[CS->size()];
+
+  unsigned UpdatedStmtCount = 0;
+  bool Changed = false;
+  clang::CompoundStmt::body_iterator bI = CS->body_begin();
+  clang::CompoundStmt::body_iterator bE = CS->body_end();
+
+  for ( ; bI != bE; bI++) {
+    clang::Stmt *S = replaceStmt(*bI);
+    Changed |= (S != *bI);
+    UpdatedStmtList[UpdatedStmtCount++] = S;
+  }
+
+  if (Changed) {
+    CS->setStmts(C, UpdatedStmtList, UpdatedStmtCount);
+  }
+
+  delete [] UpdatedStmtList;
+
   return;
 }
 
 void RSASTReplace::VisitCaseStmt(clang::CaseStmt *CS) {
-  if (matchesStmt(CS->getSubStmt())) {
-    CS->setSubStmt(mNewStmt);
-  } else {
-    VisitStmt(CS);
-  }
+  CS->setSubStmt(replaceStmt(CS->getSubStmt()));
   return;
 }
 
 void RSASTReplace::VisitDefaultStmt(clang::DefaultStmt *DS) {
-  if (matchesStmt(DS->getSubStmt())) {
-    DS->setSubStmt(mNewStmt);
-  } else {
-    VisitStmt(DS);
-  }
+  DS->setSubStmt(replaceStmt(DS->getSubStmt()));
   return;
 }
 
 void RSASTReplace::VisitDoStmt(clang::DoStmt *DS) {
-  if (matchesExpr(DS->getCond())) {
-    DS->setCond(mNewExpr);
-  } else if (matchesStmt(DS->getBody())) {
-    DS->setBody(mNewStmt);
-  } else {
-    VisitStmt(DS);
-  }
+  DS->setCond(replaceExpr(DS->getCond()));
+  DS->setBody(replaceStmt(DS->getBody()));
   return;
 }
 
 void RSASTReplace::VisitForStmt(clang::ForStmt *FS) {
-  if (matchesStmt(FS->getInit())) {
-    FS->setInit(mNewStmt);
-  } else if (matchesExpr(FS->getCond())) {
-    FS->setCond(mNewExpr);
-  } else if (matchesExpr(FS->getInc())) {
-    FS->setInc(mNewExpr);
-  } else if (matchesStmt(FS->getBody())) {
-    FS->setBody(mNewStmt);
-  } else {
-    VisitStmt(FS);
-  }
+  FS->setInit(replaceStmt(FS->getInit()));
+  FS->setCond(replaceExpr(FS->getCond()));
+  FS->setInc(replaceExpr(FS->getInc()));
+  FS->setBody(replaceStmt(FS->getBody()));
   return;
 }
 
 void RSASTReplace::VisitIfStmt(clang::IfStmt *IS) {
-  if (matchesExpr(IS->getCond())) {
-    IS->setCond(mNewExpr);
-  } else if (matchesStmt(IS->getThen())) {
-    IS->setThen(mNewStmt);
-  } else if (matchesStmt(IS->getElse())) {
-    IS->setElse(mNewStmt);
-  } else {
-    VisitStmt(IS);
-  }
+  IS->setCond(replaceExpr(IS->getCond()));
+  IS->setThen(replaceStmt(IS->getThen()));
+  IS->setElse(replaceStmt(IS->getElse()));
   return;
 }
 
@@ -147,22 +147,16 @@ void RSASTReplace::VisitSwitchCase(clang::SwitchCase *SC) {
 }
 
 void RSASTReplace::VisitSwitchStmt(clang::SwitchStmt *SS) {
-  if (matchesExpr(SS->getCond())) {
-    SS->setCond(mNewExpr);
-  } else {
-    VisitStmt(SS);
+  SS->setCond(replaceExpr(SS->getCond()));
+  if (SS->getBody()) {
+    Visit(SS->getBody());
   }
   return;
 }
 
 void RSASTReplace::VisitWhileStmt(clang::WhileStmt *WS) {
-  if (matchesExpr(WS->getCond())) {
-    WS->setCond(mNewExpr);
-  } else if (matchesStmt(WS->getBody())) {
-    WS->setBody(mNewStmt);
-  } else {
-    VisitStmt(WS);
-  }
+  WS->setCond(replaceExpr(WS->getCond()));
+  WS->setBody(replaceStmt(WS->getBody()));
   return;
 }
 
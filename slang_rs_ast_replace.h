@@ -19,6 +19,8 @@
 
 #include "clang/AST/StmtVisitor.h"
 
+#include "llvm/ADT/DenseMap.h"
+
 #include "slang_assert.h"
 #include "clang/AST/ASTContext.h"
 
@@ -31,38 +33,28 @@ namespace clang {
 namespace slang {
 
 class RSASTReplace : public clang::StmtVisitor<RSASTReplace> {
+ public:
+  // Old Stmt -> new Stmt
+  typedef llvm::DenseMap<clang::Stmt*, clang::Stmt*> ReplacementMap;
+
  private:
   clang::ASTContext &C;
-  clang::Stmt *mOuterStmt;
-  clang::Stmt *mOldStmt;
-  clang::Stmt *mNewStmt;
-  clang::Expr *mOldExpr;
-  clang::Expr *mNewExpr;
-
-  inline bool matchesExpr(const clang::Expr *E) const {
-    bool retVal = mOldExpr && (mOldExpr == E);
-    if (retVal) {
-      slangAssert(mNewExpr &&
-          "Cannot replace an expression if we don't have a new expression");
-    }
-    return retVal;
-  }
+  const ReplacementMap *mReplacements;
 
-  inline bool matchesStmt(const clang::Stmt *S) const {
-    slangAssert(mOldStmt);
-    return mOldStmt == S;
+  inline clang::Stmt *getReplacement(clang::Stmt *S) const {
+    ReplacementMap::const_iterator I = mReplacements->find(S);
+    return (I != mReplacements->end()) ? I->second : NULL;
   }
 
-  void ReplaceInCompoundStmt(clang::CompoundStmt *CS);
+  // Visit S (which may be NULL) and return what replaces it (S itself if it's
+  // not replaced.) The replacements are not visited.
+  clang::Stmt *replaceStmt(clang::Stmt *S);
+  clang::Expr *replaceExpr(clang::Expr *E);
 
  public:
   explicit RSASTReplace(clang::ASTContext &Con)
       : C(Con),
-        mOuterStmt(NULL),
-        mOldStmt(NULL),
-        mNewStmt(NULL),
-        mOldExpr(NULL),
-        mNewExpr(NULL) {
+        mReplacements(NULL) {
     return;
   }
 
@@ -82,6 +74,12 @@ class RSASTReplace : public clang::StmtVisitor<RSASTReplace> {
       clang::Stmt *OuterStmt,
       clang::Stmt *OldStmt,
       clang::Stmt *NewStmt);
+
+  // Replace all instances of each Stmt in Replacements within OuterStmt in a
+  // single traversal.
+  void ReplaceStmts(
+      clang::Stmt *OuterStmt,
+      const ReplacementMap &Replacements);
 };
 
 }  // namespace slang
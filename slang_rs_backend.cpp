@@ -16,6 +16,8 @@
 
 #include "slang_rs_backend.h"
 
+#include <cstring>
+#include <list>
 #include <string>
 #include <vector>
 
@@ -26,19 +28,35 @@
 #include "llvm/Constants.h"
 #include "llvm/DerivedTypes.h"
 #include "llvm/Function.h"
+#include "llvm/GlobalVariable.h"
+#include "llvm/Instructions.h"
+#include "llvm/Intrinsics.h"
 #include "llvm/Metadata.h"
 #include "llvm/Module.h"
 
 #include "llvm/Support/IRBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "llvm/Target/TargetData.h"
+
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
 
 #include "slang_assert.h"
 #include "slang_rs.h"
 #include "slang_rs_context.h"
+#include "slang_rs_element_access.h"
 #include "slang_rs_export_foreach.h"
 #include "slang_rs_export_func.h"
+#include "slang_rs_export_reduce.h"
 #include "slang_rs_export_type.h"
 #include "slang_rs_export_var.h"
+#include "slang_rs_kernel_cost.h"
 #include "slang_rs_metadata.h"
+#include "slang_rs_metadata_spec.h"
+#include "slang_rs_profile.h"
+#include "slang_rs_type_spec.h"
+#include "slang_utils.h"
+#include "slang_version.h"
 
 namespace slang {
 
@@ -49,18 +67,31 @@ RSBackend::RSBackend(RSContext *Context,
                      PragmaList *Pragmas,
                      llvm::raw_ostream *OS,
                      Slang::OutputType OT,
+                     const std::vector<Slang::CodeGenOutput> &ExtraOutputs,
+                     CompileReport *Report,
                      clang::SourceManager &SourceMgr,
-                     bool AllowRSPrefix)
-  : Backend(DiagEngine, CodeGenOpts, TargetOpts, Pragmas, OS, OT),
+                     bool AllowRSPrefix,
+                     bool EmitCompactMetadata,
+                     bool ProfileGenerate,
+                     const std::string &ProfileUseFile)
+  : Backend(Context->getLLVMContext(), DiagEngine, CodeGenOpts, TargetOpts,
+            Pragmas, OS, OT, ExtraOutputs, Report),
     mContext(Context),
     mSourceMgr(SourceMgr),
     mAllowRSPrefix(AllowRSPrefix),
+    mEmitCompactMetadata(EmitCompactMetadata),
+    mProfileGenerate(ProfileGenerate),
+    mProfileUseFile(ProfileUseFile),
     mExportVarMetadata(NULL),
     mExportFuncMetadata(NULL),
+    mExportForEachNameMetadata(NULL),
     mExportForEachMetadata(NULL),
+    mExportForEachParamMetadata(NULL),
+    mExportReduceMetadata(NULL),
     mExportTypeMetadata(NULL),
     mRSObjectSlotsMetadata(NULL),
-    mRefCount(mContext->getASTContext()) {
+    mRefCount(mContext->getASTContext()),
+    mFPPrecision(FP_Full) {
 }
 
 // 1) Add zero initialization of local RS object types
@@ -68,9 +99,212 @@ void RSBackend::AnnotateFunction(clang::FunctionDecl *FD) {
   if (FD &&
       FD->hasBody() &&
       !SlangRS::IsFunctionInRSHeaderFile(FD, mSourceMgr)) {
+    CompileReport::PhaseScope Scope(mReport, CompileReport::PhaseRefCount);
     mRefCount.Init();
     mRefCount.Visit(FD->getBody());
   }
+
+  // Emit the helpers clearing/setting the RS objects in structs that were
+  // created for FD. They are static and never referred to by the source, so
+  // they don't need any of the checks and annotations in
+  // HandleTopLevelDecl().
+  std::list<clang::FunctionDecl*> HelperFDs;
+  mRefCount.takeHelperFunctions(&HelperFDs);
+  for (std::list<clang::FunctionDecl*>::const_iterator I = HelperFDs.begin(),
+          E = HelperFDs.end();
+       I != E;
+       I++) {
+    Backend::HandleTopLevelDecl(clang::DeclGroupRef(*I));
+  }
+  return;
+}
+
+unsigned RSBackend::AnnotateForEachParams(llvm::Module *M,
+                                          const RSExportForEach *EFE) {
+  unsigned Encoding = EFE->getMetadataEncoding();
+  unsigned Access = 0;
+  if (Encoding & 0x01)
+    Access |= RS_FOREACH_ACCESS_IN_READ_ONLY;
+  if (Encoding & 0x04)
+    Access |= RS_FOREACH_ACCESS_USRDATA_READ_ONLY;
+
+  // Without #pragma rs noalias, a kernel may be launched in place (i.e., with
+  // the same allocation as in and out).
+  llvm::Function *F = M->getFunction(EFE->getName());
+  if (EFE->isDummyRoot() || !EFE->isNoAlias() || (F == NULL) ||
+      F->isDeclaration())
+    return Access;
+
+  // The in, out and usrData (as validated by RSExportForEach) are the leading
+  // parameters. The pragma promises that they point to distinct cells (and
+  // the reflected forEach_*() rejects the same allocation for in and out.)
+  unsigned NumPointers = 0;
+  for (unsigned Bit = 0x01; Bit <= 0x04; Bit <<= 1) {
+    if (Encoding & Bit)
+      NumPointers++;
+  }
+
+  llvm::Function::arg_iterator Arg = F->arg_begin();
+  for (unsigned i = 0; i < NumPointers; i++, Arg++) {
+    if ((Arg == F->arg_end()) || !Arg->getType()->isPointerTy())
+      return Access;
+  }
+  for (unsigned i = 0; i < NumPointers; i++) {
+    // Attribute index 0 is the return value
+    F->addAttribute(i + 1, llvm::Attribute::NoAlias);
+  }
+
+  return Access | RS_FOREACH_ACCESS_NO_ALIAS;
+}
+
+void RSBackend::VectorizeForEach(llvm::Module *M,
+                                 const RSExportForEach *EFE) {
+  unsigned Width = EFE->getVectorWidth();
+  llvm::Function *F = M->getFunction(EFE->getName());
+  if ((Width <= 1) || (F == NULL) || F->isDeclaration())
+    return;
+
+  // foo.xN(in, out, usrData, x, ...) has the same parameters as foo. It calls
+  // foo on the N cells starting at in and out (i.e., x to x + N - 1), and the
+  // calls are inlined by the optimizer such that the N iterations end up in
+  // one straight-line block the code generator can combine.
+  llvm::Function *Widened =
+      llvm::Function::Create(F->getFunctionType(),
+                             llvm::GlobalValue::ExternalLinkage,
+                             EFE->getName() + ".x" + llvm::utostr_32(Width),
+                             M);
+  Widened->setCallingConv(F->getCallingConv());
+  Widened->setAttributes(F->getAttributes());
+  F->addFnAttr(llvm::Attribute::InlineHint);
+
+  unsigned Encoding = EFE->getMetadataEncoding();
+  unsigned InArg = 0, OutArg = 0, XArg = 0;
+  unsigned NumArgs = 0;
+  if (Encoding & 0x01)
+    InArg = ++NumArgs;
+  if (Encoding & 0x02)
+    OutArg = ++NumArgs;
+  if (Encoding & 0x04)
+    ++NumArgs;
+  if (Encoding & 0x08)
+    XArg = ++NumArgs;
+
+  llvm::BasicBlock *BB =
+      llvm::BasicBlock::Create(mLLVMContext, "entry", Widened);
+  llvm::IRBuilder<> IB(BB);
+  llvm::SmallVector<llvm::Value*, 6> Args;
+
+  for (unsigned i = 0; i < Width; i++) {
+    llvm::Value *Offset =
+        llvm::ConstantInt::get(llvm::Type::getInt32Ty(mLLVMContext), i);
+    unsigned ArgNo = 1;
+    for (llvm::Function::arg_iterator AI = Widened->arg_begin(),
+            AE = Widened->arg_end();
+         AI != AE;
+         AI++, ArgNo++) {
+      llvm::Value *Arg = AI;
+      if (i != 0) {
+        if ((ArgNo == InArg) || (ArgNo == OutArg))
+          Arg = IB.CreateInBoundsGEP(Arg, Offset);
+        else if (ArgNo == XArg)
+          Arg = IB.CreateAdd(Arg, Offset);
+      }
+      Args.push_back(Arg);
+    }
+
+    llvm::CallInst *CI = IB.CreateCall(F, Args);
+    CI->setCallingConv(F->getCallingConv());
+    Args.clear();
+  }
+  IB.CreateRetVoid();
+
+  return;
+}
+
+void RSBackend::FuseForEach(llvm::Module *M, const RSExportForEach *EFE) {
+  const std::vector<const RSExportForEach*> &Stages = EFE->getStages();
+
+  // The IR functions of the stages, whose leading parameters are in, out (as
+  // validated by RSContext, they take no usrData), x and y as they have them
+  std::vector<llvm::Function*> StageFuncs;
+  for (unsigned i = 0, e = Stages.size(); i != e; i++) {
+    llvm::Function *F = M->getFunction(Stages[i]->getName());
+    if ((F == NULL) || F->isDeclaration())
+      return;
+    StageFuncs.push_back(F);
+  }
+
+  llvm::Type *Int32Ty = llvm::Type::getInt32Ty(mLLVMContext);
+  unsigned Encoding = EFE->getMetadataEncoding();
+  std::vector<llvm::Type*> ParamTys;
+  if (Encoding & 0x01)
+    ParamTys.push_back(StageFuncs.front()->getFunctionType()->getParamType(0));
+  if (Encoding & 0x02) {
+    unsigned LastEncoding = Stages.back()->getMetadataEncoding();
+    ParamTys.push_back(StageFuncs.back()->getFunctionType()->getParamType(
+        (LastEncoding & 0x01) ? 1 : 0));
+  }
+  if (Encoding & 0x08)
+    ParamTys.push_back(Int32Ty);
+  if (Encoding & 0x10)
+    ParamTys.push_back(Int32Ty);
+
+  llvm::Function *Fused =
+      llvm::Function::Create(
+          llvm::FunctionType::get(llvm::Type::getVoidTy(mLLVMContext),
+                                  ParamTys, /* isVarArg = */false),
+          llvm::GlobalValue::ExternalLinkage, EFE->getName(), M);
+  Fused->setCallingConv(StageFuncs.front()->getCallingConv());
+
+  llvm::Function::arg_iterator AI = Fused->arg_begin();
+  llvm::Value *In = (Encoding & 0x01) ? &*AI++ : NULL;
+  llvm::Value *Out = (Encoding & 0x02) ? &*AI++ : NULL;
+  llvm::Value *X = (Encoding & 0x08) ? &*AI++ : NULL;
+  llvm::Value *Y = (Encoding & 0x10) ? &*AI++ : NULL;
+
+  llvm::BasicBlock *BB =
+      llvm::BasicBlock::Create(mLLVMContext, "entry", Fused);
+  llvm::IRBuilder<> IB(BB);
+
+  // The cell passed from each stage to the next one, which the optimizer
+  // keeps in registers once the stages are inlined
+  std::vector<llvm::Value*> Cells;
+  for (unsigned i = 0, e = StageFuncs.size() - 1; i != e; i++) {
+    unsigned StageEncoding = Stages[i]->getMetadataEncoding();
+    llvm::Type *OutTy = StageFuncs[i]->getFunctionType()->getParamType(
+        (StageEncoding & 0x01) ? 1 : 0);
+    llvm::AllocaInst *Cell = IB.CreateAlloca(
+        llvm::cast<llvm::PointerType>(OutTy)->getElementType());
+    Cell->setAlignment(Stages[i]->getOutAlignment());
+    Cells.push_back(Cell);
+  }
+
+  llvm::SmallVector<llvm::Value*, 4> Args;
+  for (unsigned i = 0, e = StageFuncs.size(); i != e; i++) {
+    llvm::Function *F = StageFuncs[i];
+    llvm::FunctionType *FT = F->getFunctionType();
+    unsigned StageEncoding = Stages[i]->getMetadataEncoding();
+
+    if (StageEncoding & 0x01)
+      Args.push_back((i == 0) ? In : Cells[i - 1]);
+    if (StageEncoding & 0x02)
+      Args.push_back((i == e - 1) ? Out : Cells[i]);
+    if (StageEncoding & 0x08)
+      Args.push_back(X);
+    if (StageEncoding & 0x10)
+      Args.push_back(Y);
+
+    // The in of a stage may be const where the out of the previous one isn't.
+    for (unsigned j = 0, je = Args.size(); j != je; j++)
+      Args[j] = IB.CreateBitCast(Args[j], FT->getParamType(j));
+
+    llvm::CallInst *CI = IB.CreateCall(F, Args);
+    CI->setCallingConv(F->getCallingConv());
+    F->addFnAttr(llvm::Attribute::InlineHint);
+    Args.clear();
+  }
+  IB.CreateRetVoid();
+
   return;
 }
 
@@ -166,9 +400,15 @@ void RSBackend::HandleTranslationUnitPre(clang::ASTContext &C) {
       "Pragma for version in source file must be set to 1"));
   }
 
+  ComputeFPPrecision();
+
   // Create a static global destructor if necessary (to handle RS object
   // runtime cleanup).
-  clang::FunctionDecl *FD = mRefCount.CreateStaticGlobalDtor();
+  clang::FunctionDecl *FD = NULL;
+  {
+    CompileReport::PhaseScope Scope(mReport, CompileReport::PhaseRefCount);
+    FD = mRefCount.CreateStaticGlobalDtor();
+  }
   if (FD) {
     HandleTopLevelDecl(clang::DeclGroupRef(FD));
   }
@@ -185,11 +425,304 @@ void RSBackend::HandleTranslationUnitPre(clang::ASTContext &C) {
     }
   }
 
+  if (mReport != NULL) {
+    mReport->addCount("rs_set_object_elided",
+                      mRefCount.getNumSetObjectsElided());
+    mReport->addCount("rs_clear_object_elided",
+                      mRefCount.getNumClearObjectsElided());
+  }
+
   return;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
+namespace {
+
+struct MathFunction {
+  const char *Name;
+  llvm::Intrinsic::ID ID;
+  unsigned NumArgs;
+  // Whether the intrinsic computes the same result for all the inputs (then
+  // it's used in the relaxed mode too.)
+  bool Exact;
+};
+
+const MathFunction MathFunctions[] = {
+  { "fma", llvm::Intrinsic::fma, 3, true },
+  { "sqrt", llvm::Intrinsic::sqrt, 1, false },
+  { "pow", llvm::Intrinsic::pow, 2, false },
+  { "sin", llvm::Intrinsic::sin, 1, false },
+  { "cos", llvm::Intrinsic::cos, 1, false },
+  { "exp", llvm::Intrinsic::exp, 1, false },
+  { "exp2", llvm::Intrinsic::exp2, 1, false },
+  { "log", llvm::Intrinsic::log, 1, false },
+  { "log2", llvm::Intrinsic::log2, 1, false },
+  { "log10", llvm::Intrinsic::log10, 1, false }
+};
+
+// The RS math functions are overloadable, so @Name is mangled like
+// _Z4sqrtf or _Z4sqrtDv4_f. The parameter types are checked against the
+// function type by the caller instead.
+const MathFunction *LookupMathFunction(llvm::StringRef Name) {
+  if (!Name.startswith("_Z"))
+    return NULL;
+  Name = Name.substr(2);
+
+  size_t NameBegin = Name.find_first_not_of("0123456789");
+  unsigned NameLength;
+  if ((NameBegin == 0) || (NameBegin == llvm::StringRef::npos) ||
+      Name.substr(0, NameBegin).getAsInteger(10, NameLength))
+    return NULL;
+  Name = Name.substr(NameBegin, NameLength);
+
+  for (size_t i = 0, e = sizeof(MathFunctions) / sizeof(MathFunctions[0]);
+       i != e;
+       i++) {
+    if (Name == MathFunctions[i].Name)
+      return &MathFunctions[i];
+  }
+  return NULL;
+}
+
+struct AtomicFunction {
+  // Mangled, the RS atomic functions are overloaded on the signedness.
+  const char *Name;
+  // The operation, unless rsAtomicCas()
+  llvm::AtomicRMWInst::BinOp Op;
+  // Including the pointer. rsAtomicInc() and rsAtomicDec() take none but it,
+  // and rsAtomicCas() takes the value compared and the new one.
+  unsigned NumArgs;
+};
+
+const AtomicFunction AtomicFunctions[] = {
+  { "_Z11rsAtomicIncPVi", llvm::AtomicRMWInst::Add, 1 },
+  { "_Z11rsAtomicIncPVj", llvm::AtomicRMWInst::Add, 1 },
+  { "_Z11rsAtomicDecPVi", llvm::AtomicRMWInst::Sub, 1 },
+  { "_Z11rsAtomicDecPVj", llvm::AtomicRMWInst::Sub, 1 },
+  { "_Z11rsAtomicAddPVii", llvm::AtomicRMWInst::Add, 2 },
+  { "_Z11rsAtomicAddPVjj", llvm::AtomicRMWInst::Add, 2 },
+  { "_Z11rsAtomicSubPVii", llvm::AtomicRMWInst::Sub, 2 },
+  { "_Z11rsAtomicSubPVjj", llvm::AtomicRMWInst::Sub, 2 },
+  { "_Z11rsAtomicAndPVii", llvm::AtomicRMWInst::And, 2 },
+  { "_Z11rsAtomicAndPVjj", llvm::AtomicRMWInst::And, 2 },
+  { "_Z10rsAtomicOrPVii", llvm::AtomicRMWInst::Or, 2 },
+  { "_Z10rsAtomicOrPVjj", llvm::AtomicRMWInst::Or, 2 },
+  { "_Z11rsAtomicXorPVii", llvm::AtomicRMWInst::Xor, 2 },
+  { "_Z11rsAtomicXorPVjj", llvm::AtomicRMWInst::Xor, 2 },
+  { "_Z11rsAtomicMinPVii", llvm::AtomicRMWInst::Min, 2 },
+  { "_Z11rsAtomicMinPVjj", llvm::AtomicRMWInst::UMin, 2 },
+  { "_Z11rsAtomicMaxPVii", llvm::AtomicRMWInst::Max, 2 },
+  { "_Z11rsAtomicMaxPVjj", llvm::AtomicRMWInst::UMax, 2 },
+  { "_Z11rsAtomicCasPViii", llvm::AtomicRMWInst::BAD_BINOP, 3 },
+  { "_Z11rsAtomicCasPVjjj", llvm::AtomicRMWInst::BAD_BINOP, 3 }
+};
+
+const AtomicFunction *LookupAtomicFunction(llvm::StringRef Name) {
+  if (!Name.startswith("_Z1"))
+    return NULL;
+
+  for (size_t i = 0, e = sizeof(AtomicFunctions) / sizeof(AtomicFunctions[0]);
+       i != e;
+       i++) {
+    if (Name == AtomicFunctions[i].Name)
+      return &AtomicFunctions[i];
+  }
+  return NULL;
+}
+
+}  // namespace
+
+void RSBackend::ComputeFPPrecision() {
+  bool HasPrecisionPragma = false;
+  for (PragmaList::const_iterator I = mPragmas->begin(), E = mPragmas->end();
+       I != E;
+       I++) {
+    FPPrecision Precision;
+    if (I->first == "rs_fp_full") {
+      Precision = FP_Full;
+    } else if (I->first == "rs_fp_relaxed") {
+      Precision = FP_Relaxed;
+    } else if (I->first == "rs_fp_imprecise") {
+      Precision = FP_Imprecise;
+    } else {
+      continue;
+    }
+
+    if (HasPrecisionPragma && (Precision != mFPPrecision)) {
+      mDiagEngine.Report(mDiagEngine.getCustomDiagID(
+        clang::DiagnosticsEngine::Error,
+        "Multiple float precision pragmas specified"));
+      return;
+    }
+    HasPrecisionPragma = true;
+    mFPPrecision = Precision;
+  }
+  return;
+}
+
+void RSBackend::LowerMathFunctions(llvm::Module *M) {
+  unsigned NumLowered = 0;
+  for (llvm::Module::iterator I = M->begin(), E = M->end(); I != E; ) {
+    llvm::Function *F = I++;
+    if (!F->isDeclaration() || F->use_empty())
+      continue;
+
+    const MathFunction *MF = LookupMathFunction(F->getName());
+    if ((MF == NULL) || (!MF->Exact && (mFPPrecision != FP_Imprecise)))
+      continue;
+
+    // All the arguments and the result are of the same floating point
+    // (vector) type.
+    llvm::FunctionType *FT = F->getFunctionType();
+    llvm::Type *T = FT->getReturnType();
+    if (!T->getScalarType()->isFloatingPointTy() || FT->isVarArg() ||
+        (FT->getNumParams() != MF->NumArgs))
+      continue;
+
+    bool Match = true;
+    for (unsigned i = 0, e = FT->getNumParams(); i != e; i++) {
+      if (FT->getParamType(i) != T) {
+        Match = false;
+        break;
+      }
+    }
+    if (!Match)
+      continue;
+
+    llvm::Function *Intrinsic = llvm::Intrinsic::getDeclaration(M, MF->ID, T);
+    F->replaceAllUsesWith(Intrinsic);
+    F->eraseFromParent();
+    NumLowered++;
+  }
+
+  if (mReport != NULL)
+    mReport->addCount("math_functions_lowered", NumLowered);
+  return;
+}
+
+void RSBackend::LowerAtomicFunctions(llvm::Module *M) {
+  unsigned NumLowered = 0;
+  llvm::IRBuilder<> IB(mLLVMContext);
+  for (llvm::Module::iterator I = M->begin(), E = M->end(); I != E; ) {
+    llvm::Function *F = I++;
+    if (!F->isDeclaration() || F->use_empty())
+      continue;
+
+    const AtomicFunction *AF = LookupAtomicFunction(F->getName());
+    if (AF == NULL)
+      continue;
+
+    // int32_t or uint32_t (both i32), the first argument by pointer
+    llvm::FunctionType *FT = F->getFunctionType();
+    llvm::Type *T = FT->getReturnType();
+    if (!T->isIntegerTy(32) || FT->isVarArg() ||
+        (FT->getNumParams() != AF->NumArgs) ||
+        (FT->getParamType(0) != T->getPointerTo()))
+      continue;
+
+    bool Match = true;
+    for (unsigned i = 1, e = FT->getNumParams(); i != e; i++) {
+      if (FT->getParamType(i) != T) {
+        Match = false;
+        break;
+      }
+    }
+    if (!Match)
+      continue;
+
+    for (llvm::Value::use_iterator UI = F->use_begin(), UE = F->use_end();
+         UI != UE; ) {
+      llvm::CallInst *CI = llvm::dyn_cast<llvm::CallInst>(*UI++);
+      // The other uses (e.g., its address taken) still need the function.
+      if ((CI == NULL) || (CI->getCalledFunction() != F))
+        continue;
+
+      // The implementations of the runtime are full barriers (__sync_*), so
+      // are the atomics sequentially consistent on every target.
+      IB.SetInsertPoint(CI);
+      llvm::Value *Ptr = CI->getArgOperand(0);
+      llvm::Instruction *Atomic;
+      if (AF->NumArgs == 3) {
+        Atomic = IB.CreateAtomicCmpXchg(Ptr,
+                                        CI->getArgOperand(1),
+                                        CI->getArgOperand(2),
+                                        llvm::SequentiallyConsistent);
+      } else {
+        llvm::Value *Val = (AF->NumArgs == 2) ?
+                           CI->getArgOperand(1) :
+                           llvm::ConstantInt::get(T, 1);
+        Atomic = IB.CreateAtomicRMW(AF->Op, Ptr, Val,
+                                    llvm::SequentiallyConsistent);
+      }
+
+      // Both return the value before the operation, like the RS functions.
+      Atomic->takeName(CI);
+      CI->replaceAllUsesWith(Atomic);
+      CI->eraseFromParent();
+      NumLowered++;
+    }
+
+    if (F->use_empty())
+      F->eraseFromParent();
+  }
+
+  if (mReport != NULL)
+    mReport->addCount("atomic_functions_lowered", NumLowered);
+  return;
+}
+
+void RSBackend::MarkAllocationDimFunctions(llvm::Module *M) {
+  static const char *const DimFunctions[] = {
+    "_Z19rsAllocationGetDimX13rs_allocation",
+    "_Z19rsAllocationGetDimY13rs_allocation",
+    "_Z19rsAllocationGetDimZ13rs_allocation"
+  };
+
+  for (unsigned i = 0;
+       i < sizeof(DimFunctions) / sizeof(DimFunctions[0]);
+       i++) {
+    // uint32_t (rs_allocation), with the allocation in a single value
+    llvm::Function *F = M->getFunction(DimFunctions[i]);
+    if ((F == NULL) || !F->isDeclaration() ||
+        !F->getReturnType()->isIntegerTy(32) ||
+        (F->getFunctionType()->getNumParams() != 1) ||
+        F->paramHasAttr(1, llvm::Attribute::ByVal))
+      continue;
+
+    F->setDoesNotAccessMemory();
+    F->setDoesNotThrow();
+  }
+  return;
+}
+
+namespace {
+
+void AddElementAccessPass(const llvm::PassManagerBuilder &Builder,
+                          llvm::PassManagerBase &PM) {
+  PM.add(createRSElementAccessPass());
+  return;
+}
+
+}  // namespace
+
+void RSBackend::AddModulePasses(llvm::PassManagerBuilder *PMBuilder) const {
+  // After the loops are rotated (and have their preheaders) and their
+  // invariants are hoisted
+  PMBuilder->addExtension(llvm::PassManagerBuilder::EP_LoopOptimizerEnd,
+                          AddElementAccessPass);
+  return;
+}
+
 void RSBackend::HandleTranslationUnitPost(llvm::Module *M) {
+  if (mFPPrecision != FP_Full)
+    LowerMathFunctions(M);
+
+  // The bitcode readers before JB don't know the atomic instructions.
+  if (getTargetAPI() >= SLANG_JB_TARGET_API)
+    LowerAtomicFunctions(M);
+
+  MarkAllocationDimFunctions(M);
+
   if (!mContext->processExport()) {
     return;
   }
@@ -273,6 +806,22 @@ void RSBackend::HandleTranslationUnitPost(llvm::Module *M) {
     }
   }
 
+  // The folded constants are never looked up by the runtime, so the optimizer
+  // can fold their loads and drop them.
+  for (RSContext::const_export_var_iterator
+          I = mContext->constant_vars_begin(),
+          E = mContext->constant_vars_end();
+       I != E;
+       I++) {
+    llvm::GlobalVariable *GV = M->getNamedGlobal((*I)->getName());
+    if ((GV != NULL) && !GV->isDeclaration())
+      GV->setLinkage(llvm::GlobalValue::InternalLinkage);
+  }
+
+  // Appended to the exported variables, bound by the reflected class
+  if (!mContext->getInstrumentedFuncs().empty())
+    InstrumentKernels(M);
+
   // Dump export function info
   if (mContext->hasExportFunc()) {
     if (mExportFuncMetadata == NULL)
@@ -402,13 +951,24 @@ void RSBackend::HandleTranslationUnitPost(llvm::Module *M) {
     }
   }
 
-  // Dump export function info
+  // Dump export forEach info (the names and the signatures of the kernels in
+  // the order of their slots)
   if (mContext->hasExportForEach()) {
+    if (mExportForEachNameMetadata == NULL)
+      mExportForEachNameMetadata =
+          M->getOrInsertNamedMetadata(RS_EXPORT_FOREACH_NAME_MN);
     if (mExportForEachMetadata == NULL)
       mExportForEachMetadata =
           M->getOrInsertNamedMetadata(RS_EXPORT_FOREACH_MN);
 
+    if (mExportForEachParamMetadata == NULL)
+      mExportForEachParamMetadata =
+          M->getOrInsertNamedMetadata(RS_EXPORT_FOREACH_PARAM_MN);
+
+    llvm::SmallVector<llvm::Value*, 1> ExportForEachName;
     llvm::SmallVector<llvm::Value*, 1> ExportForEachInfo;
+    llvm::SmallVector<llvm::Value*, 3> ExportForEachParam;
+    bool HasVectorized = false;
 
     for (RSContext::const_export_foreach_iterator
             I = mContext->export_foreach_begin(),
@@ -417,6 +977,16 @@ void RSBackend::HandleTranslationUnitPost(llvm::Module *M) {
          I++) {
       const RSExportForEach *EFE = *I;
 
+      if (EFE->isFused())
+        FuseForEach(M, EFE);
+
+      ExportForEachName.push_back(
+          llvm::MDString::get(mLLVMContext, EFE->getName()));
+
+      mExportForEachNameMetadata->addOperand(
+          llvm::MDNode::get(mLLVMContext, ExportForEachName));
+      ExportForEachName.clear();
+
       ExportForEachInfo.push_back(
           llvm::MDString::get(mLLVMContext,
                               llvm::utostr_32(EFE->getMetadataEncoding())));
@@ -424,6 +994,84 @@ void RSBackend::HandleTranslationUnitPost(llvm::Module *M) {
       mExportForEachMetadata->addOperand(
           llvm::MDNode::get(mLLVMContext, ExportForEachInfo));
       ExportForEachInfo.clear();
+
+      unsigned Access = AnnotateForEachParams(M, EFE);
+      ExportForEachParam.push_back(
+          llvm::MDString::get(mLLVMContext, llvm::utostr_32(Access)));
+      ExportForEachParam.push_back(
+          llvm::MDString::get(mLLVMContext,
+                              llvm::utostr_32(EFE->getInAlignment())));
+      ExportForEachParam.push_back(
+          llvm::MDString::get(mLLVMContext,
+                              llvm::utostr_32(EFE->getOutAlignment())));
+
+      mExportForEachParamMetadata->addOperand(
+          llvm::MDNode::get(mLLVMContext, ExportForEachParam));
+      ExportForEachParam.clear();
+
+      if (EFE->getVectorWidth() > 1)
+        HasVectorized = true;
+    }
+
+    if (HasVectorized) {
+      llvm::NamedMDNode *ExportForEachVectorizeMetadata =
+          M->getOrInsertNamedMetadata(RS_EXPORT_FOREACH_VECTORIZE_MN);
+
+      for (RSContext::const_export_foreach_iterator
+              I = mContext->export_foreach_begin(),
+              E = mContext->export_foreach_end();
+           I != E;
+           I++) {
+        const RSExportForEach *EFE = *I;
+        VectorizeForEach(M, EFE);
+        ExportForEachVectorizeMetadata->addOperand(
+            llvm::MDNode::get(mLLVMContext,
+                llvm::MDString::get(mLLVMContext,
+                                    llvm::utostr_32(EFE->getVectorWidth()))));
+      }
+    }
+  }
+
+  // Dump export reduce info
+  if (mContext->hasExportReduce()) {
+    if (mExportReduceMetadata == NULL)
+      mExportReduceMetadata =
+          M->getOrInsertNamedMetadata(RS_EXPORT_REDUCE_MN);
+
+    llvm::SmallVector<llvm::Value*, 7> ExportReduceInfo;
+
+    for (RSContext::const_export_reduce_iterator
+            I = mContext->export_reduce_begin(),
+            E = mContext->export_reduce_end();
+         I != E;
+         I++) {
+      const RSExportReduce *ER = *I;
+      const clang::FunctionDecl *Functions[] = {
+        ER->getAccumulator(),
+        ER->getInitializer(),
+        ER->getCombiner(),
+        ER->getOutConverter()
+      };
+
+      ExportReduceInfo.push_back(
+          llvm::MDString::get(mLLVMContext, ER->getName()));
+      for (unsigned i = 0; i < sizeof(Functions) / sizeof(Functions[0]); i++) {
+        // The omitted ones are given as ""
+        llvm::StringRef Name;
+        if (Functions[i] != NULL)
+          Name = Functions[i]->getName();
+        ExportReduceInfo.push_back(llvm::MDString::get(mLLVMContext, Name));
+      }
+      ExportReduceInfo.push_back(
+          llvm::MDString::get(mLLVMContext,
+                              llvm::utostr_32(ER->getAccumSize())));
+      ExportReduceInfo.push_back(
+          llvm::MDString::get(mLLVMContext,
+                              llvm::utostr_32(ER->getMetadataEncoding())));
+
+      mExportReduceMetadata->addOperand(
+          llvm::MDNode::get(mLLVMContext, ExportReduceInfo));
+      ExportReduceInfo.clear();
     }
   }
 
@@ -508,6 +1156,270 @@ void RSBackend::HandleTranslationUnitPost(llvm::Module *M) {
     }
   }
 
+  if (mEmitCompactMetadata)
+    EmitCompactMetadata(M);
+
+  // After all the functions of the bitcode are created
+  if (mProfileGenerate || !mProfileUseFile.empty())
+    HandleProfile(M);
+
+  // #pragma rs optimize (the ones for the whole file first), after all the
+  // functions of the bitcode are created as well
+  for (RSContext::const_optimize_spec_iterator
+          I = mContext->optimize_specs_begin(),
+          E = mContext->optimize_specs_end();
+       I != E;
+       I++) {
+    if (!I->Function.empty())
+      continue;
+    for (llvm::Module::iterator FI = M->begin(), FE = M->end(); FI != FE; FI++)
+      if (!FI->isDeclaration())
+        setFunctionOptimizationLevel(FI->getName().str(), I->OptLevel,
+                                     I->SizeLevel);
+  }
+  for (RSContext::const_optimize_spec_iterator
+          I = mContext->optimize_specs_begin(),
+          E = mContext->optimize_specs_end();
+       I != E;
+       I++) {
+    if (!I->Function.empty())
+      setFunctionOptimizationLevel(I->Function, I->OptLevel, I->SizeLevel);
+  }
+
+  return;
+}
+
+void RSBackend::HandleModuleEmitted(llvm::Module *M) {
+  const std::string &File = mContext->getKernelCostReportFile();
+  if (File.empty())
+    return;
+
+  llvm::TargetData TD(M);
+  std::string Report;
+  llvm::raw_string_ostream OS(Report);
+  OS << "{\n  \"version\": 1,\n  \"functions\": [";
+  bool First = true;
+
+  for (RSContext::const_export_foreach_iterator
+          I = mContext->export_foreach_begin(),
+          E = mContext->export_foreach_end();
+       I != E;
+       I++) {
+    const llvm::Function *F = M->getFunction((*I)->getName());
+    if ((F == NULL) || F->isDeclaration())
+      continue;
+    OS << (First ? "\n" : ",\n");
+    RSKernelCost(*F, "forEach", TD).printJSON(OS, 4);
+    First = false;
+  }
+
+  for (RSContext::const_export_func_iterator
+          I = mContext->export_funcs_begin(),
+          E = mContext->export_funcs_end();
+       I != E;
+       I++) {
+    const llvm::Function *F = M->getFunction((*I)->getName());
+    if ((F == NULL) || F->isDeclaration())
+      continue;
+    OS << (First ? "\n" : ",\n");
+    RSKernelCost(*F, "invokable", TD).printJSON(OS, 4);
+    First = false;
+  }
+
+  OS << "\n  ]\n}\n";
+  OS.flush();
+
+  std::string Error;
+  if (!SlangUtils::WriteFileIfChanged(File, Report, &Error))
+    mDiagEngine.Report(mDiagEngine.getCustomDiagID(
+        clang::DiagnosticsEngine::Error,
+        "cannot write the kernel cost report '%0': %1")) << File << Error;
+  return;
+}
+
+void RSBackend::HandleProfile(llvm::Module *M) {
+  if (mProfileGenerate) {
+    RSProfile::Instrument(M);
+    return;
+  }
+
+  RSProfile Profile;
+  std::string Error;
+  if (!Profile.load(mProfileUseFile, &Error)) {
+    mDiagEngine.Report(mDiagEngine.getCustomDiagID(
+      clang::DiagnosticsEngine::Error, "%0")) << Error;
+    return;
+  }
+
+  std::vector<std::string> OutOfDate;
+  Profile.apply(M, &OutOfDate);
+  for (std::vector<std::string>::const_iterator I = OutOfDate.begin(),
+          E = OutOfDate.end();
+       I != E;
+       I++) {
+    mDiagEngine.Report(mDiagEngine.getCustomDiagID(
+      clang::DiagnosticsEngine::Warning,
+      "the profile of '%0' doesn't match its code and is ignored")) << *I;
+  }
+
+  return;
+}
+
+void RSBackend::InstrumentKernels(llvm::Module *M) {
+  const std::vector<std::string> &Funcs = mContext->getInstrumentedFuncs();
+  llvm::Type *Int64Ty = llvm::Type::getInt64Ty(mLLVMContext);
+  llvm::PointerType *BufferTy = llvm::PointerType::getUnqual(Int64Ty);
+
+  // A pointer bound to an allocation of 2 longs per function, the number of
+  // calls and the time spent in nanoseconds.
+  llvm::GlobalVariable *Buffer =
+      new llvm::GlobalVariable(*M, BufferTy, false,
+                               llvm::GlobalValue::ExternalLinkage,
+                               llvm::ConstantPointerNull::get(BufferTy),
+                               RS_KERNEL_PROFILE_VAR_NAME);
+
+  if (mExportVarMetadata == NULL)
+    mExportVarMetadata = M->getOrInsertNamedMetadata(RS_EXPORT_VAR_MN);
+  llvm::Value *ExportVarInfo[] = {
+    llvm::MDString::get(mLLVMContext, RS_KERNEL_PROFILE_VAR_NAME),
+    llvm::MDString::get(mLLVMContext, "*long")
+  };
+  mExportVarMetadata->addOperand(
+      llvm::MDNode::get(mLLVMContext, ExportVarInfo));
+
+  // int64_t rsUptimeNanos(void)
+  llvm::Constant *Clock =
+      M->getOrInsertFunction("_Z13rsUptimeNanosv", Int64Ty, NULL);
+
+  llvm::NamedMDNode *KernelProfileMetadata =
+      M->getOrInsertNamedMetadata(RS_KERNEL_PROFILE_MN);
+
+  for (unsigned i = 0, e = Funcs.size(); i != e; i++) {
+    KernelProfileMetadata->addOperand(llvm::MDNode::get(mLLVMContext,
+        llvm::MDString::get(mLLVMContext, Funcs[i])));
+
+    llvm::Function *F = M->getFunction(Funcs[i]);
+    if ((F == NULL) || F->isDeclaration())
+      continue;
+
+    llvm::IRBuilder<> IB(F->getEntryBlock().getFirstNonPHI());
+    llvm::Value *Start = IB.CreateCall(Clock);
+
+    std::vector<llvm::ReturnInst*> Returns;
+    for (llvm::Function::iterator BB = F->begin(), BE = F->end();
+         BB != BE;
+         BB++) {
+      llvm::ReturnInst *RI = llvm::dyn_cast<llvm::ReturnInst>(
+          BB->getTerminator());
+      if (RI != NULL)
+        Returns.push_back(RI);
+    }
+
+    // The kernels run on all the cores at once, hence the atomics. The
+    // buffer isn't bound yet while the script is created (e.g., when an
+    // invokable function is called by init()), so nothing is counted then.
+    for (unsigned r = 0, re = Returns.size(); r != re; r++) {
+      llvm::BasicBlock *BB = Returns[r]->getParent();
+      llvm::BasicBlock *Done = BB->splitBasicBlock(Returns[r]);
+      llvm::BasicBlock *Count =
+          llvm::BasicBlock::Create(mLLVMContext, "", F, Done);
+      BB->getTerminator()->eraseFromParent();
+
+      IB.SetInsertPoint(BB);
+      llvm::Value *Elapsed = IB.CreateSub(IB.CreateCall(Clock), Start);
+      llvm::Value *Counters = IB.CreateLoad(Buffer);
+      IB.CreateCondBr(IB.CreateIsNotNull(Counters), Count, Done);
+
+      IB.SetInsertPoint(Count);
+      IB.CreateAtomicRMW(llvm::AtomicRMWInst::Add,
+                         IB.CreateConstInBoundsGEP1_32(Counters, 2 * i),
+                         llvm::ConstantInt::get(Int64Ty, 1),
+                         llvm::Monotonic);
+      IB.CreateAtomicRMW(llvm::AtomicRMWInst::Add,
+                         IB.CreateConstInBoundsGEP1_32(Counters, 2 * i + 1),
+                         Elapsed,
+                         llvm::Monotonic);
+      IB.CreateBr(Done);
+    }
+  }
+
+  return;
+}
+
+void RSBackend::EmitCompactMetadata(llvm::Module *M) {
+  RSMetadataEncoder *Encoder = CreateRSMetadataEncoder(M);
+  int Res = 0;
+
+  // The same order as the legacy metadata, i.e., the slots agree.
+  for (RSContext::const_export_var_iterator I = mContext->export_vars_begin(),
+          E = mContext->export_vars_end();
+       (I != E) && (Res == 0);
+       I++) {
+    const RSExportVar *EV = *I;
+    RSVar V;
+    V.name = EV->getName().c_str();
+    V.type = EV->getType()->getSpecType();
+    Res = RSEncodeVarMetadata(Encoder, &V);
+  }
+
+  // Appended to the exported variables by InstrumentKernels()
+  union RSType ProfileCellType, ProfileType;
+  if ((Res == 0) && !mContext->getInstrumentedFuncs().empty()) {
+    memset(&ProfileCellType, 0, sizeof(ProfileCellType));
+    RS_TYPE_SET_CLASS(&ProfileCellType, RS_TC_Primitive);
+    RS_PRIMITIVE_TYPE_SET_DATA_TYPE(&ProfileCellType, RS_DT_Signed64);
+
+    memset(&ProfileType, 0, sizeof(ProfileType));
+    RS_TYPE_SET_CLASS(&ProfileType, RS_TC_Pointer);
+    RS_POINTER_TYPE_SET_POINTEE_TYPE(&ProfileType, &ProfileCellType);
+
+    RSVar V;
+    V.name = RS_KERNEL_PROFILE_VAR_NAME;
+    V.type = &ProfileType;
+    Res = RSEncodeVarMetadata(Encoder, &V);
+  }
+
+  for (RSContext::const_export_func_iterator
+          I = mContext->export_funcs_begin(),
+          E = mContext->export_funcs_end();
+       (I != E) && (Res == 0);
+       I++) {
+    const RSExportFunc *EF = *I;
+    // The functions with parameters are invoked through their helpers (see
+    // above.)
+    const std::string Name =
+        EF->hasParam() ? (".helper_" + EF->getName()) : EF->getName();
+    RSFunction F;
+    F.name = Name.c_str();
+    Res = RSEncodeFunctionMetadata(Encoder, &F);
+  }
+
+  for (RSContext::const_export_foreach_iterator
+          I = mContext->export_foreach_begin(),
+          E = mContext->export_foreach_end();
+       (I != E) && (Res == 0);
+       I++) {
+    const RSExportForEach *EFE = *I;
+    RSForEach FE;
+    FE.name = EFE->getName().c_str();
+    FE.signature = EFE->getMetadataEncoding();
+    Res = RSEncodeForEachMetadata(Encoder, &FE);
+  }
+
+  // Without the string table (which is flushed by the finalization) the
+  // runtime ignores what has been emitted and falls back to the legacy
+  // metadata.
+  if (Res == 0) {
+    Res = FinalizeRSMetadataEncoder(Encoder);
+  } else {
+    DestroyRSMetadataEncoder(Encoder);
+  }
+
+  if (Res != 0) {
+    fprintf(stderr, "Failed to emit the compact export metadata (error %d)\n",
+            Res);
+  }
+
   return;
 }
 
@@ -17,11 +17,14 @@
 #ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_BACKEND_H_  // NOLINT
 #define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_BACKEND_H_
 
+#include <string>
+
 #include "slang_backend.h"
 #include "slang_pragma_recorder.h"
 #include "slang_rs_object_ref_count.h"
 
 namespace llvm {
+  class Module;
   class NamedMDNode;
 }
 
@@ -38,6 +41,7 @@ namespace clang {
 namespace slang {
 
 class RSContext;
+class RSExportForEach;
 
 class RSBackend : public Backend {
  private:
@@ -47,28 +51,96 @@ class RSBackend : public Backend {
 
   bool mAllowRSPrefix;
 
+  // Also emit the exports in the compact encoding of slang_rs_metadata_spec.h
+  bool mEmitCompactMetadata;
+
+  // Instrument the functions to collect their profile, or optimize them by
+  // the profile in mProfileUseFile (see RSProfile.)
+  bool mProfileGenerate;
+  std::string mProfileUseFile;
+
   llvm::NamedMDNode *mExportVarMetadata;
   llvm::NamedMDNode *mExportFuncMetadata;
+  llvm::NamedMDNode *mExportForEachNameMetadata;
   llvm::NamedMDNode *mExportForEachMetadata;
+  llvm::NamedMDNode *mExportForEachParamMetadata;
+  llvm::NamedMDNode *mExportReduceMetadata;
   llvm::NamedMDNode *mExportTypeMetadata;
   llvm::NamedMDNode *mExportElementMetadata;
   llvm::NamedMDNode *mRSObjectSlotsMetadata;
 
   RSObjectRefCount mRefCount;
 
+  // From #pragma rs_fp_*
+  FPPrecision mFPPrecision;
+
   void AnnotateFunction(clang::FunctionDecl *FD);
 
+  // Tell the optimizer that the in, out and usrData of the kernel @EFE don't
+  // alias each other (if it's named by #pragma rs noalias). Return the RS_FOREACH_ACCESS_* bits for the metadata.
+  unsigned AnnotateForEachParams(llvm::Module *M, const RSExportForEach *EFE);
+
+  // Create the widened variant of the kernel @EFE (see #pragma rs vectorize),
+  // which runs it on EFE->getVectorWidth() consecutive cells per call.
+  void VectorizeForEach(llvm::Module *M, const RSExportForEach *EFE);
+
+  // Define the fused kernel @EFE (see #pragma rs fuse), which calls its
+  // stages in turn on each cell with the cells in between in locals.
+  void FuseForEach(llvm::Module *M, const RSExportForEach *EFE);
+
+  // Pick the floating point precision from the recorded pragmas.
+  void ComputeFPPrecision();
+
+  // Replace the calls to the RS math functions with the LLVM intrinsics the
+  // optimizer and the code generator understand (as allowed by mFPPrecision).
+  void LowerMathFunctions(llvm::Module *M);
+
+  // Replace the calls to the rs_atomic functions (rsAtomicAdd(), rsAtomicCas()
+  // and the like) with the atomicrmw and cmpxchg instructions, which the code
+  // generator inlines into the kernels.
+  void LowerAtomicFunctions(llvm::Module *M);
+
+  // Mark rsAllocationGetDimX(), rsAllocationGetDimY() and rsAllocationGetDimZ()
+  // as not accessing memory (the dimensions of an allocation don't change in a
+  // kernel), such that the loops bounded by them have an invariant trip count
+  // (see slang_rs_element_access.h.)
+  void MarkAllocationDimFunctions(llvm::Module *M);
+
+  // Encode the exported variables, functions and kernels by the string table
+  // and the RSType stream of slang_rs_metadata_spec.h, which is much cheaper to
+  // decode than the legacy metadata. Nothing is emitted on failure.
+  void EmitCompactMetadata(llvm::Module *M);
+
+  // Instrument @M or apply the profile to it (see mProfileGenerate.)
+  void HandleProfile(llvm::Module *M);
+
+  // Time the functions of RSContext::getInstrumentedFuncs() into the buffer
+  // exported as the last variable (see RS_KERNEL_PROFILE_VAR_NAME.)
+  void InstrumentKernels(llvm::Module *M);
+
  protected:
   virtual unsigned int getTargetAPI() const {
     return mContext->getTargetAPI();
   }
 
+  virtual FPPrecision getFPPrecision() const {
+    return mFPPrecision;
+  }
+
+  // The specialization of rsGetElementAt() in the loops (see
+  // createRSElementAccessPass())
+  virtual void AddModulePasses(llvm::PassManagerBuilder *PMBuilder) const;
+
   virtual void HandleTopLevelDecl(clang::DeclGroupRef D);
 
   virtual void HandleTranslationUnitPre(clang::ASTContext &C);
 
   virtual void HandleTranslationUnitPost(llvm::Module *M);
 
+  // Write the RSKernelCost of each kernel and invokable function to
+  // RSContext::getKernelCostReportFile() (if any).
+  virtual void HandleModuleEmitted(llvm::Module *M);
+
  public:
   RSBackend(RSContext *Context,
             clang::DiagnosticsEngine *DiagEngine,
@@ -77,8 +149,13 @@ class RSBackend : public Backend {
             PragmaList *Pragmas,
             llvm::raw_ostream *OS,
             Slang::OutputType OT,
+            const std::vector<Slang::CodeGenOutput> &ExtraOutputs,
+            CompileReport *Report,
             clang::SourceManager &SourceMgr,
-            bool AllowRSPrefix);
+            bool AllowRSPrefix,
+            bool EmitCompactMetadata,
+            bool ProfileGenerate,
+            const std::string &ProfileUseFile);
 
   virtual ~RSBackend();
 };
@@ -0,0 +1,296 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "slang_rs_cache.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallString.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/system_error.h"
+
+#include "slang_utils.h"
+#include "slang_version.h"
+
+namespace slang {
+
+namespace {
+
+// Bump whenever the format below is changed
+const char EntryMagic[] = "slang-cache-entry-2";
+
+// The entry file is a sequence of records, each starts with a line of a tag
+// and its arguments. Records with "sized" tags are followed by the given
+// number of bytes and a newline.
+//
+//  package <package name>
+//  dep <file>
+//  odr <record type name> <signature>
+//  bitcode <size>
+//  java <size> <class name>
+//  accessor <size> <class name>
+//  messages <size>
+//  diagnostics <size>
+void WriteSizedRecord(llvm::raw_ostream &OS, llvm::StringRef Tag,
+                      llvm::StringRef Name, llvm::StringRef Data) {
+  OS << Tag << ' ' << Data.size();
+  if (!Name.empty())
+    OS << ' ' << Name;
+  OS << '\n' << Data << '\n';
+  return;
+}
+
+class EntryParser {
+ private:
+  llvm::StringRef mBuffer;
+
+ public:
+  explicit EntryParser(llvm::StringRef Buffer) : mBuffer(Buffer) {
+    return;
+  }
+
+  bool atEnd() const { return mBuffer.empty(); }
+
+  bool readLine(llvm::StringRef *Line) {
+    size_t End = mBuffer.find('\n');
+    if (End == llvm::StringRef::npos)
+      return false;
+    *Line = mBuffer.substr(0, End);
+    mBuffer = mBuffer.substr(End + 1);
+    return true;
+  }
+
+  // @Args holds "<size>[ <name>]" of a sized record.
+  bool readData(llvm::StringRef Args, llvm::StringRef *Name,
+                std::string *Data) {
+    std::pair<llvm::StringRef, llvm::StringRef> SizeAndName = Args.split(' ');
+    size_t Size;
+    if (SizeAndName.first.getAsInteger(10, Size) ||
+        (mBuffer.size() < Size + 1) || (mBuffer[Size] != '\n'))
+      return false;
+    *Name = SizeAndName.second;
+    *Data = mBuffer.substr(0, Size).str();
+    mBuffer = mBuffer.substr(Size + 1);
+    return true;
+  }
+};
+
+}  // namespace
+
+RSCompilationCache::RSCompilationCache(const std::string &CacheDir)
+    : mCacheDir(CacheDir) {
+  resetKey();
+  return;
+}
+
+void RSCompilationCache::resetKey() {
+  // FNV-1a 128-bit offset basis
+  mKeyHi = 0x6c62272e07bb0142ULL;
+  mKeyLo = 0x62b821756295c58dULL;
+
+  // Any change to the compiler (including the libraries linked into it)
+  // invalidates the entries.
+  addToKey(EntryMagic);
+  addToKey(SlangUtils::GetBuildID());
+  addToKey(SLANG_MAXIMUM_TARGET_API);
+  return;
+}
+
+void RSCompilationCache::hash(const char *Data, size_t Size) {
+  for (size_t i = 0, e = Size; i != e; i++) {
+    mKeyLo ^= static_cast<unsigned char>(Data[i]);
+
+    // Key *= FNV-1a 128-bit prime (2^88 + 0x13b)
+    uint64_t A = (mKeyLo & 0xffffffffULL) * 0x13b;
+    uint64_t B = (mKeyLo >> 32) * 0x13b;
+    uint64_t Lo = A + (B << 32);
+    uint64_t Carry = (B >> 32) + ((Lo < A) ? 1 : 0);
+    mKeyHi = mKeyHi * 0x13b + Carry + (mKeyLo << 24);
+    mKeyLo = Lo;
+  }
+  return;
+}
+
+void RSCompilationCache::addToKey(llvm::StringRef Data) {
+  // Hash the length too such that the boundaries of the data are encoded.
+  addToKey(static_cast<unsigned>(Data.size()));
+  hash(Data.data(), Data.size());
+  return;
+}
+
+void RSCompilationCache::addToKey(unsigned Data) {
+  const char Bytes[] = {
+    static_cast<char>(Data & 0xff),
+    static_cast<char>((Data >> 8) & 0xff),
+    static_cast<char>((Data >> 16) & 0xff),
+    static_cast<char>((Data >> 24) & 0xff)
+  };
+
+  hash(Bytes, sizeof(Bytes));
+  return;
+}
+
+std::string RSCompilationCache::getKey() const {
+  std::string Key;
+  llvm::raw_string_ostream OS(Key);
+  OS << llvm::format("%016llx%016llx",
+                     static_cast<unsigned long long>(mKeyHi),  // NOLINT
+                     static_cast<unsigned long long>(mKeyLo));  // NOLINT
+  return OS.str();
+}
+
+std::string RSCompilationCache::getEntryFileName() const {
+  llvm::SmallString<256> File(mCacheDir);
+  llvm::sys::path::append(File, getKey());
+  return File.str();
+}
+
+bool RSCompilationCache::lookup(Entry *E) const {
+  std::string Buffer;
+  if (!ReadFile(getEntryFileName(), &Buffer))
+    return false;
+
+  EntryParser P(Buffer);
+  llvm::StringRef Line;
+  if (!P.readLine(&Line) || (Line != EntryMagic))
+    return false;
+
+  Entry Result;
+  while (!P.atEnd()) {
+    if (!P.readLine(&Line))
+      return false;
+
+    std::pair<llvm::StringRef, llvm::StringRef> TagAndArgs = Line.split(' ');
+    llvm::StringRef Tag = TagAndArgs.first, Args = TagAndArgs.second;
+    llvm::StringRef Name;
+    std::string Data;
+
+    if (Tag == "package") {
+      Result.PackageName = Args.str();
+    } else if (Tag == "dep") {
+      Result.Deps.push_back(Args.str());
+    } else if (Tag == "odr") {
+      std::pair<llvm::StringRef, llvm::StringRef> NameAndSig = Args.split(' ');
+      Result.ODRSignatures.push_back(std::make_pair(NameAndSig.first.str(),
+                                                    NameAndSig.second.str()));
+    } else if (Tag == "bitcode") {
+      if (!P.readData(Args, &Name, &Result.Bitcode))
+        return false;
+    } else if (Tag == "java") {
+      if (!P.readData(Args, &Name, &Data))
+        return false;
+      Result.JavaFiles.push_back(std::make_pair(Name.str(), Data));
+    } else if (Tag == "accessor") {
+      if (!P.readData(Args, &Name, &Data))
+        return false;
+      Result.BitcodeAccessor = std::make_pair(Name.str(), Data);
+    } else if (Tag == "messages") {
+      if (!P.readData(Args, &Name, &Result.Messages))
+        return false;
+    } else if (Tag == "diagnostics") {
+      if (!P.readData(Args, &Name, &Result.Diagnostics))
+        return false;
+    } else {
+      return false;
+    }
+  }
+
+  *E = Result;
+  return true;
+}
+
+bool RSCompilationCache::store(const Entry &E) const {
+  std::string Buffer;
+  llvm::raw_string_ostream OS(Buffer);
+
+  OS << EntryMagic << '\n';
+  OS << "package " << E.PackageName << '\n';
+  for (std::vector<std::string>::const_iterator I = E.Deps.begin(),
+          IE = E.Deps.end();
+       I != IE;
+       I++) {
+    OS << "dep " << *I << '\n';
+  }
+  for (std::vector<std::pair<std::string, std::string> >::const_iterator
+          I = E.ODRSignatures.begin(), IE = E.ODRSignatures.end();
+       I != IE;
+       I++) {
+    OS << "odr " << I->first << ' ' << I->second << '\n';
+  }
+  WriteSizedRecord(OS, "bitcode", "", E.Bitcode);
+  for (std::vector<JavaFileTy>::const_iterator I = E.JavaFiles.begin(),
+          IE = E.JavaFiles.end();
+       I != IE;
+       I++) {
+    WriteSizedRecord(OS, "java", I->first, I->second);
+  }
+  if (!E.BitcodeAccessor.first.empty())
+    WriteSizedRecord(OS, "accessor", E.BitcodeAccessor.first,
+                     E.BitcodeAccessor.second);
+  WriteSizedRecord(OS, "messages", "", E.Messages);
+  WriteSizedRecord(OS, "diagnostics", "", E.Diagnostics);
+  OS.flush();
+
+  if (!SlangUtils::CreateDirectoryWithParents(mCacheDir, NULL))
+    return false;
+
+  // Write to a temporary file first and then move it to the entry, so the
+  // concurrent lookups never see a partially written entry.
+  std::string EntryFile = getEntryFileName();
+  int FD;
+  llvm::SmallString<256> TmpFile;
+  if (llvm::sys::fs::unique_file(EntryFile + "-%%%%%%%%", FD, TmpFile))
+    return false;
+
+  {
+    llvm::raw_fd_ostream TmpOS(FD, /* shouldClose = */true);
+    TmpOS << Buffer;
+    TmpOS.close();
+    if (TmpOS.has_error()) {
+      TmpOS.clear_error();
+      bool Existed;
+      llvm::sys::fs::remove(TmpFile.str(), Existed);
+      return false;
+    }
+  }
+
+  if (llvm::sys::fs::rename(TmpFile.str(), EntryFile)) {
+    bool Existed;
+    llvm::sys::fs::remove(TmpFile.str(), Existed);
+    return false;
+  }
+
+  return true;
+}
+
+bool RSCompilationCache::ReadFile(const std::string &File,
+                                  std::string *Content) {
+  llvm::OwningPtr<llvm::MemoryBuffer> MB;
+  if (llvm::MemoryBuffer::getFile(File, MB))
+    return false;
+  *Content = MB->getBuffer().str();
+  return true;
+}
+
+}  // namespace slang
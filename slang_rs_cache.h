@@ -0,0 +1,98 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_CACHE_H_  // NOLINT
+#define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_CACHE_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/DataTypes.h"
+
+namespace slang {
+
+// RSCompilationCache - The on-disk cache of the outputs of compiling an input
+// file (see llvm-rs-cc -cache-dir.) The entries are keyed by a hash of
+// everything the outputs depend on, which is accumulated by addToKey().
+class RSCompilationCache {
+ public:
+  typedef std::pair<std::string, std::string> JavaFileTy;
+
+  struct Entry {
+    // The bitcode (as written to the output file)
+    std::string Bitcode;
+
+    // The package where the reflected classes go
+    std::string PackageName;
+
+    // <class name, file content> of the reflected classes (ScriptC_*.java
+    // and ScriptField_*.java)
+    std::vector<JavaFileTy> JavaFiles;
+
+    // The bitcode accessor (empty if the bitcode is not stored in Java code)
+    JavaFileTy BitcodeAccessor;
+
+    // The files the input depends on
+    std::vector<std::string> Deps;
+
+    // <record type name, signature> of the record types defined by the input
+    // (see SlangRS::checkODR())
+    std::vector<std::pair<std::string, std::string> > ODRSignatures;
+
+    // What the reflection printed, e.g., "Generating ScriptC_foo.java ..."
+    std::string Messages;
+
+    // The diagnostics (i.e., warnings) emitted by the compilation
+    std::string Diagnostics;
+  };
+
+ private:
+  std::string mCacheDir;
+
+  // The 128-bit FNV-1a hash of the key
+  uint64_t mKeyHi;
+  uint64_t mKeyLo;
+
+  void hash(const char *Data, size_t Size);
+
+  std::string getEntryFileName() const;
+
+ public:
+  explicit RSCompilationCache(const std::string &CacheDir);
+
+  // Start over the key of a new entry.
+  void resetKey();
+
+  void addToKey(llvm::StringRef Data);
+  void addToKey(unsigned Data);
+
+  std::string getKey() const;
+
+  // Look up the entry of the current key. Return false on a miss.
+  bool lookup(Entry *E) const;
+
+  // Store @E as the entry of the current key. Failing to store is not an
+  // error, it's reported by returning false only.
+  bool store(const Entry &E) const;
+
+  static bool ReadFile(const std::string &File, std::string *Content);
+};
+
+}  // namespace slang
+
+#endif  // _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_CACHE_H_  NOLINT
@@ -17,6 +17,7 @@
 #include "slang_rs_context.h"
 
 #include <string>
+#include <vector>
 
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
@@ -25,29 +26,36 @@
 #include "clang/AST/Type.h"
 
 #include "clang/Basic/Linkage.h"
+#include "clang/Basic/SourceManager.h"
 #include "clang/Basic/TargetInfo.h"
 
 #include "clang/Index/ASTLocation.h"
 
 #include "llvm/LLVMContext.h"
 
+#include "llvm/Support/raw_ostream.h"
+
 #include "llvm/Target/TargetData.h"
 
 #include "slang.h"
 #include "slang_assert.h"
 #include "slang_rs_export_foreach.h"
+#include "slang_rs_export_reduce.h"
 #include "slang_rs_export_func.h"
 #include "slang_rs_export_type.h"
 #include "slang_rs_export_var.h"
 #include "slang_rs_exportable.h"
 #include "slang_rs_pragma_handler.h"
 #include "slang_rs_reflection.h"
+#include "slang_rs_struct_layout.h"
+#include "slang_version.h"
 
 namespace slang {
 
 RSContext::RSContext(clang::Preprocessor &PP,
                      clang::ASTContext &Ctx,
                      const clang::TargetInfo &Target,
+                     llvm::LLVMContext &LLVMContext,
                      PragmaList *Pragmas,
                      unsigned int TargetAPI,
                      std::vector<std::string> *GeneratedFileNames)
@@ -58,9 +66,14 @@ RSContext::RSContext(clang::Preprocessor &PP,
       mTargetAPI(TargetAPI),
       mGeneratedFileNames(GeneratedFileNames),
       mTargetData(NULL),
-      mLLVMContext(llvm::getGlobalContext()),
+      mLLVMContext(LLVMContext),
       mLicenseNote(NULL),
+      mInstrumentKernels(false),
+      mStructLayoutReport(NULL),
+      mWarnStructPadding(false),
       version(0),
+      mExportTypeCacheHits(0),
+      mExportTypeCacheMisses(0),
       mMangleCtx(Ctx.createMangleContext()) {
   slangAssert(mGeneratedFileNames && "Must supply GeneratedFileNames");
 
@@ -72,6 +85,30 @@ RSContext::RSContext(clang::Preprocessor &PP,
   PP.AddPragmaHandler(
       "rs", RSPragmaHandler::CreatePragmaJavaPackageNameHandler(this));
 
+  // For #pragma rs reduce
+  PP.AddPragmaHandler(
+      "rs", RSPragmaHandler::CreatePragmaReduceHandler(this));
+
+  // For #pragma rs vectorize
+  PP.AddPragmaHandler(
+      "rs", RSPragmaHandler::CreatePragmaVectorizeHandler(this));
+
+  // For #pragma rs kernel
+  PP.AddPragmaHandler(
+      "rs", RSPragmaHandler::CreatePragmaKernelHandler(this));
+
+  // For #pragma rs noalias
+  PP.AddPragmaHandler(
+      "rs", RSPragmaHandler::CreatePragmaNoAliasHandler(this));
+
+  // For #pragma rs fuse
+  PP.AddPragmaHandler(
+      "rs", RSPragmaHandler::CreatePragmaFuseHandler(this));
+
+  // For #pragma rs optimize
+  PP.AddPragmaHandler(
+      "rs", RSPragmaHandler::CreatePragmaOptimizeHandler(this));
+
   // For #pragma rs set_reflect_license
   PP.AddPragmaHandler(
       "rs", RSPragmaHandler::CreatePragmaReflectLicenseHandler(this));
@@ -79,6 +116,15 @@ RSContext::RSContext(clang::Preprocessor &PP,
   // For #pragma version
   PP.AddPragmaHandler(RSPragmaHandler::CreatePragmaVersionHandler(this));
 
+  // For #pragma rs_fp_full, #pragma rs_fp_relaxed and #pragma rs_fp_imprecise
+  PP.AddPragmaHandler(
+      RSPragmaHandler::CreatePragmaFPPrecisionHandler(this, "rs_fp_full"));
+  PP.AddPragmaHandler(
+      RSPragmaHandler::CreatePragmaFPPrecisionHandler(this, "rs_fp_relaxed"));
+  PP.AddPragmaHandler(
+      RSPragmaHandler::CreatePragmaFPPrecisionHandler(this,
+                                                      "rs_fp_imprecise"));
+
   // Prepare target data
   mTargetData = new llvm::TargetData(Target.getTargetDescription());
 
@@ -94,9 +140,11 @@ bool RSContext::processExportVar(const clang::VarDecl *VD) {
   if (!ET)
     return false;
 
-  RSExportVar *EV = new RSExportVar(this, VD, ET);
+  RSExportVar *EV = new (this) RSExportVar(this, VD, ET);
   if (EV == NULL)
     return false;
+  else if (EV->isFolded())
+    mConstantVars.push_back(EV);
   else
     mExportVars.push_back(EV);
 
@@ -116,7 +164,16 @@ bool RSContext::processExportFunc(const clang::FunctionDecl *FD) {
     return false;
   }
 
-  if (RSExportForEach::isRSForEachFunc(mTargetAPI, FD)) {
+  // Reflected by reduce_*() instead (see processExportReduce())
+  if (isReduceFunction(FD->getName())) {
+    return true;
+  }
+
+  // (A kernel taking nothing is reported by processKernel().)
+  if (RSExportForEach::isRSForEachFunc(mTargetAPI, FD) ||
+      ((mTargetAPI >= SLANG_JB_TARGET_API) &&
+       isKernelFunction(FD->getName()) &&
+       !RSExportForEach::isSpecialRSFunc(FD) && (FD->getNumParams() != 0))) {
     RSExportForEach *EFE = RSExportForEach::Create(this, FD);
     if (EFE == NULL)
       return false;
@@ -129,6 +186,8 @@ bool RSContext::processExportFunc(const clang::FunctionDecl *FD) {
                                                   getDiagnostics(), FD)) {
       return false;
     }
+    if (!RSExportForEach::isDtorRSFunc(FD))
+      mSpecialFuncs.push_back(FD->getName());
     return true;
   }
 
@@ -186,6 +245,305 @@ bool RSContext::processExportType(const llvm::StringRef &Name) {
   return (ET != NULL);
 }
 
+void RSContext::addReduceSpec(const ReduceSpec &Spec) {
+  mReduceSpecs.push_back(Spec);
+
+  const std::string *Functions[] = {
+    &Spec.Accumulator, &Spec.Initializer, &Spec.Combiner, &Spec.OutConverter
+  };
+  for (unsigned i = 0; i < sizeof(Functions) / sizeof(Functions[0]); i++) {
+    if (!Functions[i]->empty())
+      mReduceFunctions.insert(*Functions[i]);
+  }
+  return;
+}
+
+bool RSContext::processExportReduce(const ReduceSpec &Spec) {
+  for (ExportReduceList::const_iterator I = mExportReduce.begin(),
+          E = mExportReduce.end();
+       I != E;
+       I++) {
+    if ((*I)->getName() == Spec.Name) {
+      clang::DiagnosticsEngine *DiagEngine = getDiagnostics();
+      DiagEngine->Report(
+        clang::FullSourceLoc(Spec.Loc, DiagEngine->getSourceManager()),
+        DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                    "duplicate reduction '%0'"))
+        << Spec.Name;
+      return false;
+    }
+  }
+
+  RSExportReduce *ER = RSExportReduce::Create(this, Spec);
+  if (ER == NULL)
+    return false;
+
+  mExportReduce.push_back(ER);
+  return true;
+}
+
+bool RSContext::processVectorize(const VectorizeSpec &Spec) {
+  clang::DiagnosticsEngine *DiagEngine = getDiagnostics();
+  clang::FullSourceLoc Loc(Spec.Loc, DiagEngine->getSourceManager());
+
+  for (ExportForEachList::const_iterator I = mExportForEach.begin(),
+          E = mExportForEach.end();
+       I != E;
+       I++) {
+    RSExportForEach *EFE = *I;
+    if (EFE->isDummyRoot())
+      continue;
+
+    if (Spec.Kernel.empty()) {
+      // Those which can't be widened are left alone.
+      if (EFE->canVectorize())
+        EFE->setVectorWidth(Spec.Width);
+    } else if (EFE->getName() == Spec.Kernel) {
+      if (!EFE->canVectorize()) {
+        DiagEngine->Report(Loc,
+          DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                      "kernel '%0' cannot be vectorized since "
+                                      "the size of its in or out cell is "
+                                      "unknown"))
+          << Spec.Kernel;
+        return false;
+      }
+      EFE->setVectorWidth(Spec.Width);
+      return true;
+    }
+  }
+
+  if (Spec.Kernel.empty())
+    return true;
+
+  DiagEngine->Report(Loc,
+    DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                "'%0' in '#pragma rs vectorize' is not a "
+                                "kernel"))
+    << Spec.Kernel;
+  return false;
+}
+
+bool RSContext::processKernel(const KernelSpec &Spec) {
+  clang::DiagnosticsEngine *DiagEngine = getDiagnostics();
+  clang::FullSourceLoc Loc(Spec.Loc, DiagEngine->getSourceManager());
+
+  if (mTargetAPI < SLANG_JB_TARGET_API) {
+    DiagEngine->Report(Loc,
+      DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                  "'#pragma rs kernel' requires target API "
+                                  "%0 or later"))
+      << SLANG_JB_TARGET_API;
+    return false;
+  }
+
+  for (ExportForEachList::const_iterator I = mExportForEach.begin(),
+          E = mExportForEach.end();
+       I != E;
+       I++) {
+    if (!(*I)->isDummyRoot() && ((*I)->getName() == Spec.Kernel))
+      return true;
+  }
+
+  // A function failing the checks of the kernels was reported by
+  // RSExportForEach::Create() already.
+  clang::TranslationUnitDecl *TUDecl = mCtx.getTranslationUnitDecl();
+  for (clang::DeclContext::decl_iterator DI = TUDecl->decls_begin(),
+           DE = TUDecl->decls_end();
+       DI != DE;
+       DI++) {
+    const clang::FunctionDecl *FD = llvm::dyn_cast<clang::FunctionDecl>(*DI);
+    if ((FD != NULL) && FD->isThisDeclarationADefinition() &&
+        (FD->getName() == Spec.Kernel) &&
+        (FD->getLinkage() == clang::ExternalLinkage) &&
+        !RSExportForEach::isSpecialRSFunc(FD) && (FD->getNumParams() != 0))
+      return false;
+  }
+
+  DiagEngine->Report(Loc,
+    DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                "'%0' in '#pragma rs kernel' is not a "
+                                "non-static function taking in or out"))
+    << Spec.Kernel;
+  return false;
+}
+
+bool RSContext::processNoAlias(const NoAliasSpec &Spec) {
+  for (ExportForEachList::const_iterator I = mExportForEach.begin(),
+          E = mExportForEach.end();
+       I != E;
+       I++) {
+    RSExportForEach *EFE = *I;
+    if (!EFE->isDummyRoot() && (EFE->getName() == Spec.Kernel)) {
+      EFE->setNoAlias(true);
+      return true;
+    }
+  }
+
+  clang::DiagnosticsEngine *DiagEngine = getDiagnostics();
+  DiagEngine->Report(
+    clang::FullSourceLoc(Spec.Loc, DiagEngine->getSourceManager()),
+    DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                "'%0' in '#pragma rs noalias' is not a "
+                                "kernel"))
+    << Spec.Kernel;
+  return false;
+}
+
+namespace {
+
+// The name of the type of the cells @ET (the in or out of a kernel) points to
+inline const std::string &GetCellTypeName(const RSExportType *ET) {
+  slangAssert(ET->getClass() == RSExportType::ExportClassPointer);
+  return static_cast<const RSExportPointerType*>(ET)->getPointeeType()
+      ->getName();
+}
+
+}  // namespace
+
+bool RSContext::processFuse(const FuseSpec &Spec) {
+  clang::DiagnosticsEngine *DiagEngine = getDiagnostics();
+  clang::FullSourceLoc Loc(Spec.Loc, DiagEngine->getSourceManager());
+
+  if (getTargetAPI() < SLANG_JB_TARGET_API) {
+    DiagEngine->Report(Loc,
+      DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                  "'#pragma rs fuse' requires target API "
+                                  "%0 or later"))
+      << SLANG_JB_TARGET_API;
+    return false;
+  }
+
+  if (Spec.Kernels.size() < 2) {
+    DiagEngine->Report(Loc,
+      DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                  "'#pragma rs fuse' needs at least two "
+                                  "kernels"));
+    return false;
+  }
+
+  // The fused kernel is a function of its own.
+  bool NameTaken = false;
+  clang::TranslationUnitDecl *TUDecl = mCtx.getTranslationUnitDecl();
+  for (clang::DeclContext::decl_iterator DI = TUDecl->decls_begin(),
+           DE = TUDecl->decls_end();
+       !NameTaken && (DI != DE);
+       DI++) {
+    const clang::NamedDecl *ND = llvm::dyn_cast<clang::NamedDecl>(*DI);
+    NameTaken = (ND != NULL) && (ND->getName() == Spec.Name);
+  }
+  for (ExportForEachList::const_iterator I = mExportForEach.begin(),
+          E = mExportForEach.end();
+       !NameTaken && (I != E);
+       I++) {
+    NameTaken = ((*I)->getName() == Spec.Name);
+  }
+  if (NameTaken) {
+    DiagEngine->Report(Loc,
+      DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                  "the fused kernel '%0' is already "
+                                  "defined"))
+      << Spec.Name;
+    return false;
+  }
+
+  std::vector<const RSExportForEach*> Stages;
+  for (unsigned i = 0, e = Spec.Kernels.size(); i != e; i++) {
+    const RSExportForEach *Stage = NULL;
+    for (ExportForEachList::const_iterator I = mExportForEach.begin(),
+            E = mExportForEach.end();
+         I != E;
+         I++) {
+      if (!(*I)->isDummyRoot() && !(*I)->isFused() &&
+          ((*I)->getName() == Spec.Kernels[i]))
+        Stage = *I;
+    }
+
+    if (Stage == NULL) {
+      DiagEngine->Report(Loc,
+        DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                    "'%0' in '#pragma rs fuse' is not a "
+                                    "kernel"))
+        << Spec.Kernels[i];
+      return false;
+    }
+
+    // The usrData is given per launch, which a fused kernel has only one of.
+    if (Stage->getMetadataEncoding() & 0x04) {
+      DiagEngine->Report(Loc,
+        DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                    "kernel '%0' cannot be fused since it "
+                                    "takes usrData"))
+        << Spec.Kernels[i];
+      return false;
+    }
+
+    // Each cell in between is a local of the fused kernel, so its size must
+    // be known.
+    if ((i != 0) && (!Stage->hasIn() || (Stage->getInAlignment() == 0))) {
+      DiagEngine->Report(Loc,
+        DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                    "kernel '%0' cannot be fused after "
+                                    "another one since it has no typed in"))
+        << Spec.Kernels[i];
+      return false;
+    }
+    if ((i != e - 1) &&
+        (!Stage->hasOut() || (Stage->getOutAlignment() == 0))) {
+      DiagEngine->Report(Loc,
+        DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                    "kernel '%0' cannot be fused before "
+                                    "another one since it has no typed out"))
+        << Spec.Kernels[i];
+      return false;
+    }
+
+    if ((i != 0) &&
+        (GetCellTypeName(Stages.back()->getOutType()) !=
+            GetCellTypeName(Stage->getInType()))) {
+      DiagEngine->Report(Loc,
+        DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                    "the out of kernel '%0' (%1) is not the "
+                                    "in of kernel '%2' (%3)"))
+        << Stages.back()->getName()
+        << GetCellTypeName(Stages.back()->getOutType())
+        << Stage->getName() << GetCellTypeName(Stage->getInType());
+      return false;
+    }
+
+    Stages.push_back(Stage);
+  }
+
+  mExportForEach.push_back(RSExportForEach::CreateFused(this, Spec.Name,
+                                                        Stages));
+  return true;
+}
+
+bool RSContext::processOptimize(const OptimizeSpec &Spec) {
+  if (Spec.Function.empty())
+    return true;
+
+  clang::TranslationUnitDecl *TUDecl = mCtx.getTranslationUnitDecl();
+  for (clang::DeclContext::decl_iterator DI = TUDecl->decls_begin(),
+           DE = TUDecl->decls_end();
+       DI != DE;
+       DI++) {
+    const clang::FunctionDecl *FD = llvm::dyn_cast<clang::FunctionDecl>(*DI);
+    if ((FD != NULL) && FD->isThisDeclarationADefinition() &&
+        (FD->getName() == Spec.Function))
+      return true;
+  }
+
+  clang::DiagnosticsEngine *DiagEngine = getDiagnostics();
+  DiagEngine->Report(
+    clang::FullSourceLoc(Spec.Loc, DiagEngine->getSourceManager()),
+    DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                "'%0' in '#pragma rs optimize' is not a "
+                                "function defined in this file"))
+    << Spec.Function;
+  return false;
+}
+
 bool RSContext::processExport() {
   bool valid = true;
 
@@ -217,6 +575,103 @@ bool RSContext::processExport() {
     }
   }
 
+  for (std::list<KernelSpec>::const_iterator I = mKernelSpecs.begin(),
+          E = mKernelSpecs.end();
+       I != E;
+       I++) {
+    if (!processKernel(*I)) {
+      valid = false;
+    }
+  }
+
+  // The runtime launches root() by the slot 0, so it comes first among the
+  // kernels (or a placeholder does if there's none.)
+  if (!mExportForEach.empty()) {
+    ExportForEachList::iterator Root = mExportForEach.begin();
+    while ((Root != mExportForEach.end()) &&
+           ((*Root)->getName() != "root"))
+      Root++;
+
+    if (Root == mExportForEach.end())
+      mExportForEach.push_front(RSExportForEach::CreateDummyRoot(this));
+    else
+      mExportForEach.splice(mExportForEach.begin(), mExportForEach, Root);
+  }
+
+  // Fuse the kernels, such that the fused ones can be vectorized too
+  for (std::list<FuseSpec>::const_iterator I = mFuseSpecs.begin(),
+          E = mFuseSpecs.end();
+       I != E;
+       I++) {
+    if (!processFuse(*I)) {
+      valid = false;
+    }
+  }
+
+  // After fusing, such that the fused kernels can be named too
+  for (std::list<NoAliasSpec>::const_iterator I = mNoAliasSpecs.begin(),
+          E = mNoAliasSpecs.end();
+       I != E;
+       I++) {
+    if (!processNoAlias(*I)) {
+      valid = false;
+    }
+  }
+
+  // Vectorize the kernels (in the order of the pragmas, i.e., the last one
+  // naming a kernel wins.)
+  for (std::list<VectorizeSpec>::const_iterator I = mVectorizeSpecs.begin(),
+          E = mVectorizeSpecs.end();
+       I != E;
+       I++) {
+    if (!processVectorize(*I)) {
+      valid = false;
+    }
+  }
+
+  for (OptimizeSpecList::const_iterator I = mOptimizeSpecs.begin(),
+          E = mOptimizeSpecs.end();
+       I != E;
+       I++) {
+    if (!processOptimize(*I)) {
+      valid = false;
+    }
+  }
+
+  // Export reductions
+  for (std::list<ReduceSpec>::const_iterator I = mReduceSpecs.begin(),
+          E = mReduceSpecs.end();
+       I != E;
+       I++) {
+    if (!processExportReduce(*I)) {
+      valid = false;
+    }
+  }
+
+  if (mInstrumentKernels) {
+    for (ExportForEachList::const_iterator I = mExportForEach.begin(),
+            E = mExportForEach.end();
+         I != E;
+         I++) {
+      if (!(*I)->isDummyRoot())
+        mInstrumentedFuncs.push_back((*I)->getName());
+    }
+    // Not init(), which runs before the counters are bound
+    for (std::vector<std::string>::const_iterator I = mSpecialFuncs.begin(),
+            E = mSpecialFuncs.end();
+         I != E;
+         I++) {
+      if (*I != "init")
+        mInstrumentedFuncs.push_back(*I);
+    }
+    for (ExportFuncList::const_iterator I = mExportFuncs.begin(),
+            E = mExportFuncs.end();
+         I != E;
+         I++) {
+      mInstrumentedFuncs.push_back((*I)->getName());
+    }
+  }
+
   // Finally, export type forcely set to be exported by user
   for (NeedExportTypeSet::const_iterator EI = mNeedExportTypes.begin(),
            EE = mNeedExportTypes.end();
@@ -227,9 +682,59 @@ bool RSContext::processExport() {
     }
   }
 
+  if (valid && ((mStructLayoutReport != NULL) || mWarnStructPadding))
+    processStructLayouts();
+
   return valid;
 }
 
+void RSContext::processStructLayouts() {
+  clang::DiagnosticsEngine *DiagEngine = getDiagnostics();
+  clang::SourceManager &SM = DiagEngine->getSourceManager();
+  llvm::OwningPtr<llvm::raw_string_ostream> Report;
+  if (mStructLayoutReport != NULL)
+    Report.reset(new llvm::raw_string_ostream(*mStructLayoutReport));
+
+  for (const_export_type_iterator I = export_types_begin(),
+          E = export_types_end();
+       I != E;
+       I++) {
+    const RSExportType *ET = I->getValue();
+    if (ET->getClass() != RSExportType::ExportClassRecord)
+      continue;
+    const RSExportRecordType *ERT =
+        static_cast<const RSExportRecordType*>(ET);
+    // The parameter packets of the invokable functions aren't declared by the
+    // user.
+    if (ERT->isArtificial() || (ERT->getRecordDecl() == NULL))
+      continue;
+
+    const clang::RecordDecl *RD = ERT->getRecordDecl();
+    RSStructLayout Layout(mCtx, RD);
+
+    if (Report) {
+      clang::PresumedLoc PLoc = SM.getPresumedLoc(RD->getLocation());
+      if (PLoc.isValid())
+        (*Report) << PLoc.getFilename() << ":" << PLoc.getLine() << ": ";
+      Layout.print(*Report);
+    }
+
+    if (mWarnStructPadding && Layout.canShrink()) {
+      DiagEngine->Report(
+          clang::FullSourceLoc(RD->getLocation(), SM),
+          DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Warning,
+                                      "struct '%0' has %1 bytes of padding, "
+                                      "declaring its fields as '%2' would "
+                                      "shrink it from %3 to %4 bytes"))
+          << Layout.getName() << static_cast<unsigned>(Layout.getPadding())
+          << Layout.getBestOrder() << static_cast<unsigned>(Layout.getSize())
+          << static_cast<unsigned>(Layout.getBestSize());
+    }
+  }
+
+  return;
+}
+
 bool RSContext::insertExportType(const llvm::StringRef &TypeName,
                                  RSExportType *ET) {
   ExportTypeMap::value_type *NewItem =
@@ -241,15 +746,26 @@ bool RSContext::insertExportType(const llvm::StringRef &TypeName,
   if (mExportTypes.insert(NewItem)) {
     return true;
   } else {
-    free(NewItem);
+    NewItem->Destroy(mExportTypes.getAllocator());
     return false;
   }
 }
 
+RSExportType *RSContext::lookupExportTypeCache(const clang::Type *T) {
+  ExportTypeCacheTy::const_iterator I = mExportTypeCache.find(T);
+  if (I == mExportTypeCache.end()) {
+    mExportTypeCacheMisses++;
+    return NULL;
+  }
+  mExportTypeCacheHits++;
+  return I->second;
+}
+
 bool RSContext::reflectToJava(const std::string &OutputPathBase,
                               const std::string &OutputPackageName,
                               const std::string &InputFileName,
                               const std::string &OutputBCFileName,
+                              const ReflectionOptions &Options,
                               std::string *RealPackageName) {
   if (RealPackageName != NULL)
     RealPackageName->clear();
@@ -267,7 +783,7 @@ bool RSContext::reflectToJava(const std::string &OutputPathBase,
   // Copy back the really applied package name
   RealPackageName->assign(PackageName);
 
-  RSReflection *R = new RSReflection(this, mGeneratedFileNames);
+  RSReflection *R = new RSReflection(this, mGeneratedFileNames, Options);
   bool ret = R->reflect(OutputPathBase, PackageName,
                         InputFileName, OutputBCFileName);
   if (!ret)
@@ -280,12 +796,13 @@ bool RSContext::reflectToJava(const std::string &OutputPathBase,
 RSContext::~RSContext() {
   delete mLicenseNote;
   delete mTargetData;
+  // The exportables are in mExportableAllocator, only run their destructors
+  // here.
   for (ExportableList::iterator I = mExportables.begin(),
           E = mExportables.end();
        I != E;
        I++) {
-    if (!(*I)->isKeep())
-      delete *I;
+    (*I)->~RSExportable();
   }
 }
 
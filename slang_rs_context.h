@@ -21,14 +21,18 @@
 #include <list>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "clang/Lex/Preprocessor.h"
 #include "clang/AST/Mangle.h"
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/OwningPtr.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/StringMap.h"
 
+#include "llvm/Support/Allocator.h"
+
 #include "slang_pragma_recorder.h"
 
 namespace llvm {
@@ -42,6 +46,7 @@ namespace clang {
   class TargetInfo;
   class FunctionDecl;
   class SourceManager;
+  class Type;
 }   // namespace clang
 
 namespace slang {
@@ -49,7 +54,9 @@ namespace slang {
   class RSExportVar;
   class RSExportFunc;
   class RSExportForEach;
+  class RSExportReduce;
   class RSExportType;
+  struct ReflectionOptions;
 
 class RSContext {
   typedef llvm::StringSet<> NeedExportVarSet;
@@ -57,11 +64,62 @@ class RSContext {
   typedef llvm::StringSet<> NeedExportTypeSet;
 
  public:
-  typedef std::list<RSExportable*> ExportableList;
+  typedef std::vector<RSExportable*> ExportableList;
   typedef std::list<RSExportVar*> ExportVarList;
   typedef std::list<RSExportFunc*> ExportFuncList;
   typedef std::list<RSExportForEach*> ExportForEachList;
-  typedef llvm::StringMap<RSExportType*> ExportTypeMap;
+  typedef std::list<RSExportReduce*> ExportReduceList;
+  typedef llvm::StringMap<RSExportType*, llvm::BumpPtrAllocator>
+      ExportTypeMap;
+
+  // What #pragma rs reduce(Name) accumulator(Accumulator) ... declares (the
+  // names of the omitted functions are empty.)
+  struct ReduceSpec {
+    std::string Name;
+    std::string Accumulator;
+    std::string Initializer;
+    std::string Combiner;
+    std::string OutConverter;
+    clang::SourceLocation Loc;
+  };
+
+  // What #pragma rs vectorize(Width[, Kernel...]) asks for (Kernel is empty
+  // for all the kernels of the file.)
+  struct VectorizeSpec {
+    std::string Kernel;
+    unsigned Width;
+    clang::SourceLocation Loc;
+  };
+
+  // A function named by #pragma rs kernel(Kernel...)
+  struct KernelSpec {
+    std::string Kernel;
+    clang::SourceLocation Loc;
+  };
+
+  // A kernel named by #pragma rs noalias(Kernel...)
+  struct NoAliasSpec {
+    std::string Kernel;
+    clang::SourceLocation Loc;
+  };
+
+  // What #pragma rs fuse(Name, Kernel...) asks for
+  struct FuseSpec {
+    std::string Name;
+    std::vector<std::string> Kernels;
+    clang::SourceLocation Loc;
+  };
+
+  // What #pragma rs optimize(Level[, Function...]) asks for (Function is
+  // empty for all the functions of the file.) The levels are the ones of
+  // llvm::PassManagerBuilder.
+  struct OptimizeSpec {
+    std::string Function;
+    unsigned OptLevel;
+    unsigned SizeLevel;
+    clang::SourceLocation Loc;
+  };
+  typedef std::list<OptimizeSpec> OptimizeSpecList;
 
  private:
   clang::Preprocessor &mPP;
@@ -74,6 +132,9 @@ class RSContext {
   llvm::TargetData *mTargetData;
   llvm::LLVMContext &mLLVMContext;
 
+  // Where the exportables (see RSExportable::operator new()) and the fields of
+  // the record types live. Freed all at once with the context.
+  llvm::BumpPtrAllocator mExportableAllocator;
   ExportableList mExportables;
 
   NeedExportTypeSet mNeedExportTypes;
@@ -88,16 +149,72 @@ class RSContext {
   bool processExportVar(const clang::VarDecl *VD);
   bool processExportFunc(const clang::FunctionDecl *FD);
   bool processExportType(const llvm::StringRef &Name);
+  bool processExportReduce(const ReduceSpec &Spec);
+  bool processVectorize(const VectorizeSpec &Spec);
+  bool processFuse(const FuseSpec &Spec);
+  bool processNoAlias(const NoAliasSpec &Spec);
+  bool processKernel(const KernelSpec &Spec);
+  bool processOptimize(const OptimizeSpec &Spec);
+  // Report/warn about the padding of the exported structs when requested
+  void processStructLayouts();
 
   ExportVarList mExportVars;
+  // The exported variables folded into constants (see RSExportVar::isFolded()),
+  // which take no slot.
+  ExportVarList mConstantVars;
   ExportFuncList mExportFuncs;
   ExportForEachList mExportForEach;
+  ExportReduceList mExportReduce;
   ExportTypeMap mExportTypes;
 
+  // The reductions are resolved by processExport() since the functions may
+  // be defined after the pragmas.
+  std::list<ReduceSpec> mReduceSpecs;
+  llvm::StringSet<> mReduceFunctions;
+
+  // The functions other than root() exported as kernels (the others are
+  // invokable), checked by processExport().
+  std::list<KernelSpec> mKernelSpecs;
+  llvm::StringSet<> mKernelFunctions;
+
+  // Applied to the kernels by processExport() for the same reason.
+  std::list<VectorizeSpec> mVectorizeSpecs;
+  std::list<FuseSpec> mFuseSpecs;
+  std::list<NoAliasSpec> mNoAliasSpecs;
+
+  // Checked by processExport() and applied by the backend to the functions
+  // of the module, in the order of the pragmas.
+  OptimizeSpecList mOptimizeSpecs;
+
+  // Time the entry points of the script (llvm-rs-cc -finstrument-kernels.)
+  // The names (as in the bitcode) of the kernels, root() and init() (if any)
+  // and the exported functions are collected by processExport().
+  bool mInstrumentKernels;
+  std::vector<std::string> mSpecialFuncs;
+  std::vector<std::string> mInstrumentedFuncs;
+
+  // Where the layouts of the exported structs go (NULL if not reported), and
+  // whether to warn about the ones that could be smaller (see RSStructLayout.)
+  std::string *mStructLayoutReport;
+  bool mWarnStructPadding;
+
+  // Where the RSBackend writes the static costs of the entry points (see
+  // RSKernelCost), empty if not reported
+  std::string mKernelCostReportFile;
+
+  // The results of RSExportType::Create() keyed by the canonical type, which
+  // avoid normalizing the same type again whenever it's reached from another
+  // variable, function parameter, kernel or record field.
+  typedef llvm::DenseMap<const clang::Type*, RSExportType*> ExportTypeCacheTy;
+  ExportTypeCacheTy mExportTypeCache;
+  unsigned mExportTypeCacheHits;
+  unsigned mExportTypeCacheMisses;
+
  public:
   RSContext(clang::Preprocessor &PP,
             clang::ASTContext &Ctx,
             const clang::TargetInfo &Target,
+            llvm::LLVMContext &LLVMContext,
             PragmaList *Pragmas,
             unsigned int TargetAPI,
             std::vector<std::string> *GeneratedFileNames);
@@ -138,6 +255,18 @@ class RSContext {
   }
 
   bool processExport();
+
+  inline llvm::BumpPtrAllocator &getExportableAllocator() {
+    return mExportableAllocator;
+  }
+  inline size_t getExportableArenaSize() const {
+    return mExportableAllocator.getTotalMemory();
+  }
+  // The memory held by the names of the entries of mExportTypes
+  inline size_t getExportTypeNameArenaSize() const {
+    return mExportTypes.getAllocator().getTotalMemory();
+  }
+
   inline void newExportable(RSExportable *E) {
     if (E != NULL)
       mExportables.push_back(E);
@@ -161,6 +290,13 @@ class RSContext {
     return !mExportVars.empty();
   }
 
+  const_export_var_iterator constant_vars_begin() const {
+    return mConstantVars.begin();
+  }
+  const_export_var_iterator constant_vars_end() const {
+    return mConstantVars.end();
+  }
+
   typedef ExportFuncList::const_iterator const_export_func_iterator;
   const_export_func_iterator export_funcs_begin() const {
     return mExportFuncs.begin();
@@ -179,6 +315,57 @@ class RSContext {
   }
   inline bool hasExportForEach() const { return !mExportForEach.empty(); }
 
+  typedef ExportReduceList::const_iterator const_export_reduce_iterator;
+  const_export_reduce_iterator export_reduce_begin() const {
+    return mExportReduce.begin();
+  }
+  const_export_reduce_iterator export_reduce_end() const {
+    return mExportReduce.end();
+  }
+  inline bool hasExportReduce() const { return !mExportReduce.empty(); }
+
+  void addReduceSpec(const ReduceSpec &Spec);
+
+  void addVectorizeSpec(const VectorizeSpec &Spec) {
+    mVectorizeSpecs.push_back(Spec);
+  }
+
+  void addFuseSpec(const FuseSpec &Spec) {
+    mFuseSpecs.push_back(Spec);
+  }
+
+  void addKernelSpec(const KernelSpec &Spec) {
+    mKernelSpecs.push_back(Spec);
+    mKernelFunctions.insert(Spec.Kernel);
+  }
+
+  // Whether @Name is named by #pragma rs kernel (and exported as a kernel
+  // rather than an invokable function)
+  inline bool isKernelFunction(const llvm::StringRef &Name) const {
+    return (mKernelFunctions.count(Name) != 0);
+  }
+
+  void addNoAliasSpec(const NoAliasSpec &Spec) {
+    mNoAliasSpecs.push_back(Spec);
+  }
+
+  void addOptimizeSpec(const OptimizeSpec &Spec) {
+    mOptimizeSpecs.push_back(Spec);
+  }
+  typedef OptimizeSpecList::const_iterator const_optimize_spec_iterator;
+  const_optimize_spec_iterator optimize_specs_begin() const {
+    return mOptimizeSpecs.begin();
+  }
+  const_optimize_spec_iterator optimize_specs_end() const {
+    return mOptimizeSpecs.end();
+  }
+
+  // Whether @Name is one of the functions of a reduction (which are not
+  // reflected as invokable functions.)
+  inline bool isReduceFunction(const llvm::StringRef &Name) const {
+    return (mReduceFunctions.count(Name) != 0);
+  }
+
   typedef ExportTypeMap::iterator export_type_iterator;
   typedef ExportTypeMap::const_iterator const_export_type_iterator;
   export_type_iterator export_types_begin() { return mExportTypes.begin(); }
@@ -203,12 +390,55 @@ class RSContext {
   // and return true.
   bool insertExportType(const llvm::StringRef &TypeName, RSExportType *Type);
 
+  // Return the RSExportType previously created for the canonical type @T (see
+  // RSExportType::Create()), or NULL if there's none.
+  RSExportType *lookupExportTypeCache(const clang::Type *T);
+  inline void insertExportTypeCache(const clang::Type *T, RSExportType *ET) {
+    mExportTypeCache[T] = ET;
+    return;
+  }
+  inline unsigned getExportTypeCacheHits() const {
+    return mExportTypeCacheHits;
+  }
+  inline unsigned getExportTypeCacheMisses() const {
+    return mExportTypeCacheMisses;
+  }
+
   bool reflectToJava(const std::string &OutputPathBase,
                      const std::string &OutputPackageName,
                      const std::string &InputFileName,
                      const std::string &OutputBCFileName,
+                     const ReflectionOptions &Options,
                      std::string *RealPackageName);
 
+  void setInstrumentKernels(bool Instrument) {
+    mInstrumentKernels = Instrument;
+    return;
+  }
+  // The entry points timed by the bitcode, where each has a pair of counters
+  // (the number of calls and the time spent in nanoseconds) in that order.
+  // Empty if not instrumenting.
+  const std::vector<std::string> &getInstrumentedFuncs() const {
+    return mInstrumentedFuncs;
+  }
+
+  void setStructLayoutReport(std::string *Report) {
+    mStructLayoutReport = Report;
+    return;
+  }
+  void setWarnStructPadding(bool Warn) {
+    mWarnStructPadding = Warn;
+    return;
+  }
+
+  void setKernelCostReportFile(const std::string &File) {
+    mKernelCostReportFile = File;
+    return;
+  }
+  const std::string &getKernelCostReportFile() const {
+    return mKernelCostReportFile;
+  }
+
   int getVersion() const { return version; }
   void setVersion(int v) {
     version = v;
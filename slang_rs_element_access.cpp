@@ -0,0 +1,296 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "slang_rs_element_access.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "llvm/Constants.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/Function.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Instructions.h"
+#include "llvm/Pass.h"
+
+#include "llvm/Analysis/Dominators.h"
+#include "llvm/Analysis/LoopInfo.h"
+
+#include "llvm/Support/IRBuilder.h"
+
+#include "llvm/Target/TargetData.h"
+
+namespace slang {
+
+namespace {
+
+// rsGetElementAt() of the RS headers, by the number of coordinates
+const char *const ElementAtFunctions[] = {
+  "_Z14rsGetElementAt13rs_allocationj",
+  "_Z14rsGetElementAt13rs_allocationjj",
+  "_Z14rsGetElementAt13rs_allocationjjj"
+};
+
+// Return the number of coordinates of @F if it's rsGetElementAt(), or 0.
+unsigned GetNumCoordinates(const llvm::Function *F) {
+  for (unsigned i = 0;
+       i < sizeof(ElementAtFunctions) / sizeof(ElementAtFunctions[0]);
+       i++) {
+    if (F->getName() != ElementAtFunctions[i])
+      continue;
+
+    // const void *(rs_allocation, uint32_t...), with the allocation in a
+    // single value
+    llvm::FunctionType *FT = F->getFunctionType();
+    if ((FT->getReturnType() !=
+            llvm::Type::getInt8PtrTy(F->getContext())) ||
+        (FT->getNumParams() != i + 2))
+      return 0;
+    for (unsigned j = 1; j < FT->getNumParams(); j++)
+      if (!FT->getParamType(j)->isIntegerTy(32))
+        return 0;
+    return i + 1;
+  }
+  return 0;
+}
+
+class RSElementAccessPass : public llvm::FunctionPass {
+ private:
+  // <the loop, the arguments of the call (NULL for the varying coordinate)>
+  typedef std::pair<llvm::Loop*, std::vector<llvm::Value*> > AccessKeyTy;
+  // <the address of the cell at 0, the distance to the one at 1>
+  typedef std::pair<llvm::Value*, llvm::Value*> AccessTy;
+
+  // Return the coordinate (from 1) of @Call going through the cells 0, 1, ...
+  // in the iterations of @L, or 0 if none, and set @LatchCompare to the
+  // compare deciding whether @L goes around again. The cell 0 of the call is
+  // then accessed by the first iteration of @L, and the cell 1 by the second
+  // one if there's one.
+  unsigned getVaryingCoordinate(llvm::CallInst *Call, unsigned NumCoordinates,
+                                llvm::Loop *L,
+                                llvm::ICmpInst **LatchCompare) const;
+
+  // Take the address of the cell of @Call with the coordinate @Varying at 0
+  // and its distance to the one at 1 in the preheader of @L. The cell at 1 is
+  // only taken if @L runs twice (by @LatchCompare), the distance is 0 else.
+  AccessTy createAccess(llvm::CallInst *Call, unsigned Varying, llvm::Loop *L,
+                        llvm::ICmpInst *LatchCompare,
+                        llvm::Type *IntPtrTy) const;
+
+ public:
+  static char ID;
+
+  RSElementAccessPass() : llvm::FunctionPass(ID) {
+    llvm::PassRegistry &Registry = *llvm::PassRegistry::getPassRegistry();
+    llvm::initializeDominatorTreePass(Registry);
+    llvm::initializeLoopInfoPass(Registry);
+    return;
+  }
+
+  virtual const char *getPassName() const {
+    return "RenderScript Element Access";
+  }
+
+  virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const {
+    AU.addRequired<llvm::DominatorTree>();
+    AU.addRequired<llvm::LoopInfo>();
+    AU.setPreservesCFG();
+    return;
+  }
+
+  virtual bool runOnFunction(llvm::Function &F);
+};
+
+char RSElementAccessPass::ID = 0;
+
+// The probes of createAccess() only depend on their arguments: the allocation
+// doesn't change in the loop (it's invariant) and the cells are accessed by
+// the loop anyway.
+llvm::CallInst *CloneAccessor(llvm::IRBuilder<> &Builder,
+                              const llvm::CallInst *Call,
+                              const std::vector<llvm::Value*> &Args) {
+  llvm::CallInst *Clone = Builder.CreateCall(Call->getCalledValue(), Args);
+  Clone->setCallingConv(Call->getCallingConv());
+  Clone->setAttributes(Call->getAttributes());
+  Clone->setDoesNotAccessMemory();
+  Clone->setDoesNotThrow();
+  return Clone;
+}
+
+unsigned
+RSElementAccessPass::getVaryingCoordinate(llvm::CallInst *Call,
+                                          unsigned NumCoordinates,
+                                          llvm::Loop *L,
+                                          llvm::ICmpInst **LatchCompare) const {
+  // The loop is tested at the bottom (entering it runs the first iteration)
+  // and the call is in every iteration.
+  llvm::BasicBlock *Latch = L->getLoopLatch();
+  if ((Latch == NULL) || (L->getExitingBlock() != Latch) ||
+      !getAnalysis<llvm::DominatorTree>().dominates(Call->getParent(), Latch))
+    return 0;
+
+  // The coordinate is the induction variable counting from 0 by 1.
+  llvm::PHINode *IndVar = L->getCanonicalInductionVariable();
+  if (IndVar == NULL)
+    return 0;
+
+  // The loop goes around again if the next value of the induction variable
+  // compares to a loop invariant (e.g., rsAllocationGetDimX() or a parameter
+  // of the kernel) in some way, such that whether it runs twice can be told
+  // before it.
+  llvm::BranchInst *Branch =
+      llvm::dyn_cast<llvm::BranchInst>(Latch->getTerminator());
+  if ((Branch == NULL) || !Branch->isConditional())
+    return 0;
+  llvm::ICmpInst *Compare = llvm::dyn_cast<llvm::ICmpInst>(
+      Branch->getCondition());
+  llvm::Value *Next = IndVar->getIncomingValueForBlock(Latch);
+  if ((Compare == NULL) ||
+      !(((Compare->getOperand(0) == Next) &&
+         L->isLoopInvariant(Compare->getOperand(1))) ||
+        ((Compare->getOperand(1) == Next) &&
+         L->isLoopInvariant(Compare->getOperand(0)))))
+    return 0;
+
+  // Exactly one of the coordinates (the arguments from 1) varies.
+  unsigned Varying = 0;
+  for (unsigned i = 1; i <= NumCoordinates; i++) {
+    if (L->isLoopInvariant(Call->getArgOperand(i)))
+      continue;
+    if ((Varying != 0) || (Call->getArgOperand(i) != IndVar))
+      return 0;
+    Varying = i;
+  }
+
+  *LatchCompare = Compare;
+  return Varying;
+}
+
+RSElementAccessPass::AccessTy
+RSElementAccessPass::createAccess(llvm::CallInst *Call, unsigned Varying,
+                                  llvm::Loop *L, llvm::ICmpInst *LatchCompare,
+                                  llvm::Type *IntPtrTy) const {
+  llvm::IRBuilder<> Builder(L->getLoopPreheader()->getTerminator());
+  llvm::Type *Int32Ty = llvm::Type::getInt32Ty(Call->getContext());
+
+  std::vector<llvm::Value*> Args;
+  for (unsigned i = 0, e = Call->getNumArgOperands(); i != e; i++)
+    Args.push_back(Call->getArgOperand(i));
+
+  Args[Varying] = llvm::ConstantInt::get(Int32Ty, 0);
+  llvm::CallInst *Base = CloneAccessor(Builder, Call, Args);
+
+  // The latch of the first iteration, i.e., with the next value at 1
+  llvm::BasicBlock *Latch = L->getLoopLatch();
+  llvm::Value *Next = L->getCanonicalInductionVariable()->
+      getIncomingValueForBlock(Latch);
+  llvm::Value *One = llvm::ConstantInt::get(Next->getType(), 1);
+  llvm::Value *LHS = LatchCompare->getOperand(0);
+  llvm::Value *RHS = LatchCompare->getOperand(1);
+  llvm::Value *Taken = Builder.CreateICmp(LatchCompare->getPredicate(),
+                                          (LHS == Next) ? One : LHS,
+                                          (RHS == Next) ? One : RHS);
+  llvm::BranchInst *Branch = llvm::cast<llvm::BranchInst>(
+      Latch->getTerminator());
+  llvm::Value *RunsTwice = (Branch->getSuccessor(0) == L->getHeader()) ?
+                               Taken : Builder.CreateNot(Taken);
+
+  Args[Varying] = Builder.CreateSelect(RunsTwice,
+                                       llvm::ConstantInt::get(Int32Ty, 1),
+                                       llvm::ConstantInt::get(Int32Ty, 0));
+  llvm::CallInst *Second = CloneAccessor(Builder, Call, Args);
+
+  llvm::Value *Stride = Builder.CreateSub(Builder.CreatePtrToInt(Second,
+                                                                 IntPtrTy),
+                                          Builder.CreatePtrToInt(Base,
+                                                                 IntPtrTy));
+  return std::make_pair(Base, Stride);
+}
+
+bool RSElementAccessPass::runOnFunction(llvm::Function &F) {
+  std::vector<std::pair<llvm::CallInst*, unsigned> > Calls;
+  for (llvm::Function::iterator BB = F.begin(), BE = F.end(); BB != BE; BB++) {
+    for (llvm::BasicBlock::iterator I = BB->begin(), E = BB->end();
+         I != E;
+         I++) {
+      llvm::CallInst *Call = llvm::dyn_cast<llvm::CallInst>(I);
+      if (Call == NULL)
+        continue;
+      llvm::Function *Callee = Call->getCalledFunction();
+      unsigned NumCoordinates =
+          (Callee != NULL) ? GetNumCoordinates(Callee) : 0;
+      if (NumCoordinates != 0)
+        Calls.push_back(std::make_pair(Call, NumCoordinates));
+    }
+  }
+
+  if (Calls.empty())
+    return false;
+
+  const llvm::TargetData *TD = getAnalysisIfAvailable<llvm::TargetData>();
+  llvm::LoopInfo &LI = getAnalysis<llvm::LoopInfo>();
+  std::map<AccessKeyTy, AccessTy> Accesses;
+  bool Changed = false;
+
+  for (unsigned i = 0, e = Calls.size(); i != e; i++) {
+    llvm::CallInst *Call = Calls[i].first;
+    unsigned NumCoordinates = Calls[i].second;
+
+    // (An allocation passed in memory may change in the loop.)
+    llvm::Loop *L = LI.getLoopFor(Call->getParent());
+    if ((TD == NULL) || (L == NULL) || (L->getLoopPreheader() == NULL) ||
+        Call->paramHasAttr(1, llvm::Attribute::ByVal) ||
+        !L->isLoopInvariant(Call->getArgOperand(0)))
+      continue;
+
+    llvm::ICmpInst *LatchCompare = NULL;
+    unsigned Varying = getVaryingCoordinate(Call, NumCoordinates, L,
+                                            &LatchCompare);
+    if (Varying == 0)
+      continue;
+
+    llvm::Type *IntPtrTy = TD->getIntPtrType(F.getContext());
+    std::vector<llvm::Value*> Key;
+    for (unsigned j = 0; j <= NumCoordinates; j++)
+      Key.push_back((j == Varying) ? NULL : Call->getArgOperand(j));
+    AccessTy &Access = Accesses[std::make_pair(L, Key)];
+    if (Access.first == NULL)
+      Access = createAccess(Call, Varying, L, LatchCompare, IntPtrTy);
+
+    // The address of the cell at @Varying is the one at 0 plus @Varying times
+    // the distance to the next one.
+    llvm::IRBuilder<> Builder(Call);
+    llvm::Value *Offset = Builder.CreateMul(
+        Builder.CreateIntCast(Call->getArgOperand(Varying), IntPtrTy,
+                              /* isSigned = */false),
+        Access.second);
+    llvm::Value *Address = Builder.CreateInBoundsGEP(Access.first, Offset);
+    Call->replaceAllUsesWith(Address);
+    Call->eraseFromParent();
+    Changed = true;
+  }
+
+  return Changed;
+}
+
+}  // namespace
+
+llvm::FunctionPass *createRSElementAccessPass() {
+  return new RSElementAccessPass();
+}
+
+}  // namespace slang
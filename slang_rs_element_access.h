@@ -0,0 +1,43 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_ELEMENT_ACCESS_H_  // NOLINT
+#define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_ELEMENT_ACCESS_H_
+
+namespace llvm {
+  class FunctionPass;
+}
+
+namespace slang {
+
+// The pass specializing the calls of rsGetElementAt() in the loops. The
+// layout of an allocation is the runtime's, so the address of a cell is left
+// to rsGetElementAt(), but it is affine in each coordinate: where a single
+// coordinate of the call is the induction variable of a loop, the loop is
+// tested at its bottom against an invariant bound (e.g., the dimension of the
+// allocation) and the call is in every iteration, the address of the cell at 0
+// and the distance to the one at 1 are taken once before the loop (the one at
+// 1 only if the bound lets the loop run twice, such that both are accessed by
+// the loop anyway), and each cell is then accessed by a
+// direct indexed load or store the optimizer can see (and combine, vectorize
+// or keep in registers.) The other calls are left as they are.
+//
+// Run it after the loop optimizations (it needs the preheaders.)
+llvm::FunctionPass *createRSElementAccessPass();
+
+}  // namespace slang
+
+#endif  // _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_ELEMENT_ACCESS_H_  NOLINT
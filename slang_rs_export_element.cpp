@@ -25,37 +25,25 @@
 #include "slang_assert.h"
 #include "slang_rs_context.h"
 #include "slang_rs_export_type.h"
+#include "slang_rs_type_spec.h"
 
 namespace slang {
 
-bool RSExportElement::Initialized = false;
-RSExportElement::ElementInfoMapTy RSExportElement::ElementInfoMap;
-
-void RSExportElement::Init() {
-  if (!Initialized) {
-    // Initialize ElementInfoMap
-#define ENUM_RS_DATA_ELEMENT(_name, _dk, _dt, _norm, _vsize)  \
-    {                                                         \
-      ElementInfo *EI = new ElementInfo;                      \
-      EI->kind = RSExportPrimitiveType::DataKind ## _dk;      \
-      EI->type = RSExportPrimitiveType::DataType ## _dt;      \
-      EI->normalized = _norm;                                 \
-      EI->vsize = _vsize;                                     \
-                                                              \
-      llvm::StringRef Name(_name);                            \
-      ElementInfoMap.insert(                                  \
-          ElementInfoMapTy::value_type::Create(               \
-              Name.begin(),                                   \
-              Name.end(),                                     \
-              ElementInfoMap.getAllocator(),                  \
-              EI));                                           \
-    }
-#include "RSDataElementEnums.inc"
-
-    Initialized = true;
-  }
-  return;
-}
+const RSExportElement::ElementInfoSlot RSExportElement::ElementInfoTable[] = {
+#define ENUM_RS_DATA_ELEMENT_SLOT(_name, _dk, _dt, _norm, _vsize)  \
+  { _name,                                                         \
+    { RSExportPrimitiveType::DataKind ## _dk,                      \
+      RSExportPrimitiveType::DataType ## _dt,                      \
+      _norm,                                                       \
+      _vsize } },
+#define ENUM_RS_EMPTY_SLOT()                                       \
+  { NULL,                                                          \
+    { RSExportPrimitiveType::DataKindUser,                         \
+      RSExportPrimitiveType::DataTypeUnknown,                      \
+      false,                                                       \
+      0 } },
+#include "RSDataElementTable.inc"
+};
 
 RSExportType *RSExportElement::Create(RSContext *Context,
                                       const clang::Type *T,
@@ -65,9 +53,6 @@ RSExportType *RSExportElement::Create(RSContext *Context,
   llvm::StringRef TypeName;
   RSExportType *ET = NULL;
 
-  if (!Initialized)
-    Init();
-
   slangAssert(EI != NULL && "Element info not found");
 
   if (!RSExportType::NormalizeType(T, TypeName, Context->getDiagnostics(),
@@ -157,14 +142,14 @@ RSExportType *RSExportElement::CreateFromDecl(RSContext *Context,
 
 const RSExportElement::ElementInfo *
 RSExportElement::GetElementInfo(const llvm::StringRef &Name) {
-  if (!Initialized)
-    Init();
-
-  ElementInfoMapTy::const_iterator I = ElementInfoMap.find(Name);
-  if (I == ElementInfoMap.end())
+  const ElementInfoSlot &Slot =
+      ElementInfoTable[RSSpecHash(Name.begin(), Name.end(),
+                                  RS_DATA_ELEMENT_TABLE_SEED) &
+                       (RS_DATA_ELEMENT_TABLE_SIZE - 1)];
+  if ((Slot.name == NULL) || (Name != Slot.name))
     return NULL;
   else
-    return I->getValue();
+    return &Slot.info;
 }
 
 }  // namespace slang
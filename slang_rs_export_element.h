@@ -21,7 +21,6 @@
 
 #include "clang/Lex/Token.h"
 
-#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 
 #include "slang_rs_export_type.h"
@@ -47,13 +46,16 @@ class RSExportElement {
     unsigned vsize;
   } ElementInfo;
 
-  typedef llvm::StringMap<const ElementInfo*> ElementInfoMapTy;
+  // A slot of ElementInfoTable
+  typedef struct {
+    const char *name;
+    ElementInfo info;
+  } ElementInfoSlot;
 
  private:
-  // Macro name <-> ElementInfo
-  static ElementInfoMapTy ElementInfoMap;
-
-  static bool Initialized;
+  // Macro name <-> ElementInfo, the perfect hash table generated by
+  // rs-spec-gen
+  static const ElementInfoSlot ElementInfoTable[];
 
   static RSExportType *Create(RSContext *Context,
                               const clang::Type *T,
@@ -62,8 +64,6 @@ class RSExportElement {
   static const ElementInfo *GetElementInfo(const llvm::StringRef &Name);
 
  public:
-  static void Init();
-
   static RSExportType *CreateFromDecl(RSContext *Context,
                                       const clang::DeclaratorDecl *DD);
 };
@@ -17,6 +17,7 @@
 #include "slang_rs_export_foreach.h"
 
 #include <string>
+#include <vector>
 
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
@@ -48,6 +49,21 @@ static void ReportNameError(clang::DiagnosticsEngine *DiagEngine,
   return;
 }
 
+// The alignment of the cells of an allocation pointed to by the parameter of
+// the type @ET (0 if unknown)
+static unsigned int GetCellAlignment(RSContext *Context,
+                                     const RSExportType *ET) {
+  if ((ET == NULL) || (ET->getClass() != RSExportType::ExportClassPointer))
+    return 0;
+
+  const RSExportType *PointeeType =
+      static_cast<const RSExportPointerType*>(ET)->getPointeeType();
+  llvm::Type *T = PointeeType->getLLVMType();
+  if ((T == NULL) || !T->isSized())
+    return 0;
+  return Context->getTargetData()->getABITypeAlignment(T);
+}
+
 }  // namespace
 
 // This function takes care of additional validation and construction of
@@ -59,20 +75,17 @@ bool RSExportForEach::validateAndConstructParams(
   clang::ASTContext &C = Context->getASTContext();
   clang::DiagnosticsEngine *DiagEngine = Context->getDiagnostics();
 
-  if (!isRootRSFunc(FD)) {
-    slangAssert(false && "must be called on compute root function!");
-  }
-
   numParams = FD->getNumParams();
   slangAssert(numParams > 0);
 
-  // Compute root functions are required to return a void type for now
+  // Compute kernels are required to return a void type for now
   if (FD->getResultType().getCanonicalType() != C.VoidTy) {
     DiagEngine->Report(
       clang::FullSourceLoc(FD->getLocation(), DiagEngine->getSourceManager()),
       DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
-                                  "compute root() is required to return a "
-                                  "void type"));
+                                  "compute %0() is required to return a "
+                                  "void type"))
+      << FD->getName();
     valid = false;
   }
 
@@ -104,8 +117,9 @@ bool RSExportForEach::validateAndConstructParams(
       clang::FullSourceLoc(FD->getLocation(),
                            DiagEngine->getSourceManager()),
       DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
-                                  "Compute root() must have at least one "
-                                  "parameter for in or out"));
+                                  "Compute %0() must have at least one "
+                                  "parameter for in or out"))
+      << FD->getName();
     valid = false;
   }
 
@@ -128,9 +142,9 @@ bool RSExportForEach::validateAndConstructParams(
         clang::FullSourceLoc(PVD->getLocation(),
                              DiagEngine->getSourceManager()),
         DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
-                                    "Unexpected root() parameter '%0' "
-                                    "of type '%1'"))
-        << PVD->getName() << PVD->getType().getAsString();
+                                    "Unexpected %0() parameter '%1' "
+                                    "of type '%2'"))
+        << FD->getName() << PVD->getName() << PVD->getType().getAsString();
       valid = false;
     } else {
       llvm::StringRef ParamName = PVD->getName();
@@ -162,9 +176,10 @@ bool RSExportForEach::validateAndConstructParams(
             clang::FullSourceLoc(PVD->getLocation(),
                                  DiagEngine->getSourceManager()),
             DiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
-                                        "Unexpected root() parameter '%0' "
-                                        "of type '%1'"))
-            << PVD->getName() << PVD->getType().getAsString();
+                                        "Unexpected %0() parameter '%1' "
+                                        "of type '%2'"))
+            << FD->getName() << PVD->getName()
+            << PVD->getType().getAsString();
           valid = false;
         }
       }
@@ -214,7 +229,7 @@ RSExportForEach *RSExportForEach::Create(RSContext *Context,
 
   slangAssert(!Name.empty() && "Function must have a name");
 
-  FE = new RSExportForEach(Context, Name, FD);
+  FE = new (Context) RSExportForEach(Context, Name, FD);
 
   if (!FE->validateAndConstructParams(Context, FD)) {
     return NULL;
@@ -283,19 +298,65 @@ RSExportForEach *RSExportForEach::Create(RSContext *Context,
   if (FE->mIn) {
     const clang::Type *T = FE->mIn->getType().getCanonicalType().getTypePtr();
     FE->mInType = RSExportType::Create(Context, T);
+    FE->mInAlignment = GetCellAlignment(Context, FE->mInType);
   }
 
   if (FE->mOut) {
     const clang::Type *T = FE->mOut->getType().getCanonicalType().getTypePtr();
     FE->mOutType = RSExportType::Create(Context, T);
+    FE->mOutAlignment = GetCellAlignment(Context, FE->mOutType);
+  }
+
+  return FE;
+}
+
+RSExportForEach *RSExportForEach::CreateDummyRoot(RSContext *Context) {
+  slangAssert(Context);
+  llvm::StringRef Name = "root";
+  RSExportForEach *FE = new (Context) RSExportForEach(Context, Name, NULL);
+  FE->mDummyRoot = true;
+  return FE;
+}
+
+RSExportForEach *
+RSExportForEach::CreateFused(RSContext *Context, const llvm::StringRef &Name,
+                             const std::vector<const RSExportForEach*> &Stages) {
+  slangAssert(Context && (Stages.size() > 1));
+  RSExportForEach *FE = new (Context) RSExportForEach(Context, Name, NULL);
+  FE->mStages = Stages;
+
+  const RSExportForEach *First = Stages.front();
+  FE->mIn = First->mIn;
+  FE->mInType = First->mInType;
+  FE->mInAlignment = First->mInAlignment;
+
+  const RSExportForEach *Last = Stages.back();
+  FE->mOut = Last->mOut;
+  FE->mOutType = Last->mOutType;
+  FE->mOutAlignment = Last->mOutAlignment;
+
+  for (std::vector<const RSExportForEach*>::const_iterator I = Stages.begin(),
+          E = Stages.end();
+       I != E;
+       I++) {
+    if ((*I)->mX)
+      FE->mX = (*I)->mX;
+    if ((*I)->mY)
+      FE->mY = (*I)->mY;
   }
 
+  FE->mMetadataEncoding |= (FE->mIn ?  0x01 : 0);
+  FE->mMetadataEncoding |= (FE->mOut ? 0x02 : 0);
+  FE->mMetadataEncoding |= (FE->mX ?   0x08 : 0);
+  FE->mMetadataEncoding |= (FE->mY ?   0x10 : 0);
+
   return FE;
 }
 
 bool RSExportForEach::isRSForEachFunc(int targetAPI,
     const clang::FunctionDecl *FD) {
-  // We currently support only compute root() being exported via forEach
+  // The other kernels are named by #pragma rs kernel (see
+  // RSContext::isKernelFunction().)
   if (!isRootRSFunc(FD)) {
     return false;
   }
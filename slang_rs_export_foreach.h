@@ -17,6 +17,8 @@
 #ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_EXPORT_FOREACH_H_  // NOLINT
 #define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_EXPORT_FOREACH_H_
 
+#include <vector>
+
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -33,8 +35,8 @@ namespace clang {
 
 namespace slang {
 
-// Base class for reflecting control-side forEach (currently for root()
-// functions that fit appropriate criteria)
+// Base class for reflecting control-side forEach (for compute root() and, since
+// JB, the other functions that fit appropriate criteria)
 class RSExportForEach : public RSExportable {
  private:
   std::string mName;
@@ -45,6 +47,25 @@ class RSExportForEach : public RSExportable {
 
   unsigned int mMetadataEncoding;
 
+  // Whether this stands in for a missing root() (see CreateDummyRoot())
+  bool mDummyRoot;
+
+  // The alignment of the cells *in and *out point to (0 if absent)
+  unsigned int mInAlignment;
+  unsigned int mOutAlignment;
+
+  // The number of cells the widened variant takes per call (see
+  // #pragma rs vectorize), 1 if there's none
+  unsigned int mVectorWidth;
+
+  // Whether the in, out and usrData are promised not to alias (see
+  // #pragma rs noalias)
+  bool mNoAlias;
+
+  // The kernels run in turn on each cell by a fused kernel (see
+  // #pragma rs fuse and CreateFused()), empty for the others
+  std::vector<const RSExportForEach*> mStages;
+
   const clang::ParmVarDecl *mIn;
   const clang::ParmVarDecl *mOut;
   const clang::ParmVarDecl *mUsrData;
@@ -58,7 +79,9 @@ class RSExportForEach : public RSExportable {
          const clang::FunctionDecl *FD)
     : RSExportable(Context, RSExportable::EX_FOREACH),
       mName(Name.data(), Name.size()), mParamPacketType(NULL), mInType(NULL),
-      mOutType(NULL), numParams(0), mMetadataEncoding(0),
+      mOutType(NULL), numParams(0), mMetadataEncoding(0), mDummyRoot(false),
+      mInAlignment(0), mOutAlignment(0), mVectorWidth(1),
+      mNoAlias(false),
       mIn(NULL), mOut(NULL), mUsrData(NULL),
       mX(NULL), mY(NULL), mZ(NULL), mAr(NULL) {
     return;
@@ -71,6 +94,18 @@ class RSExportForEach : public RSExportable {
   static RSExportForEach *Create(RSContext *Context,
                                  const clang::FunctionDecl *FD);
 
+  // The runtime launches root() by the slot 0. This makes a placeholder for
+  // it (taking no in nor out) when only the other kernels are defined.
+  static RSExportForEach *CreateDummyRoot(RSContext *Context);
+
+  // The kernel @Name running @Stages in turn on each cell, the out cell of one
+  // being the in cell of the next (as checked by RSContext), such that the
+  // cells in between never go to memory. It takes the in of the first stage,
+  // the out of the last one and the coordinates any of them takes.
+  static RSExportForEach *
+  CreateFused(RSContext *Context, const llvm::StringRef &Name,
+              const std::vector<const RSExportForEach*> &Stages);
+
   inline const std::string &getName() const {
     return mName;
   }
@@ -107,6 +142,53 @@ class RSExportForEach : public RSExportable {
     return mMetadataEncoding;
   }
 
+  inline bool isDummyRoot() const {
+    return mDummyRoot;
+  }
+
+  inline bool isFused() const {
+    return !mStages.empty();
+  }
+
+  inline const std::vector<const RSExportForEach*> &getStages() const {
+    return mStages;
+  }
+
+  inline unsigned int getInAlignment() const {
+    return mInAlignment;
+  }
+
+  inline unsigned int getOutAlignment() const {
+    return mOutAlignment;
+  }
+
+  // The widened variant steps *in and *out by their cells, so the sizes of the
+  // cells must be known (i.e., they are not void.)
+  inline bool canVectorize() const {
+    return !mDummyRoot &&
+           (!hasIn() || (mInAlignment != 0)) &&
+           (!hasOut() || (mOutAlignment != 0));
+  }
+
+  inline unsigned int getVectorWidth() const {
+    return mVectorWidth;
+  }
+
+  inline bool isNoAlias() const {
+    return mNoAlias;
+  }
+
+  inline void setNoAlias(bool NoAlias) {
+    mNoAlias = NoAlias;
+    return;
+  }
+
+  inline void setVectorWidth(unsigned int Width) {
+    slangAssert(canVectorize());
+    mVectorWidth = Width;
+    return;
+  }
+
   typedef RSExportRecordType::const_field_iterator const_param_iterator;
 
   inline const_param_iterator params_begin() const {
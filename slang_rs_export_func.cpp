@@ -60,7 +60,7 @@ RSExportFunc *RSExportFunc::Create(RSContext *Context,
     return NULL;
   }
 
-  F = new RSExportFunc(Context, Name, FD);
+  F = new (Context) RSExportFunc(Context, Name, FD);
 
   // Initialize mParamPacketType
   if (FD->getNumParams() <= 0) {
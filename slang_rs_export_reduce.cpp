@@ -0,0 +1,293 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "slang_rs_export_reduce.h"
+
+#include <string>
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+
+#include "llvm/DerivedTypes.h"
+#include "llvm/Target/TargetData.h"
+
+#include "slang_assert.h"
+#include "slang_rs_context.h"
+#include "slang_rs_export_foreach.h"
+#include "slang_rs_export_type.h"
+
+namespace slang {
+
+namespace {
+
+class ReduceDiagnostics {
+ private:
+  clang::DiagnosticsEngine *mDiagEngine;
+  const RSContext::ReduceSpec &mSpec;
+
+ public:
+  ReduceDiagnostics(clang::DiagnosticsEngine *DiagEngine,
+                    const RSContext::ReduceSpec &Spec)
+      : mDiagEngine(DiagEngine), mSpec(Spec) {
+    return;
+  }
+
+  // Report @Message (which may refer to %1 and %2) on @Loc (or on the pragma if
+  // invalid.) %0 is the name of the reduction.
+  clang::DiagnosticBuilder report(clang::SourceLocation Loc,
+                                  llvm::StringRef Message) {
+    if (Loc.isInvalid())
+      Loc = mSpec.Loc;
+    return mDiagEngine->Report(
+        clang::FullSourceLoc(Loc, mDiagEngine->getSourceManager()),
+        mDiagEngine->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                     Message)) << mSpec.Name;
+  }
+};
+
+const clang::FunctionDecl *LookupFunction(RSContext *Context,
+                                          const std::string &Name) {
+  const clang::IdentifierInfo *II =
+      Context->getPreprocessor().getIdentifierInfo(Name);
+  if (II == NULL)
+    return NULL;
+
+  clang::TranslationUnitDecl *TUDecl =
+      Context->getASTContext().getTranslationUnitDecl();
+  clang::DeclContext::lookup_const_result R = TUDecl->lookup(II);
+  for (clang::DeclContext::lookup_const_iterator I = R.first, E = R.second;
+       I != E;
+       I++) {
+    const clang::FunctionDecl *FD = llvm::dyn_cast<clang::FunctionDecl>(*I);
+    if (FD != NULL)
+      return FD;
+  }
+  return NULL;
+}
+
+bool IsPointerTo(clang::QualType QT, bool Const) {
+  QT = QT.getCanonicalType();
+  return QT->isPointerType() &&
+         (QT->getPointeeType().isConstQualified() == Const);
+}
+
+bool IsSamePointee(clang::QualType A, clang::QualType B) {
+  A = A.getCanonicalType()->getPointeeType().getUnqualifiedType();
+  B = B.getCanonicalType()->getPointeeType().getUnqualifiedType();
+  return A == B;
+}
+
+}  // namespace
+
+// Resolve the functions of @Spec and check their signatures (see the comment
+// of RSExportReduce.)
+bool RSExportReduce::validateAndConstructParams(
+    RSContext *Context, const RSContext::ReduceSpec &Spec) {
+  slangAssert(Context);
+  clang::ASTContext &C = Context->getASTContext();
+  ReduceDiagnostics Diags(Context->getDiagnostics(), Spec);
+  bool valid = true;
+
+  if (Spec.Accumulator.empty()) {
+    Diags.report(clang::SourceLocation(),
+                 "reduction '%0' requires an accumulator function");
+    return false;
+  }
+
+  // Resolve the functions
+  const char *const Roles[] = {
+    "accumulator", "initializer", "combiner", "outconverter"
+  };
+  const std::string *const Names[] = {
+    &Spec.Accumulator, &Spec.Initializer, &Spec.Combiner, &Spec.OutConverter
+  };
+  const clang::FunctionDecl **const FDs[] = {
+    &mAccumulator, &mInitializer, &mCombiner, &mOutConverter
+  };
+
+  for (unsigned i = 0; i < sizeof(Roles) / sizeof(Roles[0]); i++) {
+    if (Names[i]->empty())
+      continue;
+
+    const clang::FunctionDecl *FD = LookupFunction(Context, *Names[i]);
+    const clang::FunctionDecl *Definition = NULL;
+    if ((FD == NULL) || !FD->hasBody(Definition)) {
+      Diags.report(clang::SourceLocation(),
+                   "reduction '%0': %1 function '%2' is not defined")
+          << Roles[i] << *Names[i];
+      valid = false;
+      continue;
+    }
+    FD = Definition;
+
+    // Static functions can't be referred to by the runtime (and are gone
+    // anyway since nothing calls them.)
+    if (FD->getStorageClass() != clang::SC_None) {
+      Diags.report(FD->getLocation(),
+                   "reduction '%0': %1 function '%2' cannot be static or "
+                   "extern")
+          << Roles[i] << *Names[i];
+      valid = false;
+    } else if (RSExportForEach::isSpecialRSFunc(FD)) {
+      Diags.report(FD->getLocation(),
+                   "reduction '%0': %1 function cannot be '%2'")
+          << Roles[i] << *Names[i];
+      valid = false;
+    } else if (FD->getResultType().getCanonicalType() != C.VoidTy) {
+      Diags.report(FD->getLocation(),
+                   "reduction '%0': %1 function '%2' is required to return a "
+                   "void type")
+          << Roles[i] << *Names[i];
+      valid = false;
+    }
+
+    *FDs[i] = FD;
+  }
+
+  if (!valid)
+    return false;
+
+  // void accumulator(AccumType *accum, const InType *in[, uint32_t x
+  //                  [, uint32_t y]])
+  const clang::FunctionDecl *FD = mAccumulator;
+  unsigned NumParams = FD->getNumParams();
+  if ((NumParams < 2) || (NumParams > 4) ||
+      !IsPointerTo(FD->getParamDecl(0)->getType(), false) ||
+      !IsPointerTo(FD->getParamDecl(1)->getType(), true)) {
+    Diags.report(FD->getLocation(),
+                 "reduction '%0': accumulator function '%1' must be "
+                 "'void %1(AccumType *accum, const InType *in[, uint32_t x"
+                 "[, uint32_t y]])'")
+        << FD->getName();
+    return false;
+  }
+
+  clang::QualType AccumQT = FD->getParamDecl(0)->getType();
+  clang::QualType InQT = FD->getParamDecl(1)->getType();
+  mMetadataEncoding = 0x01;  // In
+
+  for (unsigned i = 2; i < NumParams; i++) {
+    const clang::ParmVarDecl *PVD = FD->getParamDecl(i);
+    if (PVD->getType().getCanonicalType().getUnqualifiedType() !=
+        C.UnsignedIntTy) {
+      Diags.report(PVD->getLocation(),
+                   "reduction '%0': unexpected accumulator parameter '%1' of "
+                   "type '%2'")
+          << PVD->getName() << PVD->getType().getAsString();
+      valid = false;
+    }
+    mMetadataEncoding |= ((i == 2) ? 0x08 : 0x10);  // X, Y
+  }
+
+  // void initializer(AccumType *accum)
+  FD = mInitializer;
+  if ((FD != NULL) &&
+      ((FD->getNumParams() != 1) ||
+       !IsPointerTo(FD->getParamDecl(0)->getType(), false) ||
+       !IsSamePointee(FD->getParamDecl(0)->getType(), AccumQT))) {
+    Diags.report(FD->getLocation(),
+                 "reduction '%0': initializer function '%1' must be "
+                 "'void %1(%2 accum)'")
+        << FD->getName() << AccumQT.getAsString();
+    valid = false;
+  }
+
+  // void combiner(AccumType *accum, const AccumType *other)
+  FD = mCombiner;
+  if (FD == NULL) {
+    if (!IsSamePointee(InQT, AccumQT) || (NumParams > 2)) {
+      Diags.report(clang::SourceLocation(),
+                   "reduction '%0' requires a combiner function since its "
+                   "accumulator function '%1' cannot combine two "
+                   "accumulators")
+          << mAccumulator->getName();
+      valid = false;
+    } else {
+      mCombiner = mAccumulator;
+    }
+  } else if ((FD->getNumParams() != 2) ||
+             !IsPointerTo(FD->getParamDecl(0)->getType(), false) ||
+             !IsSamePointee(FD->getParamDecl(0)->getType(), AccumQT) ||
+             !IsPointerTo(FD->getParamDecl(1)->getType(), true) ||
+             !IsSamePointee(FD->getParamDecl(1)->getType(), AccumQT)) {
+    Diags.report(FD->getLocation(),
+                 "reduction '%0': combiner function '%1' must be "
+                 "'void %1(%2 accum, const %2 other)'")
+        << FD->getName() << AccumQT.getAsString();
+    valid = false;
+  }
+
+  // void outconverter(ResultType *result, const AccumType *accum)
+  FD = mOutConverter;
+  if ((FD != NULL) &&
+      ((FD->getNumParams() != 2) ||
+       !IsPointerTo(FD->getParamDecl(0)->getType(), false) ||
+       !IsPointerTo(FD->getParamDecl(1)->getType(), true) ||
+       !IsSamePointee(FD->getParamDecl(1)->getType(), AccumQT))) {
+    Diags.report(FD->getLocation(),
+                 "reduction '%0': outconverter function '%1' must be "
+                 "'void %1(ResultType *result, const %2 accum)'")
+        << FD->getName() << AccumQT.getAsString();
+    valid = false;
+  }
+
+  return valid;
+}
+
+RSExportReduce *RSExportReduce::Create(RSContext *Context,
+                                       const RSContext::ReduceSpec &Spec) {
+  slangAssert(Context);
+  slangAssert(!Spec.Name.empty() && "Reduction must have a name");
+
+  RSExportReduce *ER = new (Context) RSExportReduce(Context, Spec.Name);
+
+  if (!ER->validateAndConstructParams(Context, Spec)) {
+    return NULL;
+  }
+
+  // The input and the result are reflected like the ones of forEach
+  const clang::Type *InT = ER->mAccumulator->getParamDecl(1)->getType()
+      .getCanonicalType().getTypePtr();
+  const clang::Type *AccumT = ER->mAccumulator->getParamDecl(0)->getType()
+      .getCanonicalType().getTypePtr();
+  const clang::Type *ResultT = AccumT;
+  if (ER->mOutConverter != NULL)
+    ResultT = ER->mOutConverter->getParamDecl(0)->getType()
+        .getCanonicalType().getTypePtr();
+
+  ER->mInType = RSExportType::Create(Context, InT);
+  ER->mAccumType = RSExportType::Create(Context, AccumT);
+  ER->mResultType = RSExportType::Create(Context, ResultT);
+  if ((ER->mInType == NULL) || (ER->mAccumType == NULL) ||
+      (ER->mResultType == NULL)) {
+    fprintf(stderr, "Failed to export the reduction %s. There's at least "
+                    "one parameter whose type is not supported by the "
+                    "reflection\n", ER->getName().c_str());
+    return NULL;
+  }
+
+  slangAssert((ER->mAccumType->getClass() == RSExportType::ExportClassPointer)
+              && "Accumulator must be a pointer");
+  const RSExportType *AccumET =
+      static_cast<const RSExportPointerType*>(ER->mAccumType)->
+          getPointeeType();
+  ER->mAccumSize =
+      Context->getTargetData()->getTypeAllocSize(AccumET->getLLVMType());
+
+  return ER;
+}
+
+}  // namespace slang
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_EXPORT_REDUCE_H_  // NOLINT
+#define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_EXPORT_REDUCE_H_
+
+#include <string>
+
+#include "llvm/ADT/StringRef.h"
+
+#include "clang/AST/Decl.h"
+
+#include "slang_assert.h"
+#include "slang_rs_context.h"
+#include "slang_rs_exportable.h"
+#include "slang_rs_export_type.h"
+
+namespace slang {
+
+// Reflecting control-side reduce_*() for a reduction declared by
+//
+//  #pragma rs reduce(name) accumulator(fn) [initializer(fn)] [combiner(fn)]
+//                          [outconverter(fn)]
+//
+// The runtime runs the accumulator over the input cells on each core with an
+// accumulator of its own, merges the per-core accumulators with the combiner
+// and turns the final one into the result by the outconverter:
+//
+//  void accumulator(AccumType *accum, const InType *in[, uint32_t x
+//                   [, uint32_t y]]);
+//  void initializer(AccumType *accum);  // Zero filled if omitted
+//  void combiner(AccumType *accum, const AccumType *other);
+//  void outconverter(ResultType *result, const AccumType *accum);
+//
+// The combiner can be omitted if the accumulator takes AccumType as its input
+// and no coordinates (then it's the combiner too.) The result is the final
+// accumulator if the outconverter is omitted.
+class RSExportReduce : public RSExportable {
+ private:
+  std::string mName;
+
+  const clang::FunctionDecl *mAccumulator;
+  const clang::FunctionDecl *mInitializer;
+  const clang::FunctionDecl *mCombiner;
+  const clang::FunctionDecl *mOutConverter;
+
+  // All are pointer types
+  RSExportType *mInType;
+  RSExportType *mAccumType;
+  RSExportType *mResultType;
+
+  size_t mAccumSize;
+
+  // The parameters of the accumulator, encoded as in #rs_export_foreach
+  unsigned int mMetadataEncoding;
+
+  RSExportReduce(RSContext *Context, const llvm::StringRef &Name)
+    : RSExportable(Context, RSExportable::EX_REDUCE),
+      mName(Name.data(), Name.size()), mAccumulator(NULL), mInitializer(NULL),
+      mCombiner(NULL), mOutConverter(NULL), mInType(NULL), mAccumType(NULL),
+      mResultType(NULL), mAccumSize(0), mMetadataEncoding(0) {
+    return;
+  }
+
+  bool validateAndConstructParams(RSContext *Context,
+                                  const RSContext::ReduceSpec &Spec);
+
+ public:
+  static RSExportReduce *Create(RSContext *Context,
+                                const RSContext::ReduceSpec &Spec);
+
+  inline const std::string &getName() const {
+    return mName;
+  }
+
+  inline const clang::FunctionDecl *getAccumulator() const {
+    return mAccumulator;
+  }
+
+  // NULL if omitted
+  inline const clang::FunctionDecl *getInitializer() const {
+    return mInitializer;
+  }
+
+  // The accumulator if omitted
+  inline const clang::FunctionDecl *getCombiner() const {
+    return mCombiner;
+  }
+
+  // NULL if omitted
+  inline const clang::FunctionDecl *getOutConverter() const {
+    return mOutConverter;
+  }
+
+  inline const RSExportType *getInType() const {
+    return mInType;
+  }
+
+  inline const RSExportType *getAccumType() const {
+    return mAccumType;
+  }
+
+  inline const RSExportType *getResultType() const {
+    return mResultType;
+  }
+
+  inline size_t getAccumSize() const {
+    return mAccumSize;
+  }
+
+  inline unsigned int getMetadataEncoding() const {
+    return mMetadataEncoding;
+  }
+};  // RSExportReduce
+
+}  // namespace slang
+
+#endif  // _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_EXPORT_REDUCE_H_  NOLINT
@@ -624,11 +624,23 @@ RSExportType *RSExportType::Create(RSContext *Context,
 }
 
 RSExportType *RSExportType::Create(RSContext *Context, const clang::Type *T) {
+  const clang::Type *CT = GET_CANONICAL_TYPE(T);
+  if (CT == NULL)
+    return NULL;
+
+  // NormalizeType() only depends on the canonical type. The failures are not
+  // cached such that the errors are reported every time.
+  if (RSExportType *ET = Context->lookupExportTypeCache(CT))
+    return ET;
+
   llvm::StringRef TypeName;
-  if (NormalizeType(T, TypeName, Context->getDiagnostics(), NULL))
-    return Create(Context, T, TypeName);
-  else
+  if (!NormalizeType(T, TypeName, Context->getDiagnostics(), NULL))
     return NULL;
+
+  RSExportType *ET = Create(Context, T, TypeName);
+  if (ET != NULL)
+    Context->insertExportTypeCache(CT, ET);
+  return ET;
 }
 
 RSExportType *RSExportType::CreateFromDecl(RSContext *Context,
@@ -668,14 +680,6 @@ RSExportType::RSExportType(RSContext *Context,
   return;
 }
 
-bool RSExportType::keep() {
-  if (!RSExportable::keep())
-    return false;
-  // Invalidate converted LLVM type.
-  mLLVMType = NULL;
-  return true;
-}
-
 bool RSExportType::equals(const RSExportable *E) const {
   CHECK_PARENT_EQUALITY(RSExportable, E);
   return (static_cast<const RSExportType*>(E)->getClass() == getClass());
@@ -686,10 +690,23 @@ RSExportType::~RSExportType() {
 }
 
 /************************** RSExportPrimitiveType **************************/
-llvm::ManagedStatic<RSExportPrimitiveType::RSSpecificTypeMapTy>
-RSExportPrimitiveType::RSSpecificTypeMap;
+namespace {
 
-llvm::Type *RSExportPrimitiveType::RSObjectLLVMType = NULL;
+// The slots of the perfect hash table of the RS matrix and object types
+struct RSSpecificTypeSlot {
+  const char *Name;
+  RSExportPrimitiveType::DataType Type;
+};
+
+const RSSpecificTypeSlot RSSpecificTypeTable[] = {
+#define ENUM_RS_SPECIFIC_TYPE_SLOT(type, cname)                     \
+  { cname, RSExportPrimitiveType::DataType ## type },
+#define ENUM_RS_EMPTY_SLOT()                                        \
+  { NULL, RSExportPrimitiveType::DataTypeUnknown },
+#include "RSSpecificTypeTable.inc"
+};
+
+}  // namespace
 
 bool RSExportPrimitiveType::IsPrimitiveType(const clang::Type *T) {
   if ((T != NULL) && (T->getTypeClass() == clang::Type::Builtin))
@@ -703,20 +720,14 @@ RSExportPrimitiveType::GetRSSpecificType(const llvm::StringRef &TypeName) {
   if (TypeName.empty())
     return DataTypeUnknown;
 
-  if (RSSpecificTypeMap->empty()) {
-#define ENUM_RS_MATRIX_TYPE(type, cname, dim)                       \
-    RSSpecificTypeMap->GetOrCreateValue(cname, DataType ## type);
-#include "RSMatrixTypeEnums.inc"
-#define ENUM_RS_OBJECT_TYPE(type, cname)                            \
-    RSSpecificTypeMap->GetOrCreateValue(cname, DataType ## type);
-#include "RSObjectTypeEnums.inc"
-  }
-
-  RSSpecificTypeMapTy::const_iterator I = RSSpecificTypeMap->find(TypeName);
-  if (I == RSSpecificTypeMap->end())
+  const RSSpecificTypeSlot &Slot =
+      RSSpecificTypeTable[RSSpecHash(TypeName.begin(), TypeName.end(),
+                                     RS_SPECIFIC_TYPE_TABLE_SEED) &
+                          (RS_SPECIFIC_TYPE_TABLE_SIZE - 1)];
+  if ((Slot.Name == NULL) || (TypeName != Slot.Name))
     return DataTypeUnknown;
   else
-    return I->getValue();
+    return Slot.Type;
 }
 
 RSExportPrimitiveType::DataType
@@ -861,8 +872,8 @@ RSExportPrimitiveType
   if ((DT == DataTypeUnknown) || TypeName.empty())
     return NULL;
   else
-    return new RSExportPrimitiveType(Context, ExportClassPrimitive, TypeName,
-                                     DT, DK, Normalized);
+    return new (Context) RSExportPrimitiveType(Context, ExportClassPrimitive,
+                                               TypeName, DT, DK, Normalized);
 }
 
 RSExportPrimitiveType *RSExportPrimitiveType::Create(RSContext *Context,
@@ -889,15 +900,21 @@ llvm::Type *RSExportPrimitiveType::convertToLLVMType() const {
     //
     // <{ [1 x i32] }> in LLVM
     //
-    if (RSObjectLLVMType == NULL) {
-      std::vector<llvm::Type *> Elements;
-      Elements.push_back(llvm::ArrayType::get(llvm::Type::getInt32Ty(C), 1));
-      RSObjectLLVMType = llvm::StructType::get(C, Elements, true);
-    }
-    return RSObjectLLVMType;
+    // Literal struct types are uniqued by (and owned by) the LLVMContext C, so
+    // there's no need to cache the result here.
+    std::vector<llvm::Type *> Elements;
+    Elements.push_back(llvm::ArrayType::get(llvm::Type::getInt32Ty(C), 1));
+    return llvm::StructType::get(C, Elements, true);
   }
 
   switch (mType) {
+    // Like clang does, half is stored as i16 and converted to float (by the
+    // llvm.convert.{from,to}.fp16 intrinsics) to compute with, which are the
+    // single vcvt instructions on the targets with fp16 support.
+    case DataTypeFloat16: {
+      return llvm::Type::getInt16Ty(C);
+      break;
+    }
     case DataTypeFloat32: {
       return llvm::Type::getFloatTy(C);
       break;
@@ -977,7 +994,7 @@ RSExportPointerType
     return NULL;
   }
 
-  return new RSExportPointerType(Context, TypeName, PointeeET);
+  return new (Context) RSExportPointerType(Context, TypeName, PointeeET);
 }
 
 llvm::Type *RSExportPointerType::convertToLLVMType() const {
@@ -997,13 +1014,6 @@ union RSType *RSExportPointerType::convertToSpecType() const {
     return NULL;
 }
 
-bool RSExportPointerType::keep() {
-  if (!RSExportType::keep())
-    return false;
-  const_cast<RSExportType*>(mPointeeType)->keep();
-  return true;
-}
-
 bool RSExportPointerType::equals(const RSExportable *E) const {
   CHECK_PARENT_EQUALITY(RSExportType, E);
   return (static_cast<const RSExportPointerType*>(E)
@@ -1052,12 +1062,12 @@ RSExportVectorType *RSExportVectorType::Create(RSContext *Context,
       RSExportPrimitiveType::GetDataType(Context, ElementType);
 
   if (DT != RSExportPrimitiveType::DataTypeUnknown)
-    return new RSExportVectorType(Context,
-                                  TypeName,
-                                  DT,
-                                  DK,
-                                  Normalized,
-                                  EVT->getNumElements());
+    return new (Context) RSExportVectorType(Context,
+                                            TypeName,
+                                            DT,
+                                            DK,
+                                            Normalized,
+                                            EVT->getNumElements());
   else
     return NULL;
 }
@@ -1159,7 +1169,7 @@ RSExportMatrixType *RSExportMatrixType::Create(RSContext *Context,
     }
   }
 
-  return new RSExportMatrixType(Context, TypeName, Dim);
+  return new (Context) RSExportMatrixType(Context, TypeName, Dim);
 }
 
 llvm::Type *RSExportMatrixType::convertToLLVMType() const {
@@ -1209,9 +1219,9 @@ RSExportConstantArrayType
     return NULL;
   }
 
-  return new RSExportConstantArrayType(Context,
-                                       ElementET,
-                                       Size);
+  return new (Context) RSExportConstantArrayType(Context,
+                                                 ElementET,
+                                                 Size);
 }
 
 llvm::Type *RSExportConstantArrayType::convertToLLVMType() const {
@@ -1232,13 +1242,6 @@ union RSType *RSExportConstantArrayType::convertToSpecType() const {
     return NULL;
 }
 
-bool RSExportConstantArrayType::keep() {
-  if (!RSExportType::keep())
-    return false;
-  const_cast<RSExportType*>(mElementType)->keep();
-  return true;
-}
-
 bool RSExportConstantArrayType::equals(const RSExportable *E) const {
   CHECK_PARENT_EQUALITY(RSExportType, E);
   const RSExportConstantArrayType *RHS =
@@ -1271,11 +1274,12 @@ RSExportRecordType *RSExportRecordType::Create(RSContext *Context,
       "Failed to retrieve the struct layout from Clang.");
 
   RSExportRecordType *ERT =
-      new RSExportRecordType(Context,
-                             TypeName,
-                             RD->hasAttr<clang::PackedAttr>(),
-                             mIsArtificial,
-                             RL->getSize().getQuantity());
+      new (Context) RSExportRecordType(Context,
+                                       TypeName,
+                                       RD->hasAttr<clang::PackedAttr>(),
+                                       mIsArtificial,
+                                       RL->getSize().getQuantity());
+  ERT->mRecordDecl = RD;
   unsigned int Index = 0;
 
   for (clang::RecordDecl::field_iterator FI = RD->field_begin(),
@@ -1297,7 +1301,8 @@ RSExportRecordType *RSExportRecordType::Create(RSContext *Context,
 
     if (ET != NULL) {
       ERT->mFields.push_back(
-          new Field(ET, FD->getName(), ERT,
+          new (Context->getExportableAllocator().Allocate<Field>())
+              Field(ET, FD->getName(), ERT,
                     static_cast<size_t>(RL->getFieldOffset(Index) >> 3)));
     } else {
       DiagEngine->Report(
@@ -1378,18 +1383,6 @@ union RSType *RSExportRecordType::convertToSpecType() const {
   return ST.take();
 }
 
-bool RSExportRecordType::keep() {
-  if (!RSExportType::keep())
-    return false;
-  for (std::list<const Field*>::iterator I = mFields.begin(),
-          E = mFields.end();
-       I != E;
-       I++) {
-    const_cast<RSExportType*>((*I)->getType())->keep();
-  }
-  return true;
-}
-
 bool RSExportRecordType::equals(const RSExportable *E) const {
   CHECK_PARENT_EQUALITY(RSExportType, E);
 
@@ -17,9 +17,9 @@
 #ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_EXPORT_TYPE_H_  // NOLINT
 #define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_EXPORT_TYPE_H_
 
-#include <list>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "clang/AST/Decl.h"
 #include "clang/AST/Type.h"
@@ -28,8 +28,6 @@
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 
-#include "llvm/Support/ManagedStatic.h"
-
 #include "slang_rs_exportable.h"
 
 #define GET_CANONICAL_TYPE(T) \
@@ -162,7 +160,6 @@ class RSExportType : public RSExportable {
 
   inline const std::string &getName() const { return mName; }
 
-  virtual bool keep();
   virtual bool equals(const RSExportable *E) const;
 };  // RSExportType
 
@@ -214,11 +211,6 @@ class RSExportPrimitiveType : public RSExportType {
   DataKind mKind;
   bool mNormalized;
 
-  typedef llvm::StringMap<DataType> RSSpecificTypeMapTy;
-  static llvm::ManagedStatic<RSSpecificTypeMapTy> RSSpecificTypeMap;
-
-  static llvm::Type *RSObjectLLVMType;
-
   static const size_t SizeOfDataTypeInBits[];
   // @T was normalized by calling RSExportType::NormalizeType() before calling
   // this.
@@ -260,6 +252,8 @@ class RSExportPrimitiveType : public RSExportType {
                                        const clang::Type *T,
                                        DataKind DK = DataKindUser);
 
+  // Looked up in the perfect hash table generated by rs-spec-gen, so it's
+  // safe to call concurrently.
   static DataType GetRSSpecificType(const llvm::StringRef &TypeName);
   static DataType GetRSSpecificType(const clang::Type *T);
 
@@ -309,7 +303,6 @@ class RSExportPointerType : public RSExportType {
   virtual union RSType *convertToSpecType() const;
 
  public:
-  virtual bool keep();
 
   inline const RSExportType *getPointeeType() const { return mPointeeType; }
 
@@ -421,7 +414,6 @@ class RSExportConstantArrayType : public RSExportType {
   inline unsigned getSize() const { return mSize; }
   inline const RSExportType *getElementType() const { return mElementType; }
 
-  virtual bool keep();
   virtual bool equals(const RSExportable *E) const;
 };
 
@@ -456,7 +448,8 @@ class RSExportRecordType : public RSExportType {
     inline size_t getOffsetInParent() const { return mOffset; }
   };
 
-  typedef std::list<const Field*>::const_iterator const_field_iterator;
+  typedef std::vector<const Field*> FieldList;
+  typedef FieldList::const_iterator const_field_iterator;
 
   inline const_field_iterator fields_begin() const {
     return this->mFields.begin();
@@ -466,12 +459,15 @@ class RSExportRecordType : public RSExportType {
   }
 
  private:
-  std::list<const Field*> mFields;
+  // The fields are allocated from the arena of the RSContext.
+  FieldList mFields;
   bool mIsPacked;
   // Artificial export struct type is not exported by user (and thus it won't
   // get reflected)
   bool mIsArtificial;
   size_t mAllocSize;
+  // The definition of the struct
+  const clang::RecordDecl *mRecordDecl;
 
   RSExportRecordType(RSContext *Context,
                      const llvm::StringRef &Name,
@@ -481,7 +477,8 @@ class RSExportRecordType : public RSExportType {
       : RSExportType(Context, ExportClassRecord, Name),
         mIsPacked(IsPacked),
         mIsArtificial(IsArtificial),
-        mAllocSize(AllocSize) {
+        mAllocSize(AllocSize),
+        mRecordDecl(NULL) {
     return;
   }
 
@@ -498,21 +495,19 @@ class RSExportRecordType : public RSExportType {
   virtual union RSType *convertToSpecType() const;
 
  public:
-  inline const std::list<const Field*>& getFields() const { return mFields; }
+  inline const FieldList &getFields() const { return mFields; }
   inline bool isPacked() const { return mIsPacked; }
   inline bool isArtificial() const { return mIsArtificial; }
   inline size_t getAllocSize() const { return mAllocSize; }
+  inline const clang::RecordDecl *getRecordDecl() const { return mRecordDecl; }
 
-  virtual bool keep();
   virtual bool equals(const RSExportable *E) const;
 
   ~RSExportRecordType() {
-    for (std::list<const Field*>::iterator I = mFields.begin(),
-             E = mFields.end();
+    for (FieldList::iterator I = mFields.begin(), E = mFields.end();
          I != E;
          I++)
-      if (*I != NULL)
-        delete *I;
+      (*I)->~Field();
     return;
   }
 };  // RSExportRecordType
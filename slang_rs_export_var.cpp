@@ -32,7 +32,8 @@ RSExportVar::RSExportVar(RSContext *Context,
     : RSExportable(Context, RSExportable::EX_VAR),
       mName(VD->getName().data(), VD->getName().size()),
       mET(ET),
-      mIsConst(false) {
+      mIsConst(false),
+      mIsFolded(false) {
   // mInit - Evaluate initializer expression
   const clang::Expr *Initializer = VD->getAnyInitializer();
   if (Initializer != NULL) {
@@ -52,6 +53,32 @@ RSExportVar::RSExportVar(RSContext *Context,
           Initializer->Evaluate(mInit, Context->getASTContext());
         break;
       }
+      case RSExportType::ExportClassConstantArray: {
+        // Evaluated element by element since clang can't evaluate an array
+        const clang::InitListExpr *IL =
+            llvm::dyn_cast<clang::InitListExpr>(Initializer);
+        const RSExportType *ElementET =
+            static_cast<const RSExportConstantArrayType*>(ET)->
+                getElementType();
+        if ((IL == NULL) ||
+            (ElementET->getClass() != RSExportType::ExportClassPrimitive) ||
+            static_cast<const RSExportPrimitiveType*>(ElementET)->
+                isRSObjectType())
+          break;
+
+        for (unsigned i = 0, e = IL->getNumInits(); i != e; i++) {
+          clang::Expr::EvalResult Element;
+          if ((IL->getInit(i) == NULL) ||
+              !IL->getInit(i)->Evaluate(Element, Context->getASTContext()) ||
+              Element.HasSideEffects ||
+              !(Element.Val.isInt() || Element.Val.isFloat())) {
+            mArrayInit.clear();
+            break;
+          }
+          mArrayInit.push_back(Element.Val);
+        }
+        break;
+      }
       case RSExportType::ExportClassRecord: {
         // No action
         fprintf(stderr, "RSExportVar::RSExportVar : Reflection of initializer "
@@ -73,6 +100,19 @@ RSExportVar::RSExportVar(RSContext *Context,
     mIsConst = QT.isConstQualified();
   }
 
+  // mIsFolded - Does it need a slot? The RS objects are always set at runtime,
+  // and mArrayInit is only set for the arrays of scalars evaluated in full.
+  if (mIsConst && !mInit.Val.isUninit() && !mInit.HasSideEffects) {
+    if (ET->getClass() == RSExportType::ExportClassPrimitive) {
+      mIsFolded =
+          !static_cast<const RSExportPrimitiveType*>(ET)->isRSObjectType();
+    } else if (ET->getClass() == RSExportType::ExportClassVector) {
+      mIsFolded = true;
+    }
+  } else if (mIsConst && !mArrayInit.empty()) {
+    mIsFolded = true;
+  }
+
   return;
 }
 
@@ -18,6 +18,7 @@
 #define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_EXPORT_VAR_H_
 
 #include <string>
+#include <vector>
 
 #include "clang/AST/Decl.h"
 #include "clang/AST/Expr.h"
@@ -40,9 +41,14 @@ class RSExportVar : public RSExportable {
   std::string mName;
   const RSExportType *mET;
   bool mIsConst;
+  bool mIsFolded;
 
   clang::Expr::EvalResult mInit;
 
+  // The leading elements of an array of scalars given by its initializer (the
+  // rest are zero), empty if any can't be evaluated.
+  std::vector<clang::APValue> mArrayInit;
+
   RSExportVar(RSContext *Context,
               const clang::VarDecl *VD,
               const RSExportType *ET);
@@ -52,7 +58,15 @@ class RSExportVar : public RSExportable {
   inline const RSExportType *getType() const { return mET; }
   inline bool isConst() const { return mIsConst; }
 
+  // A const scalar, vector or array of scalars with a constant initializer,
+  // which is reflected as a Java constant and folded into the code instead of
+  // taking a slot.
+  inline bool isFolded() const { return mIsFolded; }
+
   inline const clang::APValue &getInit() const { return mInit.Val; }
+  inline const std::vector<clang::APValue> &getArrayInit() const {
+    return mArrayInit;
+  }
 };  // RSExportVar
 
 }   // namespace slang
@@ -16,14 +16,15 @@
 
 #include "slang_rs_exportable.h"
 
+#include "llvm/Support/AlignOf.h"
+#include "llvm/Support/DataTypes.h"
+
 namespace slang {
 
-bool RSExportable::keep() {
-  if (isKeep())
-    return false;
-  // Invalidate associated Context.
-  mContext = NULL;
-  return true;
+void *RSExportable::operator new(size_t Size, RSContext *Context) {
+  // None of the exportables has a member aligned more strictly than uint64_t.
+  return Context->getExportableAllocator().Allocate(
+      Size, llvm::AlignOf<uint64_t>::Alignment);
 }
 
 bool RSExportable::equals(const RSExportable *E) const {
@@ -17,17 +17,24 @@
 #ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_EXPORTABLE_H_  // NOLINT
 #define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_EXPORTABLE_H_
 
+#include <cstddef>
+
 #include "slang_rs_context.h"
 
 namespace slang {
 
+// The reflection runs after the AST is freed (see Slang::setLowMemory()), so
+// it must only read what the exportables keep of their own (names, types,
+// layouts and initial values.) The clang declarations some of them refer to
+// are for the export processing of the backend alone.
 class RSExportable {
  public:
   enum Kind {
     EX_FUNC,
     EX_TYPE,
     EX_VAR,
-    EX_FOREACH
+    EX_FOREACH,
+    EX_REDUCE
   };
 
  private:
@@ -44,14 +51,15 @@ class RSExportable {
   }
 
  public:
-  inline Kind getKind() const { return mK; }
+  // RSExportables are allocated from the arena of the RSContext they belong
+  // to (i.e., new (Context) RSExportXXX(Context, ...)) and are destroyed all
+  // at once with it (see RSContext::~RSContext()). Deleting one individually
+  // releases nothing.
+  static void *operator new(size_t Size, RSContext *Context);
+  static void operator delete(void *Ptr, RSContext *Context) { }
+  static void operator delete(void *Ptr) { }
 
-  // When keep() is invoked, mKeep will set to true and the associated RSContext
-  // won't free this RSExportable object in its destructor. The deallcation
-  // responsibility is then transferred to the object who invoked this function.
-  // Return false if the exportable is kept or failed to keep.
-  virtual bool keep();
-  inline bool isKeep() const { return (mContext == NULL); }
+  inline Kind getKind() const { return mK; }
 
   virtual bool equals(const RSExportable *E) const;
 
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "slang_rs_kernel_cost.h"
+
+#include <cctype>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "llvm/Constants.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/Function.h"
+#include "llvm/Instructions.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include "llvm/Target/TargetData.h"
+
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include "slang_utils.h"
+
+namespace slang {
+
+namespace {
+
+// The name in the source of the function @Name, i.e., <name> of
+// _Z<length of name><name><parameters> if it's mangled.
+llvm::StringRef GetSourceName(llvm::StringRef Name) {
+  if (!Name.startswith("_Z"))
+    return Name;
+
+  size_t i = 2, Length = 0;
+  while ((i < Name.size()) && isdigit(Name[i]))
+    Length = Length * 10 + (Name[i++] - '0');
+  if ((Length == 0) || (i + Length > Name.size()))
+    return Name;
+  return Name.substr(i, Length);
+}
+
+}  // namespace
+
+RSKernelCost::RSKernelCost(const llvm::Function &F, const char *Kind,
+                           const llvm::TargetData &TD)
+    : mName(F.getName()), mKind(Kind), mInstructions(0), mLoads(0),
+      mStores(0), mCalls(0), mLoops(0), mStackBytes(0),
+      mHasDynamicStack(false) {
+  for (llvm::Function::const_iterator BB = F.begin(), BE = F.end();
+       BB != BE;
+       BB++) {
+    for (llvm::BasicBlock::const_iterator I = BB->begin(), IE = BB->end();
+         I != IE;
+         I++) {
+      mInstructions++;
+
+      llvm::Type *T = I->getType();
+      if (llvm::isa<llvm::LoadInst>(I)) {
+        mLoads++;
+      } else if (const llvm::StoreInst *SI =
+                     llvm::dyn_cast<llvm::StoreInst>(I)) {
+        mStores++;
+        T = SI->getValueOperand()->getType();
+      } else if (const llvm::CallInst *CI =
+                     llvm::dyn_cast<llvm::CallInst>(I)) {
+        mCalls++;
+        const llvm::Function *Callee = CI->getCalledFunction();
+        if ((Callee != NULL) && Callee->isDeclaration() &&
+            (Callee->getIntrinsicID() == 0))
+          mRuntimeCalls[GetSourceName(Callee->getName()).str()]++;
+      } else if (const llvm::AllocaInst *AI =
+                     llvm::dyn_cast<llvm::AllocaInst>(I)) {
+        const llvm::ConstantInt *Size =
+            llvm::dyn_cast<llvm::ConstantInt>(AI->getArraySize());
+        if (AI->isStaticAlloca() && (Size != NULL))
+          mStackBytes += TD.getTypeAllocSize(AI->getAllocatedType()) *
+                         Size->getZExtValue();
+        else
+          mHasDynamicStack = true;
+      }
+
+      if (llvm::VectorType *VT = llvm::dyn_cast<llvm::VectorType>(T))
+        mVectorInstructions[VT->getNumElements()]++;
+    }
+  }
+
+  llvm::SmallVector<std::pair<const llvm::BasicBlock*,
+                              const llvm::BasicBlock*>, 8> BackEdges;
+  llvm::FindFunctionBackedges(F, BackEdges);
+  std::set<const llvm::BasicBlock*> Headers;
+  for (unsigned i = 0, e = BackEdges.size(); i != e; i++)
+    Headers.insert(BackEdges[i].second);
+  mLoops = Headers.size();
+
+  return;
+}
+
+void RSKernelCost::printJSON(llvm::raw_ostream &OS, unsigned Indent) const {
+  std::string In(Indent, ' ');
+  OS << In << "{\n";
+  OS << In << "  \"name\": ";
+  SlangUtils::PrintJSONString(OS, mName);
+  OS << ",\n" << In << "  \"kind\": \"" << mKind << "\",\n";
+  OS << In << "  \"instructions\": " << mInstructions << ",\n";
+  OS << In << "  \"loads\": " << mLoads << ",\n";
+  OS << In << "  \"stores\": " << mStores << ",\n";
+  OS << In << "  \"calls\": " << mCalls << ",\n";
+
+  OS << In << "  \"runtime_calls\": {";
+  for (std::map<std::string, unsigned>::const_iterator
+          I = mRuntimeCalls.begin(), E = mRuntimeCalls.end();
+       I != E;
+       I++) {
+    OS << ((I == mRuntimeCalls.begin()) ? " " : ", ");
+    SlangUtils::PrintJSONString(OS, I->first);
+    OS << ": " << I->second;
+  }
+  OS << (mRuntimeCalls.empty() ? "},\n" : " },\n");
+
+  OS << In << "  \"loops\": " << mLoops << ",\n";
+
+  // Keyed by the number of elements
+  OS << In << "  \"vector_instructions\": {";
+  for (std::map<unsigned, unsigned>::const_iterator
+          I = mVectorInstructions.begin(), E = mVectorInstructions.end();
+       I != E;
+       I++) {
+    OS << ((I == mVectorInstructions.begin()) ? " " : ", ");
+    OS << "\"" << I->first << "\": " << I->second;
+  }
+  OS << (mVectorInstructions.empty() ? "},\n" : " },\n");
+
+  OS << In << "  \"stack_bytes\": " << mStackBytes << ",\n";
+  OS << In << "  \"dynamic_stack\": "
+     << (mHasDynamicStack ? "true" : "false") << "\n";
+  OS << In << "}";
+  return;
+}
+
+}  // namespace slang
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_KERNEL_COST_H_  // NOLINT
+#define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_KERNEL_COST_H_
+
+#include <map>
+#include <string>
+
+#include "llvm/Support/DataTypes.h"
+
+namespace llvm {
+  class Function;
+  class raw_ostream;
+  class TargetData;
+}
+
+namespace slang {
+
+// RSKernelCost - A static estimate of the cost of an entry point of a script
+// (a kernel or an invokable function), counted on its optimized IR (see
+// llvm-rs-cc -kernel-cost-report.) Nothing is run, such that the costs of two
+// builds of a script can be compared without a device. The callees are not
+// accounted, only the calls to them.
+class RSKernelCost {
+ private:
+  std::string mName;
+  const char *mKind;
+
+  unsigned mInstructions;
+  unsigned mLoads;
+  unsigned mStores;
+  unsigned mCalls;
+  // The loops (i.e., the blocks targeted by a back edge)
+  unsigned mLoops;
+
+  // The calls to the functions of the runtime by name (without the mangling,
+  // so the overloads are counted together), e.g., rsSetObject
+  std::map<std::string, unsigned> mRuntimeCalls;
+
+  // The instructions producing (or storing) a vector by number of elements
+  std::map<unsigned, unsigned> mVectorInstructions;
+
+  // The size of the allocas of fixed size, and whether there are others
+  uint64_t mStackBytes;
+  bool mHasDynamicStack;
+
+ public:
+  // @Kind is "forEach" or "invokable".
+  RSKernelCost(const llvm::Function &F, const char *Kind,
+               const llvm::TargetData &TD);
+
+  inline const std::string &getName() const { return mName; }
+  inline unsigned getInstructions() const { return mInstructions; }
+
+  // An object of the "functions" array of the report, indented by @Indent
+  void printJSON(llvm::raw_ostream &OS, unsigned Indent) const;
+};
+
+}  // namespace slang
+
+#endif  // _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_KERNEL_COST_H_  NOLINT
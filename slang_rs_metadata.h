@@ -31,4 +31,39 @@
 
 #define RS_EXPORT_FOREACH_MN "#rs_export_foreach"
 
+#define RS_EXPORT_FOREACH_NAME_MN "#rs_export_foreach_name"
+
+// What the kernel in the same slot of #rs_export_foreach promises about its
+// pointer parameters
+#define RS_EXPORT_FOREACH_PARAM_MN "#rs_export_foreach_param"
+#define RS_EXPORT_FOREACH_PARAM_ACCESS 0
+#define RS_EXPORT_FOREACH_PARAM_IN_ALIGN 1
+#define RS_EXPORT_FOREACH_PARAM_OUT_ALIGN 2
+
+// Bits of RS_EXPORT_FOREACH_PARAM_ACCESS
+#define RS_FOREACH_ACCESS_IN_READ_ONLY 0x01
+#define RS_FOREACH_ACCESS_USRDATA_READ_ONLY 0x04
+#define RS_FOREACH_ACCESS_NO_ALIAS 0x08
+
+// The number of cells the widened variant of the kernel in the same slot of
+// #rs_export_foreach takes per call (1 if there's none.) The variant of kernel
+// foo taking N cells is foo.xN (see #pragma rs vectorize.) Only emitted if
+// there's any.
+#define RS_EXPORT_FOREACH_VECTORIZE_MN "#rs_export_foreach_vectorize"
+
+#define RS_EXPORT_REDUCE_MN "#rs_export_reduce"
+#define RS_EXPORT_REDUCE_NAME 0
+#define RS_EXPORT_REDUCE_ACCUMULATOR 1
+#define RS_EXPORT_REDUCE_INITIALIZER 2
+#define RS_EXPORT_REDUCE_COMBINER 3
+#define RS_EXPORT_REDUCE_OUTCONVERTER 4
+#define RS_EXPORT_REDUCE_ACCUM_SIZE 5
+#define RS_EXPORT_REDUCE_SIGNATURE 6
+
+// The exported variable (always the last one) pointing to the counters of
+// llvm-rs-cc -finstrument-kernels: calls and nanoseconds as a pair of longs
+// for each function in #rs_kernel_profile, in that order.
+#define RS_KERNEL_PROFILE_VAR_NAME ".rs.kernel_profile"
+#define RS_KERNEL_PROFILE_MN "#rs_kernel_profile"
+
 #endif  // _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_METADATA_H_  NOLINT
@@ -33,6 +33,10 @@
 //
 // 5. RSVar => an string table index plus RSType array index
 // 6. RSFunction => an string table index
+// 7. RSForEach => an string table index plus the signature (as in
+//    #rs_export_foreach)
+//
+// All the integers are 32-bit little-endian, stored as raw bytes in MDString.
 
 namespace llvm {
   class Module;
@@ -50,6 +54,11 @@ struct RSFunction {
   const char *name;  // function name
 };
 
+struct RSForEach {
+  const char *name;  // kernel name
+  unsigned signature;
+};
+
 // Opaque pointer
 typedef int RSMetadataEncoder;
 
@@ -60,6 +69,8 @@ RSMetadataEncoder *CreateRSMetadataEncoder(llvm::Module *M);
 int RSEncodeVarMetadata(RSMetadataEncoder *E, const RSVar *V);
 // Encode F as a metadata in M. Return 0 if every thing goes well.
 int RSEncodeFunctionMetadata(RSMetadataEncoder *E, const RSFunction *F);
+// Encode FE as a metadata in M. Return 0 if every thing goes well.
+int RSEncodeForEachMetadata(RSMetadataEncoder *E, const RSForEach *FE);
 
 // Release the memory allocation of Encoder without flushing things.
 void DestroyRSMetadataEncoder(RSMetadataEncoder *E);
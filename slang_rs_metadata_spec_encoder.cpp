@@ -17,6 +17,7 @@
 #include "slang_rs_metadata_spec.h"
 
 #include <cstdlib>
+#include <cstring>
 #include <list>
 #include <map>
 #include <string>
@@ -30,11 +31,14 @@
 #include "slang_assert.h"
 #include "slang_rs_type_spec.h"
 
-#define RS_METADATA_STRTAB_MN   "#rs_metadata_strtab"
-#define RS_TYPE_INFO_MN         "#rs_type_info"
-#define RS_EXPORT_VAR_MN        "#rs_export_var"
-#define RS_EXPORT_FUNC_MN       "#rs_export_func"
-#define RS_EXPORT_RECORD_TYPE_NAME_MN_PREFIX  "%"
+// The names don't clash with the legacy metadata (see slang_rs_metadata.h)
+// such that both can be emitted into the same module.
+#define RS_METADATA_STRTAB_MN   "#rs_compact_strtab"
+#define RS_TYPE_INFO_MN         "#rs_compact_type_info"
+#define RS_EXPORT_VAR_MN        "#rs_compact_export_var"
+#define RS_EXPORT_FUNC_MN       "#rs_compact_export_func"
+#define RS_EXPORT_FOREACH_MN    "#rs_compact_export_foreach"
+#define RS_EXPORT_RECORD_TYPE_NAME_MN_PREFIX  "#rs_compact_record:"
 
 ///////////////////////////////////////////////////////////////////////////////
 // Useful utility functions
@@ -76,6 +80,7 @@ class RSMetadataEncoderInternal {
 
   llvm::NamedMDNode *mVarInfoMetadata;
   llvm::NamedMDNode *mFuncInfoMetadata;
+  llvm::NamedMDNode *mForEachInfoMetadata;
 
   // This function check the return value of function:
   //   joinString, encodeTypeBase, encode*Type(), encodeRSType, encodeRSVar,
@@ -107,6 +112,7 @@ RS_DATA_TYPE_CLASS_ENUMS
 
   int encodeRSVar(const RSVar *V);
   int encodeRSFunc(const RSFunction *F);
+  int encodeRSForEach(const RSForEach *FE);
 
   int finalize();
 };
@@ -117,7 +123,8 @@ RSMetadataEncoderInternal::RSMetadataEncoderInternal(llvm::Module *M)
       mCurTypeIndex(0),
       mCurStringIndex(0),
       mVarInfoMetadata(NULL),
-      mFuncInfoMetadata(NULL) {
+      mFuncInfoMetadata(NULL),
+      mForEachInfoMetadata(NULL) {
   mTypes.clear();
   mEncodedRSTypeInfo.clear();
   mRecordTypes.clear();
@@ -320,6 +327,9 @@ int RSMetadataEncoderInternal::encodeRSVar(const RSVar *V) {
 
   // 2. type
   unsigned Type = encodeRSType(V->type);
+  if (!checkReturnIndex(&Type)) {
+    return -2;
+  }
 
   llvm::SmallVector<llvm::Value*, 1> VarInfo;
 
@@ -365,6 +375,38 @@ int RSMetadataEncoderInternal::encodeRSFunc(const RSFunction *F) {
   return 0;
 }
 
+int RSMetadataEncoderInternal::encodeRSForEach(const RSForEach *FE) {
+  // check parameter
+  if ((FE == NULL) || (FE->name == NULL)) {
+    return -1;
+  }
+
+  // 1. kernel name
+  unsigned ForEachName = joinString(FE->name);
+  if (!checkReturnIndex(&ForEachName)) {
+    return -2;
+  }
+
+  llvm::SmallVector<llvm::Value*, 2> ForEachInfo;
+  if (!EncodeInteger(mModule->getContext(), ForEachName, ForEachInfo)) {
+    return -3;
+  }
+
+  // 2. signature
+  if (!EncodeInteger(mModule->getContext(), FE->signature, ForEachInfo)) {
+    return -4;
+  }
+
+  if (mForEachInfoMetadata == NULL)
+    mForEachInfoMetadata =
+        mModule->getOrInsertNamedMetadata(RS_EXPORT_FOREACH_MN);
+
+  mForEachInfoMetadata->addOperand(llvm::MDNode::get(mModule->getContext(),
+                                                     ForEachInfo));
+
+  return 0;
+}
+
 // Write string table and string index table
 int RSMetadataEncoderInternal::flushStringTable() {
   slangAssert((mCurStringIndex == mEncodedStrings.size()));
@@ -409,6 +451,7 @@ int RSMetadataEncoderInternal::flushStringTable() {
                              mStrings.size() * sizeof(unsigned));
 
   // Copy
+  char *StrTabPtr = StrTab;
   StrIdxI = 1;
   for (std::list<const char*>::const_iterator I = mEncodedStrings.begin(),
           E = mEncodedStrings.end();
@@ -416,21 +459,22 @@ int RSMetadataEncoderInternal::flushStringTable() {
        I++) {
     // Get string length from StrIdx (O(1)) instead of call strlen again (O(n)).
     unsigned CurStrLength = StrIdx[StrIdxI] - StrIdx[StrIdxI - 1];
-    ::memcpy(StrTab, *I, CurStrLength);
+    ::memcpy(StrTabPtr, *I, CurStrLength);
     // Move forward the pointer
-    StrTab += CurStrLength;
+    StrTabPtr += CurStrLength;
     StrIdxI++;
   }
 
-  // Flush to metadata
+  // Flush to metadata (MDString keeps a copy of the data.)
   llvm::Value *StrTabMDS =
       llvm::MDString::get(mModule->getContext(), StrTabData);
   llvm::Value *StrIdxMDS =
       llvm::MDString::get(mModule->getContext(), StrIdxData);
 
+  free(StrIdx);
+  free(StrTab);
+
   if ((StrTabMDS == NULL) || (StrIdxMDS == NULL)) {
-    free(StrIdx);
-    free(StrTab);
     return -1;
   }
 
@@ -486,12 +530,14 @@ int RSMetadataEncoderInternal::flushTypeInfo() {
   return 0;
 }
 
+// The string table goes last, so a module has it only if everything else was
+// flushed successfully. Its presence tells the decoder the rest is complete.
 int RSMetadataEncoderInternal::finalize() {
-  int Res = flushStringTable();
+  int Res = flushTypeInfo();
   if (Res != 0)
     return Res;
 
-  Res = flushTypeInfo();
+  Res = flushStringTable();
   if (Res != 0)
     return Res;
 
@@ -513,6 +559,10 @@ int RSEncodeFunctionMetadata(RSMetadataEncoder *E, const RSFunction *F) {
   return reinterpret_cast<RSMetadataEncoderInternal*>(E)->encodeRSFunc(F);
 }
 
+int RSEncodeForEachMetadata(RSMetadataEncoder *E, const RSForEach *FE) {
+  return reinterpret_cast<RSMetadataEncoderInternal*>(E)->encodeRSForEach(FE);
+}
+
 void DestroyRSMetadataEncoder(RSMetadataEncoder *E) {
   RSMetadataEncoderInternal *C =
       reinterpret_cast<RSMetadataEncoderInternal*>(E);
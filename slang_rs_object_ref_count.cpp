@@ -17,7 +17,11 @@
 #include "slang_rs_object_ref_count.h"
 
 #include <list>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "clang/AST/Decl.h"
 #include "clang/AST/DeclGroup.h"
 #include "clang/AST/Expr.h"
 #include "clang/AST/NestedNameSpecifier.h"
@@ -25,6 +29,8 @@
 #include "clang/AST/Stmt.h"
 #include "clang/AST/StmtVisitor.h"
 
+#include "llvm/ADT/StringExtras.h"
+
 #include "slang_assert.h"
 #include "slang_rs.h"
 #include "slang_rs_ast_replace.h"
@@ -32,17 +38,17 @@
 
 namespace slang {
 
-clang::FunctionDecl *RSObjectRefCount::
-    RSSetObjectFD[RSExportPrimitiveType::LastRSObjectType -
-                  RSExportPrimitiveType::FirstRSObjectType + 1];
-clang::FunctionDecl *RSObjectRefCount::
-    RSClearObjectFD[RSExportPrimitiveType::LastRSObjectType -
-                    RSExportPrimitiveType::FirstRSObjectType + 1];
+llvm::sys::ThreadLocal<const RSObjectRefCount::RSObjectFDTable>
+    RSObjectRefCount::CurrentRSObjectFD;
+
+llvm::sys::ThreadLocal<RSObjectRefCount::RSObjectHelperTable>
+    RSObjectRefCount::CurrentRSObjectHelpers;
 
 void RSObjectRefCount::GetRSRefCountingFunctions(clang::ASTContext &C) {
-  for (unsigned i = 0;
-       i < (sizeof(RSClearObjectFD) / sizeof(clang::FunctionDecl*));
-       i++) {
+  clang::FunctionDecl **RSSetObjectFD = mRSObjectFD.RSSetObjectFD;
+  clang::FunctionDecl **RSClearObjectFD = mRSObjectFD.RSClearObjectFD;
+
+  for (unsigned i = 0; i < NumRSObjectTypes; i++) {
     RSSetObjectFD[i] = NULL;
     RSClearObjectFD[i] = NULL;
   }
@@ -117,74 +123,66 @@ static clang::CompoundStmt* BuildCompoundStmt(clang::ASTContext &C,
   return CS;
 }
 
-static void AppendAfterStmt(clang::ASTContext &C,
-                            clang::CompoundStmt *CS,
-                            clang::Stmt *S,
-                            std::list<clang::Stmt*> &StmtList) {
+typedef llvm::DenseMap<clang::Stmt*, std::list<clang::Stmt*> > InsertionMap;
+
+// This function inserts the statements in Insertions after their keys (which
+// are sub-Stmt's of CS) and appends EndStmtList to CS, rebuilding CS only
+// once.
+static void InsertIntoCompoundStmt(clang::ASTContext &C,
+                                   clang::CompoundStmt *CS,
+                                   const InsertionMap &Insertions,
+                                   const std::list<clang::Stmt*> &EndStmtList) {
   slangAssert(CS);
+  std::vector<clang::Stmt*> UpdatedStmtList;
+  UpdatedStmtList.reserve(CS->size() + EndStmtList.size());
+
+  bool HasReturn = false;
   clang::CompoundStmt::body_iterator bI = CS->body_begin();
   clang::CompoundStmt::body_iterator bE = CS->body_end();
-  clang::Stmt **UpdatedStmtList =
-      new clang::Stmt*[CS->size() + StmtList.size()];
-
-  unsigned UpdatedStmtCount = 0;
-  unsigned Once = 0;
   for ( ; bI != bE; bI++) {
-    if (!S && ((*bI)->getStmtClass() == clang::Stmt::ReturnStmtClass)) {
-      // If we come across a return here, we don't have anything we can
-      // reasonably replace. We should have already inserted our destructor
-      // code in the proper spot, so we just clean up and return.
-      delete [] UpdatedStmtList;
+    UpdatedStmtList.push_back(*bI);
 
-      return;
+    if ((*bI)->getStmtClass() == clang::Stmt::ReturnStmtClass) {
+      HasReturn = true;
     }
 
-    UpdatedStmtList[UpdatedStmtCount++] = *bI;
-
-    if ((*bI == S) && !Once) {
-      Once++;
-      std::list<clang::Stmt*>::const_iterator I = StmtList.begin();
-      std::list<clang::Stmt*>::const_iterator E = StmtList.end();
-      for ( ; I != E; I++) {
-        UpdatedStmtList[UpdatedStmtCount++] = *I;
-      }
+    InsertionMap::const_iterator I = Insertions.find(*bI);
+    if (I != Insertions.end()) {
+      UpdatedStmtList.insert(UpdatedStmtList.end(),
+                             I->second.begin(), I->second.end());
     }
   }
-  slangAssert(Once <= 1);
 
-  // When S is NULL, we are appending to the end of the CompoundStmt.
-  if (!S) {
-    slangAssert(Once == 0);
-    std::list<clang::Stmt*>::const_iterator I = StmtList.begin();
-    std::list<clang::Stmt*>::const_iterator E = StmtList.end();
-    for ( ; I != E; I++) {
-      UpdatedStmtList[UpdatedStmtCount++] = *I;
-    }
+  // If we come across a return here, we don't have anything we can
+  // reasonably append. We should have already inserted our destructor code
+  // in the proper spot.
+  if (!HasReturn) {
+    UpdatedStmtList.insert(UpdatedStmtList.end(),
+                           EndStmtList.begin(), EndStmtList.end());
   }
 
-  CS->setStmts(C, UpdatedStmtList, UpdatedStmtCount);
+  if (UpdatedStmtList.size() == CS->size()) {
+    return;
+  }
 
-  delete [] UpdatedStmtList;
+  CS->setStmts(C, &UpdatedStmtList[0], UpdatedStmtList.size());
 
   return;
 }
 
-// This class visits a compound statement and inserts DtorStmt
-// in proper locations. This includes inserting it before any
-// return statement in any sub-block, at the end of the logical enclosing
-// scope (compound statement), and/or before any break/continue statement that
-// would resume outside the declared scope. We will not handle the case for
-// goto statements that leave a local scope.
+// This class visits a compound statement and finds the proper locations for
+// the destructors of its local variables. This includes any return statement
+// in any sub-block and any break/continue statement that would resume outside
+// the declared scope (in addition to the end of the logical enclosing scope,
+// i.e., the compound statement itself). We will not handle the case for goto
+// statements that leave a local scope.
 //
 // To accomplish these goals, it collects a list of sub-Stmt's that
-// correspond to scope exit points. It then uses an RSASTReplace visitor to
-// transform the AST, inserting appropriate destructors before each of those
-// sub-Stmt's (and also before the exit of the outermost containing Stmt for
-// the scope).
+// correspond to scope exit points. Scope::InsertLocalVarDestructors() then
+// transforms the AST with a single RSASTReplace traversal, inserting
+// appropriate destructors before each of those sub-Stmt's.
 class DestructorVisitor : public clang::StmtVisitor<DestructorVisitor> {
  private:
-  clang::ASTContext &mCtx;
-
   // The loop depth of the currently visited node.
   int mLoopDepth;
 
@@ -194,60 +192,15 @@ class DestructorVisitor : public clang::StmtVisitor<DestructorVisitor> {
   // corresponding loop scope.
   int mSwitchDepth;
 
-  // The outermost statement block that we are currently visiting.
-  // This should always be a CompoundStmt.
-  clang::Stmt *mOuterStmt;
-
-  // The destructor to execute for this scope/variable.
-  clang::Stmt* mDtorStmt;
-
-  // The stack of statements which should be replaced by a compound statement
-  // containing the new destructor call followed by the original Stmt.
-  std::stack<clang::Stmt*> mReplaceStmtStack;
-
-  // The source location for the variable declaration that we are trying to
-  // insert destructors for. Note that InsertDestructors() will not generate
-  // destructor calls for source locations that occur lexically before this
-  // location.
-  clang::SourceLocation mVarLoc;
+  // The list of statements which should be replaced by a compound statement
+  // containing the destructor calls followed by the original Stmt.
+  std::list<clang::Stmt*> mExitStmtList;
 
  public:
-  DestructorVisitor(clang::ASTContext &C,
-                    clang::Stmt* OuterStmt,
-                    clang::Stmt* DtorStmt,
-                    clang::SourceLocation VarLoc);
-
-  // This code walks the collected list of Stmts to replace and actually does
-  // the replacement. It also finishes up by appending the destructor to the
-  // current outermost CompoundStmt.
-  void InsertDestructors() {
-    clang::Stmt *S = NULL;
-    clang::SourceManager &SM = mCtx.getSourceManager();
-    std::list<clang::Stmt *> StmtList;
-    StmtList.push_back(mDtorStmt);
-
-    while (!mReplaceStmtStack.empty()) {
-      S = mReplaceStmtStack.top();
-      mReplaceStmtStack.pop();
-
-      // Skip all source locations that occur before the variable's
-      // declaration, since it won't have been initialized yet.
-      if (SM.isBeforeInTranslationUnit(S->getLocStart(), mVarLoc)) {
-        continue;
-      }
+  DestructorVisitor();
 
-      StmtList.push_back(S);
-      clang::CompoundStmt *CS =
-          BuildCompoundStmt(mCtx, StmtList, S->getLocEnd());
-      StmtList.pop_back();
-
-      RSASTReplace R(mCtx);
-      R.ReplaceStmt(mOuterStmt, S, CS);
-    }
-    clang::CompoundStmt *CS =
-      llvm::dyn_cast<clang::CompoundStmt>(mOuterStmt);
-    slangAssert(CS);
-    AppendAfterStmt(mCtx, CS, NULL, StmtList);
+  inline const std::list<clang::Stmt*> &getExitStmts() const {
+    return mExitStmtList;
   }
 
   void VisitStmt(clang::Stmt *S);
@@ -266,16 +219,9 @@ class DestructorVisitor : public clang::StmtVisitor<DestructorVisitor> {
   void VisitWhileStmt(clang::WhileStmt *WS);
 };
 
-DestructorVisitor::DestructorVisitor(clang::ASTContext &C,
-                         clang::Stmt *OuterStmt,
-                         clang::Stmt *DtorStmt,
-                         clang::SourceLocation VarLoc)
-  : mCtx(C),
-    mLoopDepth(0),
-    mSwitchDepth(0),
-    mOuterStmt(OuterStmt),
-    mDtorStmt(DtorStmt),
-    mVarLoc(VarLoc) {
+DestructorVisitor::DestructorVisitor()
+  : mLoopDepth(0),
+    mSwitchDepth(0) {
   return;
 }
 
@@ -298,7 +244,7 @@ void DestructorVisitor::VisitCompoundStmt(clang::CompoundStmt *CS) {
 void DestructorVisitor::VisitBreakStmt(clang::BreakStmt *BS) {
   VisitStmt(BS);
   if ((mLoopDepth == 0) && (mSwitchDepth == 0)) {
-    mReplaceStmtStack.push(BS);
+    mExitStmtList.push_back(BS);
   }
   return;
 }
@@ -312,7 +258,7 @@ void DestructorVisitor::VisitContinueStmt(clang::ContinueStmt *CS) {
   VisitStmt(CS);
   if (mLoopDepth == 0) {
     // Switch statements can have nested continues.
-    mReplaceStmtStack.push(CS);
+    mExitStmtList.push_back(CS);
   }
   return;
 }
@@ -342,7 +288,7 @@ void DestructorVisitor::VisitIfStmt(clang::IfStmt *IS) {
 }
 
 void DestructorVisitor::VisitReturnStmt(clang::ReturnStmt *RS) {
-  mReplaceStmtStack.push(RS);
+  mExitStmtList.push_back(RS);
   return;
 }
 
@@ -438,6 +384,110 @@ static int ArrayDim(const clang::Type *T) {
   return static_cast<int>(CAT->getSize().getSExtValue());
 }
 
+// Arrays and structs holding up to this many RS objects are cleared (or set)
+// by straight-line code. Larger arrays are handled by loops and larger structs
+// by a helper function shared by all the uses of the struct type.
+const unsigned MaxInlineRSObjects = 4;
+
+// Return the number of RS objects held by an object of type T.
+static unsigned CountRSObjects(const clang::Type *T) {
+  slangAssert(T);
+
+  if (T->isArrayType()) {
+    unsigned N = ArrayDim(T);
+    return N ? (N * CountRSObjects(T->getArrayElementTypeNoTypeQual())) : 0;
+  }
+
+  if (RSExportPrimitiveType::IsRSObjectType(T)) {
+    return 1;
+  }
+
+  if (!T->isStructureType()) {
+    return 0;
+  }
+
+  unsigned RSObjectCount = 0;
+  clang::RecordDecl *RD = T->getAsStructureType()->getDecl();
+  RD = RD->getDefinition();
+  for (clang::RecordDecl::field_iterator FI = RD->field_begin(),
+         FE = RD->field_end();
+       FI != FE;
+       FI++) {
+    RSObjectCount += CountRSObjects(RSExportType::GetTypeOfDecl(*FI));
+  }
+  return RSObjectCount;
+}
+
+// Return the expression of Arr[Index].
+static clang::Expr *CreateArrayElement(clang::ASTContext &C,
+                                       clang::Expr *Arr,
+                                       clang::Expr *Index,
+                                       clang::SourceLocation Loc) {
+  const clang::Type *BaseType =
+      Arr->getType().getTypePtr()->getArrayElementTypeNoTypeQual();
+
+  clang::Expr *ArrPtr =
+      clang::ImplicitCastExpr::Create(C,
+          C.getPointerType(BaseType->getCanonicalTypeInternal()),
+          clang::CK_ArrayToPointerDecay,
+          Arr,
+          NULL,
+          clang::VK_RValue);
+
+  return new(C) clang::ArraySubscriptExpr(ArrPtr,
+                                          Index,
+                                          BaseType->getCanonicalTypeInternal(),
+                                          clang::VK_RValue,
+                                          clang::OK_Ordinary,
+                                          Loc);
+}
+
+// Return the call "FD(Args...)" of the helper function FD.
+static clang::Expr *CallHelperFunction(clang::ASTContext &C,
+                                       clang::FunctionDecl *FD,
+                                       clang::Expr **Args,
+                                       unsigned NumArgs,
+                                       clang::SourceLocation Loc) {
+  clang::QualType FDType = FD->getType();
+
+  clang::Expr *RefFD =
+      clang::DeclRefExpr::Create(C,
+                                 clang::NestedNameSpecifierLoc(),
+                                 FD,
+                                 Loc,
+                                 FDType,
+                                 clang::VK_RValue,
+                                 NULL);
+
+  clang::Expr *FP =
+      clang::ImplicitCastExpr::Create(C,
+                                      C.getPointerType(FDType),
+                                      clang::CK_FunctionToPointerDecay,
+                                      RefFD,
+                                      NULL,
+                                      clang::VK_RValue);
+
+  return new(C) clang::CallExpr(C,
+                                FP,
+                                Args,
+                                NumArgs,
+                                FD->getCallResultType(),
+                                clang::VK_RValue,
+                                Loc);
+}
+
+// Return "&E" passed to the helper functions.
+static clang::Expr *TakeAddress(clang::ASTContext &C,
+                                clang::Expr *E,
+                                clang::SourceLocation Loc) {
+  return new(C) clang::UnaryOperator(E,
+                                     clang::UO_AddrOf,
+                                     C.getPointerType(E->getType()),
+                                     clang::VK_RValue,
+                                     clang::OK_Ordinary,
+                                     Loc);
+}
+
 static clang::Stmt *ClearStructRSObject(
     clang::ASTContext &C,
     clang::DeclContext *DC,
@@ -445,6 +495,41 @@ static clang::Stmt *ClearStructRSObject(
     clang::SourceLocation StartLoc,
     clang::SourceLocation Loc);
 
+// Clear each RS object field of RefRSStruct in place (i.e., without calling
+// the helper of the struct type.)
+static clang::Stmt *ClearStructRSObjectFields(
+    clang::ASTContext &C,
+    clang::DeclContext *DC,
+    clang::Expr *RefRSStruct,
+    clang::SourceLocation StartLoc,
+    clang::SourceLocation Loc);
+
+static clang::Stmt *ClearArrayRSObject(
+    clang::ASTContext &C,
+    clang::DeclContext *DC,
+    clang::Expr *RefRSArr,
+    clang::SourceLocation StartLoc,
+    clang::SourceLocation Loc);
+
+// Clear the RS object(s) in E of any type (an RS object, an array or a
+// struct.)
+static clang::Stmt *ClearAnyRSObject(
+    clang::ASTContext &C,
+    clang::DeclContext *DC,
+    clang::Expr *E,
+    clang::SourceLocation StartLoc,
+    clang::SourceLocation Loc) {
+  const clang::Type *T = E->getType().getTypePtr();
+  if (T->isArrayType()) {
+    return ClearArrayRSObject(C, DC, E, StartLoc, Loc);
+  } else if (RSExportPrimitiveType::GetRSSpecificType(T) ==
+             RSExportPrimitiveType::DataTypeUnknown) {
+    return ClearStructRSObject(C, DC, E, StartLoc, Loc);
+  } else {
+    return ClearSingleRSObject(C, E, Loc);
+  }
+}
+
 static clang::Stmt *ClearArrayRSObject(
     clang::ASTContext &C,
     clang::DeclContext *DC,
@@ -465,6 +550,27 @@ static clang::Stmt *ClearArrayRSObject(
     return NULL;
   }
 
+  if (CountRSObjects(RefRSArr->getType().getTypePtr()) <= MaxInlineRSObjects) {
+    // Clear the elements one by one, e.g., for "rs_font fontArr[2];"
+    //
+    // (CompoundStmt
+    //   (CallExpr 'void' ... rsClearObject(&fontArr[0]))
+    //   (CallExpr 'void' ... rsClearObject(&fontArr[1])))
+    clang::Stmt **ElementStmts = new clang::Stmt*[NumArrayElements];
+    for (int i = 0; i < NumArrayElements; i++) {
+      clang::Expr *Index = clang::IntegerLiteral::Create(C,
+          llvm::APInt(C.getTypeSize(C.IntTy), i), C.IntTy, Loc);
+      ElementStmts[i] = ClearAnyRSObject(
+          C, DC, CreateArrayElement(C, RefRSArr, Index, Loc), StartLoc, Loc);
+    }
+
+    clang::CompoundStmt *CS =
+        new(C) clang::CompoundStmt(C, ElementStmts, NumArrayElements, Loc,
+                                   Loc);
+    delete [] ElementStmts;
+    return CS;
+  }
+
   // Example destructor loop for "rs_font fontArr[10];"
   //
   // (CompoundStmt
@@ -555,36 +661,9 @@ static clang::Stmt *ClearArrayRSObject(
 
   // Body -> "rsClearObject(&VD[rsIntIter]);"
   // Destructor loop operates on individual array elements
-
-  clang::Expr *RefRSArrPtr =
-      clang::ImplicitCastExpr::Create(C,
-          C.getPointerType(BaseType->getCanonicalTypeInternal()),
-          clang::CK_ArrayToPointerDecay,
-          RefRSArr,
-          NULL,
-          clang::VK_RValue);
-
-  clang::Expr *RefRSArrPtrSubscript =
-      new(C) clang::ArraySubscriptExpr(RefRSArrPtr,
-                                       RefrsIntIter,
-                                       BaseType->getCanonicalTypeInternal(),
-                                       clang::VK_RValue,
-                                       clang::OK_Ordinary,
-                                       Loc);
-
-  RSExportPrimitiveType::DataType DT =
-      RSExportPrimitiveType::GetRSSpecificType(BaseType);
-
-  clang::Stmt *RSClearObjectCall = NULL;
-  if (BaseType->isArrayType()) {
-    RSClearObjectCall =
-        ClearArrayRSObject(C, DC, RefRSArrPtrSubscript, StartLoc, Loc);
-  } else if (DT == RSExportPrimitiveType::DataTypeUnknown) {
-    RSClearObjectCall =
-        ClearStructRSObject(C, DC, RefRSArrPtrSubscript, StartLoc, Loc);
-  } else {
-    RSClearObjectCall = ClearSingleRSObject(C, RefRSArrPtrSubscript, Loc);
-  }
+  clang::Stmt *RSClearObjectCall = ClearAnyRSObject(
+      C, DC, CreateArrayElement(C, RefRSArr, RefrsIntIter, Loc), StartLoc,
+      Loc);
 
   clang::ForStmt *DestructorLoop =
       new(C) clang::ForStmt(C,
@@ -667,6 +746,26 @@ static clang::Stmt *ClearStructRSObject(
     clang::SourceLocation Loc) {
   const clang::Type *BaseType = RefRSStruct->getType().getTypePtr();
 
+  if (CountRSObjects(BaseType) <= MaxInlineRSObjects) {
+    return ClearStructRSObjectFields(C, DC, RefRSStruct, StartLoc, Loc);
+  }
+
+  // Call the helper shared by all the structs of this type, i.e.,
+  // ".rs.clear.<struct>(&RefRSStruct)"
+  clang::FunctionDecl *HelperFD = RSObjectRefCount::GetRSClearStructFD(
+      C, BaseType->getAsStructureType()->getDecl()->getDefinition());
+  clang::Expr *Arg = TakeAddress(C, RefRSStruct, Loc);
+  return CallHelperFunction(C, HelperFD, &Arg, 1, Loc);
+}
+
+static clang::Stmt *ClearStructRSObjectFields(
+    clang::ASTContext &C,
+    clang::DeclContext *DC,
+    clang::Expr *RefRSStruct,
+    clang::SourceLocation StartLoc,
+    clang::SourceLocation Loc) {
+  const clang::Type *BaseType = RefRSStruct->getType().getTypePtr();
+
   slangAssert(!BaseType->isArrayType());
 
   // Structs should show up as unknown primitive types
@@ -831,6 +930,39 @@ static clang::Stmt *CreateStructRSSetObject(clang::ASTContext &C,
                                             clang::SourceLocation StartLoc,
                                             clang::SourceLocation Loc);
 
+static clang::Stmt *CreateArrayRSSetObject(clang::ASTContext &C,
+                                           clang::Expr *DstArr,
+                                           clang::Expr *SrcArr,
+                                           clang::SourceLocation StartLoc,
+                                           clang::SourceLocation Loc);
+
+// Set each RS object field of LHS in place (i.e., without calling the helper
+// of the struct type) and then copy the whole struct.
+static clang::Stmt *CreateStructRSSetObjectFields(
+    clang::ASTContext &C,
+    clang::Expr *LHS,
+    clang::Expr *RHS,
+    clang::SourceLocation StartLoc,
+    clang::SourceLocation Loc);
+
+// Set the RS object(s) in Dst of any type (an RS object, an array or a
+// struct) to the ones in Src.
+static clang::Stmt *CreateAnyRSSetObject(clang::ASTContext &C,
+                                         clang::Expr *Dst,
+                                         clang::Expr *Src,
+                                         clang::SourceLocation StartLoc,
+                                         clang::SourceLocation Loc) {
+  const clang::Type *T = Dst->getType().getTypePtr();
+  if (T->isArrayType()) {
+    return CreateArrayRSSetObject(C, Dst, Src, StartLoc, Loc);
+  } else if (RSExportPrimitiveType::GetRSSpecificType(T) ==
+             RSExportPrimitiveType::DataTypeUnknown) {
+    return CreateStructRSSetObject(C, Dst, Src, StartLoc, Loc);
+  } else {
+    return CreateSingleRSSetObject(C, Dst, Src, StartLoc, Loc);
+  }
+}
+
 static clang::Stmt *CreateArrayRSSetObject(clang::ASTContext &C,
                                            clang::Expr *DstArr,
                                            clang::Expr *SrcArr,
@@ -851,6 +983,29 @@ static clang::Stmt *CreateArrayRSSetObject(clang::ASTContext &C,
     return NULL;
   }
 
+  if (CountRSObjects(DstArr->getType().getTypePtr()) <= MaxInlineRSObjects) {
+    // Set the elements one by one
+    clang::Stmt **ElementStmts = new clang::Stmt*[NumArrayElements];
+    for (int i = 0; i < NumArrayElements; i++) {
+      clang::Expr *DstIndex = clang::IntegerLiteral::Create(C,
+          llvm::APInt(C.getTypeSize(C.IntTy), i), C.IntTy, Loc);
+      clang::Expr *SrcIndex = clang::IntegerLiteral::Create(C,
+          llvm::APInt(C.getTypeSize(C.IntTy), i), C.IntTy, Loc);
+      ElementStmts[i] = CreateAnyRSSetObject(
+          C,
+          CreateArrayElement(C, DstArr, DstIndex, Loc),
+          CreateArrayElement(C, SrcArr, SrcIndex, Loc),
+          StartLoc,
+          Loc);
+    }
+
+    clang::CompoundStmt *CS =
+        new(C) clang::CompoundStmt(C, ElementStmts, NumArrayElements, Loc,
+                                   Loc);
+    delete [] ElementStmts;
+    return CS;
+  }
+
   // Create helper variable for iterating through elements
   clang::IdentifierInfo& II = C.Idents.get("rsIntIter");
   clang::VarDecl *IIVD =
@@ -918,56 +1073,12 @@ static clang::Stmt *CreateArrayRSSetObject(clang::ASTContext &C,
 
   // Body -> "rsSetObject(&Dst[rsIntIter], Src[rsIntIter]);"
   // Loop operates on individual array elements
-
-  clang::Expr *DstArrPtr =
-      clang::ImplicitCastExpr::Create(C,
-          C.getPointerType(BaseType->getCanonicalTypeInternal()),
-          clang::CK_ArrayToPointerDecay,
-          DstArr,
-          NULL,
-          clang::VK_RValue);
-
-  clang::Expr *DstArrPtrSubscript =
-      new(C) clang::ArraySubscriptExpr(DstArrPtr,
-                                       RefrsIntIter,
-                                       BaseType->getCanonicalTypeInternal(),
-                                       clang::VK_RValue,
-                                       clang::OK_Ordinary,
-                                       Loc);
-
-  clang::Expr *SrcArrPtr =
-      clang::ImplicitCastExpr::Create(C,
-          C.getPointerType(BaseType->getCanonicalTypeInternal()),
-          clang::CK_ArrayToPointerDecay,
-          SrcArr,
-          NULL,
-          clang::VK_RValue);
-
-  clang::Expr *SrcArrPtrSubscript =
-      new(C) clang::ArraySubscriptExpr(SrcArrPtr,
-                                       RefrsIntIter,
-                                       BaseType->getCanonicalTypeInternal(),
-                                       clang::VK_RValue,
-                                       clang::OK_Ordinary,
-                                       Loc);
-
-  RSExportPrimitiveType::DataType DT =
-      RSExportPrimitiveType::GetRSSpecificType(BaseType);
-
-  clang::Stmt *RSSetObjectCall = NULL;
-  if (BaseType->isArrayType()) {
-    RSSetObjectCall = CreateArrayRSSetObject(C, DstArrPtrSubscript,
-                                             SrcArrPtrSubscript,
-                                             StartLoc, Loc);
-  } else if (DT == RSExportPrimitiveType::DataTypeUnknown) {
-    RSSetObjectCall = CreateStructRSSetObject(C, DstArrPtrSubscript,
-                                              SrcArrPtrSubscript,
-                                              StartLoc, Loc);
-  } else {
-    RSSetObjectCall = CreateSingleRSSetObject(C, DstArrPtrSubscript,
-                                              SrcArrPtrSubscript,
-                                              StartLoc, Loc);
-  }
+  clang::Stmt *RSSetObjectCall = CreateAnyRSSetObject(
+      C,
+      CreateArrayElement(C, DstArr, RefrsIntIter, Loc),
+      CreateArrayElement(C, SrcArr, RefrsIntIter, Loc),
+      StartLoc,
+      Loc);
 
   clang::ForStmt *DestructorLoop =
       new(C) clang::ForStmt(C,
@@ -994,6 +1105,31 @@ static clang::Stmt *CreateStructRSSetObject(clang::ASTContext &C,
                                             clang::Expr *RHS,
                                             clang::SourceLocation StartLoc,
                                             clang::SourceLocation Loc) {
+  const clang::Type *T = LHS->getType().getTypePtr();
+
+  // The helper takes the address of the source, which is only possible for
+  // an lvalue (e.g., not for a call returning a struct.)
+  clang::Expr *Src = RHS->IgnoreParenLValueCasts();
+  if ((CountRSObjects(T) <= MaxInlineRSObjects) || !Src->isLValue()) {
+    return CreateStructRSSetObjectFields(C, LHS, RHS, StartLoc, Loc);
+  }
+
+  // Call the helper shared by all the structs of this type, i.e.,
+  // ".rs.set.<struct>(&LHS, &RHS)"
+  clang::FunctionDecl *HelperFD = RSObjectRefCount::GetRSSetStructFD(
+      C, T->getAsStructureType()->getDecl()->getDefinition());
+  clang::Expr *Args[2];
+  Args[0] = TakeAddress(C, LHS, Loc);
+  Args[1] = TakeAddress(C, Src, Loc);
+  return CallHelperFunction(C, HelperFD, Args, 2, Loc);
+}
+
+static clang::Stmt *CreateStructRSSetObjectFields(
+    clang::ASTContext &C,
+    clang::Expr *LHS,
+    clang::Expr *RHS,
+    clang::SourceLocation StartLoc,
+    clang::SourceLocation Loc) {
   clang::QualType QT = LHS->getType();
   const clang::Type *T = QT.getTypePtr();
   slangAssert(T->isStructureType());
@@ -1049,7 +1185,8 @@ static clang::Stmt *CreateStructRSSetObject(clang::ASTContext &C,
                                   clang::DeclarationNameInfo(),
                                   NULL,
                                   OrigType->getCanonicalTypeInternal(),
-                                  clang::VK_RValue,
+                                  (RHS->isLValue() ? clang::VK_LValue :
+                                                     clang::VK_RValue),
                                   clang::OK_Ordinary);
 
     if (FT->isArrayType()) {
@@ -1099,15 +1236,356 @@ static clang::Stmt *CreateStructRSSetObject(clang::ASTContext &C,
   return CS;
 }
 
+// This class finds the local RS objects that can borrow the reference they
+// hold instead of counting it. A local of an RS object type (arrays and
+// structs are not handled) borrows its reference if
+// 1) it's only initialized or assigned from the parameters and the global
+//    variables which are neither assigned nor have their addresses taken in
+//    the function (so they keep the reference while the local is alive),
+//    and, from a parameter, only if the function assigns no RS object to a
+//    global variable (which could be the one the caller passed),
+// 2) it doesn't escape, i.e., it's only used as the source of assignments and
+//    as the arguments of calls,
+// 3) the function doesn't call anything but the functions in the RS headers
+//    (excluding rsSetObject(), rsClearObject() and rsForEach()), any of which
+//    could drop the reference of a global variable, and
+// 4) the function doesn't store an RS object but to a variable (e.g., through
+//    a pointer, which could point to any global variable.)
+class BorrowedRSObjectFinder
+    : public clang::StmtVisitor<BorrowedRSObjectFinder> {
+ private:
+  clang::ASTContext &mCtx;
+
+  // The locals of RS object types seen so far and the ones of them which
+  // can't borrow the reference
+  llvm::SmallPtrSet<const clang::VarDecl*, 8> mLocals;
+  llvm::SmallPtrSet<const clang::VarDecl*, 8> mCounted;
+
+  // The variables assigned or having their addresses taken
+  llvm::SmallPtrSet<const clang::VarDecl*, 8> mModified;
+
+  // <local, source> for each initialization and assignment of the locals
+  std::list<std::pair<const clang::VarDecl*, const clang::VarDecl*> >
+      mSources;
+
+  bool mHasUnsafeCall;
+
+  // Whether an RS object is stored but to a variable, and to a global one
+  bool mHasIndirectStore;
+  bool mHasGlobalStore;
+
+  static const clang::VarDecl *GetReferencedVar(clang::Expr *E) {
+    clang::DeclRefExpr *DRE =
+        llvm::dyn_cast<clang::DeclRefExpr>(E->IgnoreParenImpCasts());
+    if (DRE == NULL)
+      return NULL;
+    return llvm::dyn_cast<clang::VarDecl>(DRE->getDecl());
+  }
+
+  inline bool isLocal(const clang::VarDecl *VD) const {
+    return (VD != NULL) && mLocals.count(VD);
+  }
+
+  // The local @VD gets the value of @E.
+  void addSource(const clang::VarDecl *VD, clang::Expr *E) {
+    const clang::VarDecl *Src = GetReferencedVar(E);
+    if ((Src != NULL) && !isLocal(Src) &&
+        (llvm::isa<clang::ParmVarDecl>(Src) || Src->hasGlobalStorage())) {
+      mSources.push_back(std::make_pair(VD, Src));
+    } else {
+      mCounted.insert(VD);
+    }
+    return;
+  }
+
+  // Visit @E which is used by value (i.e., copied.)
+  void visitCopiedValue(clang::Expr *E) {
+    if (GetReferencedVar(E) == NULL)
+      Visit(E);
+    return;
+  }
+
+ public:
+  explicit BorrowedRSObjectFinder(clang::ASTContext &C)
+      : mCtx(C),
+        mHasUnsafeCall(false),
+        mHasIndirectStore(false),
+        mHasGlobalStore(false) {
+    return;
+  }
+
+  void getBorrowedRSObjects(
+      llvm::SmallPtrSet<const clang::VarDecl*, 8> *Borrowed) const {
+    if (mHasUnsafeCall || mHasIndirectStore)
+      return;
+
+    llvm::SmallPtrSet<const clang::VarDecl*, 8> Counted(mCounted);
+    for (std::list<std::pair<const clang::VarDecl*,
+                             const clang::VarDecl*> >::const_iterator
+            I = mSources.begin(), E = mSources.end();
+         I != E;
+         I++) {
+      if (mModified.count(I->second) ||
+          (mHasGlobalStore && llvm::isa<clang::ParmVarDecl>(I->second)))
+        Counted.insert(I->first);
+    }
+
+    for (llvm::SmallPtrSet<const clang::VarDecl*, 8>::const_iterator
+            I = mLocals.begin(), E = mLocals.end();
+         I != E;
+         I++) {
+      if (!Counted.count(*I))
+        Borrowed->insert(*I);
+    }
+    return;
+  }
+
+  void VisitStmt(clang::Stmt *S) {
+    for (clang::Stmt::child_iterator I = S->child_begin(), E = S->child_end();
+         I != E;
+         I++) {
+      if (clang::Stmt *Child = *I) {
+        Visit(Child);
+      }
+    }
+    return;
+  }
+
+  void VisitDeclStmt(clang::DeclStmt *DS) {
+    for (clang::DeclStmt::decl_iterator I = DS->decl_begin(),
+            E = DS->decl_end();
+         I != E;
+         I++) {
+      clang::VarDecl *VD = llvm::dyn_cast<clang::VarDecl>(*I);
+      if (VD == NULL)
+        continue;
+
+      clang::Expr *Init = VD->getInit();
+      const clang::Type *T = RSExportType::GetTypeOfDecl(VD);
+      if (VD->hasLocalStorage() && RSExportPrimitiveType::IsRSObjectType(T)) {
+        mLocals.insert(VD);
+        if (Init != NULL)
+          addSource(VD, Init);
+      }
+
+      if (Init != NULL)
+        visitCopiedValue(Init);
+    }
+    return;
+  }
+
+  void VisitBinAssign(clang::BinaryOperator *AS) {
+    const clang::VarDecl *Dst = GetReferencedVar(AS->getLHS());
+    if (CountRSObjectTypes(mCtx, AS->getType().getTypePtr(),
+                           AS->getExprLoc())) {
+      if (Dst == NULL)
+        mHasIndirectStore = true;
+      else if (Dst->hasGlobalStorage())
+        mHasGlobalStore = true;
+    }
+
+    if (Dst != NULL) {
+      mModified.insert(Dst);
+      if (isLocal(Dst))
+        addSource(Dst, AS->getRHS());
+    } else {
+      Visit(AS->getLHS());
+    }
+    visitCopiedValue(AS->getRHS());
+    return;
+  }
+
+  void VisitUnaryAddrOf(clang::UnaryOperator *UO) {
+    const clang::VarDecl *VD = GetReferencedVar(UO->getSubExpr());
+    if (VD != NULL) {
+      mModified.insert(VD);
+      if (isLocal(VD))
+        mCounted.insert(VD);
+    } else {
+      Visit(UO->getSubExpr());
+    }
+    return;
+  }
+
+  void VisitCallExpr(clang::CallExpr *CE) {
+    const clang::FunctionDecl *FD = CE->getDirectCallee();
+    if ((FD == NULL) ||
+        !SlangRS::IsFunctionInRSHeaderFile(FD, mCtx.getSourceManager()) ||
+        (FD->getName() == "rsSetObject") ||
+        (FD->getName() == "rsClearObject") ||
+        (FD->getName() == "rsForEach")) {
+      mHasUnsafeCall = true;
+    }
+
+    // The arguments are passed by value.
+    for (clang::CallExpr::arg_iterator I = CE->arg_begin(), E = CE->arg_end();
+         I != E;
+         I++) {
+      visitCopiedValue(*I);
+    }
+    return;
+  }
+
+  // Any other use lets the local escape.
+  void VisitDeclRefExpr(clang::DeclRefExpr *DRE) {
+    const clang::VarDecl *VD = llvm::dyn_cast<clang::VarDecl>(DRE->getDecl());
+    if (isLocal(VD))
+      mCounted.insert(VD);
+    return;
+  }
+};
+
+}  // namespace
+
+clang::FunctionDecl *RSObjectRefCount::CreateHelperFD(
+    clang::ASTContext &C,
+    llvm::StringRef Prefix,
+    const clang::RecordDecl *RD,
+    unsigned NumParams,
+    clang::ParmVarDecl **Params) {
+  RSObjectHelperTable *Helpers = CurrentRSObjectHelpers.get();
+  clang::SourceLocation Loc;
+
+  // Name the helper after the struct (or its typedef if it's anonymous),
+  // making it unique in case of the structs of the same name in different
+  // scopes.
+  std::string Name = Prefix.str();
+  if (!RD->getName().empty()) {
+    Name.append(RD->getName());
+  } else if (const clang::TypedefNameDecl *TD =
+                 RD->getTypedefNameForAnonDecl()) {
+    Name.append(TD->getName());
+  } else {
+    Name.append("anon");
+  }
+  if (Helpers->Names.count(Name)) {
+    Name.append("." + llvm::utostr(Helpers->Names.size()));
+  }
+  Helpers->Names.insert(Name);
+
+  clang::QualType ParamType = C.getPointerType(C.getRecordType(RD));
+  clang::QualType ParamTypes[2] = { ParamType, ParamType };
+  slangAssert(NumParams <= 2);
+
+  clang::FunctionProtoType::ExtProtoInfo EPI;
+  clang::QualType T = C.getFunctionType(C.VoidTy, ParamTypes, NumParams, EPI);
+  clang::FunctionDecl *FD =
+      clang::FunctionDecl::Create(C,
+                                  C.getTranslationUnitDecl(),
+                                  Loc,
+                                  Loc,
+                                  clang::DeclarationName(&C.Idents.get(Name)),
+                                  T,
+                                  NULL,
+                                  clang::SC_Static,
+                                  clang::SC_Static);
+
+  for (unsigned i = 0; i < NumParams; i++) {
+    Params[i] =
+        clang::ParmVarDecl::Create(C,
+                                   FD,
+                                   Loc,
+                                   Loc,
+                                   &C.Idents.get("p" + llvm::utostr(i)),
+                                   ParamType,
+                                   C.getTrivialTypeSourceInfo(ParamType),
+                                   clang::SC_None,
+                                   clang::SC_None,
+                                   NULL);
+  }
+  FD->setParams(llvm::ArrayRef<clang::ParmVarDecl*>(Params, NumParams));
+
+  Helpers->NewFDs.push_back(FD);
+  return FD;
+}
+
+namespace {
+
+// Return "*P" where P is a parameter of a helper function.
+static clang::Expr *DerefHelperParam(clang::ASTContext &C,
+                                     clang::ParmVarDecl *P,
+                                     clang::SourceLocation Loc) {
+  clang::QualType T = P->getType();
+  clang::Expr *RefP =
+      clang::DeclRefExpr::Create(C,
+                                 clang::NestedNameSpecifierLoc(),
+                                 P,
+                                 Loc,
+                                 T,
+                                 clang::VK_RValue,
+                                 NULL);
+
+  return new(C) clang::UnaryOperator(RefP,
+                                     clang::UO_Deref,
+                                     T->getPointeeType(),
+                                     clang::VK_LValue,
+                                     clang::OK_Ordinary,
+                                     Loc);
+}
+
 }  // namespace
 
+clang::FunctionDecl *RSObjectRefCount::GetRSClearStructFD(
+    clang::ASTContext &C,
+    const clang::RecordDecl *RD) {
+  RSObjectHelperTable *Helpers = CurrentRSObjectHelpers.get();
+  llvm::DenseMap<const clang::RecordDecl*, clang::FunctionDecl*>::iterator I =
+      Helpers->ClearFD.find(RD);
+  if (I != Helpers->ClearFD.end()) {
+    return I->second;
+  }
+
+  // static void .rs.clear.<struct>(<struct> *p0) {
+  //   rsClearObject(&(*p0).field); ...
+  // }
+  clang::ParmVarDecl *Params[1];
+  clang::FunctionDecl *HelperFD = CreateHelperFD(C, ".rs.clear.", RD, 1,
+                                                 Params);
+  clang::SourceLocation Loc;
+  clang::Stmt *Body = ClearStructRSObjectFields(
+      C, HelperFD, DerefHelperParam(C, Params[0], Loc), Loc, Loc);
+  HelperFD->setBody(Body);
+
+  Helpers->ClearFD[RD] = HelperFD;
+  return HelperFD;
+}
+
+clang::FunctionDecl *RSObjectRefCount::GetRSSetStructFD(
+    clang::ASTContext &C,
+    const clang::RecordDecl *RD) {
+  RSObjectHelperTable *Helpers = CurrentRSObjectHelpers.get();
+  llvm::DenseMap<const clang::RecordDecl*, clang::FunctionDecl*>::iterator I =
+      Helpers->SetFD.find(RD);
+  if (I != Helpers->SetFD.end()) {
+    return I->second;
+  }
+
+  // static void .rs.set.<struct>(<struct> *p0, <struct> *p1) {
+  //   rsSetObject(&(*p0).field, (*p1).field); ...
+  //   *p0 = *p1;
+  // }
+  clang::ParmVarDecl *Params[2];
+  clang::FunctionDecl *HelperFD = CreateHelperFD(C, ".rs.set.", RD, 2,
+                                                 Params);
+  clang::SourceLocation Loc;
+  clang::Stmt *Body = CreateStructRSSetObjectFields(
+      C,
+      DerefHelperParam(C, Params[0], Loc),
+      DerefHelperParam(C, Params[1], Loc),
+      Loc,
+      Loc);
+  HelperFD->setBody(Body);
+
+  Helpers->SetFD[RD] = HelperFD;
+  return HelperFD;
+}
+
 void RSObjectRefCount::Scope::ReplaceRSObjectAssignment(
     clang::BinaryOperator *AS) {
 
   clang::QualType QT = AS->getType();
 
-  clang::ASTContext &C = RSObjectRefCount::GetRSSetObjectFD(
-      RSExportPrimitiveType::DataTypeRSFont)->getASTContext();
+  clang::ASTContext &C = mCtx;
 
   clang::SourceLocation Loc = AS->getExprLoc();
   clang::SourceLocation StartLoc = AS->getExprLoc();
@@ -1122,8 +1600,7 @@ void RSObjectRefCount::Scope::ReplaceRSObjectAssignment(
         CreateSingleRSSetObject(C, AS->getLHS(), AS->getRHS(), StartLoc, Loc);
   }
 
-  RSASTReplace R(C);
-  R.ReplaceStmt(mCS, AS, UpdatedStmt);
+  mReplacements[AS] = UpdatedStmt;
   return;
 }
 
@@ -1138,8 +1615,7 @@ void RSObjectRefCount::Scope::AppendRSObjectInit(
     return;
   }
 
-  clang::ASTContext &C = RSObjectRefCount::GetRSSetObjectFD(
-      RSExportPrimitiveType::DataTypeRSFont)->getASTContext();
+  clang::ASTContext &C = mCtx;
   clang::SourceLocation Loc = RSObjectRefCount::GetRSSetObjectFD(
       RSExportPrimitiveType::DataTypeRSFont)->getLocation();
   clang::SourceLocation StartLoc = RSObjectRefCount::GetRSSetObjectFD(
@@ -1153,15 +1629,13 @@ void RSObjectRefCount::Scope::AppendRSObjectInit(
                                    VD,
                                    Loc,
                                    T->getCanonicalTypeInternal(),
-                                   clang::VK_RValue,
+                                   clang::VK_LValue,
                                    NULL);
 
     clang::Stmt *RSSetObjectOps =
         CreateStructRSSetObject(C, RefRSVar, InitExpr, StartLoc, Loc);
 
-    std::list<clang::Stmt*> StmtList;
-    StmtList.push_back(RSSetObjectOps);
-    AppendAfterStmt(C, mCS, DS, StmtList);
+    mInsertions[DS].push_back(RSSetObjectOps);
     return;
   }
 
@@ -1219,14 +1693,18 @@ void RSObjectRefCount::Scope::AppendRSObjectInit(
                              clang::VK_RValue,
                              Loc);
 
-  std::list<clang::Stmt*> StmtList;
-  StmtList.push_back(RSSetObjectCall);
-  AppendAfterStmt(C, mCS, DS, StmtList);
+  mInsertions[DS].push_back(RSSetObjectCall);
 
   return;
 }
 
 void RSObjectRefCount::Scope::InsertLocalVarDestructors() {
+  clang::ASTContext &C = mCtx;
+  clang::SourceManager &SM = C.getSourceManager();
+
+  // The destructors in the order of the declarations
+  std::list<clang::VarDecl*> DtorVarList;
+  std::list<clang::Stmt*> DtorStmtList;
   for (std::list<clang::VarDecl*>::const_iterator I = mRSO.begin(),
           E = mRSO.end();
         I != E;
@@ -1234,14 +1712,48 @@ void RSObjectRefCount::Scope::InsertLocalVarDestructors() {
     clang::VarDecl *VD = *I;
     clang::Stmt *RSClearObjectCall = ClearRSObject(VD, VD->getDeclContext());
     if (RSClearObjectCall) {
-      DestructorVisitor DV((*mRSO.begin())->getASTContext(),
-                           mCS,
-                           RSClearObjectCall,
-                           VD->getSourceRange().getBegin());
-      DV.Visit(mCS);
-      DV.InsertDestructors();
+      DtorVarList.push_back(VD);
+      DtorStmtList.push_back(RSClearObjectCall);
     }
   }
+
+  if (!DtorStmtList.empty()) {
+    DestructorVisitor DV;
+    DV.Visit(mCS);
+
+    const std::list<clang::Stmt*> &ExitStmtList = DV.getExitStmts();
+    for (std::list<clang::Stmt*>::const_iterator I = ExitStmtList.begin(),
+            E = ExitStmtList.end();
+         I != E;
+         I++) {
+      clang::Stmt *S = *I;
+      std::list<clang::Stmt*> StmtList;
+
+      std::list<clang::VarDecl*>::const_iterator VI = DtorVarList.begin();
+      std::list<clang::Stmt*>::const_iterator DI = DtorStmtList.begin();
+      for ( ; DI != DtorStmtList.end(); VI++, DI++) {
+        // Skip the variables declared after the exit, since they won't have
+        // been initialized yet.
+        if (!SM.isBeforeInTranslationUnit(S->getLocStart(),
+                                          (*VI)->getSourceRange().getBegin())) {
+          StmtList.push_back(*DI);
+        }
+      }
+
+      if (!StmtList.empty()) {
+        StmtList.push_back(S);
+        mReplacements[S] = BuildCompoundStmt(C, StmtList, S->getLocEnd());
+      }
+    }
+  }
+
+  InsertIntoCompoundStmt(C, mCS, mInsertions, DtorStmtList);
+
+  if (!mReplacements.empty()) {
+    RSASTReplace R(C);
+    R.ReplaceStmts(mCS, mReplacements);
+  }
+
   return;
 }
 
@@ -1441,7 +1953,16 @@ void RSObjectRefCount::VisitDeclStmt(clang::DeclStmt *DS) {
       RSExportPrimitiveType::DataType DT =
           RSExportPrimitiveType::DataTypeUnknown;
       clang::Expr *InitExpr = NULL;
-      if (InitializeRSObject(VD, &DT, &InitExpr)) {
+      if (isBorrowedRSObject(VD)) {
+        // A borrowed reference is a plain copy of its source, which is left
+        // as is (only zero-initialized if uninitialized.)
+        if (VD->getInit() != NULL) {
+          mNumSetObjectsElided++;
+        } else {
+          InitializeRSObject(VD, &DT, &InitExpr);
+        }
+        mNumClearObjectsElided++;
+      } else if (InitializeRSObject(VD, &DT, &InitExpr)) {
         getCurrentScope()->addRSObject(VD);
         getCurrentScope()->AppendRSObjectInit(VD, DS, DT, InitExpr);
       }
@@ -1450,10 +1971,24 @@ void RSObjectRefCount::VisitDeclStmt(clang::DeclStmt *DS) {
   return;
 }
 
+void RSObjectRefCount::FindBorrowedRSObjects(clang::Stmt *Body) {
+  BorrowedRSObjectFinder Finder(mCtx);
+  Finder.Visit(Body);
+
+  mBorrowedRSObjects.clear();
+  Finder.getBorrowedRSObjects(&mBorrowedRSObjects);
+  return;
+}
+
 void RSObjectRefCount::VisitCompoundStmt(clang::CompoundStmt *CS) {
+  if (mScopeStack.empty()) {
+    // Entering the body of a function
+    FindBorrowedRSObjects(CS);
+  }
+
   if (!CS->body_empty()) {
     // Push a new scope
-    Scope *S = new Scope(CS);
+    Scope *S = new Scope(mCtx, CS);
     mScopeStack.push(S);
 
     VisitStmt(CS);
@@ -1470,6 +2005,15 @@ void RSObjectRefCount::VisitCompoundStmt(clang::CompoundStmt *CS) {
 void RSObjectRefCount::VisitBinAssign(clang::BinaryOperator *AS) {
   clang::QualType QT = AS->getType();
 
+  clang::DeclRefExpr *DRE =
+      llvm::dyn_cast<clang::DeclRefExpr>(AS->getLHS()->IgnoreParenImpCasts());
+  if ((DRE != NULL) &&
+      isBorrowedRSObject(llvm::dyn_cast<clang::VarDecl>(DRE->getDecl()))) {
+    // Leave the plain copy to the borrowed reference
+    mNumSetObjectsElided++;
+    return;
+  }
+
   if (CountRSObjectTypes(mCtx, QT.getTypePtr(), AS->getExprLoc())) {
     getCurrentScope()->ReplaceRSObjectAssignment(AS);
   }
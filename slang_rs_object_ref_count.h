@@ -22,12 +22,22 @@
 
 #include "clang/AST/StmtVisitor.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/ThreadLocal.h"
+
 #include "slang_assert.h"
+#include "slang_rs_ast_replace.h"
 #include "slang_rs_export_type.h"
 
 namespace clang {
   class Expr;
+  class FunctionDecl;
+  class ParmVarDecl;
+  class RecordDecl;
   class Stmt;
+  class VarDecl;
 }
 
 namespace slang {
@@ -42,15 +52,25 @@ namespace slang {
 // appropriate (possibly a series of) rsSetObject() calls.
 // 3) Finally, each local object must call rsClearObject() when it goes out
 // of scope.
+// Locals that only borrow the reference of a parameter or a global variable
+// (see FindBorrowedRSObjects()) are exempted from 2) and 3).
 class RSObjectRefCount : public clang::StmtVisitor<RSObjectRefCount> {
  private:
   class Scope {
    private:
+    clang::ASTContext &mCtx;
     clang::CompoundStmt *mCS;      // Associated compound statement ({ ... })
     std::list<clang::VarDecl*> mRSO;  // Declared RS objects in this scope
 
+    // The changes to mCS, which are collected while visiting it and applied
+    // all at once by InsertLocalVarDestructors(): the statements to insert
+    // after the DeclStmt's in mCS and the statements to replace (i.e., the
+    // RS object assignments and the scope exits needing destructors.)
+    llvm::DenseMap<clang::Stmt*, std::list<clang::Stmt*> > mInsertions;
+    RSASTReplace::ReplacementMap mReplacements;
+
    public:
-    explicit Scope(clang::CompoundStmt *CS) : mCS(CS) {
+    Scope(clang::ASTContext &C, clang::CompoundStmt *CS) : mCtx(C), mCS(CS) {
       return;
     }
 
@@ -66,6 +86,8 @@ class RSObjectRefCount : public clang::StmtVisitor<RSObjectRefCount> {
                             RSExportPrimitiveType::DataType DT,
                             clang::Expr *InitExpr);
 
+    // Insert the destructors of the RS objects and apply all the changes
+    // collected for mCS in a single traversal.
     void InsertLocalVarDestructors();
 
     static clang::Stmt *ClearRSObject(clang::VarDecl *VD,
@@ -76,17 +98,66 @@ class RSObjectRefCount : public clang::StmtVisitor<RSObjectRefCount> {
   std::stack<Scope*> mScopeStack;
   bool RSInitFD;
 
+  // The locals of the function being visited that borrow a reference
+  llvm::SmallPtrSet<const clang::VarDecl*, 8> mBorrowedRSObjects;
+
+  // The number of rsSetObject() calls and of the locals whose rsClearObject()
+  // destructors are omitted for borrowing the references
+  unsigned mNumSetObjectsElided;
+  unsigned mNumClearObjectsElided;
+
   // RSSetObjectFD and RSClearObjectFD holds FunctionDecl of rsSetObject()
   // and rsClearObject() in the current ASTContext.
-  static clang::FunctionDecl *RSSetObjectFD[];
-  static clang::FunctionDecl *RSClearObjectFD[];
+  enum {
+    NumRSObjectTypes = RSExportPrimitiveType::LastRSObjectType -
+                       RSExportPrimitiveType::FirstRSObjectType + 1
+  };
+  struct RSObjectFDTable {
+    clang::FunctionDecl *RSSetObjectFD[NumRSObjectTypes];
+    clang::FunctionDecl *RSClearObjectFD[NumRSObjectTypes];
+  } mRSObjectFD;
+
+  // The table of the RSObjectRefCount working on the current thread. The
+  // static helpers below look up rs{Set,Clear}Object() through it, so that
+  // translation units compiled concurrently don't see each other's decls.
+  static llvm::sys::ThreadLocal<const RSObjectFDTable> CurrentRSObjectFD;
+
+  // The helper functions clearing and setting the RS objects in the struct
+  // types too large to be handled in place, one of each per struct type. They
+  // are shared by all the functions in the translation unit.
+  struct RSObjectHelperTable {
+    llvm::DenseMap<const clang::RecordDecl*, clang::FunctionDecl*> ClearFD;
+    llvm::DenseMap<const clang::RecordDecl*, clang::FunctionDecl*> SetFD;
+    llvm::StringSet<> Names;
+    // The helpers created since the last takeHelperFunctions()
+    std::list<clang::FunctionDecl*> NewFDs;
+  } mRSObjectHelpers;
+
+  static llvm::sys::ThreadLocal<RSObjectHelperTable> CurrentRSObjectHelpers;
+
+  // Create "static void <Prefix><struct>(<struct> *p0[, <struct> *p1])" with
+  // NumParams parameters, which are returned in Params.
+  static clang::FunctionDecl *CreateHelperFD(clang::ASTContext &C,
+                                             llvm::StringRef Prefix,
+                                             const clang::RecordDecl *RD,
+                                             unsigned NumParams,
+                                             clang::ParmVarDecl **Params);
 
   inline Scope *getCurrentScope() {
     return mScopeStack.top();
   }
 
+  // Find the locals in the function body @Body that hold a plain copy of the
+  // reference in a parameter or a global variable which outlives them, and
+  // put them into mBorrowedRSObjects.
+  void FindBorrowedRSObjects(clang::Stmt *Body);
+
+  inline bool isBorrowedRSObject(const clang::VarDecl *VD) const {
+    return mBorrowedRSObjects.count(VD);
+  }
+
   // Initialize RSSetObjectFD and RSClearObjectFD.
-  static void GetRSRefCountingFunctions(clang::ASTContext &C);
+  void GetRSRefCountingFunctions(clang::ASTContext &C);
 
   // Return false if the type of variable declared in VD does not contain
   // an RS object type.
@@ -104,7 +175,9 @@ class RSObjectRefCount : public clang::StmtVisitor<RSObjectRefCount> {
  public:
   explicit RSObjectRefCount(clang::ASTContext &C)
       : mCtx(C),
-        RSInitFD(false) {
+        RSInitFD(false),
+        mNumSetObjectsElided(0),
+        mNumClearObjectsElided(0) {
     return;
   }
 
@@ -113,13 +186,34 @@ class RSObjectRefCount : public clang::StmtVisitor<RSObjectRefCount> {
       GetRSRefCountingFunctions(mCtx);
       RSInitFD = true;
     }
+    CurrentRSObjectFD.set(&mRSObjectFD);
+    CurrentRSObjectHelpers.set(&mRSObjectHelpers);
+    return;
+  }
+
+  // Return the helper function clearing the RS objects in a struct of type RD
+  // (i.e., "static void .rs.clear.<struct>(<struct> *p)"), creating it for
+  // the first use.
+  static clang::FunctionDecl *GetRSClearStructFD(clang::ASTContext &C,
+                                                 const clang::RecordDecl *RD);
+
+  // Return the helper function copying a struct of type RD, i.e.,
+  // "static void .rs.set.<struct>(<struct> *dst, <struct> *src)".
+  static clang::FunctionDecl *GetRSSetStructFD(clang::ASTContext &C,
+                                               const clang::RecordDecl *RD);
+
+  // Move the helper functions created since the last call to FDs. They have
+  // to be emitted along with the functions calling them.
+  void takeHelperFunctions(std::list<clang::FunctionDecl*> *FDs) {
+    FDs->splice(FDs->end(), mRSObjectHelpers.NewFDs);
     return;
   }
 
   static clang::FunctionDecl *GetRSSetObjectFD(
       RSExportPrimitiveType::DataType DT) {
     slangAssert(RSExportPrimitiveType::IsRSObjectType(DT));
-    return RSSetObjectFD[(DT - RSExportPrimitiveType::FirstRSObjectType)];
+    return CurrentRSObjectFD.get()->RSSetObjectFD[
+        (DT - RSExportPrimitiveType::FirstRSObjectType)];
   }
 
   static clang::FunctionDecl *GetRSSetObjectFD(const clang::Type *T) {
@@ -129,13 +223,22 @@ class RSObjectRefCount : public clang::StmtVisitor<RSObjectRefCount> {
   static clang::FunctionDecl *GetRSClearObjectFD(
       RSExportPrimitiveType::DataType DT) {
     slangAssert(RSExportPrimitiveType::IsRSObjectType(DT));
-    return RSClearObjectFD[(DT - RSExportPrimitiveType::FirstRSObjectType)];
+    return CurrentRSObjectFD.get()->RSClearObjectFD[
+        (DT - RSExportPrimitiveType::FirstRSObjectType)];
   }
 
   static clang::FunctionDecl *GetRSClearObjectFD(const clang::Type *T) {
     return GetRSClearObjectFD(RSExportPrimitiveType::GetRSSpecificType(T));
   }
 
+  unsigned getNumSetObjectsElided() const {
+    return mNumSetObjectsElided;
+  }
+
+  unsigned getNumClearObjectsElided() const {
+    return mNumClearObjectsElided;
+  }
+
   void VisitStmt(clang::Stmt *S);
   void VisitDeclStmt(clang::DeclStmt *DS);
   void VisitCompoundStmt(clang::CompoundStmt *CS);
@@ -0,0 +1,312 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "slang_rs_odr_database.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef USE_MINGW
+#include <pthread.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/system_error.h"
+
+#include "slang_utils.h"
+
+namespace slang {
+
+namespace {
+
+// Bump whenever the format is changed
+const char DatabaseMagic[] = "slang-odr-database-1";
+
+// How long to wait for the other invocations to release the lock
+const unsigned LockRetryIntervalUs = 10 * 1000;
+const unsigned LockRetries = 3000;
+
+#ifndef USE_MINGW
+// fcntl() locks are owned by the process, so the threads of the process
+// (e.g., the jobs of llvm-rs-cc -jobs) take this as well.
+pthread_mutex_t LockMutex = PTHREAD_MUTEX_INITIALIZER;
+#else
+// No fcntl() locks, so the lock file is created exclusively and the one left
+// by a killed invocation is removed when it's that old.
+const time_t LockStaleSeconds = 5 * 60;
+#endif
+
+// RAII of the lock of the database, which is an fcntl() lock of the lock file
+// next to it. The system releases it whenever the holder exits, including
+// when it's killed or exits from a fatal error without running destructors,
+// so a stale lock never blocks the later invocations.
+class DatabaseLock {
+ private:
+  std::string mLockFile;
+  int mFD;
+  bool mLocked;
+
+ public:
+  explicit DatabaseLock(const std::string &File)
+      : mLockFile(File + ".lock"), mFD(-1), mLocked(false) {
+#ifndef USE_MINGW
+    pthread_mutex_lock(&LockMutex);
+    mFD = ::open(mLockFile.c_str(), O_RDWR | O_CREAT, 0666);
+    if (mFD >= 0) {
+      struct flock Lock;
+      ::memset(&Lock, 0, sizeof(Lock));
+      Lock.l_type = F_WRLCK;
+      Lock.l_whence = SEEK_SET;  // The whole file
+      for (unsigned i = 0; i < LockRetries; i++) {
+        if (::fcntl(mFD, F_SETLK, &Lock) == 0) {
+          mLocked = true;
+          break;
+        }
+        if ((errno != EACCES) && (errno != EAGAIN) && (errno != EINTR))
+          break;
+        ::usleep(LockRetryIntervalUs);
+      }
+    }
+    if (!mLocked) {
+      if (mFD >= 0)
+        ::close(mFD);
+      pthread_mutex_unlock(&LockMutex);
+    }
+#else
+    for (unsigned i = 0; i < LockRetries; i++) {
+      mFD = ::open(mLockFile.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+      if (mFD >= 0) {
+        ::close(mFD);
+        mLocked = true;
+        break;
+      }
+      struct stat Stat;
+      if ((::stat(mLockFile.c_str(), &Stat) == 0) &&
+          (::time(NULL) - Stat.st_mtime > LockStaleSeconds)) {
+        ::unlink(mLockFile.c_str());
+        continue;
+      }
+      ::usleep(LockRetryIntervalUs);
+    }
+#endif
+    return;
+  }
+
+  ~DatabaseLock() {
+    if (!mLocked)
+      return;
+#ifndef USE_MINGW
+    // Releases the fcntl() lock. The file is kept, since removing it could
+    // let an invocation waiting on it and a new one (creating another file)
+    // both lock.
+    ::close(mFD);
+    pthread_mutex_unlock(&LockMutex);
+#else
+    ::unlink(mLockFile.c_str());
+#endif
+    return;
+  }
+
+  inline bool isLocked() const { return mLocked; }
+};
+
+// Whether @D is a definition of a file in @Files
+inline bool IsDefinedBy(const RSODRDatabase::Definition &D,
+                        const std::set<std::string> &Files) {
+  return Files.count(D.File.str()) != 0;
+}
+
+}  // namespace
+
+RSODRDatabase::~RSODRDatabase() {
+  return;
+}
+
+llvm::StringRef RSODRDatabase::save(llvm::StringRef S) {
+  return *(mStrings.insert(S.str()).first);
+}
+
+bool RSODRDatabase::read(std::string *Error) {
+  mDefinitions.clear();
+  mBuffer.reset();
+
+  bool Exists;
+  if (llvm::sys::fs::exists(mFile, Exists) || !Exists)
+    return true;
+
+  if (llvm::MemoryBuffer::getFile(mFile, mBuffer)) {
+    *Error = "cannot read '" + mFile + "'";
+    return false;
+  }
+
+  llvm::StringRef Rest = mBuffer->getBuffer();
+  std::pair<llvm::StringRef, llvm::StringRef> LineAndRest = Rest.split('\n');
+  if (LineAndRest.first != DatabaseMagic) {
+    *Error = "'" + mFile + "' is not an ODR database";
+    return false;
+  }
+
+  for (Rest = LineAndRest.second; !Rest.empty(); Rest = LineAndRest.second) {
+    LineAndRest = Rest.split('\n');
+    std::pair<llvm::StringRef, llvm::StringRef> Name =
+        LineAndRest.first.split(' ');
+    std::pair<llvm::StringRef, llvm::StringRef> SignatureAndFile =
+        Name.second.split(' ');
+    if (Name.first.empty() || SignatureAndFile.first.empty() ||
+        SignatureAndFile.second.empty()) {
+      *Error = "'" + mFile + "' is corrupted";
+      return false;
+    }
+    mDefinitions.push_back(Definition(Name.first, SignatureAndFile.first,
+                                      SignatureAndFile.second));
+  }
+
+  // Written sorted, but don't trust an edited file.
+  std::stable_sort(mDefinitions.begin(), mDefinitions.end());
+
+  return true;
+}
+
+bool RSODRDatabase::load(std::string *Error) {
+  return read(Error);
+}
+
+bool RSODRDatabase::findConflict(llvm::StringRef Name,
+                                 llvm::StringRef Signature,
+                                 Definition *Conflict) const {
+  for (std::vector<Definition>::const_iterator
+          I = std::lower_bound(mDefinitions.begin(), mDefinitions.end(),
+                               Definition(Name, "", "")),
+          E = mDefinitions.end();
+       (I != E) && (I->Name == Name);
+       I++) {
+    if (!IsDefinedBy(*I, mCompiledFiles) && (I->Signature != Signature)) {
+      *Conflict = *I;
+      return true;
+    }
+  }
+  return false;
+}
+
+void RSODRDatabase::addCompiledFile(llvm::StringRef File) {
+  mCompiledFiles.insert(File.str());
+  return;
+}
+
+void RSODRDatabase::add(llvm::StringRef Name, llvm::StringRef Signature,
+                        llvm::StringRef File) {
+  addCompiledFile(File);
+  mNewDefinitions.push_back(Definition(save(Name), save(Signature),
+                                       save(File)));
+  return;
+}
+
+bool RSODRDatabase::commit(ConflictListTy *Conflicts, std::string *Error) {
+  llvm::SmallString<256> Dir(mFile);
+  llvm::sys::path::remove_filename(Dir);
+  if (!Dir.empty() &&
+      !SlangUtils::CreateDirectoryWithParents(Dir.str(), Error))
+    return false;
+
+  DatabaseLock Lock(mFile);
+  if (!Lock.isLocked()) {
+    *Error = "cannot lock '" + mFile + "' (another llvm-rs-cc has held it "
+             "for too long)";
+    return false;
+  }
+
+  // Another invocation may have updated it since load().
+  if (!read(Error))
+    return false;
+
+  for (std::vector<Definition>::const_iterator I = mNewDefinitions.begin(),
+          E = mNewDefinitions.end();
+       I != E;
+       I++) {
+    Definition Conflict;
+    if (findConflict(I->Name, I->Signature, &Conflict))
+      Conflicts->push_back(std::make_pair(*I, Conflict));
+  }
+  if (!Conflicts->empty())
+    return false;
+
+  std::vector<Definition> Definitions;
+  for (std::vector<Definition>::const_iterator I = mDefinitions.begin(),
+          E = mDefinitions.end();
+       I != E;
+       I++) {
+    if (!IsDefinedBy(*I, mCompiledFiles))
+      Definitions.push_back(*I);
+  }
+  Definitions.insert(Definitions.end(), mNewDefinitions.begin(),
+                     mNewDefinitions.end());
+  std::sort(Definitions.begin(), Definitions.end());
+
+  int FD;
+  llvm::SmallString<256> TmpFile;
+  if (llvm::sys::fs::unique_file(mFile + "-%%%%%%%%", FD, TmpFile)) {
+    *Error = "cannot create a temporary file for '" + mFile + "'";
+    return false;
+  }
+
+  // Read by the invocations of the other users too.
+  SlangUtils::SetReplacingFileMode(FD, mFile);
+
+  {
+    llvm::raw_fd_ostream OS(FD, /* shouldClose = */true);
+    OS << DatabaseMagic << '\n';
+    for (std::vector<Definition>::const_iterator I = Definitions.begin(),
+            E = Definitions.end();
+         I != E;
+         I++) {
+      OS << I->Name << ' ' << I->Signature << ' ' << I->File << '\n';
+    }
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      bool Existed;
+      llvm::sys::fs::remove(TmpFile.str(), Existed);
+      *Error = "cannot write '" + mFile + "'";
+      return false;
+    }
+  }
+
+  if (llvm::sys::fs::rename(TmpFile.str(), mFile)) {
+    bool Existed;
+    llvm::sys::fs::remove(TmpFile.str(), Existed);
+    *Error = "cannot write '" + mFile + "'";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace slang
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_ODR_DATABASE_H_  // NOLINT
+#define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_ODR_DATABASE_H_
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+  class MemoryBuffer;
+}
+
+namespace slang {
+
+// RSODRDatabase - The record types defined by the input files of all the
+// invocations of llvm-rs-cc sharing a database file (see llvm-rs-cc
+// -odr-database), such that the ODR is checked across separate invocations
+// (e.g., one per input file, spread over many machines sharing the file.)
+//
+// The file is
+//
+//  slang-odr-database-1
+//  <record type name> <signature> <input file>
+//  ...
+//
+// i.e., one line per definition, sorted by name and then by file. It's mapped
+// by llvm::MemoryBuffer and the definitions refer to it, so loading a large
+// database copies nothing and a name is looked up by a binary search.
+class RSODRDatabase {
+ public:
+  struct Definition {
+    llvm::StringRef Name;
+    llvm::StringRef Signature;
+    llvm::StringRef File;
+
+    Definition() { }
+    Definition(llvm::StringRef N, llvm::StringRef S, llvm::StringRef F)
+        : Name(N), Signature(S), File(F) { }
+
+    bool operator<(const Definition &Other) const {
+      int Cmp = Name.compare(Other.Name);
+      return (Cmp < 0) || ((Cmp == 0) && (File < Other.File));
+    }
+  };
+
+  // <the definition of this invocation, the conflicting one in the database>
+  typedef std::vector<std::pair<Definition, Definition> > ConflictListTy;
+
+ private:
+  std::string mFile;
+
+  // The last read database and its definitions
+  llvm::OwningPtr<llvm::MemoryBuffer> mBuffer;
+  std::vector<Definition> mDefinitions;
+
+  // The input files compiled by this invocation (their earlier definitions in
+  // the database are replaced) and their definitions. The strings of the
+  // definitions are in mStrings.
+  std::set<std::string> mCompiledFiles;
+  std::vector<Definition> mNewDefinitions;
+  std::set<std::string> mStrings;
+
+  bool read(std::string *Error);
+
+  llvm::StringRef save(llvm::StringRef S);
+
+ public:
+  explicit RSODRDatabase(const std::string &File) : mFile(File) { }
+  ~RSODRDatabase();
+
+  inline const std::string &getFile() const { return mFile; }
+
+  // Read the database as it is now. A missing file is an empty database.
+  // Return false and set @Error on failure.
+  bool load(std::string *Error);
+
+  // Find a definition of @Name by another file than the ones compiled by this
+  // invocation that's different from @Signature. Return false if none.
+  bool findConflict(llvm::StringRef Name, llvm::StringRef Signature,
+                    Definition *Conflict) const;
+
+  // Record that @File, compiled by this invocation, defines @Name as
+  // @Signature.
+  void add(llvm::StringRef Name, llvm::StringRef Signature,
+           llvm::StringRef File);
+  void addCompiledFile(llvm::StringRef File);
+
+  // Replace the definitions of the files compiled by this invocation in the
+  // database by the added ones. The database is locked, read again, checked
+  // against the added definitions and written to a temporary file moved over
+  // the database, so concurrent invocations never see a partial update nor
+  // lose each other's definitions. Return false and set @Error on failure,
+  // or fill @Conflicts (and leave the database unchanged) if a definition
+  // was added by another invocation meanwhile.
+  bool commit(ConflictListTy *Conflicts, std::string *Error);
+};
+
+}  // namespace slang
+
+#endif  // _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_ODR_DATABASE_H_  NOLINT
@@ -18,6 +18,7 @@
 
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "clang/Basic/TokenKinds.h"
 
@@ -138,6 +139,424 @@ class RSReflectLicensePragmaHandler : public RSPragmaHandler {
   }
 };
 
+class RSReducePragmaHandler : public RSPragmaHandler {
+ private:
+  // Lex '(' identifier ')' starting from @PragmaToken, and leave @PragmaToken
+  // at the token after it.
+  bool lexParenthesizedName(clang::Preprocessor &PP,
+                            clang::Token &PragmaToken,
+                            std::string *Name) {
+    if (PragmaToken.isNot(clang::tok::l_paren))
+      return false;
+    PP.LexUnexpandedToken(PragmaToken);
+    if (PragmaToken.isNot(clang::tok::identifier))
+      return false;
+    *Name = PP.getSpelling(PragmaToken);
+    PP.LexUnexpandedToken(PragmaToken);
+    if (PragmaToken.isNot(clang::tok::r_paren))
+      return false;
+    PP.LexUnexpandedToken(PragmaToken);
+    return true;
+  }
+
+  void reportError(clang::Preprocessor &PP, const clang::Token &Token,
+                   llvm::StringRef Message) {
+    clang::DiagnosticsEngine &DiagEngine = PP.getDiagnostics();
+    DiagEngine.Report(
+        clang::FullSourceLoc(Token.getLocation(), PP.getSourceManager()),
+        DiagEngine.getCustomDiagID(clang::DiagnosticsEngine::Error, Message));
+    return;
+  }
+
+ public:
+  RSReducePragmaHandler(llvm::StringRef Name, RSContext *Context)
+      : RSPragmaHandler(Name, Context) { return; }
+
+  // #pragma rs reduce(name) accumulator(fn) [initializer(fn)]
+  //                         [combiner(fn)] [outconverter(fn)]
+  void HandlePragma(clang::Preprocessor &PP,
+                    clang::PragmaIntroducerKind Introducer,
+                    clang::Token &FirstToken) {
+    clang::Token &PragmaToken = FirstToken;
+    RSContext::ReduceSpec Spec;
+    Spec.Loc = FirstToken.getLocation();
+
+    // Skip first token, "reduce"
+    PP.LexUnexpandedToken(PragmaToken);
+
+    bool Valid = lexParenthesizedName(PP, PragmaToken, &Spec.Name);
+    if (!Valid)
+      reportError(PP, PragmaToken, "expected '(reduction name)' after "
+                                   "'#pragma rs reduce'");
+
+    while (Valid && PragmaToken.isNot(clang::tok::eod)) {
+      std::string *Function = NULL;
+      if (PragmaToken.is(clang::tok::identifier)) {
+        std::string Clause = PP.getSpelling(PragmaToken);
+        if (Clause == "accumulator")
+          Function = &Spec.Accumulator;
+        else if (Clause == "initializer")
+          Function = &Spec.Initializer;
+        else if (Clause == "combiner")
+          Function = &Spec.Combiner;
+        else if (Clause == "outconverter")
+          Function = &Spec.OutConverter;
+      }
+
+      if (Function == NULL) {
+        reportError(PP, PragmaToken, "expected 'accumulator', 'initializer', "
+                                     "'combiner' or 'outconverter'");
+        Valid = false;
+      } else if (!Function->empty()) {
+        reportError(PP, PragmaToken, "duplicate function for the reduction");
+        Valid = false;
+      } else {
+        PP.LexUnexpandedToken(PragmaToken);
+        if (!lexParenthesizedName(PP, PragmaToken, Function)) {
+          reportError(PP, PragmaToken, "expected '(function name)'");
+          Valid = false;
+        }
+      }
+    }
+
+    // Lex until meets clang::tok::eod
+    while (PragmaToken.isNot(clang::tok::eod) &&
+           PragmaToken.isNot(clang::tok::eof))
+      PP.LexUnexpandedToken(PragmaToken);
+
+    if (Valid)
+      mContext->addReduceSpec(Spec);
+    return;
+  }
+};
+
+class RSVectorizePragmaHandler : public RSPragmaHandler {
+ private:
+  void reportError(clang::Preprocessor &PP, const clang::Token &Token,
+                   llvm::StringRef Message) {
+    clang::DiagnosticsEngine &DiagEngine = PP.getDiagnostics();
+    DiagEngine.Report(
+        clang::FullSourceLoc(Token.getLocation(), PP.getSourceManager()),
+        DiagEngine.getCustomDiagID(clang::DiagnosticsEngine::Error, Message));
+    return;
+  }
+
+  // Lex the width from @PragmaToken, and leave @PragmaToken at the token
+  // after it. Return 0 if it's not a supported width.
+  unsigned lexWidth(clang::Preprocessor &PP, clang::Token &PragmaToken) {
+    if (PragmaToken.isNot(clang::tok::numeric_constant))
+      return 0;
+    clang::NumericLiteralParser NumericLiteral(PragmaToken.getLiteralData(),
+        PragmaToken.getLiteralData() + PragmaToken.getLength(),
+        PragmaToken.getLocation(), PP);
+    if (NumericLiteral.hadError || !NumericLiteral.isIntegerLiteral())
+      return 0;
+    llvm::APInt Val(32, 0);
+    if (NumericLiteral.GetIntegerValue(Val))
+      return 0;
+    PP.LexUnexpandedToken(PragmaToken);
+
+    unsigned Width = static_cast<unsigned>(Val.getZExtValue());
+    return ((Width == 4) || (Width == 8)) ? Width : 0;
+  }
+
+ public:
+  RSVectorizePragmaHandler(llvm::StringRef Name, RSContext *Context)
+      : RSPragmaHandler(Name, Context) { return; }
+
+  // #pragma rs vectorize(width[, kernel...])
+  void HandlePragma(clang::Preprocessor &PP,
+                    clang::PragmaIntroducerKind Introducer,
+                    clang::Token &FirstToken) {
+    clang::Token &PragmaToken = FirstToken;
+    RSContext::VectorizeSpec Spec;
+    Spec.Loc = FirstToken.getLocation();
+
+    // Skip first token, "vectorize"
+    PP.LexUnexpandedToken(PragmaToken);
+
+    bool Valid = PragmaToken.is(clang::tok::l_paren);
+    if (!Valid) {
+      reportError(PP, PragmaToken, "expected '(' after "
+                                   "'#pragma rs vectorize'");
+    } else {
+      PP.LexUnexpandedToken(PragmaToken);
+      Spec.Width = lexWidth(PP, PragmaToken);
+      if (Spec.Width == 0) {
+        reportError(PP, PragmaToken, "expected the vector width (4 or 8)");
+        Valid = false;
+      }
+    }
+
+    std::vector<std::string> Kernels;
+    while (Valid && PragmaToken.is(clang::tok::comma)) {
+      PP.LexUnexpandedToken(PragmaToken);
+      if (PragmaToken.isNot(clang::tok::identifier)) {
+        reportError(PP, PragmaToken, "expected a kernel name");
+        Valid = false;
+      } else {
+        Kernels.push_back(PP.getSpelling(PragmaToken));
+        PP.LexUnexpandedToken(PragmaToken);
+      }
+    }
+
+    if (Valid && PragmaToken.isNot(clang::tok::r_paren)) {
+      reportError(PP, PragmaToken, "expected ')'");
+      Valid = false;
+    }
+
+    // Lex until meets clang::tok::eod
+    while (PragmaToken.isNot(clang::tok::eod) &&
+           PragmaToken.isNot(clang::tok::eof))
+      PP.LexUnexpandedToken(PragmaToken);
+
+    if (!Valid)
+      return;
+
+    if (Kernels.empty()) {
+      mContext->addVectorizeSpec(Spec);
+    } else {
+      for (std::vector<std::string>::const_iterator I = Kernels.begin(),
+              E = Kernels.end();
+           I != E;
+           I++) {
+        Spec.Kernel = *I;
+        mContext->addVectorizeSpec(Spec);
+      }
+    }
+    return;
+  }
+};
+
+class RSKernelPragmaHandler : public RSPragmaHandler {
+ private:
+  clang::SourceLocation mLoc;
+
+  void handleItem(const std::string &Item) {
+    RSContext::KernelSpec Spec;
+    Spec.Kernel = Item;
+    Spec.Loc = mLoc;
+    mContext->addKernelSpec(Spec);
+    return;
+  }
+
+ public:
+  RSKernelPragmaHandler(llvm::StringRef Name, RSContext *Context)
+      : RSPragmaHandler(Name, Context) { return; }
+
+  // #pragma rs kernel(function...)
+  void HandlePragma(clang::Preprocessor &PP,
+                    clang::PragmaIntroducerKind Introducer,
+                    clang::Token &FirstToken) {
+    mLoc = FirstToken.getLocation();
+    this->handleItemListPragma(PP, FirstToken);
+    return;
+  }
+};
+
+class RSNoAliasPragmaHandler : public RSPragmaHandler {
+ private:
+  clang::SourceLocation mLoc;
+
+  void handleItem(const std::string &Item) {
+    RSContext::NoAliasSpec Spec;
+    Spec.Kernel = Item;
+    Spec.Loc = mLoc;
+    mContext->addNoAliasSpec(Spec);
+    return;
+  }
+
+ public:
+  RSNoAliasPragmaHandler(llvm::StringRef Name, RSContext *Context)
+      : RSPragmaHandler(Name, Context) { return; }
+
+  // #pragma rs noalias(kernel...)
+  void HandlePragma(clang::Preprocessor &PP,
+                    clang::PragmaIntroducerKind Introducer,
+                    clang::Token &FirstToken) {
+    mLoc = FirstToken.getLocation();
+    this->handleItemListPragma(PP, FirstToken);
+    return;
+  }
+};
+
+class RSFusePragmaHandler : public RSPragmaHandler {
+ private:
+  void reportError(clang::Preprocessor &PP, const clang::Token &Token,
+                   llvm::StringRef Message) {
+    clang::DiagnosticsEngine &DiagEngine = PP.getDiagnostics();
+    DiagEngine.Report(
+        clang::FullSourceLoc(Token.getLocation(), PP.getSourceManager()),
+        DiagEngine.getCustomDiagID(clang::DiagnosticsEngine::Error, Message));
+    return;
+  }
+
+ public:
+  RSFusePragmaHandler(llvm::StringRef Name, RSContext *Context)
+      : RSPragmaHandler(Name, Context) { return; }
+
+  // #pragma rs fuse(name, kernel, kernel...)
+  void HandlePragma(clang::Preprocessor &PP,
+                    clang::PragmaIntroducerKind Introducer,
+                    clang::Token &FirstToken) {
+    clang::Token &PragmaToken = FirstToken;
+    RSContext::FuseSpec Spec;
+    Spec.Loc = FirstToken.getLocation();
+
+    // Skip first token, "fuse"
+    PP.LexUnexpandedToken(PragmaToken);
+
+    bool Valid = PragmaToken.is(clang::tok::l_paren);
+    if (!Valid) {
+      reportError(PP, PragmaToken, "expected '(' after '#pragma rs fuse'");
+    } else {
+      PP.LexUnexpandedToken(PragmaToken);
+      if (PragmaToken.isNot(clang::tok::identifier)) {
+        reportError(PP, PragmaToken, "expected the name of the fused kernel");
+        Valid = false;
+      } else {
+        Spec.Name = PP.getSpelling(PragmaToken);
+        PP.LexUnexpandedToken(PragmaToken);
+      }
+    }
+
+    while (Valid && PragmaToken.is(clang::tok::comma)) {
+      PP.LexUnexpandedToken(PragmaToken);
+      if (PragmaToken.isNot(clang::tok::identifier)) {
+        reportError(PP, PragmaToken, "expected a kernel name");
+        Valid = false;
+      } else {
+        Spec.Kernels.push_back(PP.getSpelling(PragmaToken));
+        PP.LexUnexpandedToken(PragmaToken);
+      }
+    }
+
+    if (Valid && PragmaToken.isNot(clang::tok::r_paren)) {
+      reportError(PP, PragmaToken, "expected ')'");
+      Valid = false;
+    }
+
+    // Lex until meets clang::tok::eod
+    while (PragmaToken.isNot(clang::tok::eod) &&
+           PragmaToken.isNot(clang::tok::eof))
+      PP.LexUnexpandedToken(PragmaToken);
+
+    if (Valid)
+      mContext->addFuseSpec(Spec);
+    return;
+  }
+};
+
+class RSOptimizePragmaHandler : public RSPragmaHandler {
+ private:
+  void reportError(clang::Preprocessor &PP, const clang::Token &Token,
+                   llvm::StringRef Message) {
+    clang::DiagnosticsEngine &DiagEngine = PP.getDiagnostics();
+    DiagEngine.Report(
+        clang::FullSourceLoc(Token.getLocation(), PP.getSourceManager()),
+        DiagEngine.getCustomDiagID(clang::DiagnosticsEngine::Error, Message));
+    return;
+  }
+
+  // Lex the level (0 to 3, s or z as in -O<level>) from @PragmaToken into
+  // @Spec, and leave @PragmaToken at the token after it. Return false if it's
+  // not a level.
+  bool lexLevel(clang::Preprocessor &PP, clang::Token &PragmaToken,
+                RSContext::OptimizeSpec *Spec) {
+    if (PragmaToken.is(clang::tok::identifier)) {
+      std::string Level = PP.getSpelling(PragmaToken);
+      if ((Level != "s") && (Level != "z"))
+        return false;
+      // -Os and -Oz are -O2 with the transformations growing the code turned
+      // down (and off.)
+      Spec->OptLevel = 2;
+      Spec->SizeLevel = (Level == "s") ? 1 : 2;
+    } else if (PragmaToken.is(clang::tok::numeric_constant)) {
+      clang::NumericLiteralParser NumericLiteral(PragmaToken.getLiteralData(),
+          PragmaToken.getLiteralData() + PragmaToken.getLength(),
+          PragmaToken.getLocation(), PP);
+      if (NumericLiteral.hadError || !NumericLiteral.isIntegerLiteral())
+        return false;
+      llvm::APInt Val(32, 0);
+      if (NumericLiteral.GetIntegerValue(Val) || Val.ugt(3))
+        return false;
+      Spec->OptLevel = static_cast<unsigned>(Val.getZExtValue());
+      Spec->SizeLevel = 0;
+    } else {
+      return false;
+    }
+    PP.LexUnexpandedToken(PragmaToken);
+    return true;
+  }
+
+ public:
+  RSOptimizePragmaHandler(llvm::StringRef Name, RSContext *Context)
+      : RSPragmaHandler(Name, Context) { return; }
+
+  // #pragma rs optimize(level[, function...])
+  void HandlePragma(clang::Preprocessor &PP,
+                    clang::PragmaIntroducerKind Introducer,
+                    clang::Token &FirstToken) {
+    clang::Token &PragmaToken = FirstToken;
+    RSContext::OptimizeSpec Spec;
+    Spec.Loc = FirstToken.getLocation();
+
+    // Skip first token, "optimize"
+    PP.LexUnexpandedToken(PragmaToken);
+
+    bool Valid = PragmaToken.is(clang::tok::l_paren);
+    if (!Valid) {
+      reportError(PP, PragmaToken, "expected '(' after "
+                                   "'#pragma rs optimize'");
+    } else {
+      PP.LexUnexpandedToken(PragmaToken);
+      if (!lexLevel(PP, PragmaToken, &Spec)) {
+        reportError(PP, PragmaToken, "expected the optimization level (0, 1, "
+                                     "2, 3, s or z)");
+        Valid = false;
+      }
+    }
+
+    std::vector<std::string> Functions;
+    while (Valid && PragmaToken.is(clang::tok::comma)) {
+      PP.LexUnexpandedToken(PragmaToken);
+      if (PragmaToken.isNot(clang::tok::identifier)) {
+        reportError(PP, PragmaToken, "expected a function name");
+        Valid = false;
+      } else {
+        Functions.push_back(PP.getSpelling(PragmaToken));
+        PP.LexUnexpandedToken(PragmaToken);
+      }
+    }
+
+    if (Valid && PragmaToken.isNot(clang::tok::r_paren)) {
+      reportError(PP, PragmaToken, "expected ')'");
+      Valid = false;
+    }
+
+    // Lex until meets clang::tok::eod
+    while (PragmaToken.isNot(clang::tok::eod) &&
+           PragmaToken.isNot(clang::tok::eof))
+      PP.LexUnexpandedToken(PragmaToken);
+
+    if (!Valid)
+      return;
+
+    if (Functions.empty()) {
+      mContext->addOptimizeSpec(Spec);
+    } else {
+      for (std::vector<std::string>::const_iterator I = Functions.begin(),
+              E = Functions.end();
+           I != E;
+           I++) {
+        Spec.Function = *I;
+        mContext->addOptimizeSpec(Spec);
+      }
+    }
+    return;
+  }
+};
+
 class RSVersionPragmaHandler : public RSPragmaHandler {
  private:
   void handleInt(const int v) {
@@ -158,6 +577,21 @@ class RSVersionPragmaHandler : public RSPragmaHandler {
   }
 };
 
+class RSFPPrecisionPragmaHandler : public RSPragmaHandler {
+ public:
+  RSFPPrecisionPragmaHandler(llvm::StringRef Name, RSContext *Context)
+      : RSPragmaHandler(Name, Context) { return; }
+
+  void HandlePragma(clang::Preprocessor &PP,
+                    clang::PragmaIntroducerKind Introducer,
+                    clang::Token &FirstToken) {
+    this->handleNonParamPragma(PP, FirstToken);
+    // The backend picks the precision up from the recorded pragmas, and so
+    // does the driver on the device from the pragma metadata.
+    mContext->addPragma(this->getName(), "");
+  }
+};
+
 }  // namespace
 
 RSPragmaHandler *
@@ -175,11 +609,47 @@ RSPragmaHandler::CreatePragmaReflectLicenseHandler(RSContext *Context) {
   return new RSReflectLicensePragmaHandler("set_reflect_license", Context);
 }
 
+RSPragmaHandler *
+RSPragmaHandler::CreatePragmaReduceHandler(RSContext *Context) {
+  return new RSReducePragmaHandler("reduce", Context);
+}
+
+RSPragmaHandler *
+RSPragmaHandler::CreatePragmaVectorizeHandler(RSContext *Context) {
+  return new RSVectorizePragmaHandler("vectorize", Context);
+}
+
+RSPragmaHandler *
+RSPragmaHandler::CreatePragmaFuseHandler(RSContext *Context) {
+  return new RSFusePragmaHandler("fuse", Context);
+}
+
+RSPragmaHandler *
+RSPragmaHandler::CreatePragmaKernelHandler(RSContext *Context) {
+  return new RSKernelPragmaHandler("kernel", Context);
+}
+
+RSPragmaHandler *
+RSPragmaHandler::CreatePragmaNoAliasHandler(RSContext *Context) {
+  return new RSNoAliasPragmaHandler("noalias", Context);
+}
+
+RSPragmaHandler *
+RSPragmaHandler::CreatePragmaOptimizeHandler(RSContext *Context) {
+  return new RSOptimizePragmaHandler("optimize", Context);
+}
+
 RSPragmaHandler *
 RSPragmaHandler::CreatePragmaVersionHandler(RSContext *Context) {
   return new RSVersionPragmaHandler("version", Context);
 }
 
+RSPragmaHandler *
+RSPragmaHandler::CreatePragmaFPPrecisionHandler(RSContext *Context,
+                                                llvm::StringRef Name) {
+  return new RSFPPrecisionPragmaHandler(Name, Context);
+}
+
 void RSPragmaHandler::handleItemListPragma(clang::Preprocessor &PP,
                                            clang::Token &FirstToken) {
   clang::Token &PragmaToken = FirstToken;
@@ -68,7 +68,16 @@ class RSPragmaHandler : public clang::PragmaHandler {
   static RSPragmaHandler *CreatePragmaJavaPackageNameHandler(
       RSContext *Context);
   static RSPragmaHandler *CreatePragmaReflectLicenseHandler(RSContext *Context);
+  static RSPragmaHandler *CreatePragmaReduceHandler(RSContext *Context);
+  static RSPragmaHandler *CreatePragmaVectorizeHandler(RSContext *Context);
+  static RSPragmaHandler *CreatePragmaFuseHandler(RSContext *Context);
+  static RSPragmaHandler *CreatePragmaKernelHandler(RSContext *Context);
+  static RSPragmaHandler *CreatePragmaNoAliasHandler(RSContext *Context);
+  static RSPragmaHandler *CreatePragmaOptimizeHandler(RSContext *Context);
   static RSPragmaHandler *CreatePragmaVersionHandler(RSContext *Context);
+  // For #pragma rs_fp_full, rs_fp_relaxed and rs_fp_imprecise (@Name)
+  static RSPragmaHandler *CreatePragmaFPPrecisionHandler(RSContext *Context,
+                                                         llvm::StringRef Name);
 
   virtual void HandlePragma(clang::Preprocessor &PP,
                             clang::PragmaIntroducerKind Introducer,
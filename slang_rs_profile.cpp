@@ -0,0 +1,283 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "slang_rs_profile.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+
+#include "llvm/Constants.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/Function.h"
+#include "llvm/GlobalVariable.h"
+#include "llvm/Instructions.h"
+#include "llvm/Metadata.h"
+#include "llvm/Module.h"
+
+#include "llvm/Support/IRBuilder.h"
+
+#include "slang_assert.h"
+#include "slang_rs_cache.h"
+
+namespace slang {
+
+namespace {
+
+const char ProfileMagic[] = "# slang profile 1";
+
+// The conditional branches of @F in the order their counters are laid out
+void CollectConditionalBranches(llvm::Function *F,
+                                std::vector<llvm::BranchInst*> *Branches) {
+  for (llvm::Function::iterator BB = F->begin(), BE = F->end();
+       BB != BE;
+       BB++) {
+    llvm::BranchInst *BI = llvm::dyn_cast<llvm::BranchInst>(
+        BB->getTerminator());
+    if ((BI != NULL) && BI->isConditional())
+      Branches->push_back(BI);
+  }
+  return;
+}
+
+// Counters[0][Index] += 1 before @InsertBefore
+void IncrementCounter(llvm::GlobalVariable *Counters, llvm::Value *Index,
+                      llvm::Instruction *InsertBefore) {
+  llvm::LLVMContext &C = Counters->getContext();
+  llvm::IRBuilder<> IB(InsertBefore);
+  llvm::Value *Idx[] = {
+    llvm::ConstantInt::get(llvm::Type::getInt32Ty(C), 0),
+    Index
+  };
+  llvm::Value *Counter = IB.CreateInBoundsGEP(Counters, Idx);
+  llvm::Value *Count = IB.CreateLoad(Counter);
+  Count = IB.CreateAdd(Count,
+                       llvm::ConstantInt::get(llvm::Type::getInt64Ty(C), 1));
+  IB.CreateStore(Count, Counter);
+  return;
+}
+
+}  // namespace
+
+// FNV-1a of the number of successors of each block
+unsigned RSProfile::ComputeChecksum(const llvm::Function *F) {
+  unsigned Checksum = 2166136261U;
+  for (llvm::Function::const_iterator BB = F->begin(), BE = F->end();
+       BB != BE;
+       BB++) {
+    const llvm::TerminatorInst *TI = BB->getTerminator();
+    unsigned NumSuccessors = (TI != NULL) ? TI->getNumSuccessors() : 0;
+    Checksum = (Checksum ^ (NumSuccessors + 1)) * 16777619U;
+  }
+  return Checksum;
+}
+
+void RSProfile::Instrument(llvm::Module *M) {
+  llvm::LLVMContext &C = M->getContext();
+
+  // Lay the counters out first, such that the checksums are computed on the
+  // functions as they are before the instrumentation.
+  std::vector<std::pair<llvm::Function*, unsigned> > Functions;
+  unsigned NumCounters = 0;
+  for (llvm::Module::iterator F = M->begin(), FE = M->end(); F != FE; F++) {
+    if (F->isDeclaration())
+      continue;
+    Functions.push_back(std::make_pair(&*F, NumCounters));
+    std::vector<llvm::BranchInst*> Branches;
+    CollectConditionalBranches(F, &Branches);
+    NumCounters += 1 + 2 * Branches.size();
+  }
+
+  if (NumCounters == 0)
+    return;
+
+  // Left external such that the optimizer keeps the stores and the runtime
+  // can find the counters.
+  llvm::ArrayType *CountersTy =
+      llvm::ArrayType::get(llvm::Type::getInt64Ty(C), NumCounters);
+  llvm::GlobalVariable *Counters =
+      new llvm::GlobalVariable(*M, CountersTy, false,
+                               llvm::GlobalValue::ExternalLinkage,
+                               llvm::ConstantAggregateZero::get(CountersTy),
+                               RS_PROFILE_COUNTERS_NAME);
+
+  llvm::NamedMDNode *ProfileMetadata =
+      M->getOrInsertNamedMetadata(RS_PROFILE_MN);
+  llvm::SmallVector<llvm::Value*, 4> ProfileInfo;
+  llvm::Type *Int32Ty = llvm::Type::getInt32Ty(C);
+
+  for (std::vector<std::pair<llvm::Function*, unsigned> >::const_iterator
+          I = Functions.begin(), E = Functions.end();
+       I != E;
+       I++) {
+    llvm::Function *F = I->first;
+    unsigned Base = I->second;
+    std::vector<llvm::BranchInst*> Branches;
+    CollectConditionalBranches(F, &Branches);
+
+    ProfileInfo.push_back(llvm::MDString::get(C, F->getName()));
+    ProfileInfo.push_back(
+        llvm::MDString::get(C, llvm::utostr_32(ComputeChecksum(F))));
+    ProfileInfo.push_back(llvm::MDString::get(C, llvm::utostr_32(Base)));
+    ProfileInfo.push_back(
+        llvm::MDString::get(C, llvm::utostr_32(1 + 2 * Branches.size())));
+    ProfileMetadata->addOperand(llvm::MDNode::get(C, ProfileInfo));
+    ProfileInfo.clear();
+
+    // The calls
+    IncrementCounter(Counters, llvm::ConstantInt::get(Int32Ty, Base),
+                     F->getEntryBlock().getFirstNonPHI());
+
+    // The branches: Base + 1 + 2 * i if the condition holds, the next counter
+    // otherwise
+    for (unsigned i = 0, e = Branches.size(); i != e; i++) {
+      llvm::BranchInst *BI = Branches[i];
+      llvm::IRBuilder<> IB(BI);
+      llvm::Value *NotTaken =
+          IB.CreateZExt(IB.CreateNot(BI->getCondition()), Int32Ty);
+      llvm::Value *Index =
+          IB.CreateAdd(NotTaken,
+                       llvm::ConstantInt::get(Int32Ty, Base + 1 + 2 * i));
+      IncrementCounter(Counters, Index, BI);
+    }
+  }
+
+  return;
+}
+
+bool RSProfile::load(const std::string &File, std::string *Error) {
+  std::string Buffer;
+  if (!RSCompilationCache::ReadFile(File, &Buffer)) {
+    *Error = "cannot read the profile '" + File + "'";
+    return false;
+  }
+
+  llvm::StringRef Rest(Buffer);
+  std::pair<llvm::StringRef, llvm::StringRef> LineAndRest = Rest.split('\n');
+  if (LineAndRest.first.rtrim() != ProfileMagic) {
+    *Error = "'" + File + "' is not a profile";
+    return false;
+  }
+
+  unsigned LineNo = 1;
+  for (Rest = LineAndRest.second; !Rest.empty(); Rest = LineAndRest.second) {
+    LineAndRest = Rest.split('\n');
+    LineNo++;
+
+    llvm::SmallVector<llvm::StringRef, 16> Fields;
+    LineAndRest.first.split(Fields, " ", -1, /* KeepEmpty = */false);
+    if (Fields.empty())
+      continue;
+
+    FunctionProfile Profile;
+    bool Valid = (Fields.size() >= 3) &&
+                 !Fields[1].getAsInteger(10, Profile.Checksum);
+    for (unsigned i = 2; Valid && (i < Fields.size()); i++) {
+      unsigned long long Count;  // NOLINT
+      Valid = !Fields[i].rtrim().getAsInteger(10, Count);
+      Profile.Counts.push_back(Count);
+    }
+
+    if (!Valid) {
+      *Error = "malformed line " + llvm::utostr_32(LineNo) + " in the "
+               "profile '" + File + "'";
+      return false;
+    }
+
+    mFunctions[Fields[0]] = Profile;
+  }
+
+  return true;
+}
+
+void RSProfile::apply(llvm::Module *M,
+                      std::vector<std::string> *OutOfDate) const {
+  llvm::LLVMContext &C = M->getContext();
+  llvm::Type *Int32Ty = llvm::Type::getInt32Ty(C);
+
+  // The functions matching their profiles, and the count of the hottest one
+  std::vector<std::pair<llvm::Function*, uint64_t> > Calls;
+  uint64_t MaxCalls = 0;
+
+  for (llvm::Module::iterator F = M->begin(), FE = M->end(); F != FE; F++) {
+    if (F->isDeclaration())
+      continue;
+
+    llvm::StringMap<FunctionProfile>::const_iterator I =
+        mFunctions.find(F->getName());
+    if (I == mFunctions.end())
+      continue;
+
+    const FunctionProfile &Profile = I->getValue();
+    std::vector<llvm::BranchInst*> Branches;
+    CollectConditionalBranches(F, &Branches);
+    if ((Profile.Checksum != ComputeChecksum(F)) ||
+        (Profile.Counts.size() != 1 + 2 * Branches.size())) {
+      OutOfDate->push_back(F->getName().str());
+      continue;
+    }
+
+    Calls.push_back(std::make_pair(&*F, Profile.Counts[0]));
+    if (Profile.Counts[0] > MaxCalls)
+      MaxCalls = Profile.Counts[0];
+
+    for (unsigned i = 0, e = Branches.size(); i != e; i++) {
+      uint64_t Taken = Profile.Counts[1 + 2 * i];
+      uint64_t NotTaken = Profile.Counts[2 + 2 * i];
+      if ((Taken == 0) && (NotTaken == 0))
+        continue;
+
+      // The weights are 32-bit
+      while ((Taken > 0xffffffffULL) || (NotTaken > 0xffffffffULL)) {
+        Taken >>= 1;
+        NotTaken >>= 1;
+      }
+
+      llvm::Value *Weights[] = {
+        llvm::MDString::get(C, "branch_weights"),
+        llvm::ConstantInt::get(Int32Ty, Taken),
+        llvm::ConstantInt::get(Int32Ty, NotTaken)
+      };
+      Branches[i]->setMetadata("prof", llvm::MDNode::get(C, Weights));
+    }
+  }
+
+  // Nothing ran (e.g., the profile of another input), no idea what's hot.
+  if (MaxCalls == 0)
+    return;
+
+  for (std::vector<std::pair<llvm::Function*, uint64_t> >::const_iterator
+          I = Calls.begin(), E = Calls.end();
+       I != E;
+       I++) {
+    llvm::Function *F = I->first;
+    if (I->second == 0) {
+      // Keep the cold ones (e.g., error handling) out of the hot code.
+      F->addFnAttr(llvm::Attribute::NoInline);
+      F->addFnAttr(llvm::Attribute::OptimizeForSize);
+    } else if (I->second >= (MaxCalls / 8)) {
+      F->addFnAttr(llvm::Attribute::InlineHint);
+    }
+  }
+
+  return;
+}
+
+}  // namespace slang
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_PROFILE_H_  // NOLINT
+#define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_PROFILE_H_
+
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/DataTypes.h"
+
+namespace llvm {
+  class Function;
+  class Module;
+}
+
+// The counters inserted by RSProfile::Instrument() (an array of i64)
+#define RS_PROFILE_COUNTERS_NAME ".rs.profile_counters"
+
+// Where the counters of each instrumented function are, one node of
+// <function name, checksum, index of the first counter, number of counters>
+#define RS_PROFILE_MN "#rs_profile"
+
+namespace slang {
+
+// RSProfile - The profile of the functions defined by a script (see llvm-rs-cc
+// -fprofile-generate and -fprofile-use.)
+//
+// Each function has a counter of the calls, followed by a pair of counters for
+// each conditional branch (taken to the first and the second successor) in
+// the order of the blocks. The counts are collected on the device by dumping
+// RS_PROFILE_COUNTERS_NAME as described by RS_PROFILE_MN into a file of
+//
+//  # slang profile 1
+//  <function name> <checksum> <count #0> <count #1> ...
+//
+// i.e., one line per function. The checksum identifies the control flow of
+// the function such that the counts of an outdated profile are not applied.
+class RSProfile {
+ private:
+  struct FunctionProfile {
+    unsigned Checksum;
+    std::vector<uint64_t> Counts;
+  };
+
+  llvm::StringMap<FunctionProfile> mFunctions;
+
+ public:
+  static unsigned ComputeChecksum(const llvm::Function *F);
+
+  // Count the calls and the branches taken of every function defined in @M by
+  // adding RS_PROFILE_COUNTERS_NAME and RS_PROFILE_MN to @M. The counters are
+  // not updated atomically, which may lose a few counts of the kernels
+  // running concurrently but keeps the relative weights.
+  static void Instrument(llvm::Module *M);
+
+  // Read the profile from @File. Return false and set @Error on failure.
+  bool load(const std::string &File, std::string *Error);
+
+  // Annotate the branches of the functions defined in @M by their weights,
+  // and tell the inliner which functions are hot and which are never called.
+  // The names of the functions whose profile doesn't match are added to
+  // @OutOfDate.
+  void apply(llvm::Module *M, std::vector<std::string> *OutOfDate) const;
+};
+
+}  // namespace slang
+
+#endif  // _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_PROFILE_H_  NOLINT
@@ -16,13 +16,20 @@
 
 #include "slang_rs_reflect_utils.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <ostream>
 #include <string>
 
+#include "llvm/ADT/OwningPtr.h"
 #include "llvm/ADT/StringRef.h"
 
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/system_error.h"
+
 #include "os_sep.h"
+#include "slang_bitcode_compressor.h"
 #include "slang_utils.h"
 
 namespace slang {
@@ -206,6 +213,181 @@ static bool GenerateJavaCodeAccessorMethod(
     return true;
 }
 
+// Each byte is a char of a string literal in the packed accessor. A string
+// constant in the class file must not exceed 64K bytes of (modified) UTF-8,
+// in which a char of 0 or above 0x7f takes 2 bytes.
+static const int PACKED_SEG_SIZE = 0x4000;
+static const int PACKED_LINE_BYTE_NUM = 32;
+
+static void GeneratePackedSegment(
+    const char *buff, int blen, FILE *pfout) {
+    fprintf(pfout, "      \"");
+    for (int i = 0; i < blen; ++i) {
+        unsigned char c = static_cast<unsigned char>(buff[i]);
+        if ((i > 0) && ((i % PACKED_LINE_BYTE_NUM) == 0))
+            fprintf(pfout, "\" +\n      \"");
+        if ((c == '"') || (c == '\\'))
+            fprintf(pfout, "\\%c", c);
+        else if ((c >= 0x20) && (c < 0x7f))
+            fputc(c, pfout);
+        else
+            // Always 3 digits such that a following digit can't extend it
+            fprintf(pfout, "\\%03o", c);
+    }
+    fprintf(pfout, "\"");
+}
+
+// Decode the compressed wrapper (see BitcodeCompressor::CompressWrapper()) of
+// the LZ4 block format, and check it against the header.
+static void GenerateDecompressMethod(FILE *pfout) {
+    fprintf(pfout, "  private static int readInt(byte[] b, int offset) {\n");
+    fprintf(pfout, "    return (b[offset] & 0xff) | "
+                   "((b[offset + 1] & 0xff) << 8) |\n");
+    fprintf(pfout, "        ((b[offset + 2] & 0xff) << 16) | "
+                   "((b[offset + 3] & 0xff) << 24);\n");
+    fprintf(pfout, "  }\n\n");
+
+    fprintf(pfout, "  private static byte[] decompress(byte[] in) {\n");
+    fprintf(pfout, "    int ip = readInt(in, 8);\n");
+    fprintf(pfout, "    int end = ip + readInt(in, 12);\n");
+    fprintf(pfout, "    if ((readInt(in, 16) != %d) || "
+                   "(readInt(in, ip - 12) != %d)) {\n",
+        BitcodeCompressor::CompressedHeaderVersion, BCCM_LZ4_BLOCK);
+    fprintf(pfout, "      throw new android.renderscript.RSRuntimeException("
+                   "\"Unknown bitcode compression\");\n");
+    fprintf(pfout, "    }\n");
+    fprintf(pfout, "    byte[] out = new byte[readInt(in, ip - 8)];\n");
+    fprintf(pfout, "    int op = 0;\n");
+    fprintf(pfout, "    while (ip < end) {\n");
+    fprintf(pfout, "      int token = in[ip++] & 0xff;\n");
+    fprintf(pfout, "      int n = token >>> 4;\n");
+    fprintf(pfout, "      if (n == 15) {\n");
+    fprintf(pfout, "        int b;\n");
+    fprintf(pfout, "        do {\n");
+    fprintf(pfout, "          b = in[ip++] & 0xff;\n");
+    fprintf(pfout, "          n += b;\n");
+    fprintf(pfout, "        } while (b == 255);\n");
+    fprintf(pfout, "      }\n");
+    fprintf(pfout, "      System.arraycopy(in, ip, out, op, n);\n");
+    fprintf(pfout, "      ip += n;\n");
+    fprintf(pfout, "      op += n;\n");
+    fprintf(pfout, "      if (ip >= end) {\n");
+    fprintf(pfout, "        break;\n");
+    fprintf(pfout, "      }\n");
+    fprintf(pfout, "      int match = op - ((in[ip] & 0xff) | "
+                   "((in[ip + 1] & 0xff) << 8));\n");
+    fprintf(pfout, "      ip += 2;\n");
+    fprintf(pfout, "      n = token & 15;\n");
+    fprintf(pfout, "      if (n == 15) {\n");
+    fprintf(pfout, "        int b;\n");
+    fprintf(pfout, "        do {\n");
+    fprintf(pfout, "          b = in[ip++] & 0xff;\n");
+    fprintf(pfout, "          n += b;\n");
+    fprintf(pfout, "        } while (b == 255);\n");
+    fprintf(pfout, "      }\n");
+    fprintf(pfout, "      // The match may overlap the bytes it produces.\n");
+    fprintf(pfout, "      for (n += 4; n > 0; n--) {\n");
+    fprintf(pfout, "        out[op++] = out[match++];\n");
+    fprintf(pfout, "      }\n");
+    fprintf(pfout, "    }\n");
+    fprintf(pfout, "    java.util.zip.CRC32 crc = new java.util.zip.CRC32();\n");
+    fprintf(pfout, "    crc.update(out);\n");
+    fprintf(pfout, "    if ((op != out.length) || "
+                   "(crc.getValue() != BITCODE_CRC32)) {\n");
+    fprintf(pfout, "      throw new android.renderscript.RSRuntimeException("
+                   "\"Corrupt bitcode\");\n");
+    fprintf(pfout, "    }\n");
+    fprintf(pfout, "    return out;\n");
+    fprintf(pfout, "  }\n\n");
+}
+
+// Pack the bitcode into string literals (one char per byte), which javac
+// keeps in the constant pool as is, instead of an array initializer which
+// takes several instructions per byte. The literals are in a nested class so
+// that they are loaded on the first getBitCode() only, and decoded once. If
+// compressed, they hold the compressed wrapper, decompressed by that call.
+static bool GeneratePackedJavaCodeAccessorMethod(
+    const RSSlangReflectUtils::BitCodeAccessorContext &context, FILE *pfout) {
+    FILE *pfin = fopen(context.bcFileName, "rb");
+    if (pfin == NULL) {
+        fprintf(stderr, "Error: could not read file %s\n", context.bcFileName);
+        return false;
+    }
+
+    string bitcode;
+    char buff[0x2000];
+    size_t read_length;
+    while ((read_length = fread(buff, 1, sizeof(buff), pfin)) > 0)
+        bitcode.append(buff, read_length);
+    fclose(pfin);
+
+    fprintf(pfout, "  // The CRC-32 (as computed by java.util.zip.CRC32) and "
+                   "the length of the\n");
+    fprintf(pfout, "  // bitcode, which identify it e.g. for caching what "
+                   "getBitCode() returns.\n");
+    fprintf(pfout, "  public static final long BITCODE_CRC32 = 0x%08xL;\n",
+        BitcodeCompressor::ComputeCRC32(bitcode));
+    fprintf(pfout, "  public static final int BITCODE_LENGTH = %d;\n\n",
+        static_cast<int>(bitcode.size()));
+
+    // The segments hold the compressed wrapper when compressed.
+    string payload;
+    if (context.compressed) {
+        string error;
+        if (!BitcodeCompressor::CompressWrapper(bitcode, payload, &error)) {
+            fprintf(stderr, "Error: could not compress file %s: %s\n",
+                    context.bcFileName, error.c_str());
+            return false;
+        }
+    } else {
+        payload.swap(bitcode);
+    }
+
+    fprintf(pfout, "  private static byte[] bitCode;\n\n");
+
+    // start the accessor method
+    fprintf(pfout, "  // return byte array representation of the bitcode. "
+                   "The array is decoded\n");
+    fprintf(pfout, "  // on the first call and shared by all the calls, it "
+                   "must not be modified.\n");
+    fprintf(pfout, "  public static synchronized byte[] getBitCode() {\n");
+    fprintf(pfout, "    if (bitCode == null) {\n");
+    fprintf(pfout, "      byte[] bc = new byte[%d];\n",
+        static_cast<int>(payload.size()));
+    fprintf(pfout, "      int offset = 0;\n");
+    fprintf(pfout, "      for (String seg : Segments.DATA) {\n");
+    fprintf(pfout, "        for (int i = 0, e = seg.length(); i < e; i++) {\n");
+    fprintf(pfout, "          bc[offset++] = (byte) seg.charAt(i);\n");
+    fprintf(pfout, "        }\n");
+    fprintf(pfout, "      }\n");
+    if (context.compressed)
+        fprintf(pfout, "      bitCode = decompress(bc);\n");
+    else
+        fprintf(pfout, "      bitCode = bc;\n");
+    fprintf(pfout, "    }\n");
+    fprintf(pfout, "    return bitCode;\n");
+    // end the accessor method
+    fprintf(pfout, "  }\n\n");
+
+    if (context.compressed)
+        GenerateDecompressMethod(pfout);
+
+    // output the data
+    fprintf(pfout, "  private static final class Segments {\n");
+    fprintf(pfout, "    static final String[] DATA = {\n");
+    for (size_t offset = 0; offset < payload.size();
+         offset += PACKED_SEG_SIZE) {
+        int seg_length = static_cast<int>(
+            std::min<size_t>(PACKED_SEG_SIZE, payload.size() - offset));
+        GeneratePackedSegment(payload.data() + offset, seg_length, pfout);
+        fprintf(pfout, ",\n");
+    }
+    fprintf(pfout, "    };\n");
+    fprintf(pfout, "  }\n\n");
+
+    return true;
+}
+
 static bool GenerateAccessorClass(
     const RSSlangReflectUtils::BitCodeAccessorContext &context,
     const char *clazz_name, FILE *pfout) {
@@ -221,7 +403,10 @@ static bool GenerateAccessorClass(
       case BCST_APK_RESOURCE:
         break;
       case BCST_JAVA_CODE:
-        ret = GenerateJavaCodeAccessorMethod(context, pfout);
+        if (context.packed || context.compressed)
+            ret = GeneratePackedJavaCodeAccessorMethod(context, pfout);
+        else
+            ret = GenerateJavaCodeAccessorMethod(context, pfout);
         break;
       default:
         ret = false;
@@ -253,7 +438,11 @@ bool RSSlangReflectUtils::GenerateBitCodeAccessor(
     string output_filename(output_path);
     output_filename += OS_PATH_SEPARATOR_STR;
     output_filename += filename;
-    printf("Generating %s ...\n", filename.c_str());
+    if (context.verboseOutput != NULL)
+        *context.verboseOutput << "Generating " << filename << " ..."
+                               << std::endl;
+    else
+        printf("Generating %s ...\n", filename.c_str());
     FILE *pfout = fopen(output_filename.c_str(), "w");
     if (pfout == NULL) {
         fprintf(stderr, "Error: could not write to file %s\n",
@@ -267,4 +456,47 @@ bool RSSlangReflectUtils::GenerateBitCodeAccessor(
     fclose(pfout);
     return ret;
 }
+
+bool RSSlangReflectUtils::ReadUsageManifest(const std::string &File,
+                                            ReflectionOptions *Options,
+                                            std::string *Error) {
+    llvm::OwningPtr<llvm::MemoryBuffer> MB;
+    if (llvm::MemoryBuffer::getFile(File, MB)) {
+        *Error = "cannot read the usage manifest '" + File + "'";
+        return false;
+    }
+
+    Options->HasUsageManifest = true;
+    llvm::StringRef Rest = MB->getBuffer();
+    while (!Rest.empty()) {
+        std::pair<llvm::StringRef, llvm::StringRef> LineAndRest =
+            Rest.split('\n');
+        Rest = LineAndRest.second;
+
+        llvm::StringRef Line = LineAndRest.first.split('#').first;
+        // Drop the parameters, then the return type.
+        Line = Line.split('(').first.trim();
+        Line = Line.substr(Line.find_last_of(" \t") + 1);
+        if (Line.empty()) {
+            continue;
+        }
+
+        size_t MethodDot = Line.rfind('.');
+        if ((MethodDot == llvm::StringRef::npos) || (MethodDot == 0) ||
+            (MethodDot + 1 == Line.size())) {
+            *Error = "malformed line '" + LineAndRest.first.str() +
+                     "' in the usage manifest '" + File + "'";
+            return false;
+        }
+
+        llvm::StringRef Class = Line.substr(0, MethodDot);
+        Class = Class.substr(Class.rfind('.') + 1);
+        llvm::StringRef Method = Line.substr(MethodDot + 1);
+
+        Options->UsedClasses.insert(Class.str());
+        Options->UsedMethods.insert(Class.str() + "." + Method.str());
+    }
+
+    return true;
+}
 }
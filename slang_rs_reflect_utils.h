@@ -17,7 +17,11 @@
 #ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_REFLECT_UTILS_H_  // NOLINT
 #define _FRAMEWORKS_COMPILE_SLANG_SLANG_REFLECT_UTILS_H_
 
+#include <iosfwd>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace slang {
 
@@ -27,6 +31,70 @@ enum BitCodeStorageType {
   BCST_JAVA_CODE
 };
 
+// Options of generating the reflected Java classes
+struct ReflectionOptions {
+  // Generate the struct-of-arrays accessors of ScriptField_* which write the
+  // fields of many items into the packed buffer at once (see llvm-rs-cc
+  // -reflect-bulk-accessors.)
+  bool BulkAccessors;
+
+  // Make resize() of ScriptField_* keep the items in an allocation at least
+  // doubled when it's too small, such that growing by one item at a time
+  // costs O(1) amortized copies (see llvm-rs-cc -reflect-amortized-resize.)
+  bool AmortizedResize;
+
+  // Keep the FieldPacker of each reflected set_*, invoke_* and forEach_*
+  // method in a field and reuse it on every call instead of allocating a new
+  // one (see llvm-rs-cc -reflect-cached-field-packers.)
+  bool CachedFieldPackers;
+
+  // Reflect beginUpdate() and commit() in the ScriptC_* classes. Between them,
+  // set_* only records the values that changed, which commit() sets all at
+  // once (see llvm-rs-cc -reflect-batched-updates.)
+  bool BatchedUpdates;
+
+  // Pack the bitcode of BCST_JAVA_CODE into string literals decoded on the
+  // first use (see llvm-rs-cc -reflect-packed-bitcode-accessor.)
+  bool PackedBitcodeAccessor;
+
+  // Store the bitcode of BCST_JAVA_CODE in the compressed wrapper of
+  // BitcodeCompressor, decompressed by the first use (see llvm-rs-cc
+  // -reflect-compressed-bitcode-accessor.)
+  bool CompressedBitcodeAccessor;
+
+  // Reflect the ScriptField_* classes into this package instead of the one of
+  // each script, only once for all the input files of the invocation (see
+  // llvm-rs-cc -reflect-shared-types-package.) Empty if disabled.
+  std::string SharedTypesPackageName;
+
+  // The structs of the input file whose ScriptField_* was reflected into
+  // SharedTypesPackageName by a previous input file (set by SlangRS)
+  std::set<std::string> ReflectedSharedTypes;
+
+  // If not NULL, the reflected classes are appended here as <fully qualified
+  // class name, source> instead of being written to files (see
+  // SlangRS::compileFromMemory().)
+  std::vector<std::pair<std::string, std::string> > *InMemoryFiles;
+
+  // Where the names of the reflected classes (and the like) are printed,
+  // std::cout if NULL (set by SlangRS)
+  std::ostream *VerboseOutput;
+
+  // The public methods used by the app, as "<class>.<method>" (see llvm-rs-cc
+  // -reflect-usage-manifest.) For the classes in UsedClasses, the other public
+  // methods (but the constructors and createElement()) are not reflected.
+  bool HasUsageManifest;
+  std::set<std::string> UsedClasses;
+  std::set<std::string> UsedMethods;
+
+  ReflectionOptions()
+      : BulkAccessors(false), AmortizedResize(false),
+        CachedFieldPackers(false), BatchedUpdates(false),
+        PackedBitcodeAccessor(false), CompressedBitcodeAccessor(false),
+        InMemoryFiles(NULL), VerboseOutput(NULL),
+        HasUsageManifest(false) { }
+};
+
 class RSSlangReflectUtils {
  public:
   // Encode a binary bitcode file into a Java source file.
@@ -35,6 +103,11 @@ class RSSlangReflectUtils {
   // reflectPath: where to output the generated Java file, no package name in
   // it.
   // packageName: the package of the output Java file.
+  // packed: pack the bitcode into string literals (see
+  // ReflectionOptions::PackedBitcodeAccessor.)
+  // compressed: store the bitcode compressed, implies packed (see
+  // ReflectionOptions::CompressedBitcodeAccessor.)
+  // verboseOutput: where the name of the class is printed (stdout if NULL)
   struct BitCodeAccessorContext {
     const char *rsFileName;
     const char *bcFileName;
@@ -42,6 +115,9 @@ class RSSlangReflectUtils {
     const char *packageName;
 
     BitCodeStorageType bcStorage;
+    bool packed;
+    bool compressed;
+    std::ostream *verboseOutput;
   };
 
   // Return the stem of the file name, i.e., remove the dir and the extension.
@@ -76,6 +152,16 @@ class RSSlangReflectUtils {
 
   // Generate the bit code accessor Java source file.
   static bool GenerateBitCodeAccessor(const BitCodeAccessorContext &context);
+
+  // Read the usage manifest @File into @Options. Each line names a method
+  // used by the app, the package, the parameters and the return type being
+  // optional, e.g. "ScriptC_mono.forEach_root" or
+  // "void com.example.ScriptC_mono.set_gain(float)". A "<class>.*" line
+  // keeps all the methods of the class. Empty lines and from '#' to the end
+  // of the line are ignored. Return false and set @Error on failure.
+  static bool ReadUsageManifest(const std::string &File,
+                                ReflectionOptions *Options,
+                                std::string *Error);
 };
 }
 
@@ -20,18 +20,21 @@
 
 #include <cstdarg>
 #include <cctype>
+#include <cstdio>
 
 #include <algorithm>
 #include <string>
 #include <utility>
 
 #include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/OwningPtr.h"
 #include "llvm/ADT/StringExtras.h"
 
 #include "os_sep.h"
 #include "slang_rs_context.h"
 #include "slang_rs_export_var.h"
 #include "slang_rs_export_foreach.h"
+#include "slang_rs_export_reduce.h"
 #include "slang_rs_export_func.h"
 #include "slang_rs_reflect_utils.h"
 #include "slang_version.h"
@@ -48,15 +51,49 @@
 #define RS_TYPE_ITEM_BUFFER_NAME         "mItemArray"
 #define RS_TYPE_ITEM_BUFFER_PACKER_NAME  "mIOBuffer"
 
+#define RS_TYPE_BULK_BUFFER_NAME         "mBulkBuffer"
+#define RS_TYPE_BULK_STAGING_NAME        "mBulkStaging"
+#define RS_TYPE_BULK_DIRTY_START_NAME    "mBulkDirtyStart"
+#define RS_TYPE_BULK_DIRTY_END_NAME      "mBulkDirtyEnd"
+
+// The number of items of ReflectionOptions::AmortizedResize, at most the
+// one of the allocation
+#define RS_TYPE_COUNT_NAME               "mCount"
+
 #define RS_EXPORT_VAR_INDEX_PREFIX       "mExportVarIdx_"
+
+#define RS_KERNEL_PROFILE_INDEX_NAME     RS_EXPORT_VAR_INDEX_PREFIX \
+                                         "__kernel_profile"
+#define RS_KERNEL_PROFILE_BUFFER_NAME    "__profile"
 #define RS_EXPORT_VAR_PREFIX             "mExportVar_"
+#define RS_EXPORT_VAR_CONST_PREFIX       "const_"
+#define RS_EXPORT_VAR_INIT_DATA_PREFIX   "InitData_"
+
+// The arrays initialized by more elements are filled from a packed string
+// (see GetPackedElementDecoder()) instead of a statement per element.
+#define RS_ARRAY_INIT_INLINE_LIMIT       16
 
 #define RS_EXPORT_FUNC_INDEX_PREFIX      "mExportFuncIdx_"
 #define RS_EXPORT_FOREACH_INDEX_PREFIX   "mExportForEachIdx_"
+#define RS_EXPORT_REDUCE_INDEX_PREFIX    "mExportReduceIdx_"
 
 #define RS_EXPORT_VAR_ALLOCATION_PREFIX  "mAlloction_"
 #define RS_EXPORT_VAR_DATA_STORAGE_PREFIX "mData_"
 
+#define RS_CACHED_FIELD_PACKER_PREFIX    "mFieldPacker_"
+
+// The state of beginUpdate() and commit() (see
+// ReflectionOptions::BatchedUpdates)
+#define RS_BATCHED_UPDATING_NAME         "mUpdating"
+#define RS_BATCHED_DIRTY_NAME            "mDirtyVars"
+#define RS_BATCHED_FIELD_PACKER_PREFIX   "mLastFieldPacker_"
+
+// The invokables taking at most that many scalars (neither vectors nor RS
+// objects) pack them into a field packer allocated once (see
+// RSReflection::IsDirectArgInvoke()), since allocating one per call costs more
+// than such a function.
+#define RS_DIRECT_INVOKE_MAX_PARAMS      4
+
 namespace slang {
 
 // Some utility function using internal in RSReflection
@@ -75,7 +112,7 @@ static bool GetClassNameFromFileName(const std::string &FileName,
 
 static const char *GetPrimitiveTypeName(const RSExportPrimitiveType *EPT) {
   static const char *PrimitiveTypeJavaNameMap[] = {
-    "",         // RSExportPrimitiveType::DataTypeFloat16
+    "short",    // RSExportPrimitiveType::DataTypeFloat16 (the raw bits)
     "float",    // RSExportPrimitiveType::DataTypeFloat32
     "double",   // RSExportPrimitiveType::DataTypeFloat64
     "byte",     // RSExportPrimitiveType::DataTypeSigned8
@@ -135,6 +172,7 @@ static const char *GetVectorTypeName(const RSExportVectorType *EVT) {
       BaseElement = VectorTypeJavaNameMap[0];
       break;
     }
+    case RSExportPrimitiveType::DataTypeFloat16:
     case RSExportPrimitiveType::DataTypeSigned16:
     case RSExportPrimitiveType::DataTypeUnsigned8: {
       BaseElement = VectorTypeJavaNameMap[1];
@@ -185,6 +223,7 @@ static const char *GetVectorElementName(const RSExportVectorType *EVT) {
     /* 7 */ { "I64_2",  "I64_3",  "I64_4" },
     /* 8 */ { "F32_2",  "F32_3",  "F32_4" },
     /* 9 */ { "F64_2",  "F64_3",  "F64_4" },
+    /* 10 */ { "F16_2", "F16_3",  "F16_4" },
   };
 
   const char **BaseElement = NULL;
@@ -230,6 +269,10 @@ static const char *GetVectorElementName(const RSExportVectorType *EVT) {
       BaseElement = VectorElementNameMap[9];
       break;
     }
+    case RSExportPrimitiveType::DataTypeFloat16: {
+      BaseElement = VectorElementNameMap[10];
+      break;
+    }
     default: {
       slangAssert(false && "RSReflection::GetVectorElementName : Unsupported "
                            "vector element data type");
@@ -275,7 +318,7 @@ static const char *GetVectorAccessor(unsigned Index) {
 
 static const char *GetPackerAPIName(const RSExportPrimitiveType *EPT) {
   static const char *PrimitiveTypePackerAPINameMap[] = {
-    "",         // RSExportPrimitiveType::DataTypeFloat16
+    "addI16",   // RSExportPrimitiveType::DataTypeFloat16
     "addF32",   // RSExportPrimitiveType::DataTypeFloat32
     "addF64",   // RSExportPrimitiveType::DataTypeFloat64
     "addI8",    // RSExportPrimitiveType::DataTypeSigned8
@@ -391,7 +434,7 @@ static const char *GetBuiltinElementConstruct(const RSExportType *ET) {
         static_cast<const RSExportPrimitiveType*>(ET);
     if (EPT->getKind() == RSExportPrimitiveType::DataKindUser) {
       static const char *PrimitiveBuiltinElementConstructMap[] = {
-        NULL,               // RSExportPrimitiveType::DataTypeFloat16
+        "Element.F16",      // RSExportPrimitiveType::DataTypeFloat16
         "Element.F32",      // RSExportPrimitiveType::DataTypeFloat32
         "Element.F64",      // RSExportPrimitiveType::DataTypeFloat64
         "Element.I8",       // RSExportPrimitiveType::DataTypeSigned8
@@ -501,7 +544,7 @@ static const char *GetElementDataKindName(RSExportPrimitiveType::DataKind DK) {
 
 static const char *GetElementDataTypeName(RSExportPrimitiveType::DataType DT) {
   static const char *ElementDataTypeNameMap[] = {
-    NULL,                            // RSExportPrimitiveType::DataTypeFloat16
+    "Element.DataType.FLOAT_16",     // RSExportPrimitiveType::DataTypeFloat16
     "Element.DataType.FLOAT_32",     // RSExportPrimitiveType::DataTypeFloat32
     "Element.DataType.FLOAT_64",     // RSExportPrimitiveType::DataTypeFloat64
     "Element.DataType.SIGNED_8",     // RSExportPrimitiveType::DataTypeSigned8
@@ -561,7 +604,7 @@ static const char *GetElementDataTypeName(RSExportPrimitiveType::DataType DT) {
 
 static const char *GetElementJavaTypeName(RSExportPrimitiveType::DataType DT) {
   static const char *ElementJavaTypeNameMap[] = {
-    NULL,                 // RSExportPrimitiveType::DataTypeFloat16
+    "F16",                // RSExportPrimitiveType::DataTypeFloat16
     "F32",                // RSExportPrimitiveType::DataTypeFloat32
     "F64",                // RSExportPrimitiveType::DataTypeFloat64
     "I8",                 // RSExportPrimitiveType::DataTypeSigned8
@@ -603,6 +646,42 @@ static const char *GetElementJavaTypeName(RSExportPrimitiveType::DataType DT) {
     return NULL;
 }
 
+// Return the method of java.nio.ByteBuffer storing a value of type @DT and set
+// @Cast to the cast from its Java type. Return NULL if it's not supported by
+// the bulk accessors.
+static const char *GetBulkPutAPIName(RSExportPrimitiveType::DataType DT,
+                                     const char **Cast) {
+  *Cast = "";
+  switch (DT) {
+    case RSExportPrimitiveType::DataTypeFloat16: return "putShort";
+    case RSExportPrimitiveType::DataTypeFloat32: return "putFloat";
+    case RSExportPrimitiveType::DataTypeFloat64: return "putDouble";
+    case RSExportPrimitiveType::DataTypeSigned8: return "put";
+    case RSExportPrimitiveType::DataTypeSigned16: return "putShort";
+    case RSExportPrimitiveType::DataTypeSigned32: return "putInt";
+    case RSExportPrimitiveType::DataTypeSigned64:
+    case RSExportPrimitiveType::DataTypeUnsigned64: return "putLong";
+    case RSExportPrimitiveType::DataTypeUnsigned8: {
+      *Cast = "(byte) ";
+      return "put";
+    }
+    case RSExportPrimitiveType::DataTypeUnsigned16:
+    case RSExportPrimitiveType::DataTypeUnsigned565:
+    case RSExportPrimitiveType::DataTypeUnsigned5551:
+    case RSExportPrimitiveType::DataTypeUnsigned4444: {
+      *Cast = "(short) ";
+      return "putShort";
+    }
+    case RSExportPrimitiveType::DataTypeUnsigned32: {
+      *Cast = "(int) ";
+      return "putInt";
+    }
+    default: {
+      return NULL;
+    }
+  }
+}
+
 
 /********************** Methods to generate script class **********************/
 bool RSReflection::genScriptClass(Context &C,
@@ -617,6 +696,14 @@ bool RSReflection::genScriptClass(Context &C,
 
   genScriptClassConstructor(C);
 
+  // Reflect the constants folded out of the exported variables
+  for (RSContext::const_export_var_iterator
+           I = mRSContext->constant_vars_begin(),
+           E = mRSContext->constant_vars_end();
+       I != E;
+       I++)
+    genExportConstant(C, *I);
+
   // Reflect export variable
   for (RSContext::const_export_var_iterator I = mRSContext->export_vars_begin(),
            E = mRSContext->export_vars_end();
@@ -624,6 +711,9 @@ bool RSReflection::genScriptClass(Context &C,
        I++)
     genExportVariable(C, *I);
 
+  if (mOptions.BatchedUpdates)
+    genBatchedUpdateMethods(C);
+
   // Reflect export for each functions (only available on ICS+)
   if (mRSContext->getTargetAPI() >= SLANG_ICS_TARGET_API) {
     for (RSContext::const_export_foreach_iterator
@@ -633,6 +723,15 @@ bool RSReflection::genScriptClass(Context &C,
       genExportForEach(C, *I);
   }
 
+  // Reflect export reductions (only available on ICS+, like forEach)
+  if (mRSContext->getTargetAPI() >= SLANG_ICS_TARGET_API) {
+    for (RSContext::const_export_reduce_iterator
+             I = mRSContext->export_reduce_begin(),
+             E = mRSContext->export_reduce_end();
+         I != E; I++)
+      genExportReduce(C, *I);
+  }
+
   // Reflect export function
   for (RSContext::const_export_func_iterator
            I = mRSContext->export_funcs_begin(),
@@ -640,7 +739,12 @@ bool RSReflection::genScriptClass(Context &C,
        I != E; I++)
     genExportFunction(C, *I);
 
-  C.endClass();
+  // Bound to the last exported variable, after all the ones above
+  if (!mRSContext->getInstrumentedFuncs().empty())
+    genKernelProfile(C);
+
+  if (!C.endClass(ErrorMsg))
+    return false;
 
   return true;
 }
@@ -667,6 +771,8 @@ void RSReflection::genScriptClassConstructor(Context &C) {
     const RSExportVar *EV = *I;
     if (!EV->getInit().isUninit())
       genInitExportVariable(C, EV->getType(), EV->getName(), EV->getInit());
+    else if (!EV->getArrayInit().empty())
+      genInitArrayExportVariable(C, EV, RS_EXPORT_VAR_PREFIX + EV->getName());
   }
 
   for (RSContext::const_export_foreach_iterator
@@ -686,6 +792,27 @@ void RSReflection::genScriptClassConstructor(Context &C) {
     }
   }
 
+  for (RSContext::const_export_reduce_iterator
+           I = mRSContext->export_reduce_begin(),
+           E = mRSContext->export_reduce_end();
+       I != E;
+       I++) {
+    const RSExportReduce *ER = *I;
+    genTypeInstance(C, ER->getInType());
+    genTypeInstance(C, ER->getResultType());
+  }
+
+  // 2 longs (i.e., 4 ints) per function, zeroed
+  size_t NumFuncs = mRSContext->getInstrumentedFuncs().size();
+  if (NumFuncs > 0) {
+    C.indent() << RS_KERNEL_PROFILE_BUFFER_NAME" = Allocation.createSized(rs, "
+                  "Element.I32(rs), " << (4 * NumFuncs) << ");" << std::endl;
+    C.indent() << RS_KERNEL_PROFILE_BUFFER_NAME".copyFrom(new int["
+               << (4 * NumFuncs) << "]);" << std::endl;
+    C.indent() << "bindAllocation("RS_KERNEL_PROFILE_BUFFER_NAME", "
+                  RS_KERNEL_PROFILE_INDEX_NAME");" << std::endl;
+  }
+
   C.endFunction();
 
   for (std::set<std::string>::iterator I = C.mTypesToCheck.begin(),
@@ -713,13 +840,9 @@ void RSReflection::genInitBoolExportVariable(Context &C,
   return;
 }
 
-void RSReflection::genInitPrimitiveExportVariable(
-      Context &C,
-      const std::string &VarName,
-      const clang::APValue &Val) {
+void RSReflection::genPrimitiveValue(Context &C, const clang::APValue &Val) {
   slangAssert(!Val.isUninit() && "Not a valid initializer");
 
-  C.indent() << RS_EXPORT_VAR_PREFIX << VarName << " = ";
   switch (Val.getKind()) {
     case clang::APValue::Int: {
       llvm::APInt api = Val.getInt();
@@ -731,7 +854,11 @@ void RSReflection::genInitPrimitiveExportVariable(
     }
     case clang::APValue::Float: {
       llvm::APFloat apf = Val.getFloat();
-      if (&apf.getSemantics() == &llvm::APFloat::IEEEsingle) {
+      if (&apf.getSemantics() == &llvm::APFloat::IEEEhalf) {
+        // Reflected as the raw bits
+        C.out() << "(short) 0x"
+                << llvm::utohexstr(apf.bitcastToAPInt().getZExtValue());
+      } else if (&apf.getSemantics() == &llvm::APFloat::IEEEsingle) {
         C.out() << apf.convertToFloat() << "f";
       } else {
         C.out() << apf.convertToDouble();
@@ -751,11 +878,194 @@ void RSReflection::genInitPrimitiveExportVariable(
       slangAssert(false && "Unknown kind of initializer");
     }
   }
+
+  return;
+}
+
+void RSReflection::genInitPrimitiveExportVariable(
+      Context &C,
+      const std::string &VarName,
+      const clang::APValue &Val) {
+  slangAssert(!Val.isUninit() && "Not a valid initializer");
+
+  C.indent() << RS_EXPORT_VAR_PREFIX << VarName << " = ";
+  genPrimitiveValue(C, Val);
   C.out() << ";" << std::endl;
 
   return;
 }
 
+// The elements of the large initialized arrays are packed into 1, 2 or 4 chars
+// (16 bits each, the least significant first) of string literals, which javac
+// keeps in the constant pool as is. Return the number of chars of an element
+// of type @DT and set @Decoder to the Java expression rebuilding it from the
+// chars at seg.charAt(j) on, or return 0 if unsupported.
+static unsigned GetPackedElementDecoder(RSExportPrimitiveType::DataType DT,
+                                        std::string *Decoder) {
+  switch (DT) {
+    case RSExportPrimitiveType::DataTypeBoolean: {
+      *Decoder = "(seg.charAt(j) != 0)";
+      return 1;
+    }
+    case RSExportPrimitiveType::DataTypeSigned8: {
+      *Decoder = "(byte) seg.charAt(j)";
+      return 1;
+    }
+    case RSExportPrimitiveType::DataTypeUnsigned8:
+    case RSExportPrimitiveType::DataTypeSigned16:
+    case RSExportPrimitiveType::DataTypeFloat16: {
+      *Decoder = "(short) seg.charAt(j)";
+      return 1;
+    }
+    case RSExportPrimitiveType::DataTypeUnsigned16: {
+      *Decoder = "seg.charAt(j)";
+      return 1;
+    }
+    case RSExportPrimitiveType::DataTypeSigned32: {
+      *Decoder = "seg.charAt(j) | (seg.charAt(j + 1) << 16)";
+      return 2;
+    }
+    case RSExportPrimitiveType::DataTypeFloat32: {
+      *Decoder = "Float.intBitsToFloat(seg.charAt(j) | "
+                 "(seg.charAt(j + 1) << 16))";
+      return 2;
+    }
+    case RSExportPrimitiveType::DataTypeUnsigned32: {
+      *Decoder = "(long) seg.charAt(j) | ((long) seg.charAt(j + 1) << 16)";
+      return 2;
+    }
+    case RSExportPrimitiveType::DataTypeSigned64:
+    case RSExportPrimitiveType::DataTypeUnsigned64: {
+      *Decoder = "(long) seg.charAt(j) | ((long) seg.charAt(j + 1) << 16) | "
+                 "((long) seg.charAt(j + 2) << 32) | "
+                 "((long) seg.charAt(j + 3) << 48)";
+      return 4;
+    }
+    case RSExportPrimitiveType::DataTypeFloat64: {
+      *Decoder = "Double.longBitsToDouble((long) seg.charAt(j) | "
+                 "((long) seg.charAt(j + 1) << 16) | "
+                 "((long) seg.charAt(j + 2) << 32) | "
+                 "((long) seg.charAt(j + 3) << 48))";
+      return 4;
+    }
+    default: {
+      return 0;
+    }
+  }
+}
+
+// Write the chars of the element @Val (see GetPackedElementDecoder())
+static void GenPackedElement(std::ostream &OS,
+                             const clang::APValue &Val,
+                             unsigned NumChars) {
+  uint64_t Bits = Val.isInt() ? Val.getInt().getZExtValue()
+                              : Val.getFloat().bitcastToAPInt().getZExtValue();
+  for (unsigned i = 0; i < NumChars; i++, Bits >>= 16) {
+    unsigned Char = static_cast<unsigned>(Bits & 0xffff);
+    if ((Char >= 0x20) && (Char < 0x7f) && (Char != '"') && (Char != '\\')) {
+      OS << static_cast<char>(Char);
+    } else {
+      // Never a \u escape of a quote, a backslash or a line terminator,
+      // which javac would translate before parsing the literal.
+      char Escape[8];
+      if (Char < 0x100)
+        snprintf(Escape, sizeof(Escape), "\\%03o", Char);
+      else
+        snprintf(Escape, sizeof(Escape), "\\u%04x", Char);
+      OS << Escape;
+    }
+  }
+  return;
+}
+
+void RSReflection::genArrayInitData(Context &C, const RSExportVar *EV) {
+  const std::vector<clang::APValue> &Init = EV->getArrayInit();
+  if (Init.size() <= RS_ARRAY_INIT_INLINE_LIMIT)
+    return;
+
+  const RSExportPrimitiveType *EPT = static_cast<const RSExportPrimitiveType*>(
+      static_cast<const RSExportConstantArrayType*>(EV->getType())->
+          getElementType());
+  std::string Decoder;
+  unsigned NumChars = GetPackedElementDecoder(EPT->getType(), &Decoder);
+  if (NumChars == 0)
+    return;
+
+  // A string constant of the class file takes up to 64K bytes of modified
+  // UTF-8, i.e., 21K chars taking 3 bytes each.
+  const unsigned ElementsPerSegment = 0x4000 / NumChars;
+  const unsigned ElementsPerLine = 16 / NumChars;
+
+  C.indent() << "private static final class "RS_EXPORT_VAR_INIT_DATA_PREFIX
+             << EV->getName() << " {" << std::endl;
+  C.incIndentLevel();
+  C.indent() << "static final String[] DATA = {" << std::endl;
+  C.incIndentLevel();
+  for (unsigned i = 0, e = Init.size(); i < e; i++) {
+    if ((i % ElementsPerSegment) == 0) {
+      C.indent() << "\"";
+    } else if ((i % ElementsPerLine) == 0) {
+      C.out() << "\" +" << std::endl;
+      C.indent() << "    \"";
+    }
+    GenPackedElement(C.out(), Init[i], NumChars);
+    if ((((i + 1) % ElementsPerSegment) == 0) || ((i + 1) == e))
+      C.out() << "\"," << std::endl;
+  }
+  C.decIndentLevel();
+  C.indent() << "};" << std::endl;
+  C.decIndentLevel();
+  C.indent() << "}" << std::endl << std::endl;
+
+  return;
+}
+
+void RSReflection::genInitArrayExportVariable(Context &C,
+                                              const RSExportVar *EV,
+                                              const std::string &VarName) {
+  const RSExportConstantArrayType *ECAT =
+      static_cast<const RSExportConstantArrayType*>(EV->getType());
+  const RSExportPrimitiveType *EPT =
+      static_cast<const RSExportPrimitiveType*>(ECAT->getElementType());
+  const std::vector<clang::APValue> &Init = EV->getArrayInit();
+
+  C.indent() << VarName << " = new " << GetPrimitiveTypeName(EPT) << "["
+             << ECAT->getSize() << "];" << std::endl;
+
+  std::string Decoder;
+  unsigned NumChars = GetPackedElementDecoder(EPT->getType(), &Decoder);
+  if ((Init.size() > RS_ARRAY_INIT_INLINE_LIMIT) && (NumChars != 0)) {
+    C.indent() << "{" << std::endl;
+    C.incIndentLevel();
+    C.indent() << "int i = 0;" << std::endl;
+    C.indent() << "for (String seg : "RS_EXPORT_VAR_INIT_DATA_PREFIX
+               << EV->getName() << ".DATA) {" << std::endl;
+    C.incIndentLevel();
+    C.indent() << "for (int j = 0, e = seg.length(); j < e; j += " << NumChars
+               << ") {" << std::endl;
+    C.incIndentLevel();
+    C.indent() << VarName << "[i++] = " << Decoder << ";" << std::endl;
+    C.decIndentLevel();
+    C.indent() << "}" << std::endl;
+    C.decIndentLevel();
+    C.indent() << "}" << std::endl;
+    C.decIndentLevel();
+    C.indent() << "}" << std::endl;
+    return;
+  }
+
+  for (unsigned i = 0, e = Init.size(); i < e; i++) {
+    C.indent() << VarName << "[" << i << "] = ";
+    if (EPT->getType() == RSExportPrimitiveType::DataTypeBoolean)
+      C.out() << ((Init[i].getInt().getSExtValue() == 0) ? "false" : "true");
+    else
+      genPrimitiveValue(C, Init[i]);
+    C.out() << ";" << std::endl;
+  }
+
+  return;
+}
+
 void RSReflection::genInitExportVariable(Context &C,
                                          const RSExportType *ET,
                                          const std::string &VarName,
@@ -775,8 +1085,8 @@ void RSReflection::genInitExportVariable(Context &C,
     }
     case RSExportType::ExportClassPointer: {
       if (!Val.isInt() || Val.getInt().getSExtValue() != 0)
-        std::cout << "Initializer which is non-NULL to pointer type variable "
-                     "will be ignored" << std::endl;
+        C.getVerboseOutput() << "Initializer which is non-NULL to pointer "
+                                "type variable will be ignored" << std::endl;
       break;
     }
     case RSExportType::ExportClassVector: {
@@ -898,6 +1208,143 @@ void RSReflection::genExportVariable(Context &C, const RSExportVar *EV) {
   return;
 }
 
+void RSReflection::genKernelProfile(Context &C) {
+  const std::vector<std::string> &Funcs = mRSContext->getInstrumentedFuncs();
+
+  C.indent() << "private final static int "RS_KERNEL_PROFILE_INDEX_NAME" = "
+             << C.getNextExportVarSlot() << ";" << std::endl;
+  C.indent() << "private final static String[] __profile_names = {"
+             << std::endl;
+  C.incIndentLevel();
+  for (unsigned i = 0, e = Funcs.size(); i != e; i++)
+    C.indent() << "\"" << Funcs[i] << "\"," << std::endl;
+  C.decIndentLevel();
+  C.indent() << "};" << std::endl;
+  C.indent() << "private Allocation "RS_KERNEL_PROFILE_BUFFER_NAME";"
+             << std::endl << std::endl;
+
+  // The entry points in the order of getProfile()
+  C.startFunction(Context::AM_Public, true, "String[]", "getProfileNames", 0);
+  C.indent() << "return __profile_names.clone();" << std::endl;
+  C.endFunction();
+
+  // { calls of #0, nanoseconds in #0, calls of #1, ... }
+  C.startFunction(Context::AM_Public, false, "long[]", "getProfile", 0);
+  C.indent() << "int[] words = new int[" << (4 * Funcs.size()) << "];"
+             << std::endl;
+  C.indent() << RS_KERNEL_PROFILE_BUFFER_NAME".copyTo(words);" << std::endl;
+  C.indent() << "long[] profile = new long[" << (2 * Funcs.size()) << "];"
+             << std::endl;
+  C.indent() << "for (int i = 0; i < profile.length; i++) {" << std::endl;
+  C.incIndentLevel();
+  C.indent() << "profile[i] = (words[2 * i] & 0xffffffffL) | "
+                "((long) words[2 * i + 1] << 32);" << std::endl;
+  C.decIndentLevel();
+  C.indent() << "}" << std::endl;
+  C.indent() << "return profile;" << std::endl;
+  C.endFunction();
+
+  C.startFunction(Context::AM_Public, false, "void", "resetProfile", 0);
+  C.indent() << RS_KERNEL_PROFILE_BUFFER_NAME".copyFrom(new int["
+             << (4 * Funcs.size()) << "]);" << std::endl;
+  C.endFunction();
+
+  return;
+}
+
+void RSReflection::genExportConstant(Context &C, const RSExportVar *EV) {
+  const RSExportType *ET = EV->getType();
+  const clang::APValue &Val = EV->getInit();
+  std::string TypeName;
+
+  if (ET->getClass() == RSExportType::ExportClassConstantArray) {
+    const std::string ConstName = RS_EXPORT_VAR_CONST_PREFIX + EV->getName();
+    TypeName = GetTypeName(ET);
+    C.indent() << "public final static " << TypeName << " " << ConstName << ";"
+               << std::endl;
+    C.indent() << "static {" << std::endl;
+    C.incIndentLevel();
+    genInitArrayExportVariable(C, EV, ConstName);
+    C.decIndentLevel();
+    C.indent() << "}" << std::endl;
+    genArrayInitData(C, EV);
+
+    // A copy, since the elements of a final array can still be changed
+    C.startFunction(Context::AM_Public,
+                    false,
+                    TypeName.c_str(),
+                    "get_" + EV->getName(),
+                    0);
+    C.indent() << "return " << ConstName << ".clone();" << std::endl;
+    C.endFunction();
+    return;
+  }
+
+  C.indent() << "public final static ";
+  if (ET->getClass() == RSExportType::ExportClassPrimitive) {
+    const RSExportPrimitiveType *EPT =
+        static_cast<const RSExportPrimitiveType*>(ET);
+    TypeName = GetPrimitiveTypeName(EPT);
+    C.out() << TypeName << " "RS_EXPORT_VAR_CONST_PREFIX << EV->getName()
+            << " = ";
+    if (EPT->getType() == RSExportPrimitiveType::DataTypeBoolean)
+      C.out() << ((Val.getInt().getSExtValue() == 0) ? "false" : "true");
+    else
+      genPrimitiveValue(C, Val);
+  } else {
+    slangAssert((ET->getClass() == RSExportType::ExportClassVector) &&
+                "Only scalars and vectors are folded");
+    const RSExportVectorType *EVT = static_cast<const RSExportVectorType*>(ET);
+    // The constructors of the vectors take the Java type of the elements,
+    // which doesn't convert the int literals implicitly.
+    const char *ElementTypeName = GetPrimitiveTypeName(EVT);
+    TypeName = GetVectorTypeName(EVT);
+    C.out() << TypeName << " "RS_EXPORT_VAR_CONST_PREFIX << EV->getName()
+            << " = new " << TypeName << "(";
+    for (unsigned i = 0; i < EVT->getNumElement(); i++) {
+      if (i != 0)
+        C.out() << ", ";
+      C.out() << "(" << ElementTypeName << ") ";
+      if (!Val.isVector())
+        genPrimitiveValue(C, Val);
+      else if (i < Val.getVectorLength())
+        genPrimitiveValue(C, Val.getVectorElt(i));
+      else
+        C.out() << "0";
+    }
+    C.out() << ")";
+  }
+  C.out() << ";" << std::endl;
+
+  C.startFunction(Context::AM_Public,
+                  false,
+                  TypeName.c_str(),
+                  "get_" + EV->getName(),
+                  0);
+  C.indent() << "return "RS_EXPORT_VAR_CONST_PREFIX << EV->getName() << ";"
+             << std::endl;
+  C.endFunction();
+
+  return;
+}
+
+bool RSReflection::IsDirectArgInvoke(const RSExportFunc *EF) {
+  if (!EF->hasParam() ||
+      (EF->getNumParameters() > RS_DIRECT_INVOKE_MAX_PARAMS))
+    return false;
+
+  for (RSExportFunc::const_param_iterator I = EF->params_begin(),
+           E = EF->params_end();
+       I != E;
+       I++) {
+    const RSExportType *T = (*I)->getType();
+    if ((T->getClass() != RSExportType::ExportClassPrimitive) ||
+        static_cast<const RSExportPrimitiveType*>(T)->isRSObjectType())
+      return false;
+  }
+  return true;
+}
+
 void RSReflection::genExportFunction(Context &C, const RSExportFunc *EF) {
   C.indent() << "private final static int "RS_EXPORT_FUNC_INDEX_PREFIX
              << EF->getName() << " = " << C.getNextExportFuncSlot() << ";"
@@ -916,7 +1363,19 @@ void RSReflection::genExportFunction(Context &C, const RSExportFunc *EF) {
     }
   }
 
-  C.startFunction(Context::AM_Public,
+  // The few scalars of a direct-argument invokable are always packed into
+  // the same small buffer.
+  bool Direct = IsDirectArgInvoke(EF);
+
+  std::string FieldPackerName = EF->getName() + "_fp";
+  if (EF->hasParam())
+    FieldPackerName = genFieldPackerName(C,
+                                         EF->getParamPacketType(),
+                                         EF->getName(),
+                                         FieldPackerName.c_str(),
+                                         Direct);
+
+  C.startFunction(getFieldPackerAccessModifier(Direct),
                   false,
                   "void",
                   "invoke_" + EF->getName(/*Mangle=*/ false),
@@ -929,9 +1388,8 @@ void RSReflection::genExportFunction(Context &C, const RSExportFunc *EF) {
                << std::endl;
   } else {
     const RSExportRecordType *ERT = EF->getParamPacketType();
-    std::string FieldPackerName = EF->getName() + "_fp";
 
-    if (genCreateFieldPacker(C, ERT, FieldPackerName.c_str()))
+    if (genCreateFieldPacker(C, ERT, FieldPackerName.c_str(), Direct))
       genPackVarOfType(C, ERT, NULL, FieldPackerName.c_str());
 
     C.indent() << "invoke("RS_EXPORT_FUNC_INDEX_PREFIX << EF->getName() << ", "
@@ -943,6 +1401,12 @@ void RSReflection::genExportFunction(Context &C, const RSExportFunc *EF) {
 }
 
 void RSReflection::genExportForEach(Context &C, const RSExportForEach *EF) {
+  if (EF->isDummyRoot()) {
+    // There's nothing to launch, but the slot is still taken.
+    C.getNextExportForEachSlot();
+    return;
+  }
+
   C.indent() << "private final static int "RS_EXPORT_FOREACH_INDEX_PREFIX
              << EF->getName() << " = " << C.getNextExportForEachSlot() << ";"
              << std::endl;
@@ -968,7 +1432,38 @@ void RSReflection::genExportForEach(Context &C, const RSExportForEach *EF) {
     }
   }
 
-  C.startFunction(Context::AM_Public,
+  std::string FieldPackerName = EF->getName() + "_fp";
+  if (ERT)
+    FieldPackerName = genFieldPackerName(C, ERT, EF->getName(),
+                                         FieldPackerName.c_str());
+
+  // Since JB MR2, the runtime can launch the kernel on a range of the cells
+  // (Script.LaunchOptions), e.g., to process a region of interest or a tile
+  // at a time. The overload taking the range does all the checks (once per
+  // launch) and the full one just passes it a null range.
+  bool HasLaunchOptions =
+      (mRSContext->getTargetAPI() >= SLANG_JB_MR2_TARGET_API);
+  if (HasLaunchOptions) {
+    C.startFunction(getFieldPackerAccessModifier(),
+                    false,
+                    "void",
+                    "forEach_" + EF->getName(),
+                    Args);
+
+    C.indent() << "forEach_" << EF->getName() << "(";
+    for (Context::ArgTy::const_iterator I = Args.begin(), E = Args.end();
+         I != E;
+         I++) {
+      C.out() << I->second << ", ";
+    }
+    C.out() << "null);" << std::endl;
+
+    C.endFunction();
+
+    Args.push_back(std::make_pair("Script.LaunchOptions", "sc"));
+  }
+
+  C.startFunction(getFieldPackerAccessModifier(),
                   false,
                   "void",
                   "forEach_" + EF->getName(),
@@ -985,6 +1480,15 @@ void RSReflection::genExportForEach(Context &C, const RSExportForEach *EF) {
   }
 
   if (EF->hasIn() && EF->hasOut()) {
+    if (EF->isNoAlias()) {
+      C.indent() << "// The kernel assumes that in and out don't alias"
+                 << std::endl;
+      C.indent() << "if (ain == aout) {" << std::endl;
+      C.indent() << "    throw new RSRuntimeException(\"Input and output "
+                 << "parameters must be distinct allocations!\");";
+      C.out()    << std::endl;
+      C.indent() << "}" << std::endl;
+    }
     C.indent() << "// Verify dimensions" << std::endl;
     C.indent() << "Type tIn = ain.getType();" << std::endl;
     C.indent() << "Type tOut = aout.getType();" << std::endl;
@@ -1000,7 +1504,6 @@ void RSReflection::genExportForEach(Context &C, const RSExportForEach *EF) {
     C.indent() << "}" << std::endl;
   }
 
-  std::string FieldPackerName = EF->getName() + "_fp";
   if (ERT) {
     if (genCreateFieldPacker(C, ERT, FieldPackerName.c_str())) {
       genPackVarOfType(C, ERT, NULL, FieldPackerName.c_str());
@@ -1023,12 +1526,46 @@ void RSReflection::genExportForEach(Context &C, const RSExportForEach *EF) {
   else
     C.out() << ", null";
 
+  if (HasLaunchOptions)
+    C.out() << ", sc";
+
   C.out() << ");" << std::endl;
 
   C.endFunction();
   return;
 }
 
+void RSReflection::genExportReduce(Context &C, const RSExportReduce *ER) {
+  C.indent() << "private final static int "RS_EXPORT_REDUCE_INDEX_PREFIX
+             << ER->getName() << " = " << C.getNextExportReduceSlot() << ";"
+             << std::endl;
+
+  // reduce_*()
+  C.startFunction(Context::AM_Public,
+                  false,
+                  "void",
+                  "reduce_" + ER->getName(),
+                  2,
+                  "Allocation", "ain",
+                  "Allocation", "aout");
+
+  genTypeCheck(C, ER->getInType(), "ain");
+  genTypeCheck(C, ER->getResultType(), "aout");
+
+  C.indent() << "// The result is a single cell" << std::endl;
+  C.indent() << "if (aout.getType().getCount() != 1) {" << std::endl;
+  C.indent() << "    throw new RSRuntimeException(\"Reduction output must "
+             << "have exactly one cell!\");";
+  C.out()    << std::endl;
+  C.indent() << "}" << std::endl;
+
+  C.indent() << "reduce("RS_EXPORT_REDUCE_INDEX_PREFIX << ER->getName()
+             << ", ain, aout, null);" << std::endl;
+
+  C.endFunction();
+  return;
+}
+
 void RSReflection::genTypeInstance(Context &C,
                                    const RSExportType *ET) {
   if (ET->getClass() == RSExportType::ExportClassPointer) {
@@ -1170,7 +1707,9 @@ void RSReflection::genPrimitiveTypeExportVariable(
              << EV->getName() << ";" << std::endl;
 
   // set_*()
-  if (!EV->isConst()) {
+  if (mOptions.BatchedUpdates && !EV->isConst()) {
+    genBatchedSetExportVariable(C, EV, TypeName);
+  } else if (!EV->isConst()) {
     C.startFunction(Context::AM_Public,
                     false,
                     "void",
@@ -1240,14 +1779,17 @@ void RSReflection::genVectorTypeExportVariable(Context &C,
   const RSExportVectorType *EVT =
       static_cast<const RSExportVectorType*>(EV->getType());
   const char *TypeName = GetVectorTypeName(EVT);
-  const char *FieldPackerName = "fp";
 
   C.indent() << "private " << TypeName << " "RS_EXPORT_VAR_PREFIX
              << EV->getName() << ";" << std::endl;
 
   // set_*()
-  if (!EV->isConst()) {
-    C.startFunction(Context::AM_Public,
+  if (mOptions.BatchedUpdates && !EV->isConst()) {
+    genBatchedSetExportVariable(C, EV, TypeName);
+  } else if (!EV->isConst()) {
+    std::string FieldPackerName =
+        genFieldPackerName(C, EV->getType(), EV->getName(), "fp");
+    C.startFunction(getFieldPackerAccessModifier(),
                     false,
                     "void",
                     "set_" + EV->getName(),
@@ -1255,8 +1797,8 @@ void RSReflection::genVectorTypeExportVariable(Context &C,
                     TypeName, "v");
     C.indent() << RS_EXPORT_VAR_PREFIX << EV->getName() << " = v;" << std::endl;
 
-    if (genCreateFieldPacker(C, EVT, FieldPackerName))
-      genPackVarOfType(C, EVT, "v", FieldPackerName);
+    if (genCreateFieldPacker(C, EVT, FieldPackerName.c_str()))
+      genPackVarOfType(C, EVT, "v", FieldPackerName.c_str());
     C.indent() << "setVar("RS_EXPORT_VAR_INDEX_PREFIX << EV->getName() << ", "
                << FieldPackerName << ");" << std::endl;
 
@@ -1275,14 +1817,17 @@ void RSReflection::genMatrixTypeExportVariable(Context &C,
   const RSExportMatrixType *EMT =
       static_cast<const RSExportMatrixType*>(EV->getType());
   const char *TypeName = GetMatrixTypeName(EMT);
-  const char *FieldPackerName = "fp";
 
   C.indent() << "private " << TypeName << " "RS_EXPORT_VAR_PREFIX
              << EV->getName() << ";" << std::endl;
 
   // set_*()
-  if (!EV->isConst()) {
-    C.startFunction(Context::AM_Public,
+  if (mOptions.BatchedUpdates && !EV->isConst()) {
+    genBatchedSetExportVariable(C, EV, TypeName);
+  } else if (!EV->isConst()) {
+    std::string FieldPackerName =
+        genFieldPackerName(C, EV->getType(), EV->getName(), "fp");
+    C.startFunction(getFieldPackerAccessModifier(),
                     false,
                     "void",
                     "set_" + EV->getName(),
@@ -1290,8 +1835,8 @@ void RSReflection::genMatrixTypeExportVariable(Context &C,
                     TypeName, "v");
     C.indent() << RS_EXPORT_VAR_PREFIX << EV->getName() << " = v;" << std::endl;
 
-    if (genCreateFieldPacker(C, EMT, FieldPackerName))
-      genPackVarOfType(C, EMT, "v", FieldPackerName);
+    if (genCreateFieldPacker(C, EMT, FieldPackerName.c_str()))
+      genPackVarOfType(C, EMT, "v", FieldPackerName.c_str());
     C.indent() << "setVar("RS_EXPORT_VAR_INDEX_PREFIX << EV->getName() << ", "
                << FieldPackerName << ");" << std::endl;
 
@@ -1312,14 +1857,18 @@ void RSReflection::genConstantArrayTypeExportVariable(
   const RSExportConstantArrayType *ECAT =
       static_cast<const RSExportConstantArrayType*>(EV->getType());
   std::string TypeName = GetTypeName(ECAT);
-  const char *FieldPackerName = "fp";
 
   C.indent() << "private " << TypeName << " "RS_EXPORT_VAR_PREFIX
              << EV->getName() << ";" << std::endl;
+  genArrayInitData(C, EV);
 
   // set_*()
-  if (!EV->isConst()) {
-    C.startFunction(Context::AM_Public,
+  if (mOptions.BatchedUpdates && !EV->isConst()) {
+    genBatchedSetExportVariable(C, EV, TypeName);
+  } else if (!EV->isConst()) {
+    std::string FieldPackerName =
+        genFieldPackerName(C, EV->getType(), EV->getName(), "fp");
+    C.startFunction(getFieldPackerAccessModifier(),
                     false,
                     "void",
                     "set_" + EV->getName(),
@@ -1327,8 +1876,8 @@ void RSReflection::genConstantArrayTypeExportVariable(
                     TypeName.c_str(), "v");
     C.indent() << RS_EXPORT_VAR_PREFIX << EV->getName() << " = v;" << std::endl;
 
-    if (genCreateFieldPacker(C, ECAT, FieldPackerName))
-      genPackVarOfType(C, ECAT, "v", FieldPackerName);
+    if (genCreateFieldPacker(C, ECAT, FieldPackerName.c_str()))
+      genPackVarOfType(C, ECAT, "v", FieldPackerName.c_str());
     C.indent() << "setVar("RS_EXPORT_VAR_INDEX_PREFIX << EV->getName() << ", "
                << FieldPackerName << ");" << std::endl;
 
@@ -1348,14 +1897,17 @@ void RSReflection::genRecordTypeExportVariable(Context &C,
       static_cast<const RSExportRecordType*>(EV->getType());
   std::string TypeName =
       RS_TYPE_CLASS_NAME_PREFIX + ERT->getName() + "."RS_TYPE_ITEM_CLASS_NAME;
-  const char *FieldPackerName = "fp";
 
   C.indent() << "private " << TypeName << " "RS_EXPORT_VAR_PREFIX
              << EV->getName() << ";" << std::endl;
 
   // set_*()
-  if (!EV->isConst()) {
-    C.startFunction(Context::AM_Public,
+  if (mOptions.BatchedUpdates && !EV->isConst()) {
+    genBatchedSetExportVariable(C, EV, TypeName);
+  } else if (!EV->isConst()) {
+    std::string FieldPackerName =
+        genFieldPackerName(C, EV->getType(), EV->getName(), "fp");
+    C.startFunction(getFieldPackerAccessModifier(),
                     false,
                     "void",
                     "set_" + EV->getName(),
@@ -1363,8 +1915,8 @@ void RSReflection::genRecordTypeExportVariable(Context &C,
                     TypeName.c_str(), "v");
     C.indent() << RS_EXPORT_VAR_PREFIX << EV->getName() << " = v;" << std::endl;
 
-    if (genCreateFieldPacker(C, ERT, FieldPackerName))
-      genPackVarOfType(C, ERT, "v", FieldPackerName);
+    if (genCreateFieldPacker(C, ERT, FieldPackerName.c_str()))
+      genPackVarOfType(C, ERT, "v", FieldPackerName.c_str());
     C.indent() << "setVar("RS_EXPORT_VAR_INDEX_PREFIX << EV->getName()
                << ", " << FieldPackerName << ");" << std::endl;
 
@@ -1390,20 +1942,127 @@ void RSReflection::genGetExportVariable(Context &C,
   return;
 }
 
+void RSReflection::genBatchedSetExportVariable(Context &C,
+                                               const RSExportVar *EV,
+                                               const std::string &TypeName) {
+  const RSExportType *ET = EV->getType();
+  unsigned Dirty = C.addBatchedVar(EV);
+  // The value given to setVar(): the primitives are compared as is, the
+  // other types by their packed bytes (the caller may modify and set again
+  // the same object.)
+  bool Packed = (ET->getClass() != RSExportType::ExportClassPrimitive);
+  std::string VarName = RS_EXPORT_VAR_PREFIX + EV->getName();
+  std::string Value = Packed ?
+      (RS_BATCHED_FIELD_PACKER_PREFIX + EV->getName()) : VarName;
+
+  if (Packed)
+    C.indent() << "private FieldPacker " << Value << ";" << std::endl;
+
+  C.startFunction(Context::AM_PublicSynchronized,
+                  false,
+                  "void",
+                  "set_" + EV->getName(),
+                  1,
+                  TypeName.c_str(), "v");
+
+  if (Packed) {
+    C.indent() << VarName << " = v;" << std::endl;
+    C.indent() << "FieldPacker fp = new FieldPacker("
+               << RSExportType::GetTypeAllocSize(ET) << ");" << std::endl;
+    if (RSExportType::GetTypeAllocSize(ET) > 0)
+      genPackVarOfType(C, ET, "v", "fp");
+    C.indent() << "if ((" << Value << " != null) && java.util.Arrays.equals("
+               << Value << ".getData(), fp.getData())) return;" << std::endl;
+    C.indent() << Value << " = fp;" << std::endl;
+  } else {
+    C.indent() << "if (" << VarName << " == v) return;" << std::endl;
+    C.indent() << VarName << " = v;" << std::endl;
+  }
+
+  C.indent() << "if ("RS_BATCHED_UPDATING_NAME") "RS_BATCHED_DIRTY_NAME"["
+             << Dirty << "] = true;" << std::endl;
+  C.indent() << "else setVar("RS_EXPORT_VAR_INDEX_PREFIX << EV->getName()
+             << ", " << Value << ");" << std::endl;
+
+  C.endFunction();
+  return;
+}
+
+void RSReflection::genBatchedUpdateMethods(Context &C) {
+  const std::vector<const RSExportVar*> &Vars = C.getBatchedVars();
+
+  C.indent() << "private boolean "RS_BATCHED_UPDATING_NAME";" << std::endl;
+  C.indent() << "private boolean[] "RS_BATCHED_DIRTY_NAME" = new boolean["
+             << Vars.size() << "];" << std::endl << std::endl;
+
+  C.startFunction(Context::AM_PublicSynchronized,
+                  false,
+                  "void",
+                  "beginUpdate",
+                  0);
+  C.indent() << RS_BATCHED_UPDATING_NAME" = true;" << std::endl;
+  C.endFunction();
+
+  // The changed variables in the order of their slots
+  C.startFunction(Context::AM_PublicSynchronized,
+                  false,
+                  "void",
+                  "commit",
+                  0);
+  C.indent() << RS_BATCHED_UPDATING_NAME" = false;" << std::endl;
+  for (unsigned i = 0, e = Vars.size(); i != e; i++) {
+    const std::string &Name = Vars[i]->getName();
+    bool Packed =
+        (Vars[i]->getType()->getClass() != RSExportType::ExportClassPrimitive);
+    C.indent() << "if ("RS_BATCHED_DIRTY_NAME"[" << i << "]) setVar("
+                  RS_EXPORT_VAR_INDEX_PREFIX << Name << ", "
+               << (Packed ? RS_BATCHED_FIELD_PACKER_PREFIX :
+                            RS_EXPORT_VAR_PREFIX) << Name << ");" << std::endl;
+  }
+  C.indent() << "java.util.Arrays.fill("RS_BATCHED_DIRTY_NAME", false);"
+             << std::endl;
+  C.endFunction();
+
+  return;
+}
+
 /******************* Methods to generate script class /end *******************/
 
 bool RSReflection::genCreateFieldPacker(Context &C,
                                         const RSExportType *ET,
-                                        const char *FieldPackerName) {
+                                        const char *FieldPackerName,
+                                        bool Cached) {
   size_t AllocSize = RSExportType::GetTypeAllocSize(ET);
-  if (AllocSize > 0)
+  if (AllocSize == 0)
+    return false;
+
+  if (mOptions.CachedFieldPackers || Cached) {
+    // Declared by genFieldPackerName()
+    C.indent() << "if (" << FieldPackerName << " == null) "
+               << FieldPackerName << " = new FieldPacker(" << AllocSize
+               << ");" << std::endl;
+    C.indent() << "else " << FieldPackerName << ".reset();" << std::endl;
+  } else {
     C.indent() << "FieldPacker " << FieldPackerName << " = new FieldPacker("
                << AllocSize << ");" << std::endl;
-  else
-    return false;
+  }
   return true;
 }
 
+std::string RSReflection::genFieldPackerName(Context &C,
+                                             const RSExportType *ET,
+                                             const std::string &Name,
+                                             const char *LocalName,
+                                             bool Cached) {
+  if (!(mOptions.CachedFieldPackers || Cached) ||
+      (RSExportType::GetTypeAllocSize(ET) == 0))
+    return LocalName;
+
+  std::string FieldPackerName = RS_CACHED_FIELD_PACKER_PREFIX + Name;
+  C.indent() << "private FieldPacker " << FieldPackerName << ";" << std::endl;
+  return FieldPackerName;
+}
+
 void RSReflection::genPackVarOfType(Context &C,
                                     const RSExportType *ET,
                                     const char *VarName,
@@ -1607,7 +2266,10 @@ bool RSReflection::genTypeClass(Context &C,
                     ErrorMsg))
     return false;
 
-  mGeneratedFileNames->push_back(ClassName);
+  if (mOptions.SharedTypesPackageName.empty())
+    mGeneratedFileNames->push_back(ClassName);
+  else
+    mGeneratedFileNames->push_back(C.getPackageName() + "." + ClassName);
 
   genTypeItemClass(C, ERT);
 
@@ -1617,6 +2279,18 @@ bool RSReflection::genTypeClass(Context &C,
   C.indent() << "private FieldPacker "RS_TYPE_ITEM_BUFFER_PACKER_NAME";"
              << std::endl;
 
+  if (mOptions.BulkAccessors) {
+    // The view of the item buffer packer written by the bulk accessors and the
+    // range of items they've changed since the last copyDirtyRange()
+    C.indent() << "private java.nio.ByteBuffer "RS_TYPE_BULK_BUFFER_NAME";"
+               << std::endl;
+    C.indent() << "private byte "RS_TYPE_BULK_STAGING_NAME"[];" << std::endl;
+    C.indent() << "private int "RS_TYPE_BULK_DIRTY_START_NAME";" << std::endl;
+    C.indent() << "private int "RS_TYPE_BULK_DIRTY_END_NAME";" << std::endl;
+  }
+  if (mOptions.AmortizedResize)
+    C.indent() << "private int "RS_TYPE_COUNT_NAME";" << std::endl;
+
   genTypeClassConstructor(C, ERT);
   genTypeClassCopyToArrayLocal(C, ERT);
   genTypeClassCopyToArray(C, ERT);
@@ -1626,8 +2300,11 @@ bool RSReflection::genTypeClass(Context &C,
   genTypeClassComponentGetter(C, ERT);
   genTypeClassCopyAll(C, ERT);
   genTypeClassResize(C);
+  if (mOptions.BulkAccessors)
+    genTypeClassBulkAccessors(C, ERT);
 
-  C.endClass();
+  if (!C.endClass(ErrorMsg))
+    return false;
 
   C.resetFieldIndex();
   C.clearFieldIndexMap();
@@ -1643,19 +2320,23 @@ void RSReflection::genTypeItemClass(Context &C,
   C.indent() << "public static final int sizeof = "
              << RSExportType::GetTypeAllocSize(ERT) << ";" << std::endl;
 
+  // The ScriptC_* classes are in other packages when the types are shared.
+  const char *Access =
+      mOptions.SharedTypesPackageName.empty() ? "" : "public ";
+
   // Member elements
   C.out() << std::endl;
   for (RSExportRecordType::const_field_iterator FI = ERT->fields_begin(),
            FE = ERT->fields_end();
        FI != FE;
        FI++) {
-    C.indent() << GetTypeName((*FI)->getType()) << " " << (*FI)->getName()
-               << ";" << std::endl;
+    C.indent() << Access << GetTypeName((*FI)->getType()) << " "
+               << (*FI)->getName() << ";" << std::endl;
   }
 
   // Constructor
   C.out() << std::endl;
-  C.indent() << RS_TYPE_ITEM_CLASS_NAME"()";
+  C.indent() << Access << RS_TYPE_ITEM_CLASS_NAME"()";
   C.startBlock();
 
   for (RSExportRecordType::const_field_iterator FI = ERT->fields_begin(),
@@ -1702,6 +2383,8 @@ void RSReflection::genTypeClassConstructor(Context &C,
              << std::endl;
   // Call init() in super class
   C.indent() << "init(" << RenderScriptVar << ", count);" << std::endl;
+  if (mOptions.AmortizedResize)
+    C.indent() << RS_TYPE_COUNT_NAME" = count;" << std::endl;
   C.endFunction();
 
   C.startFunction(Context::AM_Public,
@@ -1719,6 +2402,8 @@ void RSReflection::genTypeClassConstructor(Context &C,
              << std::endl;
   // Call init() in super class
   C.indent() << "init(" << RenderScriptVar << ", count, usages);" << std::endl;
+  if (mOptions.AmortizedResize)
+    C.indent() << RS_TYPE_COUNT_NAME" = count;" << std::endl;
   C.endFunction();
 
   return;
@@ -1883,8 +2568,11 @@ void RSReflection::genTypeClassCopyAll(Context &C,
                                        const RSExportRecordType *ERT) {
   C.startFunction(Context::AM_PublicSynchronized, false, "void", "copyAll", 0);
 
-  C.indent() << "for (int ct = 0; ct < "RS_TYPE_ITEM_BUFFER_NAME".length; ct++)"
-                  " copyToArray("RS_TYPE_ITEM_BUFFER_NAME"[ct], ct);"
+  // The items past the count of AmortizedResize were never set.
+  C.indent() << "for (int ct = 0; ct < "
+             << (mOptions.AmortizedResize ? RS_TYPE_COUNT_NAME :
+                                            RS_TYPE_ITEM_BUFFER_NAME".length")
+             << "; ct++) copyToArray("RS_TYPE_ITEM_BUFFER_NAME"[ct], ct);"
              << std::endl;
   C.indent() << "mAllocation.setFromFieldPacker(0, "
                   RS_TYPE_ITEM_BUFFER_PACKER_NAME");"
@@ -1895,10 +2583,45 @@ void RSReflection::genTypeClassCopyAll(Context &C,
 }
 
 void RSReflection::genTypeClassResize(Context &C) {
-  C.startFunction(Context::AM_PublicSynchronized,
+  // With AmortizedResize, resize() only sets the count unless it's past the
+  // size of the allocation, which then at least doubles through
+  // setCapacity().
+  if (mOptions.AmortizedResize) {
+    C.startFunction(Context::AM_PublicSynchronized,
+                    false,
+                    "void",
+                    "resize",
+                    1,
+                    "int", "newSize");
+    C.indent() << "int capacity = getType().getX();" << std::endl;
+    C.indent() << "if (newSize > capacity) "
+                  "setCapacity(Math.max(newSize, 2 * capacity));" << std::endl;
+    C.indent() << RS_TYPE_COUNT_NAME" = newSize;" << std::endl;
+    C.endFunction();
+
+    C.startFunction(Context::AM_PublicSynchronized,
+                    false,
+                    "int",
+                    "getCount",
+                    0);
+    C.indent() << "return "RS_TYPE_COUNT_NAME";" << std::endl;
+    C.endFunction();
+
+    C.startFunction(Context::AM_PublicSynchronized,
+                    false,
+                    "void",
+                    "trimToSize",
+                    0);
+    C.indent() << "setCapacity(Math.max("RS_TYPE_COUNT_NAME", 1));"
+               << std::endl;
+    C.endFunction();
+  }
+
+  C.startFunction(mOptions.AmortizedResize ? Context::AM_Private :
+                                             Context::AM_PublicSynchronized,
                   false,
                   "void",
-                  "resize",
+                  mOptions.AmortizedResize ? "setCapacity" : "resize",
                   1,
                   "int", "newSize");
 
@@ -1914,16 +2637,185 @@ void RSReflection::genTypeClassResize(Context &C) {
   C.endBlock();
   C.indent() << "mAllocation.resize(newSize);" << std::endl;
 
-  C.indent() << "if (" RS_TYPE_ITEM_BUFFER_PACKER_NAME " != null) "
-                  RS_TYPE_ITEM_BUFFER_PACKER_NAME " = "
+  if (!mOptions.BulkAccessors) {
+    C.indent() << "if (" RS_TYPE_ITEM_BUFFER_PACKER_NAME " != null) "
+                    RS_TYPE_ITEM_BUFFER_PACKER_NAME " = "
+                      "new FieldPacker(" RS_TYPE_ITEM_CLASS_NAME
+                        ".sizeof * getType().getX()/* count */"
+                          ");" << std::endl;
+  } else {
+    // The items written by the bulk accessors only live in the item buffer
+    // packer, keep them.
+    C.indent() << "if (" RS_TYPE_ITEM_BUFFER_PACKER_NAME " != null) ";
+    C.startBlock();
+    C.indent() << "byte oldData[] = "
+                    RS_TYPE_ITEM_BUFFER_PACKER_NAME ".getData();" << std::endl;
+    C.indent() << RS_TYPE_ITEM_BUFFER_PACKER_NAME " = "
                     "new FieldPacker(" RS_TYPE_ITEM_CLASS_NAME
                       ".sizeof * getType().getX()/* count */"
                         ");" << std::endl;
+    C.indent() << "System.arraycopy(oldData, 0, "
+                    RS_TYPE_ITEM_BUFFER_PACKER_NAME ".getData(), 0, "
+                    "Math.min(oldData.length, "
+                      RS_TYPE_ITEM_BUFFER_PACKER_NAME ".getData().length));"
+               << std::endl;
+    C.endBlock();
+    C.indent() << RS_TYPE_BULK_BUFFER_NAME " = null;" << std::endl;
+    C.indent() << RS_TYPE_BULK_STAGING_NAME " = null;" << std::endl;
+    C.indent() << "if (" RS_TYPE_BULK_DIRTY_END_NAME " > newSize) "
+                    RS_TYPE_BULK_DIRTY_END_NAME " = newSize;" << std::endl;
+    C.indent() << "if (" RS_TYPE_BULK_DIRTY_START_NAME " >= "
+                    RS_TYPE_BULK_DIRTY_END_NAME ") "
+                    RS_TYPE_BULK_DIRTY_START_NAME " = "
+                    RS_TYPE_BULK_DIRTY_END_NAME " = 0;" << std::endl;
+  }
 
   C.endFunction();
   return;
 }
 
+void RSReflection::genTypeClassBulkAccessors(Context &C,
+                                             const RSExportRecordType *ERT) {
+  // Wrap the item buffer packer (laid out exactly like the allocation) to
+  // store the values at arbitrary offsets.
+  C.startFunction(Context::AM_Private,
+                  false,
+                  "java.nio.ByteBuffer",
+                  "getBulkBuffer",
+                  0);
+  C.indent() << "if (" RS_TYPE_BULK_BUFFER_NAME " != null) return "
+                  RS_TYPE_BULK_BUFFER_NAME ";" << std::endl;
+  genNewItemBufferPackerIfNull(C);
+  C.indent() << RS_TYPE_BULK_BUFFER_NAME " = java.nio.ByteBuffer.wrap("
+                  RS_TYPE_ITEM_BUFFER_PACKER_NAME ".getData());" << std::endl;
+  C.indent() << RS_TYPE_BULK_BUFFER_NAME ".order("
+                  "java.nio.ByteOrder.LITTLE_ENDIAN);" << std::endl;
+  C.indent() << "return " RS_TYPE_BULK_BUFFER_NAME ";" << std::endl;
+  C.endFunction();
+
+  C.startFunction(Context::AM_Private,
+                  false,
+                  "void",
+                  "markDirty",
+                  2,
+                  "int", "offset",
+                  "int", "count");
+  C.indent() << "if (count <= 0) return;" << std::endl;
+  C.indent() << "if (" RS_TYPE_BULK_DIRTY_START_NAME " == "
+                  RS_TYPE_BULK_DIRTY_END_NAME ") ";
+  C.startBlock();
+  C.indent() << RS_TYPE_BULK_DIRTY_START_NAME " = offset;" << std::endl;
+  C.indent() << RS_TYPE_BULK_DIRTY_END_NAME " = offset + count;" << std::endl;
+  C.endBlock();
+  C.indent() << "else ";
+  C.startBlock();
+  C.indent() << RS_TYPE_BULK_DIRTY_START_NAME " = Math.min("
+                  RS_TYPE_BULK_DIRTY_START_NAME ", offset);" << std::endl;
+  C.indent() << RS_TYPE_BULK_DIRTY_END_NAME " = Math.max("
+                  RS_TYPE_BULK_DIRTY_END_NAME ", offset + count);"
+             << std::endl;
+  C.endBlock();
+  C.endFunction();
+
+  // set_<field>(<type>[] v, int offset, int count) for each field of
+  // primitive or vector type. v holds the values of the items offset to
+  // offset + count - 1 back to back, e.g., the x, y, z of the first float3,
+  // then those of the second, etc.
+  for (RSExportRecordType::const_field_iterator FI = ERT->fields_begin(),
+           FE = ERT->fields_end();
+       FI != FE;
+       FI++) {
+    const RSExportRecordType::Field *F = *FI;
+    const RSExportType *FT = F->getType();
+    if ((FT->getClass() != RSExportType::ExportClassPrimitive) &&
+        (FT->getClass() != RSExportType::ExportClassVector))
+      continue;
+
+    const RSExportPrimitiveType *EPT =
+        static_cast<const RSExportPrimitiveType*>(FT);
+    const char *Cast;
+    const char *PutAPIName = GetBulkPutAPIName(EPT->getType(), &Cast);
+    if (PutAPIName == NULL)
+      continue;
+
+    unsigned NumElements = 1;
+    if (FT->getClass() == RSExportType::ExportClassVector)
+      NumElements = static_cast<const RSExportVectorType*>(FT)->getNumElement();
+    size_t FieldOffset = F->getOffsetInParent();
+    size_t ElementSize = RSExportType::GetTypeStoreSize(FT) / NumElements;
+
+    std::string ArrayTypeName = GetPrimitiveTypeName(EPT);
+    ArrayTypeName.append("[]");
+
+    C.startFunction(Context::AM_PublicSynchronized,
+                    false,
+                    "void",
+                    "set_" + F->getName(),
+                    3,
+                    ArrayTypeName.c_str(), "v",
+                    "int", "offset",
+                    "int", "count");
+    C.indent() << "java.nio.ByteBuffer bb = getBulkBuffer();" << std::endl;
+    C.indent() << "int pos = offset * " RS_TYPE_ITEM_CLASS_NAME ".sizeof";
+    if (FieldOffset > 0)
+      C.out() << " + " << FieldOffset;
+    C.out() << ";" << std::endl;
+    if (NumElements == 1)
+      C.indent() << "for (int ct = 0; ct < count; ct++, "
+                      "pos += " RS_TYPE_ITEM_CLASS_NAME ".sizeof)";
+    else
+      C.indent() << "for (int ct = 0, vi = 0; ct < count; ct++, "
+                      "pos += " RS_TYPE_ITEM_CLASS_NAME ".sizeof)";
+    C.startBlock();
+    for (unsigned i = 0; i < NumElements; i++) {
+      C.indent() << "bb." << PutAPIName << "(pos";
+      if (i > 0)
+        C.out() << " + " << (i * ElementSize);
+      C.out() << ", " << Cast;
+      if (NumElements == 1)
+        C.out() << "v[ct]";
+      else
+        C.out() << "v[vi++]";
+      C.out() << ");" << std::endl;
+    }
+    C.endBlock();
+    C.indent() << "markDirty(offset, count);" << std::endl;
+    C.endFunction();
+  }
+
+  // Upload the items changed by the bulk accessors with a single copy.
+  C.startFunction(Context::AM_PublicSynchronized,
+                  false,
+                  "void",
+                  "copyDirtyRange",
+                  0);
+  C.indent() << "if (" RS_TYPE_BULK_DIRTY_START_NAME " == "
+                  RS_TYPE_BULK_DIRTY_END_NAME ") return;" << std::endl;
+  C.indent() << "int count = " RS_TYPE_BULK_DIRTY_END_NAME " - "
+                  RS_TYPE_BULK_DIRTY_START_NAME ";" << std::endl;
+  C.indent() << "byte data[] = " RS_TYPE_ITEM_BUFFER_PACKER_NAME ".getData();"
+             << std::endl;
+  C.indent() << "if (" RS_TYPE_BULK_DIRTY_START_NAME " > 0) ";
+  C.startBlock();
+  // The allocation is updated from the beginning of the given array.
+  C.indent() << "if (" RS_TYPE_BULK_STAGING_NAME " == null) "
+                  RS_TYPE_BULK_STAGING_NAME " = new byte[data.length];"
+             << std::endl;
+  C.indent() << "System.arraycopy(data, " RS_TYPE_BULK_DIRTY_START_NAME " * "
+                  RS_TYPE_ITEM_CLASS_NAME ".sizeof, "
+                  RS_TYPE_BULK_STAGING_NAME ", 0, count * "
+                  RS_TYPE_ITEM_CLASS_NAME ".sizeof);" << std::endl;
+  C.indent() << "data = " RS_TYPE_BULK_STAGING_NAME ";" << std::endl;
+  C.endBlock();
+  C.indent() << "mAllocation.copy1DRangeFromUnchecked("
+                  RS_TYPE_BULK_DIRTY_START_NAME ", count, data);" << std::endl;
+  C.indent() << RS_TYPE_BULK_DIRTY_START_NAME " = "
+                  RS_TYPE_BULK_DIRTY_END_NAME " = 0;" << std::endl;
+  C.endFunction();
+
+  return;
+}
+
 /******************** Methods to generate type class /end ********************/
 
 /********** Methods to create Element in Java of given record type ***********/
@@ -2173,6 +3065,25 @@ bool RSReflection::reflect(const std::string &OutputPathBase,
     if (mRSContext->getLicenseNote() != NULL) {
       C->setLicenseNote(*(mRSContext->getLicenseNote()));
     }
+    C->setInMemoryFiles(mOptions.InMemoryFiles);
+    C->setVerboseOutput(mOptions.VerboseOutput);
+    C->setUsage(&mOptions);
+
+    // The ScriptField_* classes go to the shared package if any.
+    const std::string &SharedPackageName = mOptions.SharedTypesPackageName;
+    llvm::OwningPtr<Context> SharedC;
+    if (!SharedPackageName.empty()) {
+      SharedC.reset(new Context(OutputPathBase, InputFileName,
+                                SharedPackageName, ResourceId, C->mUseStdout));
+      if (mRSContext->getLicenseNote() != NULL)
+        SharedC->setLicenseNote(*(mRSContext->getLicenseNote()));
+      SharedC->setInMemoryFiles(mOptions.InMemoryFiles);
+      SharedC->setVerboseOutput(mOptions.VerboseOutput);
+      SharedC->setUsage(&mOptions);
+      if (SharedPackageName != C->getPackageName())
+        C->addImport(SharedPackageName + ".*");
+    }
+    Context *TypeC = (SharedC.get() != NULL) ? SharedC.get() : C;
 
     if (!genScriptClass(*C, ScriptClassName, ErrorMsg)) {
       std::cerr << "Failed to generate class " << ScriptClassName << " ("
@@ -2194,7 +3105,11 @@ bool RSReflection::reflect(const std::string &OutputPathBase,
         const RSExportRecordType *ERT =
             static_cast<const RSExportRecordType*>(ET);
 
-        if (!ERT->isArtificial() && !genTypeClass(*C, ERT, ErrorMsg)) {
+        if (ERT->isArtificial() ||
+            mOptions.ReflectedSharedTypes.count(ERT->getName()))
+          continue;
+
+        if (!genTypeClass(*TypeC, ERT, ErrorMsg)) {
           std::cerr << "Failed to generate type class for struct '"
                     << ERT->getName() << "' (" << ErrorMsg << ")" << std::endl;
           return false;
@@ -2239,6 +3154,10 @@ bool RSReflection::Context::openClassFile(const std::string &ClassName,
                                           std::string &ErrorMsg) {
   if (!mUseStdout) {
     mOF.clear();
+    mOF.str("");
+    if (mInMemoryFiles != NULL)
+      return true;
+
     std::string Path =
         RSSlangReflectUtils::ComputePackagedPath(mOutputPathBase.c_str(),
                                                  mPackageName.c_str());
@@ -2246,13 +3165,7 @@ bool RSReflection::Context::openClassFile(const std::string &ClassName,
     if (!SlangUtils::CreateDirectoryWithParents(Path, &ErrorMsg))
       return false;
 
-    std::string ClassFile = Path + OS_PATH_SEPARATOR_STR + ClassName + ".java";
-
-    mOF.open(ClassFile.c_str());
-    if (!mOF.good()) {
-      ErrorMsg = "failed to open file '" + ClassFile + "' for write";
-      return false;
-    }
+    mClassFile = Path + OS_PATH_SEPARATOR_STR + ClassName + ".java";
   }
   return true;
 }
@@ -2273,7 +3186,7 @@ bool RSReflection::Context::startClass(AccessModifier AM,
                                        const char *SuperClassName,
                                        std::string &ErrorMsg) {
   if (mVerbose)
-    std::cout << "Generating " << ClassName << ".java ..." << std::endl;
+    *mVerboseOS << "Generating " << ClassName << ".java ..." << std::endl;
 
   // Open file for class
   if (!openClassFile(ClassName, ErrorMsg))
@@ -2296,6 +3209,8 @@ bool RSReflection::Context::startClass(AccessModifier AM,
   // Imports
   for (unsigned i = 0; i < (sizeof(Import) / sizeof(const char*)); i++)
     out() << "import " << Import[i] << ";" << std::endl;
+  for (unsigned i = 0, e = mImports.size(); i != e; i++)
+    out() << "import " << mImports[i] << ";" << std::endl;
   out() << std::endl;
 
   // All reflected classes should be annotated as hidden, so that they won't
@@ -2316,12 +3231,36 @@ bool RSReflection::Context::startClass(AccessModifier AM,
   return true;
 }
 
-void RSReflection::Context::endClass() {
+bool RSReflection::Context::endClass(std::string &ErrorMsg) {
   endBlock();
-  if (!mUseStdout)
-    mOF.close();
+
+  if (mVerbose && (mNumDroppedMethods > 0))
+    *mVerboseOS << "Dropped " << mNumDroppedMethods << " of "
+              << mNumPublicMethods << " public methods of " << mClassName
+              << " unused by the app" << std::endl;
+  mNumPublicMethods = 0;
+  mNumDroppedMethods = 0;
+
+  if (!mUseStdout && (mInMemoryFiles != NULL)) {
+    std::string QualifiedName = mPackageName.empty() ?
+        mClassName : (mPackageName + "." + mClassName);
+    mInMemoryFiles->push_back(std::make_pair(QualifiedName, mOF.str()));
+    clear();
+    return true;
+  }
+
   clear();
-  return;
+
+  // Leave the file untouched if nothing is changed, such that the Java
+  // compiler (and the others depending on it) don't see a new timestamp.
+  std::string Error;
+  if (!mUseStdout &&
+      !SlangUtils::WriteFileIfChanged(mClassFile, mOF.str(), &Error)) {
+    ErrorMsg = "failed to write file '" + mClassFile + "': " + Error;
+    return false;
+  }
+
+  return true;
 }
 
 void RSReflection::Context::startBlock(bool ShouldIndent) {
@@ -2377,6 +3316,18 @@ void RSReflection::Context::startFunction(AccessModifier AM,
                                           const char *ReturnType,
                                           const std::string &FunctionName,
                                           const ArgTy &Args) {
+  // The constructors and createElement() are called by the other classes.
+  if ((mUsage != NULL) && (AM != AM_Private) && (AM != AM_Protected) &&
+      (FunctionName != mClassName) && (FunctionName != "createElement")) {
+    mNumPublicMethods++;
+    if (mUsage->UsedClasses.count(mClassName) &&
+        !mUsage->UsedMethods.count(mClassName + "." + FunctionName) &&
+        !mUsage->UsedMethods.count(mClassName + ".*")) {
+      mDropping = true;
+      mNumDroppedMethods++;
+    }
+  }
+
   indent() << AccessModifierStr(AM) << ((IsStatic) ? " static " : " ")
            << ((ReturnType) ? ReturnType : "") << " " << FunctionName << "(";
 
@@ -2400,6 +3351,7 @@ void RSReflection::Context::startFunction(AccessModifier AM,
 
 void RSReflection::Context::endFunction() {
   endBlock();
+  mDropping = false;
   return;
 }
 
@@ -17,10 +17,10 @@
 #ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_REFLECTION_H_  // NOLINT
 #define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_REFLECTION_H_
 
-#include <fstream>
 #include <iostream>
 #include <map>
 #include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -28,6 +28,7 @@
 
 #include "slang_assert.h"
 #include "slang_rs_export_type.h"
+#include "slang_rs_reflect_utils.h"
 
 namespace slang {
 
@@ -35,11 +36,14 @@ namespace slang {
   class RSExportVar;
   class RSExportFunc;
   class RSExportForEach;
+  class RSExportReduce;
 
 class RSReflection {
  private:
   const RSContext *mRSContext;
 
+  ReflectionOptions mOptions;
+
   std::string mLastError;
   std::vector<std::string> *mGeneratedFileNames;
 
@@ -52,6 +56,8 @@ class RSReflection {
     static const char *const Import[];
 
     bool mVerbose;
+    // Where the verbose messages go (see ReflectionOptions::VerboseOutput)
+    std::ostream *mVerboseOS;
 
     std::string mOutputPathBase;
 
@@ -64,6 +70,21 @@ class RSReflection {
 
     std::string mLicenseNote;
 
+    // Imported by the classes in addition to Import[]
+    std::vector<std::string> mImports;
+
+    // Where the classes go instead of the files (see
+    // ReflectionOptions::InMemoryFiles), if not NULL
+    std::vector<std::pair<std::string, std::string> > *mInMemoryFiles;
+
+    // The public methods not in the usage manifest are rendered into
+    // mNullOS, which discards them (see ReflectionOptions::UsedMethods.)
+    const ReflectionOptions *mUsage;
+    bool mDropping;
+    unsigned mNumPublicMethods;
+    unsigned mNumDroppedMethods;
+    mutable std::ostream mNullOS;
+
     std::string mIndent;
 
     int mPaddingFieldIndex;
@@ -71,6 +92,11 @@ class RSReflection {
     int mNextExportVarSlot;
     int mNextExportFuncSlot;
     int mNextExportForEachSlot;
+    int mNextExportReduceSlot;
+
+    // The exported variables whose set_*() defers setVar() to commit() (see
+    // ReflectionOptions::BatchedUpdates), in the order of their slots
+    std::vector<const RSExportVar*> mBatchedVars;
 
     // A mapping from a field in a record type to its index in the rsType
     // instance. Only used when generates TypeClass (ScriptField_*).
@@ -87,6 +113,8 @@ class RSReflection {
       mNextExportVarSlot = 0;
       mNextExportFuncSlot = 0;
       mNextExportForEachSlot = 0;
+      mNextExportReduceSlot = 0;
+      mBatchedVars.clear();
       return;
     }
 
@@ -102,7 +130,10 @@ class RSReflection {
     } AccessModifier;
 
     bool mUseStdout;
-    mutable std::ofstream mOF;
+    // The class being generated is rendered here and written to mClassFile
+    // (if changed) by endClass().
+    mutable std::ostringstream mOF;
+    std::string mClassFile;
 
     std::set<std::string> mTypesToCheck;
 
@@ -114,11 +145,18 @@ class RSReflection {
             const std::string &ResourceId,
             bool UseStdout)
         : mVerbose(true),
+          mVerboseOS(&std::cout),
           mOutputPathBase(OutputPathBase),
           mInputRSFile(InputRSFile),
           mPackageName(PackageName),
           mResourceId(ResourceId),
           mLicenseNote(ApacheLicenseNote),
+          mInMemoryFiles(NULL),
+          mUsage(NULL),
+          mDropping(false),
+          mNumPublicMethods(0),
+          mNumDroppedMethods(0),
+          mNullOS(NULL),
           mUseStdout(UseStdout) {
       clear();
       resetFieldIndex();
@@ -127,6 +165,8 @@ class RSReflection {
     }
 
     inline std::ostream &out() const {
+      if (mDropping)
+        return mNullOS;
       return ((mUseStdout) ? std::cout : mOF);
     }
     inline std::ostream &indent() const {
@@ -151,6 +191,16 @@ class RSReflection {
 
     inline int getNextExportFuncSlot() { return mNextExportFuncSlot++; }
     inline int getNextExportForEachSlot() { return mNextExportForEachSlot++; }
+    inline int getNextExportReduceSlot() { return mNextExportReduceSlot++; }
+
+    // Return the index of the dirty flag of @EV.
+    inline unsigned addBatchedVar(const RSExportVar *EV) {
+      mBatchedVars.push_back(EV);
+      return mBatchedVars.size() - 1;
+    }
+    inline const std::vector<const RSExportVar*> &getBatchedVars() const {
+      return mBatchedVars;
+    }
 
     // Will remove later due to field name information is not necessary for
     // C-reflect-to-Java
@@ -162,12 +212,36 @@ class RSReflection {
       mLicenseNote = LicenseNote;
     }
 
+    inline void addImport(const std::string &Import) {
+      mImports.push_back(Import);
+      return;
+    }
+
+    inline void setInMemoryFiles(
+        std::vector<std::pair<std::string, std::string> > *Files) {
+      mInMemoryFiles = Files;
+      return;
+    }
+
+    inline void setVerboseOutput(std::ostream *OS) {
+      mVerboseOS = (OS != NULL) ? OS : &std::cout;
+      return;
+    }
+
+    inline std::ostream &getVerboseOutput() const { return *mVerboseOS; }
+
+    // Drop the unused methods if @Options has a usage manifest.
+    inline void setUsage(const ReflectionOptions *Options) {
+      mUsage = Options->HasUsageManifest ? Options : NULL;
+      return;
+    }
+
     bool startClass(AccessModifier AM,
                     bool IsStatic,
                     const std::string &ClassName,
                     const char *SuperClassName,
                     std::string &ErrorMsg);
-    void endClass();
+    bool endClass(std::string &ErrorMsg);
 
     void startFunction(AccessModifier AM,
                        bool IsStatic,
@@ -218,12 +292,20 @@ class RSReflection {
                       std::string &ErrorMsg);
   void genScriptClassConstructor(Context &C);
 
+  // Write the Java literal of the scalar @Val
+  void genPrimitiveValue(Context &C, const clang::APValue &Val);
   void genInitBoolExportVariable(Context &C,
                                  const std::string &VarName,
                                  const clang::APValue &Val);
   void genInitPrimitiveExportVariable(Context &C,
                                       const std::string &VarName,
                                       const clang::APValue &Val);
+  // Fill the Java array @VarName, the copy of @EV, by the initializer of @EV,
+  // from its InitData_* class (see genArrayInitData()) if it's large.
+  void genInitArrayExportVariable(Context &C,
+                                  const RSExportVar *EV,
+                                  const std::string &VarName);
+  void genArrayInitData(Context &C, const RSExportVar *EV);
   void genInitExportVariable(Context &C,
                              const RSExportType *ET,
                              const std::string &VarName,
@@ -238,12 +320,27 @@ class RSReflection {
   void genGetExportVariable(Context &C,
                             const std::string &TypeName,
                             const std::string &VarName);
+  // set_*() of ReflectionOptions::BatchedUpdates, and beginUpdate() and
+  // commit() after the last one
+  void genBatchedSetExportVariable(Context &C,
+                                   const RSExportVar *EV,
+                                   const std::string &TypeName);
+  void genBatchedUpdateMethods(Context &C);
+
+  // const_*, and get_*() for compatibility, of a folded constant (see
+  // RSExportVar::isFolded())
+  void genExportConstant(Context &C, const RSExportVar *EV);
 
   void genExportFunction(Context &C,
                          const RSExportFunc *EF);
 
   void genExportForEach(Context &C,
                         const RSExportForEach *EF);
+  void genExportReduce(Context &C,
+                       const RSExportReduce *ER);
+
+  // getProfile() and friends of llvm-rs-cc -finstrument-kernels
+  void genKernelProfile(Context &C);
 
   static void genTypeCheck(Context &C,
                            const RSExportType *ET,
@@ -265,6 +362,7 @@ class RSReflection {
   void genTypeClassComponentGetter(Context &C, const RSExportRecordType *ERT);
   void genTypeClassCopyAll(Context &C, const RSExportRecordType *ERT);
   void genTypeClassResize(Context &C);
+  void genTypeClassBulkAccessors(Context &C, const RSExportRecordType *ERT);
 
   void genBuildElement(Context &C,
                        const char *ElementBuilderName,
@@ -284,7 +382,27 @@ class RSReflection {
 
   bool genCreateFieldPacker(Context &C,
                             const RSExportType *T,
-                            const char *FieldPackerName);
+                            const char *FieldPackerName,
+                            bool Cached = false);
+  // Return the name of the field packer in which the method generated next
+  // packs the values of type @T. With ReflectionOptions::CachedFieldPackers
+  // (or @Cached) it's a field (declared here) named after @Name, otherwise
+  // the local variable @LocalName.
+  std::string genFieldPackerName(Context &C,
+                                 const RSExportType *T,
+                                 const std::string &Name,
+                                 const char *LocalName,
+                                 bool Cached = false);
+  // The methods sharing a cached field packer must not run concurrently.
+  inline Context::AccessModifier
+  getFieldPackerAccessModifier(bool Cached = false) const {
+    return ((mOptions.CachedFieldPackers || Cached) ?
+                Context::AM_PublicSynchronized :
+                Context::AM_Public);
+  }
+  // Whether the invokable @EF only takes a few scalars, see
+  // RS_DIRECT_INVOKE_MAX_PARAMS.
+  static bool IsDirectArgInvoke(const RSExportFunc *EF);
   void genPackVarOfType(Context &C,
                         const RSExportType *T,
                         const char *VarName,
@@ -296,9 +414,11 @@ class RSReflection {
   void genNewItemBufferPackerIfNull(Context &C);
 
  public:
-  explicit RSReflection(const RSContext *Context,
-      std::vector<std::string> *GeneratedFileNames)
+  RSReflection(const RSContext *Context,
+               std::vector<std::string> *GeneratedFileNames,
+               const ReflectionOptions &Options)
       : mRSContext(Context),
+        mOptions(Options),
         mLastError(""),
         mGeneratedFileNames(GeneratedFileNames) {
     slangAssert(mGeneratedFileNames && "Must supply GeneratedFileNames");
@@ -18,6 +18,7 @@
 #include <cstring>
 
 #include <string>
+#include <vector>
 
 #include "slang_rs_type_spec.h"
 
@@ -326,6 +327,124 @@ int GenRSDataElementEnums(const RSDataElementSpec *const DataElements[],
   return 0;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+
+// How many seeds are tried before doubling the size of a perfect hash table
+static const unsigned MaxPerfectHashSeeds = 1 << 16;
+
+// Find a seed and the smallest power of 2 size of a table in which the
+// @Names hash (RSSpecHash) to distinct slots. @Slots gets the index into
+// @Names of each slot (-1 if it's empty.)
+static void FindPerfectHash(const std::vector<const char*> &Names,
+                            unsigned *Seed,
+                            std::vector<int> *Slots) {
+  unsigned Size = 1;
+  while (Size < Names.size())
+    Size <<= 1;
+
+  for (; ; Size <<= 1) {
+    for (unsigned S = 0; S < MaxPerfectHashSeeds; S++) {
+      bool Collided = false;
+      Slots->assign(Size, -1);
+      for (unsigned i = 0; !Collided && (i < Names.size()); i++) {
+        unsigned Slot =
+            RSSpecHash(Names[i], Names[i] + ::strlen(Names[i]), S) &
+            (Size - 1);
+        if ((*Slots)[Slot] != -1)
+          Collided = true;
+        else
+          (*Slots)[Slot] = i;
+      }
+      if (!Collided) {
+        *Seed = S;
+        return;
+      }
+    }
+  }
+}
+
+static void GenPerfectHashTableSize(const char *Prefix,
+                                    unsigned Seed,
+                                    unsigned Size) {
+  printf("#define %s_TABLE_SEED %uU\n", Prefix, Seed);
+  printf("#define %s_TABLE_SIZE %u\n\n", Prefix, Size);
+  return;
+}
+
+// -gen-rs-specific-type-table
+//
+// The perfect hash table of the names of the RS matrix and object types, in
+// RS_SPECIFIC_TYPE_TABLE_SIZE slots indexed by
+// RSSpecHash(cname, RS_SPECIFIC_TYPE_TABLE_SEED) % RS_SPECIFIC_TYPE_TABLE_SIZE
+//
+// ENUM_RS_SPECIFIC_TYPE_SLOT(type, cname)
+// ENUM_RS_EMPTY_SLOT()
+// e.g., ENUM_RS_SPECIFIC_TYPE_SLOT(RSMatrix2x2, "rs_matrix2x2")
+static int GenRSSpecificTypeTable(const RSDataTypeSpec *const DataTypes[],
+                                  unsigned NumDataTypes) {
+  std::vector<const RSDataTypeSpec*> SpecificTypes;
+  std::vector<const char*> Names;
+  for (unsigned i = 0; i < NumDataTypes; i++)
+    if (DataTypes[i]->isRSMatrix() || DataTypes[i]->isRSObject()) {
+      SpecificTypes.push_back(DataTypes[i]);
+      Names.push_back(DataTypes[i]->getTypePragmaName());
+    }
+
+  unsigned Seed;
+  std::vector<int> Slots;
+  FindPerfectHash(Names, &Seed, &Slots);
+
+  GenPerfectHashTableSize("RS_SPECIFIC_TYPE", Seed, Slots.size());
+  for (unsigned i = 0; i < Slots.size(); i++)
+    if (Slots[i] < 0)
+      printf("ENUM_RS_EMPTY_SLOT()\n");
+    else
+      printf("ENUM_RS_SPECIFIC_TYPE_SLOT(%s, \"%s\")\n",
+             SpecificTypes[Slots[i]]->getTypeName(),
+             SpecificTypes[Slots[i]]->getTypePragmaName());
+  printf("#undef ENUM_RS_SPECIFIC_TYPE_SLOT\n");
+  printf("#undef ENUM_RS_EMPTY_SLOT\n");
+  return 0;
+}
+
+// -gen-rs-data-element-table
+//
+// The perfect hash table of the data elements, in RS_DATA_ELEMENT_TABLE_SIZE
+// slots indexed by
+// RSSpecHash(name, RS_DATA_ELEMENT_TABLE_SEED) % RS_DATA_ELEMENT_TABLE_SIZE
+//
+// ENUM_RS_DATA_ELEMENT_SLOT(name, dk, dt, normalized, vsize)
+// ENUM_RS_EMPTY_SLOT()
+// e.g., ENUM_RS_DATA_ELEMENT_SLOT("rs_pixel_la", PixelLA, Unsigned8, true, 2)
+static int GenRSDataElementTable(const RSDataElementSpec *const DataElements[],
+                                 unsigned NumDataElements) {
+  std::vector<const char*> Names;
+  for (unsigned i = 0; i < NumDataElements; i++)
+    Names.push_back(DataElements[i]->getElementName());
+
+  unsigned Seed;
+  std::vector<int> Slots;
+  FindPerfectHash(Names, &Seed, &Slots);
+
+  GenPerfectHashTableSize("RS_DATA_ELEMENT", Seed, Slots.size());
+  for (unsigned i = 0; i < Slots.size(); i++) {
+    if (Slots[i] < 0) {
+      printf("ENUM_RS_EMPTY_SLOT()\n");
+      continue;
+    }
+    const RSDataElementSpec *DataElement = DataElements[Slots[i]];
+    printf("ENUM_RS_DATA_ELEMENT_SLOT(\"%s\", %s, %s, %s, %d)\n",
+           DataElement->getElementName(),
+           DataElement->getDataKind()->getKindName(),
+           DataElement->getDataType()->getTypeName(),
+           ((DataElement->isNormal()) ? "true" : "false"),
+           DataElement->getVectorSize());
+  }
+  printf("#undef ENUM_RS_DATA_ELEMENT_SLOT\n");
+  printf("#undef ENUM_RS_EMPTY_SLOT\n");
+  return 0;
+}
+
 int main(int argc, char **argv) {
   if (argc < 2) {
     fprintf(stderr, "usage: %s [gen type]\n", argv[0]);
@@ -381,6 +500,7 @@ int main(int argc, char **argv) {
     new ClangBuiltinTypeMap(
       "clang::BuiltinType::LongLong", DataTypes[Signed64]),
 
+    new ClangBuiltinTypeMap("clang::BuiltinType::Half",   DataTypes[Float16]),
     new ClangBuiltinTypeMap("clang::BuiltinType::Float",  DataTypes[Float32]),
     new ClangBuiltinTypeMap("clang::BuiltinType::Double", DataTypes[Float64])
   };
@@ -451,6 +571,10 @@ int main(int argc, char **argv) {
     Result = GenRSDataKindEnums(DataKinds, NumDataKinds);
   else if (::strcmp(argv[1], "-gen-rs-data-element-enums") == 0)
     Result = GenRSDataElementEnums(DataElements, NumDataElements);
+  else if (::strcmp(argv[1], "-gen-rs-specific-type-table") == 0)
+    Result = GenRSSpecificTypeTable(DataTypes, NumDataTypes);
+  else if (::strcmp(argv[1], "-gen-rs-data-element-table") == 0)
+    Result = GenRSDataElementTable(DataElements, NumDataElements);
   else
     fprintf(stderr, "%s: Unknown table generation type '%s'\n",
                     argv[0], argv[1]);
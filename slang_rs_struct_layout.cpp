@@ -0,0 +1,152 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "slang_rs_struct_layout.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Attr.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/RecordLayout.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "slang_assert.h"
+
+namespace slang {
+
+namespace {
+
+inline size_t AlignTo(size_t Offset, size_t Alignment) {
+  return (Offset + Alignment - 1) / Alignment * Alignment;
+}
+
+// Orders the fields by decreasing alignment, keeping the ones of the same
+// alignment in the order of declaration. Since the sizes are multiples of the
+// alignments (which are powers of 2), this leaves no hole between the fields.
+class AlignmentGreater {
+ private:
+  const std::vector<RSStructLayout::FieldLayout> &mFields;
+
+ public:
+  explicit AlignmentGreater(
+      const std::vector<RSStructLayout::FieldLayout> &Fields)
+      : mFields(Fields) {
+    return;
+  }
+
+  bool operator()(unsigned A, unsigned B) const {
+    return mFields[A].Alignment > mFields[B].Alignment;
+  }
+};
+
+}  // namespace
+
+RSStructLayout::RSStructLayout(const clang::ASTContext &C,
+                               const clang::RecordDecl *RD)
+    : mName(RD->getName()),
+      mSize(0),
+      mAlignment(1),
+      mIsPacked(RD->hasAttr<clang::PackedAttr>()),
+      mBestSize(0) {
+  slangAssert(RD->isDefinition());
+  const clang::ASTRecordLayout &RL = C.getASTRecordLayout(RD);
+  mSize = RL.getSize().getQuantity();
+  mAlignment = RL.getAlignment().getQuantity();
+
+  unsigned Index = 0;
+  for (clang::RecordDecl::field_iterator FI = RD->field_begin(),
+           FE = RD->field_end();
+       FI != FE;
+       FI++, Index++) {
+    FieldLayout F;
+    F.Name = FI->getName();
+    F.Offset = static_cast<size_t>(RL.getFieldOffset(Index) >> 3);
+    F.Size = C.getTypeSizeInChars(FI->getType()).getQuantity();
+    F.Alignment = mIsPacked ? 1 : C.getDeclAlign(*FI).getQuantity();
+    mFields.push_back(F);
+    mBestOrder.push_back(Index);
+  }
+
+  // Nothing to gain by reordering the fields of a packed struct.
+  if (mIsPacked) {
+    mBestSize = mSize;
+    return;
+  }
+
+  std::stable_sort(mBestOrder.begin(), mBestOrder.end(),
+                   AlignmentGreater(mFields));
+
+  size_t Offset = 0;
+  for (unsigned i = 0, e = mBestOrder.size(); i != e; i++) {
+    const FieldLayout &F = mFields[mBestOrder[i]];
+    Offset = AlignTo(Offset, F.Alignment) + F.Size;
+  }
+  mBestSize = std::min(AlignTo(Offset, mAlignment), mSize);
+
+  return;
+}
+
+size_t RSStructLayout::getPadding() const {
+  size_t FieldsSize = 0;
+  for (unsigned i = 0, e = mFields.size(); i != e; i++)
+    FieldsSize += mFields[i].Size;
+  return mSize - FieldsSize;
+}
+
+std::string RSStructLayout::getBestOrder() const {
+  std::string Order;
+  for (unsigned i = 0, e = mBestOrder.size(); i != e; i++) {
+    if (i != 0)
+      Order.append(", ");
+    Order.append(mFields[mBestOrder[i]].Name);
+  }
+  return Order;
+}
+
+void RSStructLayout::print(llvm::raw_ostream &OS) const {
+  size_t Padding = getPadding();
+  OS << "struct " << mName << ": size " << mSize << ", alignment "
+     << mAlignment << ", padding " << Padding << " bytes";
+  if (mSize != 0)
+    OS << " (" << (Padding * 100 / mSize) << "%)";
+  OS << "\n";
+
+  OS << "  offset   size  align  field\n";
+  for (unsigned i = 0, e = mFields.size(); i != e; i++) {
+    const FieldLayout &F = mFields[i];
+    OS << llvm::format("  %6lu %6lu %6lu  ",
+                       static_cast<unsigned long>(F.Offset),  // NOLINT
+                       static_cast<unsigned long>(F.Size),  // NOLINT
+                       static_cast<unsigned long>(F.Alignment))  // NOLINT
+       << F.Name << "\n";
+  }
+
+  if (canShrink()) {
+    OS << "  best order: " << getBestOrder() << " (size " << mBestSize
+       << ", padding " << getBestPadding() << " bytes)\n";
+  } else {
+    OS << "  best order: as declared\n";
+  }
+
+  return;
+}
+
+}  // namespace slang
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_STRUCT_LAYOUT_H_  // NOLINT
+#define _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_STRUCT_LAYOUT_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace clang {
+  class ASTContext;
+  class RecordDecl;
+}
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace slang {
+
+// RSStructLayout - Where the padding of a struct is, and how small it would be
+// by declaring its fields in the best order (see llvm-rs-cc
+// -struct-layout-report and -warn-struct-padding.) The sizes are the ones of
+// clang (e.g., a float3 takes 16 bytes), i.e., the same as the Allocations.
+class RSStructLayout {
+ public:
+  struct FieldLayout {
+    std::string Name;
+    size_t Offset;
+    size_t Size;
+    size_t Alignment;
+  };
+
+ private:
+  std::string mName;
+  size_t mSize;
+  size_t mAlignment;
+  bool mIsPacked;
+
+  // In the order of declaration
+  std::vector<FieldLayout> mFields;
+
+  // The indices into mFields of the order with the least padding, and the size
+  // of the struct declared in that order.
+  std::vector<unsigned> mBestOrder;
+  size_t mBestSize;
+
+ public:
+  // @RD is the definition of the struct.
+  RSStructLayout(const clang::ASTContext &C, const clang::RecordDecl *RD);
+
+  inline const std::string &getName() const { return mName; }
+  inline size_t getSize() const { return mSize; }
+  inline size_t getAlignment() const { return mAlignment; }
+  inline const std::vector<FieldLayout> &getFields() const { return mFields; }
+
+  size_t getPadding() const;
+
+  inline size_t getBestSize() const { return mBestSize; }
+  inline size_t getBestPadding() const {
+    return getPadding() - (mSize - mBestSize);
+  }
+
+  // Whether declaring the fields in another order would shrink the struct
+  inline bool canShrink() const { return mBestSize < mSize; }
+
+  // The fields in the best order, e.g., "a, c, b"
+  std::string getBestOrder() const;
+
+  void print(llvm::raw_ostream &OS) const;
+};
+
+}  // namespace slang
+
+#endif  // _FRAMEWORKS_COMPILE_SLANG_SLANG_RS_STRUCT_LAYOUT_H_  NOLINT
@@ -26,7 +26,7 @@
     ENUM_RS_DATA_TYPE_CLASS(Record)
 
 #define PRIMITIVE_DATA_TYPE_ENUMS                         \
-    ENUM_PRIMITIVE_DATA_TYPE(Float16, NULL, 128)          \
+    ENUM_PRIMITIVE_DATA_TYPE(Float16, "half", 128)        \
     ENUM_PRIMITIVE_DATA_TYPE(Float32, "float", 256)       \
     ENUM_PRIMITIVE_DATA_TYPE(Float64, "double", 512)      \
     ENUM_PRIMITIVE_DATA_TYPE(Signed8, "char", 64)         \
@@ -263,4 +263,22 @@ union RSType {
 #define RS_RECORD_TYPE_SET_FIELD_DATA_KIND(R, I, V) \
     RS_RECORD_TYPE_GET_FIELD_DATA_KIND(R, I) = (V)
 
+// The hash of the perfect hash tables generated by rs-spec-gen (e.g.,
+// RSSpecificTypeTable.inc): FNV-1a of [Begin, End) followed by the finalizer
+// of MurmurHash3 such that the low bits (i.e., the slot) depend on all of
+// them. rs-spec-gen picks the @Seed for which the names of a table don't
+// collide.
+static inline unsigned RSSpecHash(const char *Begin, const char *End,
+                                  unsigned Seed) {
+  unsigned H = 2166136261U ^ Seed;
+  for (; Begin != End; Begin++)
+    H = (H ^ static_cast<unsigned char>(*Begin)) * 16777619U;
+  H ^= H >> 16;
+  H *= 0x85ebca6bU;
+  H ^= H >> 13;
+  H *= 0xc2b2ae35U;
+  H ^= H >> 16;
+  return H;
+}
+
 #endif  // _COMPILE_SLANG_SLANG_RS_TYPE_SPEC_H_  NOLINT
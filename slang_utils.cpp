@@ -16,16 +16,167 @@
 
 #include "slang_utils.h"
 
+#ifndef USE_MINGW
+#include <sys/stat.h>
+#endif
+
+#include <cstring>
 #include <string>
 
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/DataTypes.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Mutex.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/system_error.h"
 
 namespace slang {
 
+namespace {
+
+llvm::sys::Mutex BuildIDLock;
+std::string *BuildID = NULL;
+
+// The size and the 64-bit FNV-1a hash (by words, it's a big file) of the
+// executable, which change with any of the code linked into it and not only
+// with the sources of this file.
+std::string ComputeBuildID() {
+  llvm::sys::Path Executable = llvm::sys::Path::GetMainExecutable(
+      "", reinterpret_cast<void*>(reinterpret_cast<intptr_t>(&ComputeBuildID)));
+
+  llvm::OwningPtr<llvm::MemoryBuffer> Image;
+  if (Executable.isEmpty() ||
+      llvm::MemoryBuffer::getFile(Executable.str(), Image))
+    // Not as good: a rebuild of the other files isn't seen.
+    return "built " __DATE__ " " __TIME__;
+
+  const char *Data = Image->getBufferStart();
+  size_t Size = Image->getBufferSize();
+  uint64_t Hash = 0xcbf29ce484222325ULL;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= Size; i += sizeof(uint64_t)) {
+    uint64_t Word;
+    memcpy(&Word, Data + i, sizeof(Word));
+    Hash = (Hash ^ Word) * 0x100000001b3ULL;
+  }
+  for (; i != Size; i++)
+    Hash = (Hash ^ static_cast<unsigned char>(Data[i])) * 0x100000001b3ULL;
+
+  std::string ID;
+  llvm::raw_string_ostream OS(ID);
+  OS << Size << '-' << llvm::format("%016llx",
+                                    static_cast<unsigned long long>(Hash));
+  OS.flush();
+  return ID;
+}
+
+#ifndef USE_MINGW
+mode_t ReadUmask() {
+  mode_t Mask = ::umask(0);
+  ::umask(Mask);
+  return Mask;
+}
+
+// The umask can only be read by changing it, so it's read once at startup
+// (before any compile job starts a thread creating files.)
+const mode_t ProcessUmask = ReadUmask();
+#endif
+
+}  // namespace
+
+const std::string &SlangUtils::GetBuildID() {
+  llvm::sys::ScopedLock Lock(BuildIDLock);
+  if (BuildID == NULL)
+    BuildID = new std::string(ComputeBuildID());
+  return *BuildID;
+}
+
 bool SlangUtils::CreateDirectoryWithParents(llvm::StringRef Dir,
                                             std::string* Error) {
   return !llvm::sys::Path(Dir).createDirectoryOnDisk(/* create_parents = */true,
                                                      Error);
 }
 
+bool SlangUtils::WriteFileIfChanged(llvm::StringRef File,
+                                    llvm::StringRef Content,
+                                    std::string *Error) {
+  llvm::OwningPtr<llvm::MemoryBuffer> Existing;
+  if (!llvm::MemoryBuffer::getFile(File, Existing) &&
+      (Existing->getBuffer() == Content))
+    return true;
+
+  return WriteFileAtomically(File, Content, Error);
+}
+
+bool SlangUtils::WriteFileAtomically(llvm::StringRef File,
+                                     llvm::StringRef Content,
+                                     std::string *Error) {
+  int FD;
+  llvm::SmallString<256> TmpFile;
+  if (llvm::sys::fs::unique_file(File + "-%%%%%%%%", FD, TmpFile)) {
+    if (Error != NULL)
+      *Error = "cannot create a temporary file";
+    return false;
+  }
+
+  SetReplacingFileMode(FD, File);
+
+  {
+    llvm::raw_fd_ostream OS(FD, /* shouldClose = */true);
+    OS << Content;
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      bool Existed;
+      llvm::sys::fs::remove(TmpFile.str(), Existed);
+      if (Error != NULL)
+        *Error = "error writing the file";
+      return false;
+    }
+  }
+
+  if (llvm::sys::fs::rename(TmpFile.str(), File)) {
+    bool Existed;
+    llvm::sys::fs::remove(TmpFile.str(), Existed);
+    if (Error != NULL)
+      *Error = "cannot replace the file";
+    return false;
+  }
+
+  return true;
+}
+
+void SlangUtils::SetReplacingFileMode(int FD, llvm::StringRef File) {
+#ifndef USE_MINGW
+  // Failing to set the mode isn't an error, the file is just less accessible.
+  struct stat Stat;
+  if (::stat(File.str().c_str(), &Stat) == 0)
+    ::fchmod(FD, Stat.st_mode & 07777);
+  else
+    ::fchmod(FD, 0666 & ~ProcessUmask);
+#endif
+  return;
+}
+
+void SlangUtils::PrintJSONString(llvm::raw_ostream &OS, llvm::StringRef S) {
+  OS << '"';
+  for (size_t i = 0, e = S.size(); i != e; i++) {
+    unsigned char C = S[i];
+    if ((C == '"') || (C == '\\'))
+      OS << '\\' << C;
+    else if (C < 0x20)
+      OS << llvm::format("\\u%04x", C);
+    else
+      OS << C;
+  }
+  OS << '"';
+  return;
+}
+
 }  // namespace slang
@@ -20,6 +20,7 @@
 #include <string>
 
 namespace llvm {
+  class raw_ostream;
   class StringRef;
 }
 
@@ -32,6 +33,33 @@ class SlangUtils {
  public:
   static bool CreateDirectoryWithParents(llvm::StringRef Dir,
                                          std::string* Error);
+
+  // Write @Content to @File unless it already holds exactly the same, such
+  // that its timestamp only changes when it's really modified. It's written
+  // by WriteFileAtomically(), such that the compile jobs writing the same file
+  // (e.g., a ScriptField_* class) never leave it partially written.
+  static bool WriteFileIfChanged(llvm::StringRef File,
+                                 llvm::StringRef Content,
+                                 std::string *Error);
+
+  // Write @Content to a temporary file next to @File and move it over @File,
+  // such that @File is either left as before or fully written.
+  static bool WriteFileAtomically(llvm::StringRef File,
+                                  llvm::StringRef Content,
+                                  std::string *Error);
+
+  // Give the temporary file open as @FD, which is to be moved over @File,
+  // the mode of @File or (if there's no @File yet) the mode of a new file
+  // under the umask, instead of the 0600 of llvm::sys::fs::unique_file().
+  static void SetReplacingFileMode(int FD, llvm::StringRef File);
+
+  // An identifier of the build of the running executable (a hash of its
+  // image), computed once, e.g., to invalidate the cached outputs of another
+  // build.
+  static const std::string &GetBuildID();
+
+  // Print @S to @OS as a quoted and escaped JSON string.
+  static void PrintJSONString(llvm::raw_ostream &OS, llvm::StringRef S);
 };
 }
 
@@ -23,11 +23,15 @@
 // 12 - Honeycomb MR1
 // 13 - Honeycomb MR2
 // 14 - Ice Cream Sandwich
+// 15 - Ice Cream Sandwich MR1
+// 16 - Jelly Bean
 // ...
 #define SLANG_MINIMUM_TARGET_API 11
 #define SLANG_MAXIMUM_TARGET_API RS_VERSION
 // Note that RS_VERSION is defined at build time (see Android.mk for details).
 
 #define SLANG_ICS_TARGET_API 14
+#define SLANG_JB_TARGET_API 16
+#define SLANG_JB_MR2_TARGET_API 18
 
 #endif  // _FRAMEWORKS_COMPILE_SLANG_SLANG_VERSION_H_  NOLINT
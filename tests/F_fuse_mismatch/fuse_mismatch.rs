@@ -0,0 +1,13 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs kernel(first, second)
+#pragma rs fuse(pipeline, first, second)
+
+void first(const uchar4 *in, float4 *out) {
+    *out = convert_float4(*in);
+}
+
+void second(const float *in, float *out) {
+    *out = *in;
+}
@@ -0,0 +1,7 @@
+// -target-api 14 -finstrument-kernels
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+void root(const float *in, float *out) {
+    *out = *in;
+}
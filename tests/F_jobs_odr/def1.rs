@@ -0,0 +1,11 @@
+// -jobs 2
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+// expected-error: different types of members, compiled by different jobs
+typedef struct DifferentDefinition{
+	int member1;
+	int member2;
+} DifferentDefinition;
+
+DifferentDefinition o1;
@@ -0,0 +1,10 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs kernel(gain)
+
+float gain;
+
+void scale(const float *in, float *out) {
+    *out = *in * gain;
+}
@@ -0,0 +1,8 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs kernel(scale)
+
+void scale(float *v, float s) {
+    *v *= s;
+}
@@ -0,0 +1,8 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+float gScale;
+
+void root(const float *in, float *out) {
+	*out = clamp(*in * gScale, 0.f, 1.f);
+}
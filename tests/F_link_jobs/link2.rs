@@ -0,0 +1,6 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+void root(const float4 *in, float4 *out) {
+	*out = normalize(*in);
+}
@@ -0,0 +1,15 @@
+# Two jobs link all of the input files, although one input file of each job
+# is missing. The failures are reported in the order of the input files.
+# (Anything else failing exits with 0, which fails the test.)
+$LLVM_RS_CC link1.rs link2.rs || exit 0
+cp tmp/link1.bc tmp/link1.bc.orig
+cp tmp/link2.bc tmp/link2.bc.orig
+
+$LLVM_RS_LINK -jobs 2 tmp/link1.bc tmp/missing1.bc tmp/missing2.bc tmp/link2.bc
+STATUS=$?
+
+if cmp -s tmp/link1.bc tmp/link1.bc.orig ||
+   cmp -s tmp/link2.bc tmp/link2.bc.orig; then
+  exit 0
+fi
+exit $STATUS
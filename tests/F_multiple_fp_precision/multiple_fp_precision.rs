@@ -0,0 +1,9 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+#pragma rs_fp_relaxed
+#pragma rs_fp_full
+
+float root(float f) {
+    return sqrt(f);
+}
+
@@ -0,0 +1,11 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs kernel(scale)
+#pragma rs noalias(gain)
+
+float gain;
+
+void scale(const float *in, float *out) {
+    *out = *in * gain;
+}
@@ -0,0 +1,10 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+// expected-error: different types of members, compiled by different invocations
+typedef struct DifferentDefinition{
+	int member1;
+	float member2;
+} DifferentDefinition;
+
+DifferentDefinition o1;
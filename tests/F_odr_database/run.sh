@@ -0,0 +1,4 @@
+# def2.rs is checked against the definitions of def1.rs compiled before.
+# (Anything else failing exits with 0, which fails the test.)
+$LLVM_RS_CC -odr-database tmp/odr.db def1.rs || exit 0
+$LLVM_RS_CC -odr-database tmp/odr.db def2.rs
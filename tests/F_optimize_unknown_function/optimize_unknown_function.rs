@@ -0,0 +1,9 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs optimize(0, bar)
+
+void foo() {
+}
+
+void bar();
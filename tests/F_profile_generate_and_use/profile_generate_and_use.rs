@@ -0,0 +1,5 @@
+// -fprofile-generate -fprofile-use=profile.txt
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+int gCount;
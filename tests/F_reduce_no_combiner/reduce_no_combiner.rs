@@ -0,0 +1,9 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs reduce(count) accumulator(count_accum)
+
+void count_accum(int *accum, const float *in) {
+    if (*in > 0.f)
+        (*accum)++;
+}
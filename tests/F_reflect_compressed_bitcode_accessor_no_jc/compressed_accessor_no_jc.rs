@@ -0,0 +1,5 @@
+// -reflect-compressed-bitcode-accessor
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+float gain;
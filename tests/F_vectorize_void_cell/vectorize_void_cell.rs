@@ -0,0 +1,7 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs vectorize(4, root)
+
+void root(const void *in, void *out, uint32_t x) {
+}
@@ -0,0 +1,14 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+float weights[4] = {0.25f, 0.5f, 0.75f, 1.0f};
+int table[32] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    -16, -17, -18, -19, -20, -21, -22, -23, -24, -25, -26, -27, -28, -29,
+    -30, -31};
+uchar lut[20] = {0, 34, 92, 127, 128, 255};
+bool flags[3] = {true, false, true};
+
+void root(const float *in, float *out, uint32_t x) {
+    *out = *in * weights[x & 3] + table[x & 31] + lut[x % 20];
+}
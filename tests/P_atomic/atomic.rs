@@ -0,0 +1,28 @@
+// -emit-llvm -ftime-report-json tmp/atomic.json
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+int32_t i;
+uint32_t u;
+int32_t histogram[16];
+
+void root(const uchar *in, uint32_t x) {
+    rsAtomicInc(&histogram[*in & 15]);
+}
+
+int32_t compile_all_atomic_ops(int32_t v) {
+    int32_t r = rsAtomicInc(&i);
+    r += rsAtomicDec(&i);
+    r += rsAtomicAdd(&i, v);
+    r += rsAtomicSub(&i, v);
+    r += rsAtomicAnd(&i, v);
+    r += rsAtomicOr(&i, v);
+    r += rsAtomicXor(&i, v);
+    r += rsAtomicMin(&i, v);
+    r += rsAtomicMax(&i, v);
+    r += rsAtomicCas(&i, v, r);
+    r += rsAtomicMin(&u, (uint32_t) v);
+    r += rsAtomicMax(&u, (uint32_t) v);
+    r += rsAtomicCas(&u, (uint32_t) v, (uint32_t) r);
+    return r;
+}
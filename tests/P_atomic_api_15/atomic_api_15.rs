@@ -0,0 +1,11 @@
+// -target-api 15 -emit-llvm
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+int32_t histogram[16];
+
+// The bitcode readers before JB don't know the atomic instructions, so the
+// runtime function is still called.
+void root(const uchar *in, uint32_t x) {
+    rsAtomicInc(&histogram[*in & 15]);
+}
@@ -0,0 +1,11 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+static int foo() {
+}
+
+int gInt;
+
+void root(const int *in, int *out) {
+	*out = *in + gInt;
+}
@@ -0,0 +1,15 @@
+# The first compilation misses the cache. The second one hits it: it restores
+# the outputs and prints the same as the first one without compiling the file
+# again (so it has no compile report). The changed input misses again.
+mkdir -p tmp/src
+cp cache.rs tmp/src/cache.rs
+$LLVM_RS_CC -cache-dir tmp/cache tmp/src/cache.rs || exit 1
+
+rm tmp/cache.bc tmp/foo/ScriptC_cache.java
+$LLVM_RS_CC -cache-dir tmp/cache -ftime-report tmp/src/cache.rs 2> tmp/hit.txt || exit 1
+grep 'warning:' tmp/hit.txt >&2
+grep -q 'Compile report for' tmp/hit.txt && exit 1
+[ -f tmp/cache.bc ] && [ -f tmp/foo/ScriptC_cache.java ] || exit 1
+
+sed 's/gInt/gChanged/' cache.rs > tmp/src/cache.rs
+$LLVM_RS_CC -cache-dir tmp/cache tmp/src/cache.rs
@@ -0,0 +1,20 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+const float gain = 1.5f;
+const int iterations = 4;
+const uchar4 mask = {255, 0, 255, 0};
+const bool enabled = true;
+const short coeffs[3] = {1, -2, 1};
+const int table[20] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9,
+                       10, 11, 12, 13, 14, 15, 16, 17, 18, 19};
+int2 counter;
+
+void root(const float *in, float *out) {
+    float v = *in;
+    for (int i = 0; i < iterations; i++) {
+        v *= gain;
+    }
+    v += coeffs[0] + coeffs[1] + coeffs[2] + table[19];
+    *out = enabled ? v : *in;
+}
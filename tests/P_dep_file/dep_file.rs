@@ -0,0 +1,6 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#include "dep_header.rsh"
+
+Point gOrigin;
@@ -0,0 +1,5 @@
+# The dependencies of the same script without a precompiled RS header, when
+# precompiling it and when loading it, which lists the headers of the PCH.
+$LLVM_RS_CC dep_file.rs || exit 1
+$LLVM_RS_CC -o tmp/pch_created/ -rs-header-pch-dir tmp/pch dep_file.rs || exit 1
+$LLVM_RS_CC -o tmp/pch_loaded/ -rs-header-pch-dir tmp/pch dep_file.rs
@@ -0,0 +1,22 @@
+// -kernel-cost-report
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+int total;
+
+// Bounded by the width of the allocation: only the two calls taking the
+// address of the row and the distance between its cells are left.
+void sum_row(rs_allocation a, uint32_t y) {
+    int sum = 0;
+    for (uint32_t x = 0; x < rsAllocationGetDimX(a); x++)
+        sum += *(const int *) rsGetElementAt(a, x, y);
+    total = sum;
+}
+
+// Not every cell of the loop: left as it is.
+void sum_even(rs_allocation a, uint32_t y, uint32_t width) {
+    int sum = 0;
+    for (uint32_t x = 0; x < width; x++)
+        sum += *(const int *) rsGetElementAt(a, 2 * x, y);
+    total = sum;
+}
@@ -0,0 +1,12 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+float gain;
+
+void setGain(float g) {
+    gain = g;
+}
+
+void root(const float *in, float *out) {
+    *out = *in * gain;
+}
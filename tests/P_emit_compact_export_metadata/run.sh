@@ -0,0 +1,4 @@
+# The same script with -emit-compact-export-metadata, which keeps the legacy
+# metadata, and by default.
+$LLVM_RS_CC -emit-llvm -o tmp/compact/ -emit-compact-export-metadata compact_metadata.rs || exit 1
+$LLVM_RS_CC -emit-llvm -o tmp/default/ compact_metadata.rs
@@ -0,0 +1,9 @@
+# The exportables and the names of the exported types of each file take
+# memory from their arenas. Point, reflected for the first file, is kept in
+# the ODR arena by the time the second file is reported.
+mkdir -p tmp
+$LLVM_RS_CC -ftime-report export_arena.rs export_arena_2.rs 2> tmp/report.txt || exit 1
+[ "$(grep -cE '^  export_arena_bytes +[1-9][0-9]*$' tmp/report.txt)" = 2 ] || exit 1
+[ "$(grep -cE '^  export_type_names_bytes +[1-9][0-9]*$' tmp/report.txt)" = 2 ] || exit 1
+sed -n '/Compile report for export_arena_2\.rs/,$p' tmp/report.txt \
+    | grep -qE '^  odr_arena_bytes +[1-9][0-9]*$'
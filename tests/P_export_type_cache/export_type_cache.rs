@@ -0,0 +1,15 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+typedef struct Point {
+    float x;
+    float y;
+} Point;
+
+Point gA;
+Point gB;
+Point gC;
+
+void setC(Point p) {
+    gC = p;
+}
@@ -0,0 +1,8 @@
+# Point is reached from three variables and a parameter, it's only created
+# once. The reflected classes all use the same ScriptField_Point.
+mkdir -p tmp
+$LLVM_RS_CC -ftime-report export_type_cache.rs 2> tmp/report.txt || exit 1
+grep -qE '^  export_type_cache_hits +[1-9][0-9]*$' tmp/report.txt || exit 1
+grep -qE '^  export_type_cache_misses +[1-9][0-9]*$' tmp/report.txt || exit 1
+F=tmp/foo/ScriptC_export_type_cache.java
+[ "$(grep -c 'public ScriptField_Point.Item get_g[ABC]()' $F)" = 3 ]
@@ -0,0 +1,18 @@
+// -emit-llvm
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs kernel(to_float, grayscale, to_uchar)
+#pragma rs fuse(grayscale_blur, to_float, grayscale, to_uchar)
+
+void to_float(const uchar4 *in, float4 *out) {
+    *out = convert_float4(*in) / 255.f;
+}
+
+void grayscale(const float4 *in, float *out, uint32_t x, uint32_t y) {
+    *out = dot(*in, (float4) {0.299f, 0.587f, 0.114f, 0.f});
+}
+
+void to_uchar(const float *in, uchar *out) {
+    *out = (uchar) (*in * 255.f);
+}
@@ -0,0 +1,21 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+half h = 1.0;
+half2 h2;
+half4 h4;
+
+typedef struct pixel {
+    half4 color;
+    half alpha;
+} pixel_t;
+
+pixel_t px;
+
+void root(const half4 *in, half4 *out) {
+    *out = *in;
+}
+
+void scale(half s) {
+    h = h * s;
+}
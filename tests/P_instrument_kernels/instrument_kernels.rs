@@ -0,0 +1,18 @@
+// -finstrument-kernels -emit-compact-export-metadata
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+float gain;
+
+void set_gain(float g) {
+    gain = g;
+}
+
+// Runs before the counters are bound (and isn't timed)
+void init() {
+    set_gain(1.f);
+}
+
+void root(const float *in, float *out, uint32_t x) {
+    *out = *in * gain;
+}
@@ -0,0 +1,13 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+typedef struct SharedDefinition {
+	int member1;
+	float member2;
+} SharedDefinition;
+
+SharedDefinition o2;
+
+void root(const int *in, int *out) {
+	*out = *in + 2;
+}
@@ -0,0 +1,14 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+#pragma rs_fp_relaxed
+
+typedef struct Point {
+    float x;
+    float y;
+} Point;
+
+Point *gPoints;
+
+void root(const float *in, float *out) {
+    *out = sqrt(*in) * gPoints[0].x;
+}
@@ -0,0 +1,10 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+#pragma rs_fp_imprecise
+
+rs_allocation gAlloc;
+int gDim;
+
+void measure() {
+    gDim = rsAllocationGetDimX(gAlloc);
+}
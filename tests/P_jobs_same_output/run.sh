@@ -0,0 +1,8 @@
+# Compiling the scripts concurrently, each with its own precision, gives the
+# same bitcode and classes as compiling them one after the other.
+$LLVM_RS_CC -o tmp/seq/ -p tmp/seq/ jobs_same1.rs jobs_same2.rs jobs_same3.rs || exit 1
+$LLVM_RS_CC -jobs 3 -o tmp/jobs/ -p tmp/jobs/ jobs_same1.rs jobs_same2.rs jobs_same3.rs || exit 1
+for F in jobs_same1 jobs_same2 jobs_same3; do
+  cmp tmp/seq/$F.bc tmp/jobs/$F.bc || exit 1
+done
+diff -r tmp/seq/foo tmp/jobs/foo
@@ -0,0 +1,15 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs kernel(invert)
+
+float gain;
+
+void invert(const uchar4 *in, uchar4 *out, uint32_t x) {
+    *out = 255 - *in;
+}
+
+// Not named, so still an invokable function (invoke_scale())
+void scale(float *v, float s) {
+    *v *= s * gain;
+}
@@ -0,0 +1,8 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+float gain;
+
+void root(const float *in, float *out) {
+    *out = clamp(*in * gain, 0.0f, 1.0f);
+}
@@ -0,0 +1,14 @@
+# The first link misses the cache and stores its output. Linking the same
+# input again hits it: the output is the same and the cache isn't written.
+$LLVM_RS_CC link_cache_dir.rs || exit 1
+cp tmp/link_cache_dir.bc tmp/input.bc
+$LLVM_RS_LINK -cache-dir tmp/cache tmp/link_cache_dir.bc || exit 1
+[ -n "$(find tmp/cache -type f)" ] || exit 1
+cp tmp/link_cache_dir.bc tmp/linked.bc
+
+cp tmp/input.bc tmp/link_cache_dir.bc
+touch tmp/stamp
+sleep 1
+$LLVM_RS_LINK -cache-dir tmp/cache tmp/link_cache_dir.bc || exit 1
+[ -z "$(find tmp/cache -type f -newer tmp/stamp)" ] || exit 1
+cmp tmp/linked.bc tmp/link_cache_dir.bc
@@ -0,0 +1,9 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+// Defined by vec_length.ll
+extern float vec_length(float x, float y, float z, float w);
+
+void root(const float4 *in, float *out) {
+	*out = vec_length(in->x, in->y, in->z, in->w);
+}
@@ -0,0 +1,6 @@
+# vec_length() of the library given by -l calls length() of rslib, which the
+# script doesn't call itself. It's resolved all the same.
+$LLVM_RS_CC link_libraries.rs || exit 1
+$LLVM_AS vec_length.ll -o tmp/vec_length.bc || exit 1
+$LLVM_RS_LINK -ltmp/vec_length.bc tmp/link_libraries.bc || exit 1
+$LLVM_DIS tmp/link_libraries.bc -o tmp/link_libraries.ll
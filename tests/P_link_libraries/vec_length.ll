@@ -0,0 +1,10 @@
+define float @vec_length(float %x, float %y, float %z, float %w) nounwind readnone {
+  %1 = insertelement <4 x float> undef, float %x, i32 0
+  %2 = insertelement <4 x float> %1, float %y, i32 1
+  %3 = insertelement <4 x float> %2, float %z, i32 2
+  %4 = insertelement <4 x float> %3, float %w, i32 3
+  %5 = tail call float @_Z6lengthDv4_f(<4 x float> %4) nounwind readnone
+  ret float %5
+}
+
+declare float @_Z6lengthDv4_f(<4 x float>) nounwind readnone
@@ -0,0 +1,22 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+typedef struct Particle {
+    float2 position;
+    float mass;
+} Particle;
+
+Particle *particles;
+float gain = 2.0f;
+
+static float scale(float v) {
+    return v * gain;
+}
+
+void root(const float *in, float *out) {
+    *out = scale(*in);
+}
+
+void setGain(float g) {
+    gain = g;
+}
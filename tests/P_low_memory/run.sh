@@ -0,0 +1,5 @@
+# -low-memory frees the AST before the optimizer runs, which must not change
+# the bitcode.
+$LLVM_RS_CC -o tmp/low/ -low-memory low_memory.rs || exit 1
+$LLVM_RS_CC -o tmp/default/ low_memory.rs || exit 1
+cmp tmp/low/low_memory.bc tmp/default/low_memory.bc
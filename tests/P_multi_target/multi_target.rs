@@ -0,0 +1,9 @@
+// -emit-llvm -target armv7-none-linux-gnueabi -target i686-unknown-linux
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+float gScale;
+
+void root(const float *in, float *out) {
+	*out = *in * gScale;
+}
@@ -0,0 +1,17 @@
+// -emit-llvm
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs kernel(blur, scale)
+#pragma rs noalias(blur)
+
+float gain;
+
+void blur(const float *in, float *out, uint32_t x) {
+    *out = *in * gain;
+}
+
+// Not named, so it can still be launched in place
+void scale(const float *in, float *out) {
+    *out = *in * gain;
+}
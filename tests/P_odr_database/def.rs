@@ -0,0 +1,9 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+typedef struct Definition{
+	int member1;
+	int member2;
+} Definition;
+
+Definition o1;
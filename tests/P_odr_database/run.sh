@@ -0,0 +1,15 @@
+# The definitions of a file compiled again replace its earlier ones, against
+# which the other files aren't checked anymore.
+mkdir -p tmp/src
+cp def.rs tmp/src/def.rs
+$LLVM_RS_CC -odr-database tmp/odr.db tmp/src/def.rs || exit 1
+
+sed 's/int member2/float member2/' def.rs > tmp/src/def.rs
+$LLVM_RS_CC -odr-database tmp/odr.db tmp/src/def.rs || exit 1
+
+$LLVM_RS_CC -odr-database tmp/odr.db same.rs || exit 1
+
+# The database is shared with the other users, so it has the mode of any new
+# file (under the umask) rather than being private.
+touch tmp/new
+[ "$(stat -c %a tmp/odr.db)" = "$(stat -c %a tmp/new)" ]
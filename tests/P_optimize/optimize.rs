@@ -0,0 +1,22 @@
+// -emit-llvm
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs optimize(s)
+#pragma rs optimize(3, root)
+#pragma rs optimize(0, debug_helper)
+
+static int debug_helper(int i) {
+  return i * 2;
+}
+
+void root(const int *in, int *out, uint32_t x) {
+  *out = debug_helper(*in) + x;
+}
+
+int result;
+
+// At the level of the file
+void store(int i) {
+  result = i;
+}
@@ -0,0 +1,19 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+float gData[16];
+float gTotal;
+static int sCalls;
+
+static float __attribute__((noinline)) sum(int n) {
+    float s = 0.0f;
+    for (int i = 0; i < n; i++) {
+        s += gData[i];
+    }
+    return s;
+}
+
+void accumulate(int n) {
+    sCalls++;
+    gTotal += sum(n) / sCalls;
+}
@@ -0,0 +1,4 @@
+# The same script optimized for size, which strips the local names, and by
+# default.
+$LLVM_RS_CC -emit-llvm -o tmp/os/ -Os optimize_for_size.rs || exit 1
+$LLVM_RS_CC -emit-llvm -o tmp/default/ optimize_for_size.rs
@@ -0,0 +1,10 @@
+// -emit-llvm -fprofile-generate
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+int gCount;
+
+void count(int n) {
+    if (n > 0)
+        gCount += n;
+}
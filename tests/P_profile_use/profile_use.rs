@@ -0,0 +1,20 @@
+// -emit-llvm -fprofile-use=profile_use.txt
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+int gCount;
+
+void hot(int n) {
+    gCount += n;
+}
+
+// Never called, e.g., the handling of an error
+void cold(int n) {
+    gCount -= n;
+}
+
+// Its profile was collected before the branch was added.
+void stale(int n) {
+    if (n)
+        gCount = 0;
+}
@@ -0,0 +1,29 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs reduce(sum) accumulator(sum_accum)
+#pragma rs reduce(bounds) accumulator(bounds_accum) \
+    initializer(bounds_init) combiner(bounds_comb) outconverter(bounds_out)
+
+void sum_accum(int *accum, const int *in) {
+    *accum += *in;
+}
+
+void bounds_init(int2 *accum) {
+    accum->x = 0x7fffffff;
+    accum->y = -0x7fffffff - 1;
+}
+
+void bounds_accum(int2 *accum, const int *in, uint32_t x) {
+    accum->x = min(accum->x, *in);
+    accum->y = max(accum->y, *in);
+}
+
+void bounds_comb(int2 *accum, const int2 *other) {
+    accum->x = min(accum->x, other->x);
+    accum->y = max(accum->y, other->y);
+}
+
+void bounds_out(int *result, const int2 *accum) {
+    *result = accum->y - accum->x;
+}
@@ -0,0 +1,22 @@
+// -ftime-report-json tmp/refcount.json
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+rs_allocation gIn;
+int gDim;
+
+// Borrows the reference of gIn, which is never assigned here.
+void borrow_global() {
+    rs_allocation a = gIn;
+    gDim = rsAllocationGetDimX(a);
+}
+
+// Borrows the reference of its parameter, since no global is assigned here.
+static uint32_t borrow_param(rs_allocation p) {
+    rs_allocation a = p;
+    return rsAllocationGetDimX(a);
+}
+
+void root(const int *in, int *out) {
+    *out = *in + borrow_param(gIn);
+}
@@ -0,0 +1,25 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+rs_allocation gA;
+rs_allocation gB;
+int gDimA;
+
+// The store through the pointer can release gA.
+static void store_indirect(rs_allocation *p) {
+    rs_allocation a = gA;
+    *p = gB;
+    gDimA = rsAllocationGetDimX(a);
+}
+
+// The caller can pass gA, which the assignment releases.
+static void store_global(rs_allocation p) {
+    rs_allocation a = p;
+    gA = gB;
+    gDimA = rsAllocationGetDimX(a);
+}
+
+void run() {
+    store_indirect(&gA);
+    store_global(gA);
+}
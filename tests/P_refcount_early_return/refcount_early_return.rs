@@ -0,0 +1,29 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+// Keep the calls of each return in its own block.
+#pragma rs optimize(0, early_return, drop)
+
+rs_allocation gAlloc;
+int gDim;
+
+static void drop() {
+    rsClearObject(&gAlloc);
+}
+
+// Calls drop(), so its locals count their references instead of borrowing
+// the one of gAlloc.
+void early_return(int n) {
+    rs_allocation a = gAlloc;
+    rs_allocation b;
+    drop();
+    if (n == 0)
+        return;
+    b = a;
+    if (n == 1) {
+        rs_allocation c = b;
+        gDim = rsAllocationGetDimX(c);
+        return;
+    }
+    gDim = rsAllocationGetDimX(a);
+}
@@ -0,0 +1,9 @@
+# Each exit of early_return() clears the RS object locals in scope once: a
+# and b at the first return, c, b and a at the second and a and b at the end
+# of the body.
+mkdir -p tmp
+$LLVM_RS_CC -emit-llvm refcount_early_return.rs || exit 1
+sed -n '/^define void @early_return(/,/^}/p' tmp/refcount_early_return.ll \
+    > tmp/early_return.ll
+[ "$(grep -c rsSetObject tmp/early_return.ll)" -eq 3 ] || exit 1
+[ "$(grep -c rsClearObject tmp/early_return.ll)" -eq 7 ]
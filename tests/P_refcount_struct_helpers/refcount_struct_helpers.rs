@@ -0,0 +1,35 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+// Keep the helpers out of line, so the calls to them are in the bitcode.
+#pragma rs optimize(0)
+
+typedef struct Big {
+    rs_allocation a, b, c, d, e;
+} Big;
+
+typedef struct Small {
+    rs_allocation a, b;
+} Small;
+
+static Big gBig;
+static Small gSmall;
+int gDim;
+
+void copy_big() {
+    Big b;
+    b = gBig;
+    gDim = rsAllocationGetDimX(b.a);
+}
+
+void copy_big_again() {
+    Big b;
+    b = gBig;
+    gDim = rsAllocationGetDimY(b.e);
+}
+
+void copy_small() {
+    Small s;
+    s = gSmall;
+    gDim = rsAllocationGetDimX(s.b);
+}
@@ -0,0 +1,11 @@
+# The struct of more than 4 RS objects is cleared and set by one helper of
+# each kind, which both functions call. The small struct is still expanded in
+# place.
+mkdir -p tmp
+$LLVM_RS_CC -emit-llvm refcount_struct_helpers.rs || exit 1
+LL=tmp/refcount_struct_helpers.ll
+[ "$(grep -c '^define internal void @\.rs\.clear\.Big(' $LL)" -eq 1 ] || exit 1
+[ "$(grep -c '^define internal void @\.rs\.set\.Big(' $LL)" -eq 1 ] || exit 1
+[ "$(grep -c 'call void @\.rs\.clear\.Big(' $LL)" -ge 2 ] || exit 1
+[ "$(grep -c 'call void @\.rs\.set\.Big(' $LL)" -eq 2 ] || exit 1
+! grep -q '\.rs\.\(clear\|set\)\.Small' $LL
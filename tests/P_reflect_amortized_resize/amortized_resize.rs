@@ -0,0 +1,9 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+typedef struct Particle {
+    float2 position;
+    float mass;
+} Particle;
+
+Particle *particles;
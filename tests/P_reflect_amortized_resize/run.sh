@@ -0,0 +1,3 @@
+# The same script reflected with -reflect-amortized-resize and by default.
+$LLVM_RS_CC -p tmp/amortized/ -reflect-amortized-resize amortized_resize.rs || exit 1
+$LLVM_RS_CC -p tmp/default/ amortized_resize.rs
@@ -0,0 +1,3 @@
+# The same script reflected with -reflect-batched-updates and by default.
+$LLVM_RS_CC -p tmp/batched/ -reflect-batched-updates batched_updates.rs || exit 1
+$LLVM_RS_CC -p tmp/default/ batched_updates.rs
@@ -0,0 +1,11 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+typedef struct Particle {
+	float3 position;
+	float mass;
+	int id;
+	uchar flags;
+} Particle;
+
+Particle *particles;
@@ -0,0 +1,3 @@
+# The same script reflected with -reflect-bulk-accessors and by default.
+$LLVM_RS_CC -p tmp/bulk/ -reflect-bulk-accessors bulk_accessors.rs || exit 1
+$LLVM_RS_CC -p tmp/default/ bulk_accessors.rs
@@ -0,0 +1,9 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+float3 gVec;
+float4 gScale;
+
+void scale(float4 v) {
+    gScale = v;
+}
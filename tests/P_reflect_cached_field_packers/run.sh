@@ -0,0 +1,3 @@
+# The same script reflected with -reflect-cached-field-packers and by default.
+$LLVM_RS_CC -p tmp/cached/ -reflect-cached-field-packers cached_field_packers.rs || exit 1
+$LLVM_RS_CC -p tmp/default/ cached_field_packers.rs
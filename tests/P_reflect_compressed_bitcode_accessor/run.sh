@@ -0,0 +1,4 @@
+# The same script's bitcode accessor with -reflect-compressed-bitcode-accessor
+# and by default.
+$LLVM_RS_CC -p tmp/compressed/ -s jc -reflect-compressed-bitcode-accessor compressed_accessor.rs || exit 1
+$LLVM_RS_CC -p tmp/default/ -s jc compressed_accessor.rs
@@ -0,0 +1,18 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+float gain;
+int offset;
+
+void setParams(float g, int o) {
+    gain = g;
+    offset = o;
+}
+
+void setMany(int a, int b, int c, int d, int e) {
+    offset = a + b + c + d + e;
+}
+
+void setVector(float4 v) {
+    gain = v.x;
+}
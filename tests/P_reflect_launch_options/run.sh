@@ -0,0 +1,14 @@
+# The same script reflected for JB MR2 (which has the bounded forEach) and for
+# an API level before it. A compiler built for an older RS_VERSION can't target
+# JB MR2, so the checks of the former are here instead of in a .contains file.
+mkdir -p tmp
+if $LLVM_RS_CC -p tmp/api18/ -target-api 18 launch_options.rs > tmp/api18.out 2>&1; then
+  F=tmp/api18/foo/ScriptC_launch_options.java
+  grep -qF 'public void forEach_root(Allocation ain, Allocation aout)' $F || exit 1
+  grep -qF 'forEach_root(ain, aout, null);' $F || exit 1
+  grep -qF 'public void forEach_root(Allocation ain, Allocation aout, Script.LaunchOptions sc)' $F || exit 1
+  grep -qF 'forEach(mExportForEachIdx_root, ain, aout, null, sc);' $F || exit 1
+else
+  grep -qF "target API level '18' is out of range" tmp/api18.out || exit 1
+fi
+$LLVM_RS_CC -p tmp/api15/ -target-api 15 launch_options.rs
@@ -0,0 +1,4 @@
+# The same script's bitcode accessor with -reflect-packed-bitcode-accessor and
+# by default.
+$LLVM_RS_CC -p tmp/packed/ -s jc -reflect-packed-bitcode-accessor packed_accessor.rs || exit 1
+$LLVM_RS_CC -p tmp/default/ -s jc packed_accessor.rs
@@ -0,0 +1,3 @@
+# The same scripts reflected with -reflect-shared-types-package and by default.
+$LLVM_RS_CC -p tmp/shared/ -reflect-shared-types-package bar shared_a.rs shared_b.rs || exit 1
+$LLVM_RS_CC -p tmp/default/ shared_a.rs shared_b.rs
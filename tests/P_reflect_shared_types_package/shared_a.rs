@@ -0,0 +1,3 @@
+#include "point.rsh"
+
+Point gOrigin;
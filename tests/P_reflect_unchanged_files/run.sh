@@ -0,0 +1,14 @@
+# Reflecting the same classes again leaves their files untouched. Changing a
+# variable only rewrites the class of the script, not the one of the struct.
+mkdir -p tmp/src
+cp unchanged_files.rs tmp/src/unchanged_files.rs
+$LLVM_RS_CC tmp/src/unchanged_files.rs || exit 1
+touch tmp/stamp
+sleep 1
+$LLVM_RS_CC tmp/src/unchanged_files.rs || exit 1
+[ -z "$(find tmp/foo -type f -newer tmp/stamp)" ] || exit 1
+
+sed 's/gInt/gChanged/' unchanged_files.rs > tmp/src/unchanged_files.rs
+$LLVM_RS_CC tmp/src/unchanged_files.rs || exit 1
+[ -n "$(find tmp/foo -name ScriptC_unchanged_files.java -newer tmp/stamp)" ] || exit 1
+[ -z "$(find tmp/foo -name ScriptField_Point.java -newer tmp/stamp)" ]
@@ -0,0 +1,10 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+typedef struct Point {
+    float x;
+    float y;
+} Point;
+
+Point gOrigin;
+int gInt;
@@ -0,0 +1,3 @@
+# The same script reflected with -reflect-usage-manifest and by default.
+$LLVM_RS_CC -p tmp/manifest/ -reflect-usage-manifest usage.txt usage_manifest.rs || exit 1
+$LLVM_RS_CC -p tmp/default/ usage_manifest.rs
@@ -0,0 +1,10 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+float gain;
+int gOffset;
+
+void reset() {
+    gain = 1.0f;
+    gOffset = 0;
+}
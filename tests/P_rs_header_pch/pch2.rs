@@ -0,0 +1,8 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+rs_allocation gAlloc;
+
+void root(const int *in, int *out, uint32_t x) {
+	*out = *in + *(const int *) rsGetElementAt(gAlloc, x);
+}
@@ -0,0 +1,12 @@
+# The first compilation creates the PCH of the RS headers, the second one
+# uses it instead of creating it again.
+$LLVM_RS_CC -rs-header-pch-dir tmp/pch pch1.rs || exit 1
+
+set -- tmp/pch/rs_core-*.pch
+[ -f "$1" ] || exit 1
+
+touch tmp/stamp
+sleep 1
+$LLVM_RS_CC -rs-header-pch-dir tmp/pch pch2.rs || exit 1
+
+[ -z "$(find tmp/pch -name '*.pch' -newer tmp/stamp)" ]
@@ -0,0 +1,58 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+float2 gA2, gB2;
+float3 gA3, gB3;
+float4 gA4, gB4;
+float gT;
+rs_matrix4x4 gM4, gN4;
+rs_matrix2x2 gM2;
+
+float gDot, gLength, gDistance;
+float2 gResult2;
+float3 gResult3;
+float4 gResult4;
+
+void vector2() {
+	gDot = dot(gA2, gB2);
+	gLength = length(gA2);
+	gDistance = distance(gA2, gB2);
+	gResult2 = normalize(gA2);
+	gResult2 += mix(gA2, gB2, gB2);
+	gResult2 += mix(gA2, gB2, gT);
+	gResult2 += clamp(gA2, gB2, gB2);
+	gResult2 += clamp(gA2, 0.f, 1.f);
+}
+
+void vector3() {
+	gDot = dot(gA3, gB3);
+	gLength = length(gA3);
+	gDistance = distance(gA3, gB3);
+	gResult3 = normalize(gA3);
+	gResult3 += mix(gA3, gB3, gB3);
+	gResult3 += mix(gA3, gB3, gT);
+	gResult3 += clamp(gA3, gB3, gB3);
+	gResult3 += clamp(gA3, 0.f, 1.f);
+	gResult3 += cross(gA3, gB3);
+}
+
+void vector4() {
+	gDot = dot(gA4, gB4);
+	gLength = length(gA4);
+	gDistance = distance(gA4, gB4);
+	gResult4 = normalize(gA4);
+	gResult4 += mix(gA4, gB4, gB4);
+	gResult4 += mix(gA4, gB4, gT);
+	gResult4 += clamp(gA4, gB4, gB4);
+	gResult4 += clamp(gA4, 0.f, 1.f);
+	gResult4 += cross(gA4, gB4);
+}
+
+void matrix() {
+	gResult4 = rsMatrixMultiply(&gM4, gA4);
+	gResult4 += rsMatrixMultiply(&gM4, gA3);
+	gResult4 += rsMatrixMultiply(&gM4, gA2);
+	gResult2 = rsMatrixMultiply(&gM2, gA2);
+	rsMatrixMultiply(&gM4, &gN4);
+	rsMatrixLoadMultiply(&gN4, &gM4, &gN4);
+}
@@ -0,0 +1,5 @@
+# Every vector math and matrix function of rslib.ll which the script calls is
+# linked in, none is left to the runtime.
+$LLVM_RS_CC rslib_vector_math.rs || exit 1
+$LLVM_RS_LINK tmp/rslib_vector_math.bc || exit 1
+$LLVM_DIS tmp/rslib_vector_math.bc -o tmp/rslib_vector_math.ll
@@ -0,0 +1,20 @@
+# Both scripts are compiled by the same compile server, one request each. The
+# server removes its socket when terminated.
+mkdir -p tmp
+$LLVM_RS_CC -server tmp/server.sock &
+SERVER=$!
+
+i=0
+while [ ! -S tmp/server.sock ] && [ $i -lt 100 ]; do
+  sleep 0.1
+  i=$((i + 1))
+done
+
+$LLVM_RS_CC -connect tmp/server.sock server1.rs &&
+$LLVM_RS_CC -connect tmp/server.sock server2.rs
+STATUS=$?
+
+kill $SERVER
+wait $SERVER || exit 1
+[ ! -e tmp/server.sock ] || exit 1
+exit $STATUS
@@ -0,0 +1,8 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+int gInt;
+
+void root(const int *in, int *out) {
+	*out = *in + gInt;
+}
@@ -0,0 +1,11 @@
+// -struct-layout-report -warn-struct-padding
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+typedef struct Padded {
+    char c;
+    float4 v;
+    short s;
+} Padded;
+
+Padded gPadded;
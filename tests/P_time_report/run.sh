@@ -0,0 +1,24 @@
+# The report of each phase and the counts of one file, then the reports of two
+# files compiled concurrently, which have a single peak RSS (the process').
+mkdir -p tmp
+$LLVM_RS_CC -ftime-report -ftime-report-json tmp/report.json time_report.rs 2> tmp/report.txt || exit 1
+grep -qF 'Compile report for time_report.rs' tmp/report.txt || exit 1
+for P in parse refcount irgen export function_passes module_passes \
+         code_emission reflection total; do
+  grep -qE "^  $P +[0-9]+\.[0-9]{4}\$" tmp/report.txt || exit 1
+done
+grep -qE '^  exported_vars +2$' tmp/report.txt || exit 1
+grep -qE '^  exported_funcs +1$' tmp/report.txt || exit 1
+grep -qE '^  exported_foreach +1$' tmp/report.txt || exit 1
+grep -qE '^  bitcode_bytes +[1-9][0-9]*$' tmp/report.txt || exit 1
+grep -qE '^  peak RSS \(KB\) +[0-9]+$' tmp/report.txt || exit 1
+
+grep -qE '^  "process_peak_rss_kb": [0-9]+,$' tmp/report.json || exit 1
+grep -qF '"input": "time_report.rs"' tmp/report.json || exit 1
+grep -qE '"parse": \{ "wall_time": [0-9]+\.[0-9]{6} \}' tmp/report.json || exit 1
+grep -qF '"exported_vars": 2' tmp/report.json || exit 1
+grep -qF '"peak_rss_kb"' tmp/report.json && exit 1
+
+$LLVM_RS_CC -jobs 2 -ftime-report time_report.rs time_report_2.rs 2> tmp/jobs.txt || exit 1
+[ "$(grep -c '^  Compile report for ' tmp/jobs.txt)" = 2 ] || exit 1
+[ "$(grep -c 'peak RSS' tmp/jobs.txt)" = 1 ]
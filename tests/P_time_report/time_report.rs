@@ -0,0 +1,18 @@
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+typedef struct Point {
+    float x;
+    float y;
+} Point;
+
+Point gOrigin;
+float gain;
+
+void setGain(float g) {
+    gain = g;
+}
+
+void root(const float *in, float *out) {
+    *out = *in * gain;
+}
@@ -0,0 +1,20 @@
+// -emit-llvm
+#pragma version(1)
+#pragma rs java_package_name(foo)
+
+#pragma rs kernel(brighten, generic)
+#pragma rs vectorize(4)
+#pragma rs vectorize(8, brighten)
+
+float gain;
+
+void root(const float4 *in, float4 *out, uint32_t x) {
+    *out = *in * gain;
+}
+
+void brighten(const uchar4 *in, uchar4 *out) {
+    *out = *in + (uchar4) 16;
+}
+
+void generic(const void *in, void *out) {
+}
@@ -0,0 +1,12 @@
+# The bitcode of each target follows the wrapper header, which has the magic
+# and the size of the bitcode, and reads back with llvm-dis.
+mkdir -p tmp
+$LLVM_RS_CC -target armv7-none-linux-gnueabi -target i686-unknown-linux wrapped_bitcode.rs || exit 1
+for T in armv7 i686; do
+  BC=tmp/$T/wrapped_bitcode.bc
+  set -- $(od -A n -t x4 -N 16 $BC)
+  [ "$1" = 0b17c0de ] || exit 1
+  [ "$(wc -c < $BC)" -eq $((0x$3 + 0x$4)) ] || exit 1
+  $LLVM_DIS $BC -o tmp/$T.ll || exit 1
+  grep -q '^define void @root(' tmp/$T.ll || exit 1
+done
@@ -0,0 +1,336 @@
+#!/usr/bin/python
+#
+# Copyright 2012 Google Inc. All Rights Reserved.
+
+"""RenderScript Compiler Benchmark.
+
+Generates a synthetic corpus of scripts, each stressing one part of the
+compiler, runs llvm-rs-cc and llvm-rs-link over it and writes the wall time
+and the peak RSS of each run (and the per-phase report of llvm-rs-cc
+-ftime-report-json) to a JSON file, optionally compared against the one of a
+baseline.
+"""
+
+import getopt
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+__author__ = 'Android'
+
+
+class Options(object):
+  def __init__(self):
+    return
+  verbose = 0
+  cleanup = 1
+  scale = 1
+  repeat = 3
+  threshold = 0.10
+  bin_dir = '../../../../out/host/linux-x86/bin/'
+  include_dirs = ['../../../../frameworks/base/libs/rs/scriptc/',
+                  '../../../../external/clang/lib/Headers/']
+  output = 'bench.json'
+  baseline = None
+
+
+HEADER = ('#pragma version(1)\n'
+          '#pragma rs java_package_name(bench)\n\n')
+
+
+def GenVars(scale):
+  """Many exported variables of all the kinds reflected."""
+  out = []
+  for i in range(200 * scale):
+    out.append('int ivar%d = %d;\n' % (i, i))
+    out.append('float4 fvar%d;\n' % i)
+    out.append('rs_allocation avar%d;\n' % i)
+    out.append('const int cvar%d = %d;\n' % (i, i))
+  return ''.join(out)
+
+
+def GenStructs(scale):
+  """Deeply nested structs, exported and passed to invokables."""
+  depth = 16 * scale
+  out = ['typedef struct S0 {\n  int i;\n  float f;\n  rs_allocation a;\n'
+         '} S0;\n\n']
+  for d in range(1, depth + 1):
+    out.append('typedef struct S%d {\n  S%d inner;\n  S0 leaves[2];\n'
+               '  float2 v;\n  int n;\n} S%d;\n\n' % (d, d - 1, d))
+    out.append('S%d gs%d;\n' % (d, d))
+    out.append('void set_s%d(int n) {\n  gs%d.n = n;\n}\n\n' % (d, d))
+  return ''.join(out)
+
+
+def GenObjects(scale):
+  """Functions with many RS object locals, for RSObjectRefCount."""
+  out = ['rs_allocation gAlloc;\nrs_element gElem;\n\n']
+  for f in range(50 * scale):
+    out.append('static int objs%d(int n) {\n' % f)
+    for i in range(20):
+      out.append('  rs_allocation a%d = gAlloc;\n' % i)
+      out.append('  rs_element e%d;\n' % i)
+    out.append('  for (int i = 0; i < n; i++) {\n'
+               '    rs_allocation t = a%d;\n'
+               '    if (i == %d) {\n'
+               '      rsSetObject(&e0, gElem);\n'
+               '      return i;\n'
+               '    }\n'
+               '  }\n'
+               '  switch (n) {\n' % (f % 20, f))
+    for i in range(10):
+      out.append('    case %d: {\n'
+                 '      rs_allocation s = a%d;\n'
+                 '      return %d;\n'
+                 '    }\n' % (i, i, i))
+    out.append('    default: break;\n  }\n  return n;\n}\n\n')
+  out.append('void run_objs(int n) {\n  int r = 0;\n')
+  for f in range(50 * scale):
+    out.append('  r += objs%d(n);\n' % f)
+  out.append('}\n')
+  return ''.join(out)
+
+
+def GenArrays(scale):
+  """Large constant arrays, exported with their initializers."""
+  out = []
+  for a in range(8 * scale):
+    size = 4096
+    out.append('float table%d[%d] = {\n' % (a, size))
+    for i in range(0, size, 8):
+      out.append('    ' + ', '.join(['%d.%df' % (j, a) for j in
+                                      range(i, i + 8)]) + ',\n')
+    out.append('};\n')
+    out.append('static const int lut%d[%d] = {\n' % (a, size))
+    for i in range(0, size, 16):
+      out.append('    ' + ', '.join([str((j * 31 + a) & 0xff) for j in
+                                      range(i, i + 16)]) + ',\n')
+    out.append('};\n\n')
+  return ''.join(out)
+
+
+def GenKernels(scale):
+  """Many forEach kernels (all but root() since JB)."""
+  out = ['float gain;\n\n'
+         'void root(const float4 *in, float4 *out, uint32_t x) {\n'
+         '  *out = *in * gain;\n}\n\n']
+  for k in range(100 * scale):
+    out.append('void kernel%d(const float4 *in, float4 *out, uint32_t x,\n'
+               '             uint32_t y) {\n'
+               '  float4 v = *in;\n'
+               '  for (int i = 0; i < %d; i++)\n'
+               '    v = v * gain + (float) (x ^ y);\n'
+               '  *out = clamp(v, 0.f, 1.f);\n'
+               '}\n\n' % (k, k % 8 + 1))
+  return ''.join(out)
+
+
+# The scripts of the corpus
+GENERATORS = [
+  ('vars', GenVars),
+  ('structs', GenStructs),
+  ('objects', GenObjects),
+  ('arrays', GenArrays),
+  ('kernels', GenKernels),
+]
+
+
+def GenerateCorpus(dirname):
+  """Writes the scripts into dirname, returns their names."""
+  names = []
+  for name, generator in GENERATORS:
+    f = open(os.path.join(dirname, name + '.rs'), 'w')
+    f.write(HEADER)
+    f.write(generator(Options.scale))
+    f.close()
+    names.append(name)
+  return names
+
+
+def Run(args):
+  """Runs args, returns (exit status, wall time, peak RSS in KB)."""
+  if Options.verbose > 1:
+    print('Executing: ' + ' '.join(args))
+  devnull = open(os.devnull, 'w')
+  start = time.time()
+  p = subprocess.Popen(args, stdout=devnull, stderr=subprocess.STDOUT)
+  # The rusage of this child only (ru_maxrss is in KB on Linux.)
+  _, status, usage = os.wait4(p.pid, 0)
+  wall_time = time.time() - start
+  devnull.close()
+  return (status, wall_time, usage.ru_maxrss)
+
+
+def Measure(args, prepare=None):
+  """Runs args Options.repeat times (after prepare(), if any), returns the
+  best time and peak RSS."""
+  result = None
+  for _ in range(Options.repeat):
+    if prepare:
+      prepare()
+    status, wall_time, peak_rss = Run(args)
+    if status != 0:
+      print >> sys.stderr, 'Failed: %s' % ' '.join(args)
+      return None
+    if result is None:
+      result = {'wall_time': wall_time, 'peak_rss_kb': peak_rss}
+    else:
+      result['wall_time'] = min(result['wall_time'], wall_time)
+      result['peak_rss_kb'] = min(result['peak_rss_kb'], peak_rss)
+  return result
+
+
+def BenchScript(dirname, name):
+  """Compiles and links dirname/name.rs, returns its results."""
+  out_dir = os.path.join(dirname, name)
+  os.mkdir(out_dir)
+  report = os.path.join(out_dir, 'report.json')
+
+  cc = [os.path.join(Options.bin_dir, 'llvm-rs-cc'),
+        '-o', out_dir, '-p', out_dir, '-target-api', '16',
+        '-ftime-report-json', report]
+  for d in Options.include_dirs:
+    cc += ['-I', d]
+  cc.append(os.path.join(dirname, name + '.rs'))
+
+  results = {}
+  results['llvm-rs-cc'] = Measure(cc)
+  if results['llvm-rs-cc'] is None:
+    return None
+  f = open(report, 'r')
+  results['llvm-rs-cc']['phases'] = json.load(f)['files'][0]['phases']
+  f.close()
+
+  # llvm-rs-link links its input in place, so link a fresh copy each time.
+  bc = os.path.join(out_dir, name + '.bc')
+  linked = os.path.join(out_dir, name + '.linked.bc')
+  results['llvm-rs-link'] = Measure(
+      [os.path.join(Options.bin_dir, 'llvm-rs-link'), linked],
+      lambda: shutil.copyfile(bc, linked))
+  if results['llvm-rs-link'] is None:
+    return None
+  return results
+
+
+def Compare(results, baseline):
+  """Prints the changes from baseline, returns the number of regressions."""
+  regressions = 0
+  for name in sorted(results.keys()):
+    if name not in baseline:
+      continue
+    for tool in ('llvm-rs-cc', 'llvm-rs-link'):
+      for metric in ('wall_time', 'peak_rss_kb'):
+        old = baseline[name][tool][metric]
+        new = results[name][tool][metric]
+        if old <= 0:
+          continue
+        change = (new - old) / float(old)
+        flag = ''
+        if change > Options.threshold:
+          flag = '  REGRESSION'
+          regressions += 1
+        print('%-8s %-13s %-12s %12.4f %12.4f %+7.1f%%%s' %
+              (name, tool, metric, old, new, change * 100, flag))
+  return regressions
+
+
+def Usage():
+  print ('Usage: %s [OPTION]...\n'
+         'RenderScript Compiler Benchmark\n'
+         'Available Options:\n'
+         '  -h, --help            Help message\n'
+         '  -n, --no-cleanup      Don\'t remove the corpus and the outputs\n'
+         '  -v, --verbose         Verbose output\n'
+         '  -s, --scale N         Make the scripts N times larger (1)\n'
+         '  -r, --repeat N        Keep the best of N runs (3)\n'
+         '  -o, --output FILE     Write the results to FILE (bench.json)\n'
+         '  -b, --baseline FILE   Compare with the results in FILE\n'
+         '  -t, --threshold PCT   Regression threshold in percent (10)\n'
+         '      --bin-dir DIR     Where llvm-rs-cc and llvm-rs-link are\n'
+         '  -I DIR                Include directory (replaces the default)'
+        ) % (sys.argv[0])
+  return
+
+
+def main():
+  try:
+    opts, args = getopt.getopt(sys.argv[1:], 'hnvs:r:o:b:t:I:',
+                               ['help', 'no-cleanup', 'verbose', 'scale=',
+                                'repeat=', 'output=', 'baseline=',
+                                'threshold=', 'bin-dir='])
+  except getopt.GetoptError, e:
+    print >> sys.stderr, str(e)
+    return 1
+  if args:
+    print >> sys.stderr, 'Invalid argument: %s' % args[0]
+    return 1
+
+  include_dirs = []
+  for opt, value in opts:
+    if opt in ('-h', '--help'):
+      Usage()
+      return 0
+    elif opt in ('-n', '--no-cleanup'):
+      Options.cleanup = 0
+    elif opt in ('-v', '--verbose'):
+      Options.verbose += 1
+    elif opt in ('-s', '--scale'):
+      Options.scale = int(value)
+    elif opt in ('-r', '--repeat'):
+      Options.repeat = int(value)
+    elif opt in ('-o', '--output'):
+      Options.output = value
+    elif opt in ('-b', '--baseline'):
+      Options.baseline = value
+    elif opt in ('-t', '--threshold'):
+      Options.threshold = float(value) / 100
+    elif opt == '--bin-dir':
+      Options.bin_dir = value
+    elif opt == '-I':
+      include_dirs.append(value)
+  if include_dirs:
+    Options.include_dirs = include_dirs
+
+  dirname = tempfile.mkdtemp(prefix='slang-bench-')
+  results = {}
+  failed = 0
+  for name in GenerateCorpus(dirname):
+    if Options.verbose:
+      print('Benchmarking %s' % name)
+    script_results = BenchScript(dirname, name)
+    if script_results is None:
+      failed += 1
+    else:
+      results[name] = script_results
+
+  if Options.cleanup:
+    shutil.rmtree(dirname)
+  elif Options.verbose:
+    print('Corpus and outputs left in %s' % dirname)
+
+  f = open(Options.output, 'w')
+  json.dump({'version': 1, 'scale': Options.scale, 'repeat': Options.repeat,
+             'scripts': results}, f, indent=2, sort_keys=True)
+  f.write('\n')
+  f.close()
+
+  regressions = 0
+  if Options.baseline:
+    f = open(Options.baseline, 'r')
+    baseline = json.load(f)
+    f.close()
+    if baseline.get('scale') != Options.scale:
+      print >> sys.stderr, ('Warning: the baseline was measured at scale %s' %
+                            baseline.get('scale'))
+    regressions = Compare(results, baseline['scripts'])
+    print('Regressions: %d' % regressions)
+
+  return (failed != 0) or (regressions != 0)
+
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -0,0 +1,492 @@
+#!/usr/bin/python
+#
+# Copyright 2012 Google Inc. All Rights Reserved.
+
+"""RenderScript Reflection Benchmark.
+
+Reflects a set of representative scripts with llvm-rs-cc and generates an
+Android app benchmarking each of the generated set_*, invoke_*, forEach_*
+methods of the ScriptC_* classes and the set*, copyAll methods of the
+ScriptField_* classes, in ns/op and allocations/op.
+
+  $ ./reflect_bench.py -o <dir in the Android tree>
+  $ mmm <dir> && adb install -r $OUT/data/app/RSReflectionBench.apk
+  $ adb logcat -c && adb shell am start -W -n \
+      com.android.rs.reflectionbench/.ReflectionBench
+  (wait for "done" in adb logcat -s RSReflectionBench)
+  $ ./reflect_bench.py --collect results.json [-b baseline.json]
+"""
+
+import getopt
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+
+__author__ = 'Android'
+
+PACKAGE = 'com.android.rs.reflectionbench'
+TAG = 'RSReflectionBench'
+
+
+class Options(object):
+  def __init__(self):
+    return
+  verbose = 0
+  output_dir = 'reflect_bench'
+  collect = None
+  baseline = None
+  threshold = 0.10
+  bin_dir = '../../../../out/host/linux-x86/bin/'
+  include_dirs = ['../../../../frameworks/base/libs/rs/scriptc/',
+                  '../../../../external/clang/lib/Headers/']
+
+
+# The representative scripts: every kind of reflected method, with the
+# arguments the apps pass in their frame loops. All the kernels work on
+# float4, such that the benchmark can pass the same Allocations to all of
+# them.
+SCRIPTS = {
+  'bench': """#pragma version(1)
+#pragma rs java_package_name(%s)
+
+typedef struct Point {
+  float2 position;
+  float4 color;
+  int id;
+} Point_t;
+
+Point_t *points;
+
+int ivar;
+float fvar;
+float4 vvar;
+rs_matrix4x4 mvar;
+rs_allocation avar;
+Point_t svar;
+int arr[64];
+
+void scale(float s) {
+  fvar *= s;
+}
+
+void move(int id, float dx, float dy) {
+  points[id].position += (float2) { dx, dy };
+}
+
+void setPoint(Point_t p) {
+  svar = p;
+}
+
+void many(int a, int b, float c, float d, float4 e, int f) {
+  ivar = a + b + f;
+  vvar = e * (c + d);
+}
+
+void root(const float4 *in, float4 *out, uint32_t x) {
+  *out = *in * fvar;
+}
+
+void blend(const float4 *in, float4 *out, uint32_t x) {
+  *out = mix(*in, vvar, fvar);
+}
+""" % PACKAGE,
+}
+
+# Cells of the Allocations and of the ScriptField_* instances
+NUM_CELLS = 1024
+
+# Calls per benchmark: forEach_* launches are much slower than the others.
+ITERATIONS = 100000
+FOREACH_ITERATIONS = 1000
+WARMUP = 1000
+
+PRIMITIVE_ARGS = {
+  'boolean': 'true',
+  'byte': '(byte) 1',
+  'short': '(short) 1',
+  'int': '1',
+  'long': '1L',
+  'float': '1.f',
+  'double': '1.0',
+}
+
+VECTOR_TYPE = re.compile(r'^(Byte|Short|Int|Long|Float|Double)[234]$')
+MATRIX_TYPE = re.compile(r'^Matrix[234]f$')
+ITEM_TYPE = re.compile(r'^ScriptField_\w+\.Item$')
+METHOD = re.compile(r'^\s*public\s+(?:synchronized\s+)?(?:static\s+)?'
+                    r'[\w.\[\]]+\s+(\w+)\(([^)]*)\)')
+
+
+class Bench(object):
+  """The generated benchmark: its fields, setup code and methods."""
+  def __init__(self):
+    self.fields = []
+    self.setup = []
+    self.methods = []
+    self.names = []
+    self.skipped = []
+    self.num_fields = 0
+    return
+
+  def AddField(self, java_type, init):
+    name = 'mArg%d' % self.num_fields
+    self.num_fields += 1
+    self.fields.append('  private %s %s;' % (java_type, name))
+    self.setup.append('    %s = %s;' % (name, init))
+    return name
+
+
+def ParseMethods(java_file):
+  """Returns the (name, [(type, name)]) of the public methods of a class."""
+  methods = []
+  f = open(java_file, 'r')
+  for line in f:
+    m = METHOD.match(line)
+    if not m:
+      continue
+    params = []
+    for param in m.group(2).split(','):
+      param = param.strip()
+      if param:
+        params.append(tuple(param.rsplit(None, 1)))
+    methods.append((m.group(1), params))
+  f.close()
+  return methods
+
+
+def ArgExpr(bench, java_type, allocations):
+  """Returns the Java expression passed for an argument of java_type, or
+  None if the benchmark can't make one. allocations is the number of
+  Allocation arguments before this one."""
+  if java_type in PRIMITIVE_ARGS:
+    return PRIMITIVE_ARGS[java_type]
+  if java_type == 'Allocation':
+    return ('mIn', 'mOut')[allocations % 2]
+  if java_type == 'Element':
+    return bench.AddField('Element', 'Element.F32_4(mRS)')
+  if (VECTOR_TYPE.match(java_type) or MATRIX_TYPE.match(java_type) or
+      ITEM_TYPE.match(java_type)):
+    return bench.AddField(java_type, 'new %s()' % java_type)
+  if java_type.endswith('[]') and java_type[:-2] in PRIMITIVE_ARGS:
+    return bench.AddField(java_type,
+                          'new %s[%d]' % (java_type[:-2], NUM_CELLS))
+  return None
+
+
+def AddMethod(bench, cls, instance, method, params):
+  """Adds the benchmark of instance.method(params) of class cls."""
+  name = '%s.%s' % (cls, method)
+  args = []
+  allocations = 0
+  for java_type, param in params:
+    # The nested class of a ScriptField_*
+    if java_type == 'Item':
+      java_type = cls + '.Item'
+    if param == 'index':
+      args.append('0')
+      continue
+    arg = ArgExpr(bench, java_type, allocations)
+    if arg is None:
+      bench.skipped.append('%s (%s %s)' % (name, java_type, param))
+      return
+    if java_type == 'Allocation':
+      allocations += 1
+    args.append(arg)
+
+  call = '%s.%s(%s);' % (instance, method, ', '.join(args))
+  iterations = ITERATIONS
+  if method.startswith('forEach_'):
+    iterations = FOREACH_ITERATIONS
+  java_name = 'bench_%s_%s_%d' % (cls, method, len(bench.methods))
+  # Overloads get the number of their parameters appended.
+  if '"%s"' % name in bench.names:
+    name = '%s/%d' % (name, len(params))
+  bench.names.append('"%s"' % name)
+  bench.methods.append(
+      '  private void %s() {\n'
+      '    for (int i = 0; i < WARMUP; i++)\n'
+      '      %s\n'
+      '    mRS.finish();\n'
+      '    Debug.resetThreadAllocCount();\n'
+      '    long start = System.nanoTime();\n'
+      '    for (int i = 0; i < %d; i++)\n'
+      '      %s\n'
+      '    mRS.finish();\n'
+      '    report("%s", System.nanoTime() - start,\n'
+      '           Debug.getThreadAllocCount(), %d);\n'
+      '  }\n' % (java_name, call, iterations, call, name, iterations))
+  return
+
+
+def GenBench(src_dir):
+  """Generates ReflectionBench.java from the reflected classes."""
+  bench = Bench()
+  for java_file in sorted(glob.glob(os.path.join(src_dir,
+                                                 'ScriptC_*.java'))):
+    cls = os.path.basename(java_file)[:-len('.java')]
+    instance = 'm' + cls
+    bench.fields.append('  private %s %s;' % (cls, instance))
+    bench.setup.append('    %s = new %s(mRS, getResources(), R.raw.%s);' %
+                       (instance, cls, cls[len('ScriptC_'):].lower()))
+    for method, params in ParseMethods(java_file):
+      if method.startswith('bind_') and len(params) == 1:
+        field_cls = params[0][0]
+        field = 'm' + field_cls
+        if ('  private %s %s;' % (field_cls, field)) not in bench.fields:
+          bench.fields.append('  private %s %s;' % (field_cls, field))
+          bench.setup.append('    %s = new %s(mRS, %d);' %
+                             (field, field_cls, NUM_CELLS))
+        bench.setup.append('    %s.%s(%s);' % (instance, method, field))
+      elif (method.startswith('set_') or method.startswith('invoke_') or
+            method.startswith('forEach_')):
+        AddMethod(bench, cls, instance, method, params)
+
+  for java_file in sorted(glob.glob(os.path.join(src_dir,
+                                                 'ScriptField_*.java'))):
+    cls = os.path.basename(java_file)[:-len('.java')]
+    field = 'm' + cls
+    if ('  private %s %s;' % (cls, field)) not in bench.fields:
+      bench.fields.append('  private %s %s;' % (cls, field))
+      bench.setup.append('    %s = new %s(mRS, %d);' % (field, cls, NUM_CELLS))
+    for method, params in ParseMethods(java_file):
+      if method in ('set', 'copyAll') or method.startswith('set_'):
+        AddMethod(bench, cls, field, method, params)
+
+  calls = ['      %s();' % m.split('(')[0].split()[-1] for m in bench.methods]
+  f = open(os.path.join(src_dir, 'ReflectionBench.java'), 'w')
+  f.write("""// Generated by frameworks/compile/slang/tests/reflect_bench.py
+
+package %(package)s;
+
+import android.app.Activity;
+import android.os.Bundle;
+import android.os.Debug;
+import android.renderscript.*;
+import android.util.Log;
+
+public class ReflectionBench extends Activity {
+  private static final String TAG = "%(tag)s";
+  private static final int WARMUP = %(warmup)d;
+
+  private RenderScript mRS;
+  private Allocation mIn;
+  private Allocation mOut;
+%(fields)s
+
+  private void setup() {
+    mRS = RenderScript.create(this);
+    Type t = Type.createX(mRS, Element.F32_4(mRS), %(cells)d);
+    mIn = Allocation.createTyped(mRS, t);
+    mOut = Allocation.createTyped(mRS, t);
+%(setup)s
+  }
+
+  // One JSON object per line, see reflect_bench.py --collect.
+  private static void report(String name, long ns, int allocs,
+                             int iterations) {
+    Log.i(TAG, "{\\"name\\": \\"" + name + "\\", \\"ns_per_op\\": " +
+               ((double) ns / iterations) + ", \\"allocs_per_op\\": " +
+               ((double) allocs / iterations) + "}");
+  }
+
+%(methods)s
+  @Override
+  public void onCreate(Bundle icicle) {
+    super.onCreate(icicle);
+    new Thread(new Runnable() {
+      public void run() {
+        setup();
+        Debug.startAllocCounting();
+%(calls)s
+        Debug.stopAllocCounting();
+        mRS.destroy();
+        Log.i(TAG, "done");
+        finish();
+      }
+    }).start();
+  }
+}
+""" % {'package': PACKAGE, 'tag': TAG, 'warmup': WARMUP, 'cells': NUM_CELLS,
+       'fields': '\n'.join(bench.fields), 'setup': '\n'.join(bench.setup),
+       'methods': '\n'.join(bench.methods),
+       'calls': '\n'.join(['  ' + c for c in calls])})
+  f.close()
+  return bench
+
+
+def GenApp(out_dir):
+  """Reflects SCRIPTS into out_dir and generates the app around them."""
+  src_dir = os.path.join(out_dir, 'src', *PACKAGE.split('.'))
+  raw_dir = os.path.join(out_dir, 'res', 'raw')
+  rs_dir = os.path.join(out_dir, 'rs')
+  for d in (src_dir, raw_dir, rs_dir):
+    if not os.path.isdir(d):
+      os.makedirs(d)
+
+  rs_files = []
+  for name in sorted(SCRIPTS.keys()):
+    rs_file = os.path.join(rs_dir, name + '.rs')
+    f = open(rs_file, 'w')
+    f.write(SCRIPTS[name])
+    f.close()
+    rs_files.append(rs_file)
+
+  args = [os.path.join(Options.bin_dir, 'llvm-rs-cc'),
+          '-o', raw_dir, '-p', os.path.join(out_dir, 'src'),
+          '-target-api', '16']
+  for d in Options.include_dirs:
+    args += ['-I', d]
+  args += rs_files
+  if Options.verbose > 1:
+    print('Executing: ' + ' '.join(args))
+  if subprocess.call(args) != 0:
+    print >> sys.stderr, 'llvm-rs-cc failed'
+    return 1
+
+  bench = GenBench(src_dir)
+  if Options.verbose:
+    for name in bench.names:
+      print('Benchmark %s' % name.strip('"'))
+  for skipped in bench.skipped:
+    print('Skipped %s' % skipped)
+
+  f = open(os.path.join(out_dir, 'Android.mk'), 'w')
+  f.write('# Generated by frameworks/compile/slang/tests/reflect_bench.py\n'
+          'LOCAL_PATH := $(call my-dir)\n'
+          'include $(CLEAR_VARS)\n\n'
+          'LOCAL_MODULE_TAGS := tests\n'
+          'LOCAL_SRC_FILES := $(call all-java-files-under, src)\n'
+          'LOCAL_PACKAGE_NAME := RSReflectionBench\n\n'
+          'include $(BUILD_PACKAGE)\n')
+  f.close()
+
+  f = open(os.path.join(out_dir, 'AndroidManifest.xml'), 'w')
+  f.write('<?xml version="1.0" encoding="utf-8"?>\n'
+          '<manifest xmlns:android="http://schemas.android.com/apk/res/'
+          'android"\n'
+          '    package="%s">\n'
+          '  <uses-sdk android:minSdkVersion="16" />\n'
+          '  <application android:label="RSReflectionBench">\n'
+          '    <activity android:name="ReflectionBench">\n'
+          '      <intent-filter>\n'
+          '        <action android:name="android.intent.action.MAIN" />\n'
+          '        <category android:name="android.intent.category.LAUNCHER"'
+          ' />\n'
+          '      </intent-filter>\n'
+          '    </activity>\n'
+          '  </application>\n'
+          '</manifest>\n' % PACKAGE)
+  f.close()
+  return 0
+
+
+def Collect():
+  """Writes the results in adb logcat to Options.collect, compares them
+  with Options.baseline if any and returns the number of regressions."""
+  p = subprocess.Popen(['adb', 'logcat', '-d', '-s', TAG + ':I'],
+                       stdout=subprocess.PIPE)
+  results = {}
+  done = False
+  for line in p.stdout:
+    text = line.split(': ', 1)[-1].strip()
+    if text == 'done':
+      done = True
+    elif text.startswith('{'):
+      r = json.loads(text)
+      results[r['name']] = {'ns_per_op': r['ns_per_op'],
+                            'allocs_per_op': r['allocs_per_op']}
+  p.wait()
+  if not done:
+    print >> sys.stderr, 'Warning: the benchmark has not finished'
+
+  f = open(Options.collect, 'w')
+  json.dump({'version': 1, 'benchmarks': results}, f, indent=2,
+            sort_keys=True)
+  f.write('\n')
+  f.close()
+
+  if not Options.baseline:
+    return 0
+
+  f = open(Options.baseline, 'r')
+  baseline = json.load(f)['benchmarks']
+  f.close()
+  regressions = 0
+  for name in sorted(results.keys()):
+    if name not in baseline:
+      continue
+    for metric in ('ns_per_op', 'allocs_per_op'):
+      old = baseline[name][metric]
+      new = results[name][metric]
+      flag = ''
+      # Any new allocation is a regression.
+      if ((metric == 'allocs_per_op' and new > old) or
+          (old > 0 and (new - old) / old > Options.threshold)):
+        flag = '  REGRESSION'
+        regressions += 1
+      print('%-48s %-13s %12.2f %12.2f%s' % (name, metric, old, new, flag))
+  print('Regressions: %d' % regressions)
+  return regressions
+
+
+def Usage():
+  print ('Usage: %s [OPTION]...\n'
+         'RenderScript Reflection Benchmark\n'
+         'Available Options:\n'
+         '  -h, --help              Help message\n'
+         '  -v, --verbose           Verbose output\n'
+         '  -o, --output DIR        Generate the app into DIR (reflect_bench)\n'
+         '  -c, --collect FILE      Write the results in adb logcat to FILE\n'
+         '  -b, --baseline FILE     With -c, compare with the results in '
+         'FILE\n'
+         '  -t, --threshold PCT     Regression threshold in percent (10)\n'
+         '      --bin-dir DIR       Where llvm-rs-cc is\n'
+         '  -I DIR                  Include directory (replaces the default)'
+        ) % (sys.argv[0])
+  return
+
+
+def main():
+  try:
+    opts, args = getopt.getopt(sys.argv[1:], 'hvo:c:b:t:I:',
+                               ['help', 'verbose', 'output=', 'collect=',
+                                'baseline=', 'threshold=', 'bin-dir='])
+  except getopt.GetoptError, e:
+    print >> sys.stderr, str(e)
+    return 1
+  if args:
+    print >> sys.stderr, 'Invalid argument: %s' % args[0]
+    return 1
+
+  include_dirs = []
+  for opt, value in opts:
+    if opt in ('-h', '--help'):
+      Usage()
+      return 0
+    elif opt in ('-v', '--verbose'):
+      Options.verbose += 1
+    elif opt in ('-o', '--output'):
+      Options.output_dir = value
+    elif opt in ('-c', '--collect'):
+      Options.collect = value
+    elif opt in ('-b', '--baseline'):
+      Options.baseline = value
+    elif opt in ('-t', '--threshold'):
+      Options.threshold = float(value) / 100
+    elif opt == '--bin-dir':
+      Options.bin_dir = value
+    elif opt == '-I':
+      include_dirs.append(value)
+  if include_dirs:
+    Options.include_dirs = include_dirs
+
+  if Options.collect:
+    return Collect() != 0
+  return GenApp(Options.output_dir)
+
+
+if __name__ == '__main__':
+  sys.exit(main())
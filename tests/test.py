@@ -42,6 +42,58 @@ def CompareFiles(filename):
   return filecmp.cmp(actual, expect, False)
 
 
+def CheckContains(dirname):
+  """Checks that each file in dirname named by a NAME.contains file of the
+  test has the non-empty lines of the latter, in order. NAME is looked up in
+  the subdirectories too, e.g., the package directory of the reflected Java.
+  A line starting with 'NOT ' is text which the file must not have between
+  the lines around it. A NAME.contains file in a subdirectory of the test
+  is checked against the file in (or under) the same subdirectory of
+  dirname, e.g., the output for one of several targets."""
+  for contains in glob.glob('*.contains') + glob.glob('*/*.contains'):
+    name = contains[:-len('.contains')]
+    subdir, basename = os.path.split(name)
+    actual = os.path.join(dirname, name)
+    for root, _, files in os.walk(os.path.join(dirname, subdir)):
+      if basename in files:
+        actual = os.path.join(root, basename)
+        break
+    if not os.path.isfile(actual):
+      if Options.verbose:
+        print 'Could not find %s' % actual
+      return False
+    f = open(actual, 'r')
+    source = f.read()
+    f.close()
+    f = open(contains, 'r')
+    lines = [string.strip(line) for line in f if string.strip(line)]
+    f.close()
+    pos = 0
+    absent = []
+    for line in lines:
+      if line[0:4] == 'NOT ':
+        absent.append(string.strip(line[4:]))
+        continue
+      end = source.find(line, pos)
+      if end < 0:
+        if Options.verbose:
+          print '%s does not have %s' % (actual, line)
+        return False
+      for text in absent:
+        if source.find(text, pos, end) >= 0:
+          if Options.verbose:
+            print '%s has %s before %s' % (actual, text, line)
+          return False
+      absent = []
+      pos = end + len(line)
+    for text in absent:
+      if source.find(text, pos) >= 0:
+        if Options.verbose:
+          print '%s has %s' % (actual, text)
+        return False
+  return True
+
+
 def GetCommandLineArgs(filename):
   """Extracts command line arguments from first comment line in a file"""
   f = open(filename, 'r')
@@ -80,7 +132,22 @@ def ExecTest(dirname):
     extra_args_str += GetCommandLineArgs(rs_file)
   extra_args = extra_args_str.split()
 
-  args = base_args + extra_args + rs_files
+  # A test which runs more than a single command (e.g., a -server and its
+  # clients) has them in its run.sh instead, which gets the command line of
+  # llvm-rs-cc above (without the .rs files) as $LLVM_RS_CC and the paths of
+  # llvm-rs-link, llvm-as and llvm-dis as $LLVM_RS_LINK, $LLVM_AS and
+  # $LLVM_DIS. Its exit status is that of the test.
+  env = None
+  if os.path.isfile('run.sh'):
+    bin_dir = '../../../../../out/host/linux-x86/bin/'
+    env = dict(os.environ)
+    env['LLVM_RS_CC'] = string.join(base_args + extra_args)
+    env['LLVM_RS_LINK'] = bin_dir + 'llvm-rs-link'
+    env['LLVM_AS'] = bin_dir + 'llvm-as'
+    env['LLVM_DIS'] = bin_dir + 'llvm-dis'
+    args = ['/bin/sh', 'run.sh']
+  else:
+    args = base_args + extra_args + rs_files
 
   if Options.verbose > 1:
     print 'Executing:',
@@ -94,7 +161,8 @@ def ExecTest(dirname):
   # directory names that start with 'P_'.
   ret = 0
   try:
-    ret = subprocess.call(args, stdout=stdout_file, stderr=stderr_file)
+    ret = subprocess.call(args, stdout=stdout_file, stderr=stderr_file,
+                          env=env)
   except:
     passed = False
 
@@ -127,6 +195,9 @@ def ExecTest(dirname):
     if Options.verbose:
       print 'Test Directory name should start with an F or a P'
 
+  if not CheckContains('tmp/'):
+    passed = False
+
   if not CompareFiles('stdout.txt'):
     passed = False
     if Options.verbose: